@@ -57,8 +57,6 @@
 
 #include "mod_auth_openidc.h"
 
-#include <pcre.h>
-
 #ifdef USE_LIBJQ
 #include "jq.h"
 #endif
@@ -135,17 +133,15 @@ static apr_byte_t oidc_authz_match_value(request_rec *r, const char *spec_c,
 
 static apr_byte_t oidc_authz_match_expression(request_rec *r,
 		const char *spec_c, json_t *val) {
-	const char *errorptr;
-	int erroffset;
-	pcre *preg;
+	const oidc_pcre_t *preg = NULL;
+	char *error_str = NULL;
 	int i = 0;
 
-	/* setup the regex; spec_c points to the NULL-terminated value pattern */
-	preg = pcre_compile(spec_c, 0, &errorptr, &erroffset, NULL);
+	/* get the compiled regex; spec_c points to the NULL-terminated value pattern */
+	preg = oidc_util_regexp_get(r, spec_c, &error_str);
 
 	if (preg == NULL) {
-		oidc_error(r, "pattern [%s] is not a valid regular expression", spec_c);
-		pcre_free(preg);
+		oidc_error(r, "%s", error_str);
 		return FALSE;
 	}
 
@@ -153,11 +149,8 @@ static apr_byte_t oidc_authz_match_expression(request_rec *r,
 	if (json_is_string(val)) {
 
 		/* PCRE-compare the string value against the expression */
-		if (pcre_exec(preg, NULL, json_string_value(val),
-				(int) strlen(json_string_value(val)), 0, 0, NULL, 0) == 0) {
-			pcre_free(preg);
+		if (oidc_pcre_match(preg, json_string_value(val)) == TRUE)
 			return TRUE;
-		}
 
 		/* see if the claim value is an array */
 	} else if (json_is_array(val)) {
@@ -169,18 +162,12 @@ static apr_byte_t oidc_authz_match_expression(request_rec *r,
 			if (json_is_string(elem)) {
 
 				/* PCRE-compare the string value against the expression */
-				if (pcre_exec(preg, NULL, json_string_value(elem),
-						(int) strlen(json_string_value(elem)), 0, 0,
-						NULL, 0) == 0) {
-					pcre_free(preg);
+				if (oidc_pcre_match(preg, json_string_value(elem)) == TRUE)
 					return TRUE;
-				}
 			}
 		}
 	}
 
-	pcre_free(preg);
-
 	return FALSE;
 }
 
@@ -268,34 +255,178 @@ apr_byte_t oidc_authz_match_claim(request_rec *r, const char * const attr_spec,
 
 #ifdef USE_LIBJQ
 
-static apr_byte_t jq_parse(request_rec *r, jq_state *jq, struct jv_parser *parser) {
-	apr_byte_t rv = FALSE;
-	jv value;
+/* maximum number of distinct expressions for which compiled programs are kept */
+#define OIDC_AUTHZ_JQ_CACHE_MAX 64
+/* maximum number of idle compiled programs kept per expression */
+#define OIDC_AUTHZ_JQ_IDLE_MAX  16
+
+/* idle compiled programs for a single expression; a jq_state can only be used by one thread at a time */
+typedef struct oidc_authz_jq_program_t {
+	apr_array_header_t *idle;
+} oidc_authz_jq_program_t;
+
+/* per-process cache of compiled jq programs, keyed by expression */
+static apr_pool_t *oidc_authz_jq_cache_pool = NULL;
+static apr_hash_t *oidc_authz_jq_cache = NULL;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *oidc_authz_jq_cache_mutex = NULL;
+#endif
 
-	while (jv_is_valid((value = jv_parser_next(parser)))) {
-		jq_start(jq, value, 0);
-		jv result;
+#if APR_HAS_THREADS
+#define oidc_authz_jq_cache_lock() apr_thread_mutex_lock(oidc_authz_jq_cache_mutex)
+#define oidc_authz_jq_cache_unlock() apr_thread_mutex_unlock(oidc_authz_jq_cache_mutex)
+#else
+#define oidc_authz_jq_cache_lock()
+#define oidc_authz_jq_cache_unlock()
+#endif
 
-		while (jv_is_valid(result = jq_next(jq))) {
-			jv dumped = jv_dump_string(result, 0);
-			const char *str = jv_string_value(dumped);
-			oidc_debug(r, "dumped: %s", str);
-			rv = (apr_strnatcmp(str, "true") == 0);
+/*
+ * tear down all idle compiled jq programs when the child process exits
+ */
+static apr_status_t oidc_authz_jq_cache_cleanup(void *data) {
+	apr_hash_index_t *hi = NULL;
+	oidc_authz_jq_program_t *program = NULL;
+	jq_state *jq = NULL;
+	int i;
+	for (hi = apr_hash_first(NULL, oidc_authz_jq_cache); hi;
+			hi = apr_hash_next(hi)) {
+		apr_hash_this(hi, NULL, NULL, (void **) &program);
+		for (i = 0; i < program->idle->nelts; i++) {
+			jq = APR_ARRAY_IDX(program->idle, i, jq_state *);
+			jq_teardown(&jq);
 		}
+		program->idle->nelts = 0;
+	}
+	oidc_authz_jq_cache = NULL;
+	return APR_SUCCESS;
+}
 
-		jv_free(result);
+/*
+ * initialize the per-process cache of compiled jq programs in a child process
+ */
+apr_status_t oidc_authz_jq_cache_child_init(apr_pool_t *p, server_rec *s) {
+	apr_status_t rv = APR_SUCCESS;
+#if APR_HAS_THREADS
+	rv = apr_thread_mutex_create(&oidc_authz_jq_cache_mutex,
+			APR_THREAD_MUTEX_DEFAULT, p);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s, "apr_thread_mutex_create failed: %d", rv);
+		return rv;
 	}
+#endif
+	oidc_authz_jq_cache = apr_hash_make(p);
+	oidc_authz_jq_cache_pool = p;
+	apr_pool_cleanup_register(p, NULL, oidc_authz_jq_cache_cleanup,
+			apr_pool_cleanup_null);
+	return rv;
+}
 
-	if (jv_invalid_has_msg(jv_copy(value))) {
-		jv msg = jv_invalid_get_msg(value);
-		oidc_error(r, "invalid: %s", jv_string_value(msg));
-		jv_free(msg);
-		rv = FALSE;
-	} else {
-		jv_free(value);
+/*
+ * get a compiled jq program for an expression, either an idle one or a newly compiled one
+ */
+static jq_state *oidc_authz_jq_get(request_rec *r, const char *expr) {
+	oidc_authz_jq_program_t *program = NULL;
+	jq_state *jq = NULL;
+
+	if (oidc_authz_jq_cache != NULL) {
+		oidc_authz_jq_cache_lock();
+		program = apr_hash_get(oidc_authz_jq_cache, expr, APR_HASH_KEY_STRING);
+		if ((program != NULL) && (program->idle->nelts > 0)) {
+			program->idle->nelts--;
+			jq = APR_ARRAY_IDX(program->idle, program->idle->nelts,
+					jq_state *);
+		}
+		oidc_authz_jq_cache_unlock();
+		if (jq != NULL)
+			return jq;
 	}
 
-	return rv;
+	oidc_debug(r, "compiling: '%s'", expr);
+
+	jq = jq_init();
+	if (jq == NULL)
+		return NULL;
+
+	if (jq_compile(jq, expr) == 0) {
+		oidc_error(r, "could not compile jq expression: '%s'", expr);
+		jq_teardown(&jq);
+		return NULL;
+	}
+
+	return jq;
+}
+
+/*
+ * return a compiled jq program for an expression to the cache
+ */
+static void oidc_authz_jq_release(const char *expr, jq_state *jq) {
+	oidc_authz_jq_program_t *program = NULL;
+
+	if (oidc_authz_jq_cache != NULL) {
+		oidc_authz_jq_cache_lock();
+		program = apr_hash_get(oidc_authz_jq_cache, expr, APR_HASH_KEY_STRING);
+		if ((program == NULL)
+				&& (apr_hash_count(oidc_authz_jq_cache)
+						< OIDC_AUTHZ_JQ_CACHE_MAX)) {
+			program = apr_pcalloc(oidc_authz_jq_cache_pool,
+					sizeof(oidc_authz_jq_program_t));
+			program->idle = apr_array_make(oidc_authz_jq_cache_pool,
+					OIDC_AUTHZ_JQ_IDLE_MAX, sizeof(jq_state *));
+			apr_hash_set(oidc_authz_jq_cache,
+					apr_pstrdup(oidc_authz_jq_cache_pool, expr),
+					APR_HASH_KEY_STRING, program);
+		}
+		if ((program != NULL)
+				&& (program->idle->nelts < OIDC_AUTHZ_JQ_IDLE_MAX)) {
+			APR_ARRAY_PUSH(program->idle, jq_state *) = jq;
+			jq = NULL;
+		}
+		oidc_authz_jq_cache_unlock();
+	}
+
+	if (jq != NULL)
+		jq_teardown(&jq);
+}
+
+/*
+ * convert a JSON value to a jq value without serializing it
+ */
+static jv oidc_authz_json2jv(const json_t *json) {
+	void *iter = NULL;
+	jv result;
+	size_t i;
+
+	switch (json_typeof(json)) {
+	case JSON_OBJECT:
+		result = jv_object();
+		iter = json_object_iter((json_t *) json);
+		while (iter) {
+			result = jv_object_set(result,
+					jv_string(json_object_iter_key(iter)),
+					oidc_authz_json2jv(json_object_iter_value(iter)));
+			iter = json_object_iter_next((json_t *) json, iter);
+		}
+		return result;
+	case JSON_ARRAY:
+		result = jv_array();
+		for (i = 0; i < json_array_size(json); i++)
+			result = jv_array_append(result,
+					oidc_authz_json2jv(json_array_get(json, i)));
+		return result;
+	case JSON_STRING:
+		return jv_string(json_string_value(json));
+	case JSON_INTEGER:
+		return jv_number((double) json_integer_value(json));
+	case JSON_REAL:
+		return jv_number(json_real_value(json));
+	case JSON_TRUE:
+		return jv_true();
+	case JSON_FALSE:
+		return jv_false();
+	case JSON_NULL:
+	default:
+		return jv_null();
+	}
 }
 
 /*
@@ -304,23 +435,34 @@ static apr_byte_t jq_parse(request_rec *r, jq_state *jq, struct jv_parser *parse
 apr_byte_t oidc_authz_match_claims_expr(request_rec *r,
 		const char * const attr_spec, const json_t * const claims) {
 	apr_byte_t rv = FALSE;
+	jv result;
 
 	oidc_debug(r, "enter: '%s'", attr_spec);
 
-	jq_state *jq = jq_init();
-	if (jq_compile(jq, attr_spec) == 0) {
-		jq_teardown(&jq);
+	jq_state *jq = oidc_authz_jq_get(r, attr_spec);
+	if (jq == NULL)
 		return FALSE;
-	}
 
-	struct jv_parser *parser = jv_parser_new(0);
+	jq_start(jq, oidc_authz_json2jv(claims), 0);
 
-	char *buf = oidc_util_encode_json_object(r, (json_t *)claims, 0);
-	jv_parser_set_buf(parser, buf, strlen(buf), 0);
-	rv = jq_parse(r, jq, parser);
+	while (jv_is_valid(result = jq_next(jq))) {
+		oidc_debug(r, "result kind: %s", jv_kind_name(jv_get_kind(result)));
+		rv = (jv_get_kind(result) == JV_KIND_TRUE);
+		jv_free(result);
+	}
+
+	if (jv_invalid_has_msg(jv_copy(result))) {
+		jv msg = jv_invalid_get_msg(result);
+		oidc_error(r, "invalid: %s",
+				jv_get_kind(msg) == JV_KIND_STRING ?
+						jv_string_value(msg) : "(no message)");
+		jv_free(msg);
+		rv = FALSE;
+	} else {
+		jv_free(result);
+	}
 
-	jv_parser_free(parser);
-	jq_teardown(&jq);
+	oidc_authz_jq_release(attr_spec, jq);
 
 	return rv;
 }
@@ -67,6 +67,33 @@ typedef apr_byte_t (*oidc_cache_set_function)(request_rec *r,
 		apr_time_t expiry);
 typedef int (*oidc_cache_destroy_function)(server_rec *s);
 
+/* a single name/value pair in a multi-key get or set operation */
+typedef struct oidc_cache_entry_t {
+	const char *section;
+	const char *key;
+	/* the value to store, NULL to remove the entry; on get set to the value or NULL on a miss */
+	const char *value;
+	apr_time_t expiry;
+} oidc_cache_entry_t;
+
+typedef apr_byte_t (*oidc_cache_get_multi_function)(request_rec *r,
+		oidc_cache_entry_t *entries, int n);
+typedef apr_byte_t (*oidc_cache_set_multi_function)(request_rec *r,
+		const oidc_cache_entry_t *entries, int n);
+/* returns TRUE only when the entry exists and its expiry was updated */
+typedef apr_byte_t (*oidc_cache_touch_function)(request_rec *r,
+		const char *section, const char *key, apr_time_t expiry);
+/*
+ * add members to, or remove them from, the index (set of values) stored under a key:
+ * a member with an expiry > 0 is added or has its expiry updated, one with expiry 0
+ * is removed and an entry with a NULL member removes the index altogether
+ */
+typedef apr_byte_t (*oidc_cache_index_update_function)(request_rec *r,
+		const oidc_cache_entry_t *entries, int n);
+/* get the non-expired members of an index, an empty array when it doesn't exist */
+typedef apr_byte_t (*oidc_cache_index_get_function)(request_rec *r,
+		const char *section, const char *key, apr_array_header_t **members);
+
 typedef struct oidc_cache_t {
 	const char *name;
 	int encrypt_by_default;
@@ -75,6 +102,14 @@ typedef struct oidc_cache_t {
 	oidc_cache_get_function get;
 	oidc_cache_set_function set;
 	oidc_cache_destroy_function destroy;
+	/* optional: get/set a number of entries at once, falls back to get/set per entry when NULL */
+	oidc_cache_get_multi_function get_multi;
+	oidc_cache_set_multi_function set_multi;
+	/* optional: update the expiry of an existing entry without rewriting its value */
+	oidc_cache_touch_function touch;
+	/* optional: native index operations, fall back to an index stored as a regular value when NULL */
+	oidc_cache_index_update_function index_update;
+	oidc_cache_index_get_function index_get;
 } oidc_cache_t;
 
 typedef struct oidc_cache_mutex_t {
@@ -94,10 +129,35 @@ apr_byte_t oidc_cache_mutex_lock(server_rec *s, oidc_cache_mutex_t *m);
 apr_byte_t oidc_cache_mutex_unlock(server_rec *s, oidc_cache_mutex_t *m);
 apr_byte_t oidc_cache_mutex_destroy(server_rec *s, oidc_cache_mutex_t *m);
 
+/* key material derived from the crypto passphrase for encrypted cache entries */
+typedef struct oidc_cache_crypto_t oidc_cache_crypto_t;
+
+apr_byte_t oidc_cache_crypto_post_config(apr_pool_t *pool, server_rec *s);
+
+apr_status_t oidc_cache_l1_child_init(apr_pool_t *p, server_rec *s);
+
 apr_byte_t oidc_cache_get(request_rec *r, const char *section, const char *key,
 		char **value);
 apr_byte_t oidc_cache_set(request_rec *r, const char *section, const char *key,
 		const char *value, apr_time_t expiry);
+apr_byte_t oidc_cache_get_multi(request_rec *r, oidc_cache_entry_t *entries,
+		int n);
+apr_byte_t oidc_cache_set_multi(request_rec *r,
+		const oidc_cache_entry_t *entries, int n);
+apr_byte_t oidc_cache_touch(request_rec *r, const char *section,
+		const char *key, apr_time_t expiry);
+apr_byte_t oidc_cache_lease_acquire(request_rec *r, const char *section,
+		const char *key, apr_time_t expiry);
+void oidc_cache_lease_release(request_rec *r, const char *section,
+		const char *key);
+apr_byte_t oidc_cache_index_update(request_rec *r,
+		const oidc_cache_entry_t *entries, int n);
+apr_byte_t oidc_cache_index_get(request_rec *r, const char *section,
+		const char *key, apr_array_header_t **members);
+char *oidc_cache_index_value_update(apr_pool_t *pool, const char *value,
+		const char *member, apr_time_t expiry, apr_time_t *index_expiry);
+apr_array_header_t *oidc_cache_index_value_members(apr_pool_t *pool,
+		const char *value);
 
 #define OIDC_CACHE_SECTION_SESSION           "s"
 #define OIDC_CACHE_SECTION_NONCE             "n"
@@ -108,9 +168,9 @@ apr_byte_t oidc_cache_set(request_rec *r, const char *section, const char *key,
 #define OIDC_CACHE_SECTION_JTI               "t"
 #define OIDC_CACHE_SECTION_REQUEST_URI       "r"
 #define OIDC_CACHE_SECTION_SID               "d"
-
-// TODO: now every section occupies the same space; we may want to differentiate
-//       according to section-based size, at least for the shm backend
+#define OIDC_CACHE_SECTION_SESSION_EXPIRY    "e"
+#define OIDC_CACHE_SECTION_LEASE             "l"
+#define OIDC_CACHE_SECTION_SUB               "u"
 
 #define oidc_cache_get_session(r, key, value) oidc_cache_get(r, OIDC_CACHE_SECTION_SESSION, key, value)
 #define oidc_cache_get_nonce(r, key, value) oidc_cache_get(r, OIDC_CACHE_SECTION_NONCE, key, value)
@@ -120,7 +180,6 @@ apr_byte_t oidc_cache_set(request_rec *r, const char *section, const char *key,
 #define oidc_cache_get_oauth_provider(r, key, value) oidc_cache_get(r, OIDC_CACHE_SECTION_OAUTH_PROVIDER, key, value)
 #define oidc_cache_get_jti(r, key, value) oidc_cache_get(r, OIDC_CACHE_SECTION_JTI, key, value)
 #define oidc_cache_get_request_uri(r, key, value) oidc_cache_get(r, OIDC_CACHE_SECTION_REQUEST_URI, key, value)
-#define oidc_cache_get_sid(r, key, value) oidc_cache_get(r, OIDC_CACHE_SECTION_SID, key, value)
 
 #define oidc_cache_set_session(r, key, value, expiry) oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION, key, value, expiry)
 #define oidc_cache_set_nonce(r, key, value, expiry) oidc_cache_set(r, OIDC_CACHE_SECTION_NONCE, key, value, expiry)
@@ -130,7 +189,41 @@ apr_byte_t oidc_cache_set(request_rec *r, const char *section, const char *key,
 #define oidc_cache_set_oauth_provider(r, key, value, expiry) oidc_cache_set(r, OIDC_CACHE_SECTION_OAUTH_PROVIDER, key, value, expiry)
 #define oidc_cache_set_jti(r, key, value, expiry) oidc_cache_set(r, OIDC_CACHE_SECTION_JTI, key, value, expiry)
 #define oidc_cache_set_request_uri(r, key, value, expiry) oidc_cache_set(r, OIDC_CACHE_SECTION_REQUEST_URI, key, value, expiry)
-#define oidc_cache_set_sid(r, key, value, expiry) oidc_cache_set(r, OIDC_CACHE_SECTION_SID, key, value, expiry)
+
+/* hash index statistics of the shm cache backend */
+typedef struct oidc_cache_shm_stats_t {
+	/* number of get operations */
+	apr_uint64_t lookups;
+	/* number of get operations that returned a non-expired value */
+	apr_uint64_t hits;
+	/* total number of slots inspected by get/set operations */
+	apr_uint64_t probes;
+	/* largest number of slots inspected by a single get/set operation */
+	apr_uint64_t max_probe;
+	/* number of inspected slots that were occupied by a different key */
+	apr_uint64_t collisions;
+	/* number of non-expired entries dropped to make room for a new one */
+	apr_uint64_t evictions;
+} oidc_cache_shm_stats_t;
+
+/* additional slab class of the shm cache backend, holding entries of a smaller size */
+typedef struct oidc_cache_shm_slab_t {
+	/* size in bytes of a single entry in this class */
+	int entry_size;
+	/* number of entries in this class */
+	int size_max;
+} oidc_cache_shm_slab_t;
+
+apr_byte_t oidc_cache_shm_stats(server_rec *s, oidc_cache_shm_stats_t *stats);
+
+/* dedicated store for the IDs in the JTI and nonce sections, falls back to oidc_cache_get/oidc_cache_set when disabled */
+apr_byte_t oidc_cache_replay_exists(request_rec *r, const char *section,
+		const char *id);
+apr_byte_t oidc_cache_replay_add(request_rec *r, const char *section,
+		const char *id, apr_time_t expiry);
+int oidc_cache_replay_post_config(server_rec *s);
+apr_status_t oidc_cache_replay_child_init(apr_pool_t *p, server_rec *s);
+int oidc_cache_replay_destroy(server_rec *s);
 
 extern oidc_cache_t oidc_cache_file;
 extern oidc_cache_t oidc_cache_shm;
@@ -141,6 +234,7 @@ extern oidc_cache_t oidc_cache_memcache;
 
 #ifdef USE_LIBHIREDIS
 extern oidc_cache_t oidc_cache_redis;
+unsigned int oidc_cache_redis_key_slot(const char *key, size_t len);
 #endif
 
 #endif /* _MOD_AUTH_OPENIDC_CACHE_H_ */
@@ -70,6 +70,7 @@
 #include <openssl/err.h>
 
 #include <apr_base64.h>
+#include <apr_thread_mutex.h>
 
 #include "../mod_auth_openidc.h"
 
@@ -258,53 +259,105 @@ apr_byte_t oidc_cache_mutex_destroy(server_rec *s, oidc_cache_mutex_t *m) {
 #endif
 
 /*
- * AES GCM encrypt
+ * key material derived from the crypto passphrase once at startup
  */
-static int oidc_cache_crypto_encrypt_impl(request_rec *r,
-		unsigned char *plaintext, int plaintext_len, const unsigned char *aad,
-		int aad_len, unsigned char *key, const unsigned char *iv, int iv_len,
-		unsigned char *ciphertext, const unsigned char *tag, int tag_len) {
-	EVP_CIPHER_CTX *ctx;
-
-	int len;
+struct oidc_cache_crypto_t {
+	/* SHA-256 hash of the passphrase, used as the AES GCM 256 key */
+	unsigned char *key;
+	/* digest state after hashing the "<passphrase>:" prefix of a randomized cache key */
+	EVP_MD_CTX *md_ctx;
+	/* keyed cipher contexts that are copied for each encryption/decryption */
+	EVP_CIPHER_CTX *encrypt_ctx;
+	EVP_CIPHER_CTX *decrypt_ctx;
+};
 
-	int ciphertext_len;
+/*
+ * create and initialize a cipher context, either as a copy of a pre-keyed context or from scratch
+ */
+static EVP_CIPHER_CTX *oidc_cache_crypto_ctx_init(request_rec *r,
+		const EVP_CIPHER_CTX *keyed_ctx, int enc, unsigned char *key,
+		const unsigned char *iv, int iv_len) {
+	EVP_CIPHER_CTX *ctx;
 
 	/* create and initialize the context */
 	if (!(ctx = EVP_CIPHER_CTX_new())) {
 		oidc_cache_crypto_openssl_error(r, "EVP_CIPHER_CTX_new");
-		return -1;
+		return NULL;
 	}
 
-	/* initialize the encryption cipher */
-	if (!EVP_EncryptInit_ex(ctx, OIDC_CACHE_CIPHER, NULL, NULL, NULL)) {
-		oidc_cache_crypto_openssl_error(r, "EVP_EncryptInit_ex");
-		return -1;
+	if (keyed_ctx != NULL) {
+
+		/* re-use the key schedule that was computed at startup */
+		if (!EVP_CIPHER_CTX_copy(ctx, keyed_ctx)) {
+			oidc_cache_crypto_openssl_error(r, "EVP_CIPHER_CTX_copy");
+			goto err;
+		}
+
+	} else {
+
+		/* initialize the cipher */
+		if (!EVP_CipherInit_ex(ctx, OIDC_CACHE_CIPHER, NULL, NULL, NULL, enc)) {
+			oidc_cache_crypto_openssl_error(r, "EVP_CipherInit_ex");
+			goto err;
+		}
+
+		/* set IV length */
+		if (!EVP_CIPHER_CTX_ctrl(ctx, OIDC_CACHE_CRYPTO_SET_IVLEN, iv_len,
+				NULL)) {
+			oidc_cache_crypto_openssl_error(r, "EVP_CIPHER_CTX_ctrl");
+			goto err;
+		}
+
+		/* initialize the key */
+		if (!EVP_CipherInit_ex(ctx, NULL, NULL, key, NULL, enc)) {
+			oidc_cache_crypto_openssl_error(r, "EVP_CipherInit_ex");
+			goto err;
+		}
 	}
 
-	/* set IV length */
-	if (!EVP_CIPHER_CTX_ctrl(ctx, OIDC_CACHE_CRYPTO_SET_IVLEN, iv_len, NULL)) {
-		oidc_cache_crypto_openssl_error(r, "EVP_CIPHER_CTX_ctrl");
-		return -1;
+	/* initialize the IV */
+	if (!EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, enc)) {
+		oidc_cache_crypto_openssl_error(r, "EVP_CipherInit_ex");
+		goto err;
 	}
 
-	/* initialize key and IV */
-	if (!EVP_EncryptInit_ex(ctx, NULL, NULL, key, iv)) {
-		oidc_cache_crypto_openssl_error(r, "EVP_EncryptInit_ex");
+	return ctx;
+
+err:
+
+	EVP_CIPHER_CTX_free(ctx);
+	return NULL;
+}
+
+/*
+ * AES GCM encrypt
+ */
+static int oidc_cache_crypto_encrypt_impl(request_rec *r,
+		const EVP_CIPHER_CTX *keyed_ctx, unsigned char *plaintext,
+		int plaintext_len, const unsigned char *aad, int aad_len,
+		unsigned char *key, const unsigned char *iv, int iv_len,
+		unsigned char *ciphertext, const unsigned char *tag, int tag_len) {
+	EVP_CIPHER_CTX *ctx;
+
+	int len;
+
+	int ciphertext_len = -1;
+
+	/* create and initialize the context */
+	if (!(ctx = oidc_cache_crypto_ctx_init(r, keyed_ctx, 1, key, iv, iv_len)))
 		return -1;
-	}
 
 	/* provide AAD data */
 	if (!EVP_EncryptUpdate(ctx, NULL, &len, aad, aad_len)) {
 		oidc_cache_crypto_openssl_error(r, "EVP_DecryptUpdate aad: aad_len=%d",
 				aad_len);
-		return -1;
+		goto end;
 	}
 
 	/* provide the message to be encrypted and obtain the encrypted output */
 	if (!EVP_EncryptUpdate(ctx, ciphertext, &len, plaintext, plaintext_len)) {
 		oidc_cache_crypto_openssl_error(r, "EVP_EncryptUpdate ciphertext");
-		return -1;
+		goto end;
 	}
 	ciphertext_len = len;
 
@@ -314,7 +367,8 @@ static int oidc_cache_crypto_encrypt_impl(request_rec *r,
 	 */
 	if (!EVP_EncryptFinal_ex(ctx, ciphertext + len, &len)) {
 		oidc_cache_crypto_openssl_error(r, "EVP_EncryptFinal_ex");
-		return -1;
+		ciphertext_len = -1;
+		goto end;
 	}
 	ciphertext_len += len;
 
@@ -322,9 +376,12 @@ static int oidc_cache_crypto_encrypt_impl(request_rec *r,
 	if (!EVP_CIPHER_CTX_ctrl(ctx, OIDC_CACHE_CRYPTO_GET_TAG, tag_len,
 			(void *) tag)) {
 		oidc_cache_crypto_openssl_error(r, "EVP_CIPHER_CTX_ctrl");
-		return -1;
+		ciphertext_len = -1;
+		goto end;
 	}
 
+end:
+
 	/* clean up */
 	EVP_CIPHER_CTX_free(ctx);
 
@@ -335,49 +392,30 @@ static int oidc_cache_crypto_encrypt_impl(request_rec *r,
  * AES GCM decrypt
  */
 static int oidc_cache_crypto_decrypt_impl(request_rec *r,
-		unsigned char *ciphertext, int ciphertext_len, const unsigned char *aad,
-		int aad_len, const unsigned char *tag, int tag_len, unsigned char *key,
+		const EVP_CIPHER_CTX *keyed_ctx, unsigned char *ciphertext,
+		int ciphertext_len, const unsigned char *aad, int aad_len,
+		const unsigned char *tag, int tag_len, unsigned char *key,
 		const unsigned char *iv, int iv_len, unsigned char *plaintext) {
 	EVP_CIPHER_CTX *ctx;
 	int len;
-	int plaintext_len;
-	int ret;
+	int plaintext_len = 0;
+	int ret = 0;
 
 	/* create and initialize the context */
-	if (!(ctx = EVP_CIPHER_CTX_new())) {
-		oidc_cache_crypto_openssl_error(r, "EVP_CIPHER_CTX_new");
-		return -1;
-	}
-
-	/* initialize the decryption cipher */
-	if (!EVP_DecryptInit_ex(ctx, OIDC_CACHE_CIPHER, NULL, NULL, NULL)) {
-		oidc_cache_crypto_openssl_error(r, "EVP_DecryptInit_ex");
-		return -1;
-	}
-
-	/* set IV length */
-	if (!EVP_CIPHER_CTX_ctrl(ctx, OIDC_CACHE_CRYPTO_SET_IVLEN, iv_len, NULL)) {
-		oidc_cache_crypto_openssl_error(r, "EVP_CIPHER_CTX_ctrl");
-		return -1;
-	}
-
-	/* initialize key and IV */
-	if (!EVP_DecryptInit_ex(ctx, NULL, NULL, key, iv)) {
-		oidc_cache_crypto_openssl_error(r, "EVP_DecryptInit_ex");
+	if (!(ctx = oidc_cache_crypto_ctx_init(r, keyed_ctx, 0, key, iv, iv_len)))
 		return -1;
-	}
 
 	/* provide AAD data */
 	if (!EVP_DecryptUpdate(ctx, NULL, &len, aad, aad_len)) {
 		oidc_cache_crypto_openssl_error(r, "EVP_DecryptUpdate aad: aad_len=%d",
 				aad_len);
-		return -1;
+		goto end;
 	}
 
 	/* provide the message to be decrypted and obtain the plaintext output */
 	if (!EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, ciphertext_len)) {
 		oidc_cache_crypto_openssl_error(r, "EVP_DecryptUpdate ciphertext");
-		return -1;
+		goto end;
 	}
 	plaintext_len = len;
 
@@ -385,7 +423,7 @@ static int oidc_cache_crypto_decrypt_impl(request_rec *r,
 	if (!EVP_CIPHER_CTX_ctrl(ctx, OIDC_CACHE_CRYPTO_SET_TAG, tag_len,
 			(void *) tag)) {
 		oidc_cache_crypto_openssl_error(r, "EVP_CIPHER_CTX_ctrl");
-		return -1;
+		goto end;
 	}
 
 	/*
@@ -393,6 +431,12 @@ static int oidc_cache_crypto_decrypt_impl(request_rec *r,
 	 * anything else is a failure - the plaintext is not trustworthy
 	 */
 	ret = EVP_DecryptFinal_ex(ctx, plaintext + len, &len);
+	if (ret <= 0) {
+		/* verify failed */
+		oidc_cache_crypto_openssl_error(r, "EVP_DecryptFinal_ex");
+	}
+
+end:
 
 	/* clean up */
 	EVP_CIPHER_CTX_free(ctx);
@@ -401,11 +445,9 @@ static int oidc_cache_crypto_decrypt_impl(request_rec *r,
 		/* success */
 		plaintext_len += len;
 		return plaintext_len;
-	} else {
-		/* verify failed */
-		oidc_cache_crypto_openssl_error(r, "EVP_DecryptFinal_ex");
-		return -1;
 	}
+
+	return -1;
 }
 
 /*
@@ -426,23 +468,24 @@ static const unsigned char OIDC_CACHE_CRYPTO_GCM_IV[] = { 0x00, 0x01, 0x02,
  * AES GCM encrypt using the static AAD and IV
  */
 static int oidc_cache_crypto_encrypt(request_rec *r, const char *plaintext,
-		unsigned char *key, char **result) {
+		int plaintext_len, const EVP_CIPHER_CTX *keyed_ctx, unsigned char *key,
+		char **result) {
 	char *encoded = NULL, *p = NULL, *e_tag = NULL;
 	unsigned char *ciphertext = NULL;
-	int plaintext_len, ciphertext_len, encoded_len, e_tag_len;
+	int ciphertext_len, encoded_len, e_tag_len;
 	unsigned char tag[OIDC_CACHE_TAG_LEN];
 
 	/* allocate space for the ciphertext */
-	plaintext_len = strlen(plaintext) + 1;
 	ciphertext = apr_pcalloc(r->pool,
 			(plaintext_len + EVP_CIPHER_block_size(OIDC_CACHE_CIPHER)));
 
-	ciphertext_len = oidc_cache_crypto_encrypt_impl(r,
+	ciphertext_len = oidc_cache_crypto_encrypt_impl(r, keyed_ctx,
 			(unsigned char *) plaintext, plaintext_len,
 			OIDC_CACHE_CRYPTO_GCM_AAD, sizeof(OIDC_CACHE_CRYPTO_GCM_AAD), key,
 			OIDC_CACHE_CRYPTO_GCM_IV, sizeof(OIDC_CACHE_CRYPTO_GCM_IV),
 			ciphertext, tag, sizeof(tag));
-
+	if (ciphertext_len < 0)
+		return -1;
 	/* base64url encode the resulting ciphertext */
 	encoded_len = oidc_base64url_encode(r, &encoded, (const char *) ciphertext,
 			ciphertext_len, 1);
@@ -477,7 +520,8 @@ static int oidc_cache_crypto_encrypt(request_rec *r, const char *plaintext,
  * AES GCM decrypt using the static AAD and IV
  */
 static int oidc_cache_crypto_decrypt(request_rec *r, const char *cache_value,
-		unsigned char *key, unsigned char **plaintext) {
+		const EVP_CIPHER_CTX *keyed_ctx, unsigned char *key,
+		unsigned char **plaintext) {
 
 	int len = -1;
 
@@ -511,8 +555,8 @@ static int oidc_cache_crypto_decrypt(request_rec *r, const char *cache_value,
 
 		/* decrypt the ciphertext providing the tag value */
 
-		len = oidc_cache_crypto_decrypt_impl(r, (unsigned char *) d_bytes,
-				d_len, OIDC_CACHE_CRYPTO_GCM_AAD,
+		len = oidc_cache_crypto_decrypt_impl(r, keyed_ctx,
+				(unsigned char *) d_bytes, d_len, OIDC_CACHE_CRYPTO_GCM_AAD,
 				sizeof(OIDC_CACHE_CRYPTO_GCM_AAD), (unsigned char *) t_bytes,
 				t_len, key, OIDC_CACHE_CRYPTO_GCM_IV,
 				sizeof(OIDC_CACHE_CRYPTO_GCM_IV), *plaintext);
@@ -529,19 +573,111 @@ static int oidc_cache_crypto_decrypt(request_rec *r, const char *cache_value,
 	return len;
 }
 
+/*
+ * create a cipher context for the static IV length, keyed with the passphrase hash
+ */
+static EVP_CIPHER_CTX *oidc_cache_crypto_keyed_ctx(server_rec *s, int enc,
+		const unsigned char *key) {
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	if (ctx == NULL)
+		return NULL;
+	if ((!EVP_CipherInit_ex(ctx, OIDC_CACHE_CIPHER, NULL, NULL, NULL, enc))
+			|| (!EVP_CIPHER_CTX_ctrl(ctx, OIDC_CACHE_CRYPTO_SET_IVLEN,
+					sizeof(OIDC_CACHE_CRYPTO_GCM_IV), NULL))
+			|| (!EVP_CipherInit_ex(ctx, NULL, NULL, key, NULL, enc))) {
+		oidc_serror(s, "initializing cipher context failed: %s",
+				ERR_error_string(ERR_get_error(), NULL));
+		EVP_CIPHER_CTX_free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+/*
+ * release the OpenSSL contexts of the derived key material
+ */
+static apr_status_t oidc_cache_crypto_cleanup(void *data) {
+	oidc_cache_crypto_t *crypto = (oidc_cache_crypto_t *) data;
+	if (crypto->md_ctx != NULL) {
+		EVP_MD_CTX_destroy(crypto->md_ctx);
+		crypto->md_ctx = NULL;
+	}
+	if (crypto->encrypt_ctx != NULL) {
+		EVP_CIPHER_CTX_free(crypto->encrypt_ctx);
+		crypto->encrypt_ctx = NULL;
+	}
+	if (crypto->decrypt_ctx != NULL) {
+		EVP_CIPHER_CTX_free(crypto->decrypt_ctx);
+		crypto->decrypt_ctx = NULL;
+	}
+	return APR_SUCCESS;
+}
+
+/*
+ * derive the cache encryption key and the key hashing state from the crypto passphrase,
+ * once at startup so they can be shared read-only by all requests
+ */
+apr_byte_t oidc_cache_crypto_post_config(apr_pool_t *pool, server_rec *s) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
+			&auth_openidc_module);
+	oidc_cache_crypto_t *crypto = NULL;
+	unsigned int key_len = 0;
+	oidc_jose_error_t err;
+
+	/* vhosts may share the same configuration */
+	if ((cfg->crypto_passphrase == NULL) || (cfg->cache_crypto != NULL))
+		return TRUE;
+
+	crypto = apr_pcalloc(pool, sizeof(oidc_cache_crypto_t));
+	apr_pool_cleanup_register(pool, crypto, oidc_cache_crypto_cleanup,
+			apr_pool_cleanup_null);
+
+	if (oidc_jose_hash_bytes(pool, OIDC_JOSE_ALG_SHA256,
+			(const unsigned char *) cfg->crypto_passphrase,
+			strlen(cfg->crypto_passphrase), &crypto->key, &key_len,
+			&err) == FALSE) {
+		oidc_serror(s, "oidc_jose_hash_bytes returned an error: %s", err.text);
+		return FALSE;
+	}
+
+	crypto->md_ctx = EVP_MD_CTX_create();
+	if ((crypto->md_ctx == NULL)
+			|| (!EVP_DigestInit_ex(crypto->md_ctx, EVP_sha256(), NULL))
+			|| (!EVP_DigestUpdate(crypto->md_ctx, cfg->crypto_passphrase,
+					strlen(cfg->crypto_passphrase)))
+			|| (!EVP_DigestUpdate(crypto->md_ctx, ":", 1))) {
+		oidc_serror(s, "initializing digest context failed: %s",
+				ERR_error_string(ERR_get_error(), NULL));
+		return FALSE;
+	}
+
+	crypto->encrypt_ctx = oidc_cache_crypto_keyed_ctx(s, 1, crypto->key);
+	crypto->decrypt_ctx = oidc_cache_crypto_keyed_ctx(s, 0, crypto->key);
+	if ((crypto->encrypt_ctx == NULL) || (crypto->decrypt_ctx == NULL))
+		return FALSE;
+
+	cfg->cache_crypto = crypto;
+
+	return TRUE;
+}
+
 /*
  * hash the crypto passhphrase so it has enough key length for AES GCM 256
  */
 static unsigned char *oidc_cache_hash_passphrase(request_rec *r,
-		const char *passphrase) {
+		oidc_cfg *cfg) {
 
 	unsigned char *key = NULL;
 	unsigned int key_len = 0;
 	oidc_jose_error_t err;
 
+	/* use the key that was derived at startup */
+	if (cfg->cache_crypto != NULL)
+		return cfg->cache_crypto->key;
+
 	if (oidc_jose_hash_bytes(r->pool, OIDC_JOSE_ALG_SHA256,
-			(const unsigned char *) passphrase, strlen(passphrase), &key,
-			&key_len, &err) == FALSE) {
+			(const unsigned char *) cfg->crypto_passphrase,
+			strlen(cfg->crypto_passphrase), &key, &key_len, &err) == FALSE) {
 		oidc_error(r, "oidc_jose_hash_bytes returned an error: %s", err.text);
 		return NULL;
 	}
@@ -552,10 +688,35 @@ static unsigned char *oidc_cache_hash_passphrase(request_rec *r,
 /*
  * hash a cache key and a crypto passphrase so the result is suitable as an randomized cache key
  */
-static char *oidc_cache_get_hashed_key(request_rec *r, const char *passphrase,
+static char *oidc_cache_get_hashed_key(request_rec *r, oidc_cfg *cfg,
 		const char *key) {
-	char *input = apr_psprintf(r->pool, "%s:%s", passphrase, key);
 	char *output = NULL;
+
+	if (cfg->cache_crypto != NULL) {
+
+		/* continue from the digest state of the "<passphrase>:" prefix */
+		unsigned char hashed[EVP_MAX_MD_SIZE];
+		unsigned int hashed_len = 0;
+		EVP_MD_CTX *ctx = EVP_MD_CTX_create();
+		int ok = (ctx != NULL)
+				&& EVP_MD_CTX_copy_ex(ctx, cfg->cache_crypto->md_ctx)
+				&& EVP_DigestUpdate(ctx, key, strlen(key))
+				&& EVP_DigestFinal_ex(ctx, hashed, &hashed_len);
+		if (ctx != NULL)
+			EVP_MD_CTX_destroy(ctx);
+		if (!ok) {
+			oidc_cache_crypto_openssl_error(r, "hashing cache key");
+			return NULL;
+		}
+		if (oidc_base64url_encode(r, &output, (const char *) hashed,
+				hashed_len, TRUE) <= 0) {
+			oidc_error(r, "oidc_base64url_encode returned an error");
+			return NULL;
+		}
+		return output;
+	}
+
+	char *input = apr_psprintf(r->pool, "%s:%s", cfg->crypto_passphrase, key);
 	if (oidc_util_hash_string_and_base64url_encode(r, OIDC_JOSE_ALG_SHA256,
 			input, &output) == FALSE) {
 		oidc_error(r,
@@ -565,6 +726,291 @@ static char *oidc_cache_get_hashed_key(request_rec *r, const char *passphrase,
 	return output;
 }
 
+/*
+ * per-process L1 cache in front of the configured cache backend, for sections that
+ * opted in with OIDCCacheL1Section; entries are kept in plaintext, are updated on
+ * writes in this process and are served for at most the configured staleness
+ */
+typedef struct oidc_cache_l1_entry_t {
+	/* the key and value are allocated together with the entry */
+	char *key;
+	char *value;
+	apr_time_t expires;
+	struct oidc_cache_l1_entry_t *prev;
+	struct oidc_cache_l1_entry_t *next;
+} oidc_cache_l1_entry_t;
+
+/* default maximum number of entries in the L1 cache */
+#define OIDC_CACHE_L1_MAX_DEFAULT 256
+
+/* name of the L1 cache in metrics */
+#define OIDC_CACHE_L1_NAME "l1"
+
+static apr_hash_t *oidc_cache_l1 = NULL;
+/* most recently used entry first */
+static oidc_cache_l1_entry_t *oidc_cache_l1_head = NULL;
+static oidc_cache_l1_entry_t *oidc_cache_l1_tail = NULL;
+static int oidc_cache_l1_max = OIDC_CACHE_L1_MAX_DEFAULT;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *oidc_cache_l1_mutex = NULL;
+#endif
+
+#if APR_HAS_THREADS
+#define oidc_cache_l1_lock() apr_thread_mutex_lock(oidc_cache_l1_mutex)
+#define oidc_cache_l1_unlock() apr_thread_mutex_unlock(oidc_cache_l1_mutex)
+#else
+#define oidc_cache_l1_lock()
+#define oidc_cache_l1_unlock()
+#endif
+
+/*
+ * unlink an entry from the LRU list
+ */
+static void oidc_cache_l1_unlink(oidc_cache_l1_entry_t *e) {
+	if (e->prev != NULL)
+		e->prev->next = e->next;
+	else
+		oidc_cache_l1_head = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	else
+		oidc_cache_l1_tail = e->prev;
+	e->prev = NULL;
+	e->next = NULL;
+}
+
+/*
+ * link an entry in at the head of the LRU list
+ */
+static void oidc_cache_l1_link(oidc_cache_l1_entry_t *e) {
+	e->prev = NULL;
+	e->next = oidc_cache_l1_head;
+	if (oidc_cache_l1_head != NULL)
+		oidc_cache_l1_head->prev = e;
+	oidc_cache_l1_head = e;
+	if (oidc_cache_l1_tail == NULL)
+		oidc_cache_l1_tail = e;
+}
+
+/*
+ * remove an entry from the L1 cache and free it; the caller must hold the lock
+ */
+static void oidc_cache_l1_remove(oidc_cache_l1_entry_t *e) {
+	apr_hash_set(oidc_cache_l1, e->key, APR_HASH_KEY_STRING, NULL);
+	oidc_cache_l1_unlink(e);
+	free(e);
+}
+
+/*
+ * free all entries when the child process exits
+ */
+static apr_status_t oidc_cache_l1_cleanup(void *data) {
+	while (oidc_cache_l1_head != NULL)
+		oidc_cache_l1_remove(oidc_cache_l1_head);
+	oidc_cache_l1 = NULL;
+	return APR_SUCCESS;
+}
+
+/*
+ * initialize the L1 cache in a child process
+ */
+apr_status_t oidc_cache_l1_child_init(apr_pool_t *p, server_rec *s) {
+	oidc_cfg *cfg = ap_get_module_config(s->module_config,
+			&auth_openidc_module);
+	apr_status_t rv = APR_SUCCESS;
+#if APR_HAS_THREADS
+	rv = apr_thread_mutex_create(&oidc_cache_l1_mutex, APR_THREAD_MUTEX_DEFAULT,
+			p);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s, "apr_thread_mutex_create failed: %d", rv);
+		return rv;
+	}
+#endif
+	if (cfg->cache_l1_max > 0)
+		oidc_cache_l1_max = cfg->cache_l1_max;
+	oidc_cache_l1 = apr_hash_make(p);
+	apr_pool_cleanup_register(p, NULL, oidc_cache_l1_cleanup,
+			apr_pool_cleanup_null);
+	return rv;
+}
+
+/*
+ * return the maximum staleness in seconds of L1 entries for a section, 0 if not enabled
+ */
+static int oidc_cache_l1_staleness(oidc_cfg *cfg, const char *section) {
+	int *v = NULL;
+	if ((oidc_cache_l1 == NULL) || (cfg->cache_l1_sections == NULL))
+		return 0;
+	v = apr_hash_get(cfg->cache_l1_sections, section, APR_HASH_KEY_STRING);
+	return v ? *v : 0;
+}
+
+/*
+ * assemble the L1 key; vhosts may use different cache backends
+ */
+static const char *oidc_cache_l1_key(request_rec *r, oidc_cfg *cfg,
+		const char *section, const char *key) {
+	return apr_psprintf(r->pool, "%pp:%s:%s", cfg->cache_cfg, section, key);
+}
+
+/*
+ * get a non-expired value from the L1 cache
+ */
+static apr_byte_t oidc_cache_l1_get(request_rec *r, const char *l1_key,
+		char **value) {
+	oidc_cache_l1_entry_t *e = NULL;
+	apr_byte_t rc = FALSE;
+
+	oidc_cache_l1_lock();
+	e = apr_hash_get(oidc_cache_l1, l1_key, APR_HASH_KEY_STRING);
+	if (e != NULL) {
+		if (e->expires > apr_time_now()) {
+			*value = apr_pstrdup(r->pool, e->value);
+			oidc_cache_l1_unlink(e);
+			oidc_cache_l1_link(e);
+			rc = TRUE;
+		} else {
+			oidc_cache_l1_remove(e);
+		}
+	}
+	oidc_cache_l1_unlock();
+
+	return rc;
+}
+
+/*
+ * store a value in the L1 cache, or remove it when value is NULL
+ */
+static void oidc_cache_l1_set(const char *l1_key, const char *value,
+		apr_time_t expires) {
+	oidc_cache_l1_entry_t *e = NULL;
+	apr_size_t key_len = strlen(l1_key), value_len = 0;
+
+	oidc_cache_l1_lock();
+
+	e = apr_hash_get(oidc_cache_l1, l1_key, APR_HASH_KEY_STRING);
+	if (e != NULL)
+		oidc_cache_l1_remove(e);
+
+	if ((value != NULL) && (expires > apr_time_now())) {
+		value_len = strlen(value);
+		e = malloc(sizeof(oidc_cache_l1_entry_t) + key_len + 1 + value_len + 1);
+		if (e != NULL) {
+			e->key = (char *) e + sizeof(oidc_cache_l1_entry_t);
+			memcpy(e->key, l1_key, key_len + 1);
+			e->value = e->key + key_len + 1;
+			memcpy(e->value, value, value_len + 1);
+			e->expires = expires;
+			oidc_cache_l1_link(e);
+			apr_hash_set(oidc_cache_l1, e->key, APR_HASH_KEY_STRING, e);
+			/* evict the least recently used entries */
+			while (apr_hash_count(oidc_cache_l1) > oidc_cache_l1_max)
+				oidc_cache_l1_remove(oidc_cache_l1_tail);
+		}
+	}
+
+	oidc_cache_l1_unlock();
+}
+
+/*
+ * update the L1 cache after writing to the backend
+ */
+static void oidc_cache_l1_update(request_rec *r, oidc_cfg *cfg,
+		const char *section, const char *key, const char *value,
+		apr_time_t expiry, apr_byte_t stored) {
+	apr_time_t expires = 0;
+	int staleness = oidc_cache_l1_staleness(cfg, section);
+	if (staleness <= 0)
+		return;
+	expires = apr_time_now() + apr_time_from_sec(staleness);
+	if (expiry < expires)
+		expires = expiry;
+	/* on failure we don't know what the backend holds, so drop it */
+	oidc_cache_l1_set(oidc_cache_l1_key(r, cfg, section, key),
+			stored ? value : NULL, expires);
+}
+
+/* prefix of a compressed value stored in a cache without encryption */
+#define OIDC_CACHE_DEFLATE_PREFIX "~z1."
+
+/*
+ * compress a value that is about to be stored in the cache when configured and worthwhile;
+ * sets the bytes to store and their length, which includes the \0 terminator of a string
+ *
+ * an encrypted value is stored as a \0 followed by the DEFLATE'd bytes, which a regular
+ * string plaintext never starts with, and an unencrypted one as a base64url encoded string
+ */
+static void oidc_cache_compress(request_rec *r, oidc_cfg *cfg, int encrypted,
+		const char **value, int *value_len) {
+	char *deflated = NULL, *encoded = NULL, *buf = NULL;
+	apr_size_t deflated_len = 0;
+	int len = 0;
+
+	*value_len = strlen(*value) + 1;
+
+	if ((cfg->compress_min_size <= 0)
+			|| (*value_len - 1 < cfg->compress_min_size))
+		return;
+
+	if (oidc_util_deflate(r, *value, *value_len - 1, &deflated,
+			&deflated_len) == FALSE)
+		return;
+
+	if (encrypted == 1) {
+		len = deflated_len + 1;
+		buf = apr_palloc(r->pool, len);
+		buf[0] = '\0';
+		memcpy(buf + 1, deflated, deflated_len);
+	} else {
+		if (oidc_base64url_encode(r, &encoded, deflated, deflated_len, 1) <= 0)
+			return;
+		buf = apr_pstrcat(r->pool, OIDC_CACHE_DEFLATE_PREFIX, encoded, NULL);
+		len = strlen(buf) + 1;
+	}
+
+	if (len >= *value_len)
+		return;
+
+	oidc_debug(r, "compressed cache value from %d to %d bytes",
+			*value_len, len);
+
+	*value = buf;
+	*value_len = len;
+}
+
+/*
+ * decompress a value retrieved from the cache if it was stored in compressed form,
+ * regardless of the current configuration; returns NULL on error
+ */
+static char *oidc_cache_decompress(request_rec *r, int encrypted,
+		char *value, int value_len) {
+	char *decoded = NULL, *inflated = NULL;
+	apr_size_t inflated_len = 0;
+	int len = 0;
+
+	if (encrypted == 1) {
+		if ((value_len <= 1) || (value[0] != '\0'))
+			return value;
+		if (oidc_util_inflate(r, value + 1, value_len - 1, &inflated,
+				&inflated_len) == FALSE)
+			return NULL;
+		return inflated;
+	}
+
+	if (strncmp(value, OIDC_CACHE_DEFLATE_PREFIX,
+			strlen(OIDC_CACHE_DEFLATE_PREFIX)) != 0)
+		return value;
+
+	len = oidc_base64url_decode(r->pool, &decoded,
+			value + strlen(OIDC_CACHE_DEFLATE_PREFIX));
+	if ((len <= 0)
+			|| (oidc_util_inflate(r, decoded, len, &inflated, &inflated_len)
+					== FALSE))
+		return NULL;
+
+	return inflated;
+}
+
 /*
  * get a key/value string pair from the cache, possibly decrypting it
  */
@@ -574,15 +1020,33 @@ apr_byte_t oidc_cache_get(request_rec *r, const char *section, const char *key,
 	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
 			&auth_openidc_module);
 	int encrypted = oidc_cfg_cache_encrypt(r);
+	int staleness = oidc_cache_l1_staleness(cfg, section);
+	const char *l1_key = NULL;
+	apr_time_t start = apr_time_now();
 	apr_byte_t rc = TRUE;
 	char *msg = NULL;
+	int len = 0;
 
 	oidc_debug(r, "enter: %s (section=%s, decrypt=%d, type=%s)", key, section,
 			encrypted, cfg->cache->name);
 
+	/* see if we can serve it from the L1 cache */
+	if (staleness > 0) {
+		l1_key = oidc_cache_l1_key(r, cfg, section, key);
+		if (oidc_cache_l1_get(r, l1_key, value) == TRUE) {
+			oidc_debug(r, "L1 cache hit: return %d bytes for key %s",
+					(int )strlen(*value), key);
+			oidc_metrics_cache_timing(r, OIDC_CACHE_L1_NAME, section,
+					OIDC_METRICS_CACHE_OP_GET, start);
+			oidc_metrics_cache_result(r, OIDC_CACHE_L1_NAME, section,
+					OIDC_METRICS_CACHE_RESULT_HIT);
+			return TRUE;
+		}
+	}
+
 	/* see if encryption is turned on */
 	if (encrypted == 1)
-		key = oidc_cache_get_hashed_key(r, cfg->crypto_passphrase, key);
+		key = oidc_cache_get_hashed_key(r, cfg, key);
 
 	/* get the value from the cache */
 	const char *cache_value = NULL;
@@ -597,15 +1061,38 @@ apr_byte_t oidc_cache_get(request_rec *r, const char *section, const char *key,
 
 	/* see if encryption is turned on */
 	if (encrypted == 0) {
-		*value = apr_pstrdup(r->pool, cache_value);
+		*value = oidc_cache_decompress(r, encrypted,
+				apr_pstrdup(r->pool, cache_value), 0);
+		rc = (*value != NULL);
 		goto out;
 	}
 
-	rc = (oidc_cache_crypto_decrypt(r, cache_value,
-			oidc_cache_hash_passphrase(r, cfg->crypto_passphrase),
-			(unsigned char **) value) > 0);
+	len = oidc_cache_crypto_decrypt(r, cache_value,
+			cfg->cache_crypto ? cfg->cache_crypto->decrypt_ctx : NULL,
+			oidc_cache_hash_passphrase(r, cfg), (unsigned char **) value);
+	rc = (len > 0);
+	if (rc == TRUE) {
+		*value = oidc_cache_decompress(r, encrypted, *value, len);
+		rc = (*value != NULL);
+	}
 
 out:
+	/*
+	 * keep the plaintext value so the next hit doesn't need to go to the backend or decrypt;
+	 * the backend doesn't return the expiry so this may outlive it by the staleness, which is
+	 * why sections that must honour it exactly are refused by oidc_parse_cache_l1_section
+	 */
+	if ((rc == TRUE) && (l1_key != NULL) && (*value != NULL))
+		oidc_cache_l1_set(l1_key, *value,
+				apr_time_now() + apr_time_from_sec(staleness));
+
+	oidc_metrics_cache_timing(r, cfg->cache->name, section,
+			OIDC_METRICS_CACHE_OP_GET, start);
+	oidc_metrics_cache_result(r, cfg->cache->name, section,
+			(rc == FALSE) ? OIDC_METRICS_CACHE_RESULT_ERROR :
+			(*value != NULL) ?
+					OIDC_METRICS_CACHE_RESULT_HIT : OIDC_METRICS_CACHE_RESULT_MISS);
+
 	/* log the result */
 	msg = apr_psprintf(r->pool, "from %s cache backend for %skey %s",
 			cfg->cache->name, encrypted ? "encrypted " : "", key);
@@ -630,26 +1117,33 @@ apr_byte_t oidc_cache_set(request_rec *r, const char *section, const char *key,
 	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
 			&auth_openidc_module);
 	int encrypted = oidc_cfg_cache_encrypt(r);
+	const char *plain_key = key, *plain_value = value;
+	apr_time_t start = apr_time_now();
 	char *encoded = NULL;
 	apr_byte_t rc = FALSE;
 	char *msg = NULL;
+	int len = 0;
 
 	oidc_debug(r,
 			"enter: %s (section=%s, len=%d, encrypt=%d, ttl(s)=%" APR_TIME_T_FMT ", type=%s)",
 			key, section, value ? (int )strlen(value) : 0, encrypted,
 					apr_time_sec(expiry - apr_time_now()), cfg->cache->name);
 
+	/* see if we need to compress */
+	if (value != NULL)
+		oidc_cache_compress(r, cfg, encrypted, &value, &len);
+
 	/* see if we need to encrypt */
 	if (encrypted == 1) {
 
-		key = oidc_cache_get_hashed_key(r, cfg->crypto_passphrase, key);
+		key = oidc_cache_get_hashed_key(r, cfg, key);
 		if (key == NULL)
 			goto out;
 
 		if (value != NULL) {
-			if (oidc_cache_crypto_encrypt(r, value,
-					oidc_cache_hash_passphrase(r, cfg->crypto_passphrase),
-					&encoded) <= 0)
+			if (oidc_cache_crypto_encrypt(r, value, len,
+					cfg->cache_crypto ? cfg->cache_crypto->encrypt_ctx : NULL,
+					oidc_cache_hash_passphrase(r, cfg), &encoded) <= 0)
 				goto out;
 			value = encoded;
 		}
@@ -659,6 +1153,15 @@ apr_byte_t oidc_cache_set(request_rec *r, const char *section, const char *key,
 	rc = cfg->cache->set(r, section, key, value, expiry);
 
 out:
+	/* write through to the L1 cache */
+	oidc_cache_l1_update(r, cfg, section, plain_key, plain_value, expiry, rc);
+
+	oidc_metrics_cache_timing(r, cfg->cache->name, section,
+			OIDC_METRICS_CACHE_OP_SET, start);
+	oidc_metrics_cache_result(r, cfg->cache->name, section,
+			(rc == TRUE) ?
+					OIDC_METRICS_CACHE_RESULT_OK : OIDC_METRICS_CACHE_RESULT_ERROR);
+
 	/* log the result */
 	msg = apr_psprintf(r->pool, "%d bytes in %s cache backend for %skey %s",
 			(value ? (int) strlen(value) : 0),
@@ -671,3 +1174,529 @@ out:
 
 	return rc;
 }
+
+/*
+ * get a number of values from the cache in a single backend operation when the
+ * backend supports it; entries that are not found have their value set to NULL
+ */
+apr_byte_t oidc_cache_get_multi(request_rec *r, oidc_cache_entry_t *entries,
+		int n) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	int encrypted = oidc_cfg_cache_encrypt(r);
+	oidc_cache_entry_t *items = NULL;
+	int *index = NULL;
+	char *value = NULL;
+	apr_time_t start = 0;
+	apr_byte_t rc = TRUE;
+	int i, m = 0, staleness = 0, len = 0;
+
+	oidc_debug(r, "enter: %d entries (decrypt=%d, type=%s)", n, encrypted,
+			cfg->cache->name);
+
+	/* translate the keys to what is stored in the backend, skipping L1 cache hits */
+	items = apr_pcalloc(r->pool, n * sizeof(oidc_cache_entry_t));
+	index = apr_pcalloc(r->pool, n * sizeof(int));
+	for (i = 0; i < n; i++) {
+		entries[i].value = NULL;
+		if ((oidc_cache_l1_staleness(cfg, entries[i].section) > 0)
+				&& (oidc_cache_l1_get(r,
+						oidc_cache_l1_key(r, cfg, entries[i].section,
+								entries[i].key), &value) == TRUE)) {
+			entries[i].value = value;
+			oidc_metrics_cache_result(r, OIDC_CACHE_L1_NAME, entries[i].section,
+					OIDC_METRICS_CACHE_RESULT_HIT);
+			continue;
+		}
+		items[m].section = entries[i].section;
+		items[m].key =
+				(encrypted == 1) ?
+						oidc_cache_get_hashed_key(r, cfg, entries[i].key) :
+						entries[i].key;
+		items[m].value = NULL;
+		if (items[m].key == NULL)
+			return FALSE;
+		index[m] = i;
+		m++;
+	}
+
+	if (m == 0)
+		return TRUE;
+
+	/* get the values from the cache */
+	start = apr_time_now();
+	if (cfg->cache->get_multi != NULL) {
+		rc = cfg->cache->get_multi(r, items, m);
+	} else {
+		for (i = 0; (rc == TRUE) && (i < m); i++)
+			rc = cfg->cache->get(r, items[i].section, items[i].key,
+					&items[i].value);
+	}
+
+	/* the time of a multi-key operation is accounted to the section of the first key */
+	oidc_metrics_cache_timing(r, cfg->cache->name, items[0].section,
+			OIDC_METRICS_CACHE_OP_GET, start);
+
+	if (rc == FALSE) {
+		oidc_warn(r, "error retrieving %d values from %s cache backend", m,
+				cfg->cache->name);
+		for (i = 0; i < m; i++)
+			oidc_metrics_cache_result(r, cfg->cache->name, items[i].section,
+					OIDC_METRICS_CACHE_RESULT_ERROR);
+		return FALSE;
+	}
+
+	/* decrypt each value on its own */
+	for (i = 0; i < m; i++) {
+		if (items[i].value == NULL) {
+			oidc_debug(r, "cache miss for %skey %s",
+					encrypted ? "encrypted " : "", items[i].key);
+			oidc_metrics_cache_result(r, cfg->cache->name, items[i].section,
+					OIDC_METRICS_CACHE_RESULT_MISS);
+			continue;
+		}
+		if (encrypted == 0) {
+			len = 0;
+			value = apr_pstrdup(r->pool, items[i].value);
+		} else {
+			value = NULL;
+			len = oidc_cache_crypto_decrypt(r, items[i].value,
+					cfg->cache_crypto ? cfg->cache_crypto->decrypt_ctx : NULL,
+					oidc_cache_hash_passphrase(r, cfg),
+					(unsigned char **) &value);
+			if (len <= 0) {
+				oidc_warn(r,
+						"error decrypting value from %s cache backend for key %s",
+						cfg->cache->name, items[i].key);
+				oidc_metrics_cache_result(r, cfg->cache->name,
+						items[i].section, OIDC_METRICS_CACHE_RESULT_ERROR);
+				rc = FALSE;
+				continue;
+			}
+		}
+		value = oidc_cache_decompress(r, encrypted, value, len);
+		if (value == NULL) {
+			oidc_warn(r,
+					"error decompressing value from %s cache backend for key %s",
+					cfg->cache->name, items[i].key);
+			oidc_metrics_cache_result(r, cfg->cache->name, items[i].section,
+					OIDC_METRICS_CACHE_RESULT_ERROR);
+			rc = FALSE;
+			continue;
+		}
+		oidc_metrics_cache_result(r, cfg->cache->name, items[i].section,
+				OIDC_METRICS_CACHE_RESULT_HIT);
+		entries[index[i]].value = value;
+		staleness = oidc_cache_l1_staleness(cfg, items[i].section);
+		if (staleness > 0)
+			oidc_cache_l1_set(
+					oidc_cache_l1_key(r, cfg, items[i].section,
+							entries[index[i]].key), value,
+					apr_time_now() + apr_time_from_sec(staleness));
+	}
+
+	return rc;
+}
+
+/*
+ * store a number of key/value pairs in the cache in a single backend operation when
+ * the backend supports it; encryption is applied to each value on its own
+ */
+apr_byte_t oidc_cache_set_multi(request_rec *r,
+		const oidc_cache_entry_t *entries, int n) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	int encrypted = oidc_cfg_cache_encrypt(r);
+	oidc_cache_entry_t *items = NULL;
+	char *encoded = NULL;
+	apr_time_t start = 0;
+	apr_byte_t rc = TRUE;
+	int i, len = 0;
+
+	oidc_debug(r, "enter: %d entries (encrypt=%d, type=%s)", n, encrypted,
+			cfg->cache->name);
+
+	/* translate the keys and values to what is stored in the backend */
+	items = apr_pcalloc(r->pool, n * sizeof(oidc_cache_entry_t));
+	for (i = 0; i < n; i++) {
+		items[i] = entries[i];
+		if (items[i].value != NULL)
+			oidc_cache_compress(r, cfg, encrypted, &items[i].value, &len);
+		if (encrypted == 0)
+			continue;
+		items[i].key = oidc_cache_get_hashed_key(r, cfg, entries[i].key);
+		if (items[i].key == NULL)
+			return FALSE;
+		if (items[i].value != NULL) {
+			if (oidc_cache_crypto_encrypt(r, items[i].value, len,
+					cfg->cache_crypto ? cfg->cache_crypto->encrypt_ctx : NULL,
+					oidc_cache_hash_passphrase(r, cfg), &encoded) <= 0)
+				return FALSE;
+			items[i].value = encoded;
+		}
+	}
+
+	/* store the resulting values in the cache */
+	start = apr_time_now();
+	if (cfg->cache->set_multi != NULL) {
+		rc = cfg->cache->set_multi(r, items, n);
+	} else {
+		for (i = 0; i < n; i++)
+			if (cfg->cache->set(r, items[i].section, items[i].key,
+					items[i].value, items[i].expiry) == FALSE)
+				rc = FALSE;
+	}
+
+	/* the time of a multi-key operation is accounted to the section of the first key */
+	oidc_metrics_cache_timing(r, cfg->cache->name, entries[0].section,
+			OIDC_METRICS_CACHE_OP_SET, start);
+
+	/* write through to the L1 cache */
+	for (i = 0; i < n; i++) {
+		oidc_cache_l1_update(r, cfg, entries[i].section, entries[i].key,
+				entries[i].value, entries[i].expiry, rc);
+		oidc_metrics_cache_result(r, cfg->cache->name, entries[i].section,
+				(rc == TRUE) ?
+						OIDC_METRICS_CACHE_RESULT_OK :
+						OIDC_METRICS_CACHE_RESULT_ERROR);
+	}
+
+	if (rc == TRUE)
+		oidc_debug(r, "successfully stored %d entries in %s cache backend", n,
+				cfg->cache->name);
+	else
+		oidc_warn(r, "could NOT store %d entries in %s cache backend", n,
+				cfg->cache->name);
+
+	return rc;
+}
+
+/*
+ * update the expiry of an existing cache entry without rewriting its value;
+ * returns FALSE when the backend doesn't support it or the entry doesn't exist
+ */
+apr_byte_t oidc_cache_touch(request_rec *r, const char *section,
+		const char *key, apr_time_t expiry) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	int encrypted = oidc_cfg_cache_encrypt(r);
+	apr_byte_t rc = FALSE;
+
+	oidc_debug(r,
+			"enter: %s (section=%s, encrypt=%d, ttl(s)=%" APR_TIME_T_FMT ", type=%s)",
+			key, section, encrypted, apr_time_sec(expiry - apr_time_now()),
+			cfg->cache->name);
+
+	if (cfg->cache->touch == NULL)
+		return FALSE;
+
+	/* the key is hashed when encryption is enabled; the value is left untouched */
+	if (encrypted == 1) {
+		key = oidc_cache_get_hashed_key(r, cfg, key);
+		if (key == NULL)
+			return FALSE;
+	}
+
+	rc = cfg->cache->touch(r, section, key, expiry);
+
+	oidc_debug(r, "%s expiry of %skey %s in %s cache backend",
+			(rc == TRUE) ? "updated" : "could not update",
+			(encrypted ? "encrypted " : ""), key, cfg->cache->name);
+
+	return rc;
+}
+
+/*
+ * try to obtain a lease, until expiry, that allows a single worker to (re)create the
+ * entry identified by section and key while others wait for it or keep using a copy
+ *
+ * the cache offers no atomic add so a random token is written and read back, which
+ * makes it unlikely, though not impossible, that more than one worker gets the lease
+ */
+apr_byte_t oidc_cache_lease_acquire(request_rec *r, const char *section,
+		const char *key, apr_time_t expiry) {
+	const char *lease_key = apr_psprintf(r->pool, "%s:%s", section, key);
+	char *token = NULL, *value = NULL;
+
+	if ((oidc_cache_get(r, OIDC_CACHE_SECTION_LEASE, lease_key, &value) == FALSE)
+			|| (value != NULL))
+		return FALSE;
+
+	if (oidc_proto_generate_nonce(r, &token, 16) == FALSE)
+		return FALSE;
+
+	if (oidc_cache_set(r, OIDC_CACHE_SECTION_LEASE, lease_key, token,
+			expiry) == FALSE)
+		return FALSE;
+
+	if ((oidc_cache_get(r, OIDC_CACHE_SECTION_LEASE, lease_key, &value) == FALSE)
+			|| (value == NULL) || (apr_strnatcmp(value, token) != 0))
+		return FALSE;
+
+	oidc_debug(r, "obtained lease for %s", lease_key);
+
+	return TRUE;
+}
+
+/*
+ * give up a lease obtained with oidc_cache_lease_acquire
+ */
+void oidc_cache_lease_release(request_rec *r, const char *section,
+		const char *key) {
+	oidc_cache_set(r, OIDC_CACHE_SECTION_LEASE,
+			apr_psprintf(r->pool, "%s:%s", section, key), NULL, 0);
+}
+
+/*
+ * an index that is stored as a regular cache value holds its members separated by a space,
+ * each followed by a colon and its expiry in seconds; a member without an expiry is a plain
+ * value that was stored under the same key by an earlier version, it is returned but dropped
+ * on the next update
+ */
+#define OIDC_CACHE_INDEX_SEPARATOR        " "
+#define OIDC_CACHE_INDEX_EXPIRY_SEPARATOR ':'
+
+/*
+ * split a member of an index that is stored as a regular value in to its value and expiry
+ */
+static const char *oidc_cache_index_value_member(apr_pool_t *pool,
+		const char *token, apr_time_t *expiry) {
+	const char *p = strrchr(token, OIDC_CACHE_INDEX_EXPIRY_SEPARATOR);
+	*expiry = 0;
+	if (p == NULL)
+		return token;
+	*expiry = apr_time_from_sec(apr_atoi64(p + 1));
+	return apr_pstrmemdup(pool, token, p - token);
+}
+
+/*
+ * return the index value that results from adding (expiry > 0) or removing (expiry 0) a member,
+ * leaving out expired members; returns NULL when no members remain and otherwise sets
+ * index_expiry to the latest expiry of the members so the index lives as long as they do
+ */
+char *oidc_cache_index_value_update(apr_pool_t *pool, const char *value,
+		const char *member, apr_time_t expiry, apr_time_t *index_expiry) {
+	apr_time_t now = apr_time_now(), t = 0;
+	char *tokens = NULL, *token = NULL, *last = NULL, *result = NULL;
+	const char *m = NULL;
+
+	*index_expiry = 0;
+
+	if (value != NULL) {
+		tokens = apr_pstrdup(pool, value);
+		for (token = apr_strtok(tokens, OIDC_CACHE_INDEX_SEPARATOR, &last);
+				token != NULL;
+				token = apr_strtok(NULL, OIDC_CACHE_INDEX_SEPARATOR, &last)) {
+			m = oidc_cache_index_value_member(pool, token, &t);
+			if ((t <= now) || (apr_strnatcmp(m, member) == 0))
+				continue;
+			result = (result != NULL) ?
+					apr_pstrcat(pool, result, OIDC_CACHE_INDEX_SEPARATOR, token,
+							NULL) :
+							token;
+			if (t > *index_expiry)
+				*index_expiry = t;
+		}
+	}
+
+	if (expiry > 0) {
+		token = apr_psprintf(pool, "%s%c%" APR_TIME_T_FMT, member,
+				OIDC_CACHE_INDEX_EXPIRY_SEPARATOR, apr_time_sec(expiry));
+		result = (result != NULL) ?
+				apr_pstrcat(pool, result, OIDC_CACHE_INDEX_SEPARATOR, token,
+						NULL) :
+						token;
+		if (expiry > *index_expiry)
+			*index_expiry = expiry;
+	}
+
+	return result;
+}
+
+/*
+ * return the non-expired members of an index that is stored as a regular value
+ */
+apr_array_header_t *oidc_cache_index_value_members(apr_pool_t *pool,
+		const char *value) {
+	apr_array_header_t *members = apr_array_make(pool, 4, sizeof(const char *));
+	apr_time_t now = apr_time_now(), t = 0;
+	char *tokens = NULL, *token = NULL, *last = NULL;
+	const char *m = NULL;
+
+	if (value == NULL)
+		return members;
+
+	tokens = apr_pstrdup(pool, value);
+	for (token = apr_strtok(tokens, OIDC_CACHE_INDEX_SEPARATOR, &last);
+			token != NULL;
+			token = apr_strtok(NULL, OIDC_CACHE_INDEX_SEPARATOR, &last)) {
+		m = oidc_cache_index_value_member(pool, token, &t);
+		if ((t != 0) && (t <= now))
+			continue;
+		APR_ARRAY_PUSH(members, const char *) = m;
+	}
+
+	return members;
+}
+
+/*
+ * add members to, or remove them from, indexes in a single backend operation when the
+ * backend supports it; the key is hashed and the members are encrypted when encryption is
+ * enabled, the static IV makes that deterministic so a member can be found again in the index
+ */
+apr_byte_t oidc_cache_index_update(request_rec *r,
+		const oidc_cache_entry_t *entries, int n) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	int encrypted = oidc_cfg_cache_encrypt(r);
+	oidc_cache_entry_t *items = NULL;
+	const char *value = NULL;
+	char *encoded = NULL, *updated = NULL;
+	apr_time_t start = 0, index_expiry = 0;
+	apr_byte_t rc = TRUE;
+	int i;
+
+	oidc_debug(r, "enter: %d entries (encrypt=%d, type=%s)", n, encrypted,
+			cfg->cache->name);
+
+	/* translate the keys and members to what is stored in the backend */
+	items = apr_pcalloc(r->pool, n * sizeof(oidc_cache_entry_t));
+	for (i = 0; i < n; i++) {
+		items[i] = entries[i];
+		if (encrypted == 0)
+			continue;
+		items[i].key = oidc_cache_get_hashed_key(r, cfg, entries[i].key);
+		if (items[i].key == NULL)
+			return FALSE;
+		if (items[i].value != NULL) {
+			if (oidc_cache_crypto_encrypt(r, items[i].value,
+					strlen(items[i].value) + 1,
+					cfg->cache_crypto ? cfg->cache_crypto->encrypt_ctx : NULL,
+					oidc_cache_hash_passphrase(r, cfg), &encoded) <= 0)
+				return FALSE;
+			items[i].value = encoded;
+		}
+	}
+
+	start = apr_time_now();
+	if (cfg->cache->index_update != NULL) {
+		rc = cfg->cache->index_update(r, items, n);
+	} else {
+		/*
+		 * read and rewrite an index that is stored as a regular value; the backend offers no
+		 * atomic update so concurrent updates of the same index may lose a member
+		 */
+		for (i = 0; i < n; i++) {
+			updated = NULL;
+			if (items[i].value != NULL) {
+				value = NULL;
+				if (cfg->cache->get(r, items[i].section, items[i].key,
+						&value) == FALSE) {
+					rc = FALSE;
+					continue;
+				}
+				updated = oidc_cache_index_value_update(r->pool, value,
+						items[i].value, items[i].expiry, &index_expiry);
+			}
+			if (cfg->cache->set(r, items[i].section, items[i].key, updated,
+					index_expiry) == FALSE)
+				rc = FALSE;
+		}
+	}
+
+	/* the time of a multi-key operation is accounted to the section of the first key */
+	oidc_metrics_cache_timing(r, cfg->cache->name, entries[0].section,
+			OIDC_METRICS_CACHE_OP_SET, start);
+	for (i = 0; i < n; i++)
+		oidc_metrics_cache_result(r, cfg->cache->name, entries[i].section,
+				(rc == TRUE) ?
+						OIDC_METRICS_CACHE_RESULT_OK :
+						OIDC_METRICS_CACHE_RESULT_ERROR);
+
+	if (rc == TRUE)
+		oidc_debug(r, "successfully updated %d index entries in %s cache backend",
+				n, cfg->cache->name);
+	else
+		oidc_warn(r, "could NOT update %d index entries in %s cache backend", n,
+				cfg->cache->name);
+
+	return rc;
+}
+
+/*
+ * get the non-expired members of an index, decrypting them when encryption is enabled
+ */
+apr_byte_t oidc_cache_index_get(request_rec *r, const char *section,
+		const char *key, apr_array_header_t **members) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	int encrypted = oidc_cfg_cache_encrypt(r);
+	apr_array_header_t *items = NULL;
+	const char *value = NULL;
+	char *plaintext = NULL;
+	apr_time_t start = 0;
+	apr_byte_t rc = FALSE;
+	int i;
+
+	oidc_debug(r, "enter: %s (section=%s, decrypt=%d, type=%s)", key, section,
+			encrypted, cfg->cache->name);
+
+	*members = apr_array_make(r->pool, 4, sizeof(const char *));
+
+	if (encrypted == 1) {
+		key = oidc_cache_get_hashed_key(r, cfg, key);
+		if (key == NULL)
+			return FALSE;
+	}
+
+	start = apr_time_now();
+	if (cfg->cache->index_get != NULL) {
+		rc = cfg->cache->index_get(r, section, key, &items);
+	} else {
+		rc = cfg->cache->get(r, section, key, &value);
+		if (rc == TRUE)
+			items = oidc_cache_index_value_members(r->pool, value);
+	}
+
+	oidc_metrics_cache_timing(r, cfg->cache->name, section,
+			OIDC_METRICS_CACHE_OP_GET, start);
+	oidc_metrics_cache_result(r, cfg->cache->name, section,
+			(rc == FALSE) ? OIDC_METRICS_CACHE_RESULT_ERROR :
+			(items->nelts > 0) ?
+					OIDC_METRICS_CACHE_RESULT_HIT : OIDC_METRICS_CACHE_RESULT_MISS);
+
+	if (rc == FALSE) {
+		oidc_warn(r, "error retrieving index from %s cache backend for key %s",
+				cfg->cache->name, key);
+		return FALSE;
+	}
+
+	for (i = 0; i < items->nelts; i++) {
+		value = APR_ARRAY_IDX(items, i, const char *);
+		if (encrypted == 1) {
+			plaintext = NULL;
+			if (oidc_cache_crypto_decrypt(r, value,
+					cfg->cache_crypto ? cfg->cache_crypto->decrypt_ctx : NULL,
+					oidc_cache_hash_passphrase(r, cfg),
+					(unsigned char **) &plaintext) <= 0) {
+				oidc_warn(r,
+						"error decrypting index member from %s cache backend for key %s",
+						cfg->cache->name, key);
+				continue;
+			}
+			value = plaintext;
+		}
+		APR_ARRAY_PUSH(*members, const char *) = value;
+	}
+
+	oidc_debug(r, "found %d members in index from %s cache backend for %skey %s",
+			(*members)->nelts, cfg->cache->name, encrypted ? "encrypted " : "",
+			key);
+
+	return TRUE;
+}
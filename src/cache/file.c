@@ -78,6 +78,14 @@ typedef struct {
  */
 #define OIDC_CACHE_FILE_PREFIX "mod-auth-openidc-"
 
+/* by default all cache files live in the cache directory itself */
+#define OIDC_CACHE_FILE_LEVELS_DEFAULT 0
+/* default number of entries inspected in a single clean cycle over hashed subdirectories */
+#define OIDC_CACHE_FILE_CLEAN_MAX_DEFAULT 10000
+/* number of bits of the key hash used for the subdirectory name at each level, i.e. a fan-out of 16 */
+#define OIDC_CACHE_FILE_LEVEL_BITS 4
+#define OIDC_CACHE_FILE_LEVEL_MASK ((1 << OIDC_CACHE_FILE_LEVEL_BITS) - 1)
+
 /* post config routine */
 int oidc_cache_file_post_config(server_rec *s) {
 	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
@@ -87,9 +95,38 @@ int oidc_cache_file_post_config(server_rec *s) {
 		apr_temp_dir_get((const char **) &cfg->cache_file_dir,
 				s->process->pool);
 	}
+	if (cfg->cache_file_levels == OIDC_CONFIG_POS_INT_UNSET)
+		cfg->cache_file_levels = OIDC_CACHE_FILE_LEVELS_DEFAULT;
+	if (cfg->cache_file_clean_max == OIDC_CONFIG_POS_INT_UNSET)
+		cfg->cache_file_clean_max = OIDC_CACHE_FILE_CLEAN_MAX_DEFAULT;
 	return OK;
 }
 
+/*
+ * return the number of (leaf) subdirectories that hold cache files
+ */
+static unsigned int oidc_cache_file_shards(oidc_cfg *cfg) {
+	return 1 << (OIDC_CACHE_FILE_LEVEL_BITS * cfg->cache_file_levels);
+}
+
+/*
+ * return the path to the subdirectory with the specified index that holds cache files
+ */
+static const char *oidc_cache_file_shard_dir(request_rec *r, oidc_cfg *cfg,
+		unsigned int shard) {
+	switch (cfg->cache_file_levels) {
+	case 1:
+		return apr_psprintf(r->pool, "%s/%x", cfg->cache_file_dir,
+				shard & OIDC_CACHE_FILE_LEVEL_MASK);
+	case 2:
+		return apr_psprintf(r->pool, "%s/%x/%x", cfg->cache_file_dir,
+				shard & OIDC_CACHE_FILE_LEVEL_MASK,
+				(shard >> OIDC_CACHE_FILE_LEVEL_BITS)
+				& OIDC_CACHE_FILE_LEVEL_MASK);
+	}
+	return cfg->cache_file_dir;
+}
+
 /*
  * return the cache file name for a specified key
  */
@@ -100,14 +137,19 @@ static const char *oidc_cache_file_name(request_rec *r, const char *section,
 }
 
 /*
- * return the fully qualified path name to a cache file for a specified key
+ * return the fully qualified path name to a cache file for a specified key,
+ * in a subdirectory derived from a hash over the file name when configured
  */
 static const char *oidc_cache_file_path(request_rec *r, const char *section,
 		const char *key) {
 	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
 			&auth_openidc_module);
-	return apr_psprintf(r->pool, "%s/%s", cfg->cache_file_dir,
-			oidc_cache_file_name(r, section, key));
+	const char *name = oidc_cache_file_name(r, section, key);
+	apr_ssize_t len = APR_HASH_KEY_STRING;
+	unsigned int hash = apr_hashfunc_default(name, &len);
+	return apr_psprintf(r->pool, "%s/%s",
+			oidc_cache_file_shard_dir(r, cfg,
+					hash & (oidc_cache_file_shards(cfg) - 1)), name);
 }
 
 /*
@@ -253,13 +295,15 @@ error_close:
 	return FALSE;
 }
 
-// TODO: make these configurable?
 #define OIDC_CACHE_FILE_LAST_CLEANED "last-cleaned"
 
 /*
- * delete all expired entries from the cache directory
+ * delete the expired entries from a single directory and return the number of inspected entries;
+ * the modification time of a cache file is its expiry so only files that appear to be expired are
+ * opened, which also covers files written by versions that did not set the modification time
  */
-static apr_status_t oidc_cache_file_clean(request_rec *r) {
+static int oidc_cache_file_clean_dir(request_rec *r, const char *dirname,
+		const char *metadata_name) {
 	apr_status_t rc = APR_SUCCESS;
 	apr_dir_t *dir = NULL;
 	apr_file_t *fd = NULL;
@@ -267,76 +311,41 @@ static apr_status_t oidc_cache_file_clean(request_rec *r) {
 	apr_finfo_t fi;
 	oidc_cache_file_info_t info;
 	char s_err[128];
-
-	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
-			&auth_openidc_module);
-
-	/* get the path to the metadata file that holds "last cleaned" metadata info */
-	const char *metadata_path = oidc_cache_file_path(r, "cache-file",
-			OIDC_CACHE_FILE_LAST_CLEANED);
-
-	/* open the metadata file if it exists */
-	if ((rc = apr_stat(&fi, metadata_path, APR_FINFO_MTIME, r->pool))
-			== APR_SUCCESS) {
-
-		/* really only clean once per so much time, check that we haven not recently run */
-		if (apr_time_now() < fi.mtime + apr_time_from_sec(cfg->cache_file_clean_interval)) {
-			oidc_debug(r,
-					"last cleanup call was less than %d seconds ago (next one as early as in %" APR_TIME_T_FMT " secs)",
-					cfg->cache_file_clean_interval,
-					apr_time_sec( fi.mtime + apr_time_from_sec(cfg->cache_file_clean_interval) - apr_time_now()));
-			return APR_SUCCESS;
-		}
-
-		/* time to clean, reset the modification time of the metadata file to reflect the timestamp of this cleaning cycle */
-		apr_file_mtime_set(metadata_path, apr_time_now(), r->pool);
-
-		oidc_debug(r, "start cleaning cycle");
-
-	} else {
-
-		/* no metadata file exists yet, create one (and open it) */
-		if ((rc = apr_file_open(&fd, metadata_path,
-				(APR_FOPEN_WRITE | APR_FOPEN_CREATE), APR_OS_DEFAULT, r->pool))
-				!= APR_SUCCESS) {
-			oidc_error(r, "error creating cache timestamp file '%s' (%s)",
-					metadata_path, apr_strerror(rc, s_err, sizeof(s_err)));
-			return rc;
-		}
-
-		/* and cleanup... */
-		if ((rc = apr_file_close(fd)) != APR_SUCCESS) {
-			oidc_error(r, "error closing cache timestamp file '%s' (%s)",
-					metadata_path, apr_strerror(rc, s_err, sizeof(s_err)));
-		}
-	}
-
-	/* time to clean, open the cache directory */
-	if ((rc = apr_dir_open(&dir, cfg->cache_file_dir, r->pool)) != APR_SUCCESS) {
-		oidc_error(r, "error opening cache directory '%s' for cleaning (%s)",
-				cfg->cache_file_dir, apr_strerror(rc, s_err, sizeof(s_err)));
-		return rc;
+	int n = 0;
+
+	/* open the cache directory; a subdirectory won't exist until an entry was written to it */
+	if ((rc = apr_dir_open(&dir, dirname, r->pool)) != APR_SUCCESS) {
+		if (!APR_STATUS_IS_ENOENT(rc))
+			oidc_error(r, "error opening cache directory '%s' for cleaning (%s)",
+					dirname, apr_strerror(rc, s_err, sizeof(s_err)));
+		return 0;
 	}
 
 	/* loop trough the cache file entries */
 	do {
 
 		/* read the next entry from the directory */
-		i = apr_dir_read(&fi, APR_FINFO_NAME, dir);
+		i = apr_dir_read(&fi, APR_FINFO_NAME | APR_FINFO_TYPE | APR_FINFO_MTIME,
+				dir);
 
-		if (i == APR_SUCCESS) {
+		if ((i == APR_SUCCESS) || (i == APR_INCOMPLETE)) {
 
-			/* skip non-cache entries, cq. the ".", ".." and the metadata file */
+			/* skip non-cache entries, cq. the ".", "..", subdirectories and the metadata file */
 			if ((fi.name[0] == OIDC_CHAR_DOT)
 					|| (strstr(fi.name, OIDC_CACHE_FILE_PREFIX) != fi.name)
-					|| ((apr_strnatcmp(fi.name,
-							oidc_cache_file_name(r, "cache-file",
-									OIDC_CACHE_FILE_LAST_CLEANED)) == 0)))
+					|| ((fi.valid & APR_FINFO_TYPE) && (fi.filetype == APR_DIR))
+					|| ((apr_strnatcmp(fi.name, metadata_name) == 0)))
+				continue;
+
+			n++;
+
+			/* an entry that has not expired according to its modification time doesn't need to be opened */
+			if ((fi.valid & APR_FINFO_MTIME) && (apr_time_now() < fi.mtime))
 				continue;
 
 			/* get the fully qualified path to the cache file and open it */
-			const char *path = apr_psprintf(r->pool, "%s/%s",
-					cfg->cache_file_dir, fi.name);
+			const char *path = apr_psprintf(r->pool, "%s/%s", dirname,
+					fi.name);
 			if ((rc = apr_file_open(&fd, path, APR_FOPEN_READ, APR_OS_DEFAULT,
 					r->pool)) != APR_SUCCESS) {
 				oidc_error(r, "unable to open cache entry \"%s\" (%s)", path,
@@ -378,17 +387,115 @@ static apr_status_t oidc_cache_file_clean(request_rec *r) {
 
 		}
 
-	} while (i == APR_SUCCESS);
+	} while ((i == APR_SUCCESS) || (i == APR_INCOMPLETE));
 
 	apr_dir_close(dir);
 
+	return n;
+}
+
+/*
+ * delete expired entries from the cache directory; with hashed subdirectories a single cycle
+ * stops after inspecting a maximum number of entries and the next cycle continues from there
+ */
+static apr_status_t oidc_cache_file_clean(request_rec *r) {
+	apr_status_t rc = APR_SUCCESS;
+	apr_file_t *fd = NULL;
+	apr_finfo_t fi;
+	char buf[32];
+	apr_size_t len = sizeof(buf) - 1;
+	apr_off_t begin = 0;
+	unsigned int next = 0, shards = 0, i = 0;
+	int n = 0;
+	char s_err[128];
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+
+	/* get the path to the metadata file that holds "last cleaned" metadata info */
+	const char *metadata_name = oidc_cache_file_name(r, "cache-file",
+			OIDC_CACHE_FILE_LAST_CLEANED);
+	const char *metadata_path = apr_psprintf(r->pool, "%s/%s",
+			cfg->cache_file_dir, metadata_name);
+
+	/* really only clean once per so much time, check that we haven not recently run */
+	if (apr_stat(&fi, metadata_path, APR_FINFO_MTIME, r->pool) == APR_SUCCESS) {
+		if (apr_time_now() < fi.mtime + apr_time_from_sec(cfg->cache_file_clean_interval)) {
+			oidc_debug(r,
+					"last cleanup call was less than %d seconds ago (next one as early as in %" APR_TIME_T_FMT " secs)",
+					cfg->cache_file_clean_interval,
+					apr_time_sec( fi.mtime + apr_time_from_sec(cfg->cache_file_clean_interval) - apr_time_now()));
+			return APR_SUCCESS;
+		}
+	}
+
+	/* open the metadata file, creating it if it does not exist yet */
+	if ((rc = apr_file_open(&fd, metadata_path,
+			(APR_FOPEN_READ | APR_FOPEN_WRITE | APR_FOPEN_CREATE),
+			APR_OS_DEFAULT, r->pool)) != APR_SUCCESS) {
+		oidc_error(r, "error opening cache timestamp file '%s' (%s)",
+				metadata_path, apr_strerror(rc, s_err, sizeof(s_err)));
+		return rc;
+	}
+
+	/* don't wait for a cleaning cycle that is in progress in another process */
+	if (apr_file_lock(fd, APR_FLOCK_EXCLUSIVE | APR_FLOCK_NONBLOCK)
+			!= APR_SUCCESS) {
+		oidc_debug(r, "cleaning cycle in progress elsewhere");
+		apr_file_close(fd);
+		return APR_SUCCESS;
+	}
+
+	/* reset the modification time of the metadata file to reflect the timestamp of this cleaning cycle */
+	apr_file_mtime_set(metadata_path, apr_time_now(), r->pool);
+
+	/* the metadata file holds the index of the subdirectory to continue with */
+	if ((apr_file_read(fd, buf, &len) == APR_SUCCESS) && (len > 0)) {
+		buf[len] = '\0';
+		sscanf(buf, "%u", &next);
+	}
+
+	oidc_debug(r, "start cleaning cycle at subdirectory %u", next);
+
+	/*
+	 * index 0 is the top-level cache directory, which also holds the entries that were written before
+	 * subdirectories were configured; the other indexes are the (leaf) subdirectories
+	 */
+	shards = (cfg->cache_file_levels > 0) ? oidc_cache_file_shards(cfg) + 1 : 1;
+	if (next >= shards)
+		next = 0;
+	for (i = 0; i < shards; i++) {
+		n += oidc_cache_file_clean_dir(r,
+				(next == 0) ?
+						cfg->cache_file_dir :
+						oidc_cache_file_shard_dir(r, cfg, next - 1),
+				metadata_name);
+		next = (next + 1) % shards;
+		if ((cfg->cache_file_levels > 0) && (n >= cfg->cache_file_clean_max))
+			break;
+	}
+
+	oidc_debug(r, "inspected %d cache entries, next cleaning cycle starts at subdirectory %u",
+			n, next);
+
+	/* record where the next cycle continues */
+	len = apr_snprintf(buf, sizeof(buf), "%u", next);
+	if ((apr_file_trunc(fd, 0) != APR_SUCCESS)
+			|| (apr_file_seek(fd, APR_SET, &begin) != APR_SUCCESS)
+			|| (oidc_cache_file_write(r, metadata_path, fd, buf, len)
+					!= APR_SUCCESS))
+		oidc_error(r, "error writing cache timestamp file '%s'", metadata_path);
+
+	apr_file_unlock(fd);
+	apr_file_close(fd);
+
 	return APR_SUCCESS;
 }
 
 /*
- * write a value for the specified key to the cache
+ * write a value for the specified key to a cache file
  */
-static apr_byte_t oidc_cache_file_set(request_rec *r, const char *section,
+static apr_byte_t oidc_cache_file_store(request_rec *r, const char *section,
 		const char *key, const char *value, apr_time_t expiry) {
 	apr_file_t *fd = NULL;
 	apr_status_t rc = APR_SUCCESS;
@@ -397,9 +504,6 @@ static apr_byte_t oidc_cache_file_set(request_rec *r, const char *section,
 	/* get the fully qualified path to the cache file based on the key name */
 	const char *path = oidc_cache_file_path(r, section, key);
 
-	/* only on writes (not on reads) we clean the cache first (if not done recently) */
-	oidc_cache_file_clean(r);
-
 	/* just remove cache file if value is NULL */
 	if (value == NULL) {
 		if ((rc = apr_file_remove(path, r->pool)) != APR_SUCCESS) {
@@ -410,9 +514,22 @@ static apr_byte_t oidc_cache_file_set(request_rec *r, const char *section,
 	}
 
 	/* try to open the cache file for writing, creating it if it does not exist */
-	if ((rc = apr_file_open(&fd, path,
+	rc = apr_file_open(&fd, path,
 			(APR_FOPEN_WRITE | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE),
-			APR_OS_DEFAULT, r->pool)) != APR_SUCCESS) {
+			APR_OS_DEFAULT, r->pool);
+
+	/* create the hashed subdirectory on first use */
+	if (APR_STATUS_IS_ENOENT(rc)) {
+		char *dirname = apr_pstrdup(r->pool, path);
+		*strrchr(dirname, OIDC_CHAR_FORWARD_SLASH) = '\0';
+		if (apr_dir_make_recursive(dirname, APR_OS_DEFAULT, r->pool)
+				== APR_SUCCESS)
+			rc = apr_file_open(&fd, path,
+					(APR_FOPEN_WRITE | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE),
+					APR_OS_DEFAULT, r->pool);
+	}
+
+	if (rc != APR_SUCCESS) {
 		oidc_error(r, "cache file \"%s\" could not be opened (%s)", path,
 				apr_strerror(rc, s_err, sizeof(s_err)));
 		return FALSE;
@@ -440,6 +557,10 @@ static apr_byte_t oidc_cache_file_set(request_rec *r, const char *section,
 	apr_file_unlock(fd);
 	apr_file_close(fd);
 
+	/* record the expiry in the modification time so cleaning doesn't need to open the file */
+	if (rc == APR_SUCCESS)
+		apr_file_mtime_set(path, expiry, r->pool);
+
 	/* log our success/failure */
 	oidc_debug(r,
 			"%s entry for key \"%s\" in file of %" APR_SIZE_T_FMT " bytes",
@@ -449,6 +570,79 @@ static apr_byte_t oidc_cache_file_set(request_rec *r, const char *section,
 	return (rc == APR_SUCCESS);
 }
 
+/*
+ * write a value for the specified key to the cache
+ */
+static apr_byte_t oidc_cache_file_set(request_rec *r, const char *section,
+		const char *key, const char *value, apr_time_t expiry) {
+
+	/* only on writes (not on reads) we clean the cache first (if not done recently) */
+	oidc_cache_file_clean(r);
+
+	return oidc_cache_file_store(r, section, key, value, expiry);
+}
+
+/*
+ * write a number of values to the cache, checking for a cleanup cycle only once
+ */
+static apr_byte_t oidc_cache_file_set_multi(request_rec *r,
+		const oidc_cache_entry_t *entries, int n) {
+	apr_byte_t rc = TRUE;
+	int i;
+
+	oidc_cache_file_clean(r);
+
+	for (i = 0; i < n; i++)
+		if (oidc_cache_file_store(r, entries[i].section, entries[i].key,
+				entries[i].value, entries[i].expiry) == FALSE)
+			rc = FALSE;
+
+	return rc;
+}
+
+/*
+ * update the expiry of an existing cache entry by rewriting only the header of its file
+ */
+static apr_byte_t oidc_cache_file_touch(request_rec *r, const char *section,
+		const char *key, apr_time_t expiry) {
+	apr_file_t *fd = NULL;
+	apr_status_t rc = APR_SUCCESS;
+	oidc_cache_file_info_t info;
+	apr_byte_t touched = FALSE;
+
+	/* get the fully qualified path to the cache file based on the key name */
+	const char *path = oidc_cache_file_path(r, section, key);
+
+	/* open the cache file without truncating it; it must exist already */
+	if (apr_file_open(&fd, path, APR_FOPEN_READ | APR_FOPEN_WRITE,
+			APR_OS_DEFAULT, r->pool) != APR_SUCCESS)
+		return FALSE;
+
+	apr_file_lock(fd, APR_FLOCK_EXCLUSIVE);
+
+	/* read the header with metadata and rewrite it in place if the entry has not expired */
+	apr_off_t begin = 0;
+	apr_file_seek(fd, APR_SET, &begin);
+	if ((oidc_cache_file_read(r, path, fd, &info,
+			sizeof(oidc_cache_file_info_t)) == APR_SUCCESS)
+			&& (apr_time_now() < info.expire)) {
+		info.expire = expiry;
+		begin = 0;
+		apr_file_seek(fd, APR_SET, &begin);
+		rc = oidc_cache_file_write(r, path, fd, &info,
+				sizeof(oidc_cache_file_info_t));
+		touched = (rc == APR_SUCCESS);
+	}
+
+	apr_file_unlock(fd);
+	apr_file_close(fd);
+
+	if (touched == TRUE)
+		apr_file_mtime_set(path, expiry, r->pool);
+
+	return touched;
+}
+
 oidc_cache_t oidc_cache_file = {
 		"file",
 		1,
@@ -456,5 +650,8 @@ oidc_cache_t oidc_cache_file = {
 		NULL,
 		oidc_cache_file_get,
 		oidc_cache_file_set,
-		NULL
+		NULL,
+		NULL,
+		oidc_cache_file_set_multi,
+		oidc_cache_file_touch
 };
@@ -301,6 +301,69 @@ static apr_byte_t oidc_cache_memcache_set(request_rec *r, const char *section,
 	return (rv == APR_SUCCESS);
 }
 
+/*
+ * get a number of name/value pairs from memcache in one go
+ */
+static apr_byte_t oidc_cache_memcache_get_multi(request_rec *r,
+		oidc_cache_entry_t *entries, int n) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_memcache_t *context =
+			(oidc_cache_cfg_memcache_t *) cfg->cache_cfg;
+
+	apr_hash_t *values = NULL;
+	apr_memcache_value_t *v = NULL;
+	char **keys = apr_pcalloc(r->pool, n * sizeof(char *));
+	int i;
+
+	for (i = 0; i < n; i++) {
+		keys[i] = oidc_cache_memcache_get_key(r->pool, entries[i].section,
+				entries[i].key);
+		apr_memcache_add_multget_key(r->pool, keys[i], &values);
+		entries[i].value = NULL;
+	}
+
+	/* get them */
+	apr_status_t rv = apr_memcache_multgetp(context->cache_memcache, r->pool,
+			r->pool, values);
+
+	if (rv != APR_SUCCESS) {
+		oidc_cache_memcache_log_status_error(r, "apr_memcache_multgetp", rv);
+		return FALSE;
+	}
+
+	for (i = 0; i < n; i++) {
+
+		v = apr_hash_get(values, keys[i], APR_HASH_KEY_STRING);
+
+		if ((v == NULL) || (v->status == APR_NOTFOUND)) {
+			oidc_debug(r, "apr_memcache_multgetp: key %s not found in cache",
+					keys[i]);
+			continue;
+		}
+
+		if (v->status != APR_SUCCESS) {
+			oidc_cache_memcache_log_status_error(r, "apr_memcache_multgetp",
+					v->status);
+			return FALSE;
+		}
+
+		entries[i].value = apr_pstrmemdup(r->pool, v->data, v->len);
+	}
+
+	/*
+	 * NB: workaround the fact that the apr_memcache returns APR_NOTFOUND if a server has been marked dead
+	 */
+	if (oidc_cache_memcache_status(r, context) == FALSE) {
+		oidc_cache_memcache_log_status_error(r, "apr_memcache_multgetp",
+				APR_NOTFOUND);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 oidc_cache_t oidc_cache_memcache = {
 		"memcache",
 		1,
@@ -308,5 +371,8 @@ oidc_cache_t oidc_cache_memcache = {
 		NULL,
 		oidc_cache_memcache_get,
 		oidc_cache_memcache_set,
+		NULL,
+		oidc_cache_memcache_get_multi,
+		NULL,
 		NULL
 };
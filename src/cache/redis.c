@@ -53,6 +53,7 @@
 
 #include "apr_general.h"
 #include "apr_strings.h"
+#include "apr_thread_mutex.h"
 
 #include <httpd.h>
 #include <http_config.h>
@@ -62,31 +63,98 @@
 
 #include "hiredis/hiredis.h"
 
-// TODO: proper Redis error reporting (server unreachable etc.)
-
 extern module AP_MODULE_DECLARE_DATA auth_openidc_module;
 
-typedef struct oidc_cache_cfg_redis_t {
-	oidc_cache_mutex_t *mutex;
+/* maximum number of idle connections kept per node per child process */
+#define OIDC_REDIS_IDLE_MAX 16
+/* maximum number of nodes that a child process keeps track of */
+#define OIDC_REDIS_NODES_MAX 256
+/* maximum length of a host:port node name */
+#define OIDC_REDIS_NODE_NAME_MAX 264
+/* number of hash slots in a Redis Cluster */
+#define OIDC_REDIS_CLUSTER_SLOTS 16384
+/* maximum number of MOVED/ASK redirects or failovers followed for a single command */
+#define OIDC_REDIS_MAX_REDIRECTS 5
+/* minimum interval between refreshes of the cluster slot map or the Sentinel primary */
+#define OIDC_REDIS_REFRESH_INTERVAL apr_time_from_sec(1)
+
+/* a Redis server with the idle connections that a child process keeps to it */
+typedef struct oidc_cache_redis_node_t {
+	char *host_str;
+	apr_port_t port;
+	/* idle, connected and authenticated connections */
+	apr_array_header_t *idle;
+} oidc_cache_redis_node_t;
+
+/* a configured host:port tuple */
+typedef struct oidc_cache_redis_server_t {
 	char *host_str;
 	apr_port_t port;
+} oidc_cache_redis_server_t;
+
+typedef struct oidc_cache_cfg_redis_t {
+	int mode;
+	char *sentinel_master;
+	/* configured oidc_cache_redis_server_t entries: the server, the cluster seed nodes or the Sentinels */
+	apr_array_header_t *servers;
 	char *passwd;
-	redisContext *ctx;
+	struct timeval connect_timeout;
+	struct timeval timeout;
+	/* per-child state from here on, all protected by the mutex */
+	apr_pool_t *pool;
+	/* known nodes indexed by host:port */
+	apr_hash_t *nodes;
+	/* standalone server or the current primary discovered through Sentinel */
+	oidc_cache_redis_node_t *primary;
+	/* cluster slot map */
+	oidc_cache_redis_node_t **slots;
+	apr_byte_t refresh;
+	apr_time_t refreshed;
+#if APR_HAS_THREADS
+	apr_thread_mutex_t *mutex;
+#endif
 } oidc_cache_cfg_redis_t;
 
+#if APR_HAS_THREADS
+#define oidc_cache_redis_lock(context) apr_thread_mutex_lock(context->mutex)
+#define oidc_cache_redis_unlock(context) apr_thread_mutex_unlock(context->mutex)
+#else
+#define oidc_cache_redis_lock(context)
+#define oidc_cache_redis_unlock(context)
+#endif
+
+/* a single command in a pipeline */
+#define OIDC_REDIS_CMD_ARGS_MAX 5
+
+typedef struct oidc_cache_redis_cmd_t {
+	int argc;
+	const char *argv[OIDC_REDIS_CMD_ARGS_MAX];
+	size_t argvlen[OIDC_REDIS_CMD_ARGS_MAX];
+} oidc_cache_redis_cmd_t;
+
 /* create the cache context */
 static void *oidc_cache_redis_cfg_create(apr_pool_t *pool) {
 	oidc_cache_cfg_redis_t *context = apr_pcalloc(pool,
 			sizeof(oidc_cache_cfg_redis_t));
-	context->mutex = oidc_cache_mutex_create(pool);
-	context->host_str = NULL;
+	context->mode = OIDC_CACHE_REDIS_MODE_STANDALONE;
+	context->sentinel_master = NULL;
+	context->servers = apr_array_make(pool, 1,
+			sizeof(oidc_cache_redis_server_t));
 	context->passwd = NULL;
-	context->ctx = NULL;
+	context->pool = NULL;
+	context->nodes = NULL;
+	context->primary = NULL;
+	context->slots = NULL;
+	context->refresh = TRUE;
+	context->refreshed = 0;
+#if APR_HAS_THREADS
+	context->mutex = NULL;
+#endif
 	return context;
 }
 
 /*
- * initialize the Redis struct the specified Redis server
+ * initialize the Redis struct the specified Redis server(s)
  */
 static int oidc_cache_redis_post_config(server_rec *s) {
 	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
@@ -99,44 +167,144 @@ static int oidc_cache_redis_post_config(server_rec *s) {
 	cfg->cache_cfg = context;
 
 	apr_status_t rv = APR_SUCCESS;
+	apr_pool_t *p = s->process->pool;
+	char* split;
+	char* tok;
 
-	/* parse the host:post tuple from the configuration */
+	/* parse the host:post tuples from the configuration */
 	if (cfg->cache_redis_server == NULL) {
 		oidc_serror(s,
 				"cache type is set to \"redis\", but no valid " OIDCRedisCacheServer " setting was found");
 		return HTTP_INTERNAL_SERVER_ERROR;
 	}
 
-	char* scope_id;
-	rv = apr_parse_addr_port(&context->host_str, &scope_id, &context->port,
-			cfg->cache_redis_server, s->process->pool);
-	if (rv != APR_SUCCESS) {
-		oidc_serror(s, "failed to parse cache server: '%s'",
-				cfg->cache_redis_server);
-		return HTTP_INTERNAL_SERVER_ERROR;
+	char *cache_config = apr_pstrdup(p, cfg->cache_redis_server);
+	split = apr_strtok(cache_config, OIDC_STR_SPACE, &tok);
+	while (split) {
+		oidc_cache_redis_server_t *server = apr_array_push(context->servers);
+		char* scope_id;
+
+		rv = apr_parse_addr_port(&server->host_str, &scope_id, &server->port,
+				split, p);
+		if (rv != APR_SUCCESS) {
+			oidc_serror(s, "failed to parse cache server: '%s'", split);
+			return HTTP_INTERNAL_SERVER_ERROR;
+		}
+
+		if (server->host_str == NULL) {
+			oidc_serror(s,
+					"failed to parse cache server, no hostname specified: '%s'",
+					split);
+			return HTTP_INTERNAL_SERVER_ERROR;
+		}
+
+		if (server->port == 0)
+			server->port =
+					(cfg->cache_redis_mode == OIDC_CACHE_REDIS_MODE_SENTINEL) ?
+							26379 : 6379;
+
+		split = apr_strtok(NULL, OIDC_STR_SPACE, &tok);
 	}
 
-	if (context->host_str == NULL) {
+	if (context->servers->nelts == 0) {
 		oidc_serror(s,
-				"failed to parse cache server, no hostname specified: '%s'",
-				cfg->cache_redis_server);
+				"cache type is set to \"redis\", but no valid " OIDCRedisCacheServer " setting was found");
 		return HTTP_INTERNAL_SERVER_ERROR;
 	}
 
-	if (context->port == 0)
-		context->port = 6379;
+	context->mode = cfg->cache_redis_mode;
+
+	if ((context->mode == OIDC_CACHE_REDIS_MODE_STANDALONE)
+			&& (context->servers->nelts > 1))
+		oidc_swarn(s,
+				"more than one " OIDCRedisCacheServer " configured in standalone mode, only the first one will be used: '%s'",
+				cfg->cache_redis_server);
+
+	if (context->mode == OIDC_CACHE_REDIS_MODE_SENTINEL) {
+		if (cfg->cache_redis_sentinel_master == NULL) {
+			oidc_serror(s,
+					"Redis cache mode is set to \"sentinel\", but no " OIDCRedisCacheSentinelMaster " setting was found");
+			return HTTP_INTERNAL_SERVER_ERROR;
+		}
+		context->sentinel_master = apr_pstrdup(p,
+				cfg->cache_redis_sentinel_master);
+	}
 
 	if (cfg->cache_redis_password != NULL) {
-		context->passwd = apr_pstrdup(s->process->pool,
-				cfg->cache_redis_password);
+		context->passwd = apr_pstrdup(p, cfg->cache_redis_password);
 	}
 
-	if (oidc_cache_mutex_post_config(s, context->mutex, "redis") == FALSE)
-		return HTTP_INTERNAL_SERVER_ERROR;
+	context->connect_timeout.tv_sec = cfg->cache_redis_connect_timeout;
+	context->connect_timeout.tv_usec = 0;
+	context->timeout.tv_sec = cfg->cache_redis_timeout;
+	context->timeout.tv_usec = 0;
 
 	return OK;
 }
 
+/*
+ * close the idle connections to a node
+ */
+static void oidc_cache_redis_idle_free(oidc_cache_redis_node_t *node) {
+	int i;
+	for (i = 0; i < node->idle->nelts; i++)
+		redisFree(APR_ARRAY_IDX(node->idle, i, redisContext *));
+	node->idle->nelts = 0;
+}
+
+/*
+ * close the idle connections to all nodes; the caller must hold the lock
+ */
+static void oidc_cache_redis_nodes_free(oidc_cache_cfg_redis_t *context) {
+	apr_hash_index_t *hi;
+	void *val = NULL;
+	for (hi = apr_hash_first(NULL, context->nodes); hi; hi = apr_hash_next(hi)) {
+		apr_hash_this(hi, NULL, NULL, &val);
+		oidc_cache_redis_idle_free((oidc_cache_redis_node_t *) val);
+	}
+}
+
+/*
+ * close the idle connections when the child process exits
+ */
+static apr_status_t oidc_cache_redis_child_cleanup(void *data) {
+	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) data;
+	if (context->nodes != NULL) {
+		oidc_cache_redis_nodes_free(context);
+		context->nodes = NULL;
+	}
+	return APR_SUCCESS;
+}
+
+/*
+ * find or register the node with the specified address; the caller must hold the lock
+ */
+static oidc_cache_redis_node_t *oidc_cache_redis_node_get(
+		oidc_cache_cfg_redis_t *context, const char *host_str, size_t host_len,
+		apr_port_t port) {
+	char name[OIDC_REDIS_NODE_NAME_MAX];
+	oidc_cache_redis_node_t *node = NULL;
+
+	/* don't allocate from the long-lived child pool for lookups */
+	if (host_len > OIDC_REDIS_NODE_NAME_MAX - 8)
+		return NULL;
+	apr_snprintf(name, sizeof(name), "%.*s:%d", (int) host_len, host_str,
+			port);
+	node = apr_hash_get(context->nodes, name, APR_HASH_KEY_STRING);
+	if (node != NULL)
+		return node;
+	if (apr_hash_count(context->nodes) >= OIDC_REDIS_NODES_MAX)
+		return NULL;
+	node = apr_pcalloc(context->pool, sizeof(oidc_cache_redis_node_t));
+	node->host_str = apr_pstrndup(context->pool, host_str, host_len);
+	node->port = port;
+	node->idle = apr_array_make(context->pool, OIDC_REDIS_IDLE_MAX,
+			sizeof(redisContext *));
+	apr_hash_set(context->nodes, apr_pstrdup(context->pool, name),
+			APR_HASH_KEY_STRING, node);
+	return node;
+}
+
 /*
  * initialize the Redis cache in a child process
  */
@@ -144,9 +312,36 @@ int oidc_cache_redis_child_init(apr_pool_t *p, server_rec *s) {
 	oidc_cfg *cfg = ap_get_module_config(s->module_config,
 			&auth_openidc_module);
 	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
+	apr_status_t rv = APR_SUCCESS;
+
+	/* vhosts may share the same context */
+	if (context->nodes != NULL)
+		return APR_SUCCESS;
+
+#if APR_HAS_THREADS
+	rv = apr_thread_mutex_create(&context->mutex, APR_THREAD_MUTEX_DEFAULT, p);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s, "apr_thread_mutex_create failed: %d", rv);
+		return rv;
+	}
+#endif
+	context->pool = p;
+	context->nodes = apr_hash_make(p);
+
+	if (context->mode == OIDC_CACHE_REDIS_MODE_STANDALONE) {
+		oidc_cache_redis_server_t *server =
+				&APR_ARRAY_IDX(context->servers, 0, oidc_cache_redis_server_t);
+		context->primary = oidc_cache_redis_node_get(context, server->host_str,
+				strlen(server->host_str), server->port);
+	} else if (context->mode == OIDC_CACHE_REDIS_MODE_CLUSTER) {
+		context->slots = apr_pcalloc(p,
+				OIDC_REDIS_CLUSTER_SLOTS * sizeof(oidc_cache_redis_node_t *));
+	}
 
-	/* initialize the lock for the child process */
-	return oidc_cache_mutex_child_init(p, s, context->mutex);
+	apr_pool_cleanup_register(p, context, oidc_cache_redis_child_cleanup,
+			apr_pool_cleanup_null);
+
+	return rv;
 }
 
 /*
@@ -158,41 +353,140 @@ static char *oidc_cache_redis_get_key(apr_pool_t *pool, const char *section,
 }
 
 /*
- * free resources allocated for the per-process Redis connection context
+ * add an argument to a command
  */
-static apr_status_t oidc_cache_redis_free(oidc_cache_cfg_redis_t *context) {
-	if ((context != NULL) && (context->ctx != NULL)) {
-		redisFree(context->ctx);
-		context->ctx = NULL;
-	}
-	return APR_SUCCESS;
+static void oidc_cache_redis_cmd_arg(oidc_cache_redis_cmd_t *cmd,
+		const char *arg) {
+	cmd->argv[cmd->argc] = arg;
+	cmd->argvlen[cmd->argc] = strlen(arg);
+	cmd->argc++;
 }
 
 /*
- * connect to Redis server
+ * calculate the Redis Cluster hash slot of a key: CRC16 (XMODEM) over the key or over its
+ * {hash tag} when present, so callers can force related keys onto the same node
  */
-static apr_status_t oidc_cache_redis_connect(request_rec *r,
-		oidc_cache_cfg_redis_t *context) {
+unsigned int oidc_cache_redis_key_slot(const char *key, size_t len) {
+	size_t start, end, i;
+	unsigned int crc = 0;
+	int bit;
 
-	if (context->ctx == NULL) {
+	for (start = 0; start < len; start++)
+		if (key[start] == '{')
+			break;
+	if (start < len) {
+		for (end = start + 1; end < len; end++)
+			if (key[end] == '}')
+				break;
+		/* only a non-empty tag counts */
+		if ((end < len) && (end != start + 1)) {
+			key += start + 1;
+			len = end - start - 1;
+		}
+	}
 
-		/* no connection, connect to the configured Redis server */
-		context->ctx = redisConnect(context->host_str, context->port);
+	for (i = 0; i < len; i++) {
+		crc ^= ((unsigned char) key[i]) << 8;
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		crc &= 0xffff;
+	}
 
-		/* check for errors */
-		if ((context->ctx == NULL) || (context->ctx->err != 0)) {
-			oidc_error(r, "failed to connect to Redis server (%s:%d): '%s'",
-					context->host_str, context->port,
-					context->ctx != NULL ? context->ctx->errstr : "");
-			oidc_cache_redis_free(context);
-		} else {
-			/* log the connection */
-			oidc_debug(r, "successfully connected to Redis server (%s:%d)",
-					context->host_str, context->port);
+	return crc & (OIDC_REDIS_CLUSTER_SLOTS - 1);
+}
+
+/*
+ * connect to a Redis server and optionally authenticate
+ */
+static redisContext *oidc_cache_redis_connect(request_rec *r,
+		oidc_cache_cfg_redis_t *context, const char *host_str,
+		apr_port_t port, const char *passwd) {
+	redisReply *reply = NULL;
+
+	/* connect to the Redis server */
+	redisContext *ctx = redisConnectWithTimeout(host_str, port,
+			context->connect_timeout);
+
+	/* check for errors */
+	if ((ctx == NULL) || (ctx->err != 0)) {
+		oidc_error(r, "failed to connect to Redis server (%s:%d): '%s'",
+				host_str, port, ctx != NULL ? ctx->errstr : "");
+		if (ctx != NULL)
+			redisFree(ctx);
+		return NULL;
+	}
+
+	/* make sure a slow server cannot block the worker forever */
+	if (redisSetTimeout(ctx, context->timeout) != REDIS_OK)
+		oidc_warn(r, "failed to set timeout on Redis connection (%s:%d): '%s'",
+				host_str, port, ctx->errstr);
+
+	/* authenticate once for the lifetime of the connection */
+	if (passwd != NULL) {
+		reply = redisCommand(ctx, "AUTH %s", passwd);
+		if ((reply == NULL) || (reply->type == REDIS_REPLY_ERROR)) {
+			oidc_error(r, "Redis AUTH command (to %s:%d) failed: '%s' [%s]",
+					host_str, port, ctx->errstr, reply ? reply->str : "<n/a>");
+			if (reply != NULL)
+				freeReplyObject(reply);
+			redisFree(ctx);
+			return NULL;
 		}
+		freeReplyObject(reply);
 	}
 
-	return (context->ctx != NULL) ? APR_SUCCESS : APR_EGENERAL;
+	/* log the connection */
+	oidc_debug(r, "successfully connected to Redis server (%s:%d)", host_str,
+			port);
+
+	return ctx;
+}
+
+/*
+ * get an idle connection to a node or create a new one
+ */
+static redisContext *oidc_cache_redis_acquire(request_rec *r,
+		oidc_cache_cfg_redis_t *context, oidc_cache_redis_node_t *node) {
+	redisContext *ctx = NULL;
+
+	oidc_cache_redis_lock(context);
+	if (node->idle->nelts > 0) {
+		node->idle->nelts--;
+		ctx = APR_ARRAY_IDX(node->idle, node->idle->nelts, redisContext *);
+	}
+	oidc_cache_redis_unlock(context);
+
+	if (ctx == NULL)
+		ctx = oidc_cache_redis_connect(r, context, node->host_str, node->port,
+				context->passwd);
+
+	return ctx;
+}
+
+/*
+ * return a healthy connection to the idle list of a node
+ */
+static void oidc_cache_redis_release(oidc_cache_cfg_redis_t *context,
+		oidc_cache_redis_node_t *node, redisContext *ctx) {
+	oidc_cache_redis_lock(context);
+	if (node->idle->nelts < OIDC_REDIS_IDLE_MAX) {
+		APR_ARRAY_PUSH(node->idle, redisContext *) = ctx;
+		ctx = NULL;
+	}
+	oidc_cache_redis_unlock(context);
+	if (ctx != NULL)
+		redisFree(ctx);
+}
+
+/*
+ * drop a broken connection; other idle connections to the node are likely broken as well, e.g. after a server restart
+ */
+static void oidc_cache_redis_discard(oidc_cache_cfg_redis_t *context,
+		oidc_cache_redis_node_t *node, redisContext *ctx) {
+	redisFree(ctx);
+	oidc_cache_redis_lock(context);
+	oidc_cache_redis_idle_free(node);
+	oidc_cache_redis_unlock(context);
 }
 
 /*
@@ -208,92 +502,498 @@ static void oidc_cache_redis_reply_free(redisReply **reply) {
 #define OIDC_REDIS_MAX_TRIES 2
 
 /*
- * execute Redis command and deal with return value
+ * execute a pipeline of Redis commands on a node in a single round trip; on success every
+ * entry in replies is set, possibly to an error reply, and must be freed by the caller
  */
-static redisReply* oidc_cache_redis_command(request_rec *r,
-		oidc_cache_cfg_redis_t *context, const char *command) {
+static apr_byte_t oidc_cache_redis_pipeline(request_rec *r,
+		oidc_cache_cfg_redis_t *context, oidc_cache_redis_node_t *node,
+		oidc_cache_redis_cmd_t *cmds, int n, redisReply **replies) {
 
-	redisReply *reply = NULL;
-	int i = 0;
+	redisContext *ctx = NULL;
+	int i = 0, j = 0;
 
-	/* try to execute a command at max 2 times while reconnecting */
+	/* try to execute the commands at max 2 times while reconnecting */
 	for (i = 0; i < OIDC_REDIS_MAX_TRIES; i++) {
 
 		/* connect */
-		if (oidc_cache_redis_connect(r, context) != APR_SUCCESS)
+		ctx = oidc_cache_redis_acquire(r, context, node);
+		if (ctx == NULL)
 			break;
 
-		/* see if we need to authenticate to the Redis server */
-		if (context->passwd != NULL) {
-			reply = redisCommand(context->ctx, "AUTH %s", context->passwd);
-			if ((reply == NULL) || (reply->type == REDIS_REPLY_ERROR))
-				oidc_error(r,
-						"Redis AUTH command (attempt=%d to %s:%d) failed: '%s' [%s]",
-						i, context->host_str, context->port,
-						context->ctx->errstr, reply ? reply->str : "<n/a>");
-
-			/* free the auth answer */
-			oidc_cache_redis_reply_free(&reply);
-		}
+		/* queue the commands in the output buffer */
+		for (j = 0; j < n; j++)
+			redisAppendCommandArgv(ctx, cmds[j].argc, cmds[j].argv,
+					cmds[j].argvlen);
 
-		/* execute the actual command */
-		reply = redisCommand(context->ctx, command);
+		/* flush the output buffer and read the replies */
+		for (j = 0; j < n; j++) {
+			replies[j] = NULL;
+			if (redisGetReply(ctx, (void **) &replies[j]) != REDIS_OK)
+				break;
+		}
 
-		/* check for errors, need to return error replies for cache miss case REDIS_REPLY_NIL */
-		if ((reply != NULL) && (reply->type != REDIS_REPLY_ERROR))
-			/* break the loop and return the reply */
-			break;
+		if (j == n) {
+			/* all replies received, the connection can be re-used */
+			oidc_cache_redis_release(context, node, ctx);
+			return TRUE;
+		}
 
 		/* something went wrong, log it */
 		oidc_error(r,
-				"Redis command (attempt=%d to %s:%d) failed, disconnecting: '%s' [%s]",
-				i, context->host_str, context->port, context->ctx->errstr,
-				reply ? reply->str : "<n/a>");
+				"Redis command (attempt=%d to %s:%d) failed, disconnecting: '%s'",
+				i, node->host_str, node->port, ctx->errstr);
 
-		/* free the reply (if there is one allocated) */
-		oidc_cache_redis_reply_free(&reply);
+		/* free the replies that were received */
+		while (j > 0) {
+			j--;
+			oidc_cache_redis_reply_free(&replies[j]);
+		}
 
 		/* cleanup, we may try again (once) after reconnecting */
-		oidc_cache_redis_free(context);
+		oidc_cache_redis_discard(context, node, ctx);
 	}
 
+	return FALSE;
+}
+
+/*
+ * execute a single command on a short-lived connection to a configured server
+ */
+static redisReply *oidc_cache_redis_server_command(request_rec *r,
+		oidc_cache_cfg_redis_t *context, oidc_cache_redis_server_t *server,
+		const char *passwd, int argc, const char **argv) {
+	redisReply *reply = NULL;
+	redisContext *ctx = oidc_cache_redis_connect(r, context, server->host_str,
+			server->port, passwd);
+	if (ctx == NULL)
+		return NULL;
+	reply = redisCommandArgv(ctx, argc, argv, NULL);
+	if (reply == NULL)
+		oidc_error(r, "Redis command %s (to %s:%d) failed: '%s'", argv[0],
+				server->host_str, server->port, ctx->errstr);
+	redisFree(ctx);
 	return reply;
 }
 
 /*
- * get a name/value pair from Redis
+ * apply a CLUSTER SLOTS reply to the slot map
  */
-static apr_byte_t oidc_cache_redis_get(request_rec *r, const char *section,
-		const char *key, const char **value) {
+static apr_byte_t oidc_cache_redis_cluster_apply(oidc_cache_cfg_redis_t *context,
+		oidc_cache_redis_server_t *server, redisReply *reply) {
+	size_t i;
+	long long slot;
+	redisReply *range, *primary;
+	oidc_cache_redis_node_t *node;
+
+	if (reply->type != REDIS_REPLY_ARRAY)
+		return FALSE;
 
-	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
-			&auth_openidc_module);
-	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
-	redisReply *reply = NULL;
+	oidc_cache_redis_lock(context);
+	for (i = 0; i < reply->elements; i++) {
+		range = reply->element[i];
+		if ((range->type != REDIS_REPLY_ARRAY) || (range->elements < 3))
+			continue;
+		primary = range->element[2];
+		if ((range->element[0]->type != REDIS_REPLY_INTEGER)
+				|| (range->element[1]->type != REDIS_REPLY_INTEGER)
+				|| (primary->type != REDIS_REPLY_ARRAY)
+				|| (primary->elements < 2)
+				|| (primary->element[0]->type != REDIS_REPLY_STRING)
+				|| (primary->element[1]->type != REDIS_REPLY_INTEGER))
+			continue;
+		/* an empty host name refers to the node that we asked */
+		node = (primary->element[0]->len > 0) ?
+				oidc_cache_redis_node_get(context, primary->element[0]->str,
+						primary->element[0]->len,
+						(apr_port_t) primary->element[1]->integer) :
+				oidc_cache_redis_node_get(context, server->host_str,
+						strlen(server->host_str),
+						(apr_port_t) primary->element[1]->integer);
+		if (node == NULL)
+			continue;
+		for (slot = range->element[0]->integer;
+				(slot <= range->element[1]->integer)
+						&& (slot < OIDC_REDIS_CLUSTER_SLOTS); slot++)
+			if (slot >= 0)
+				context->slots[slot] = node;
+	}
+	context->refresh = FALSE;
+	oidc_cache_redis_unlock(context);
+
+	return TRUE;
+}
+
+/*
+ * refresh the cluster slot map from the first seed node that responds
+ */
+static void oidc_cache_redis_cluster_refresh(request_rec *r,
+		oidc_cache_cfg_redis_t *context) {
+	const char *argv[] = { "CLUSTER", "SLOTS" };
 	apr_byte_t rv = FALSE;
+	redisReply *reply = NULL;
+	int i;
+
+	for (i = 0; (rv == FALSE) && (i < context->servers->nelts); i++) {
+		oidc_cache_redis_server_t *server = &APR_ARRAY_IDX(context->servers, i,
+				oidc_cache_redis_server_t);
+		reply = oidc_cache_redis_server_command(r, context, server,
+				context->passwd, 2, argv);
+		if (reply == NULL)
+			continue;
+		rv = oidc_cache_redis_cluster_apply(context, server, reply);
+		if (rv == FALSE)
+			oidc_error(r, "Redis CLUSTER SLOTS command (to %s:%d) failed: '%s'",
+					server->host_str, server->port,
+					reply->type == REDIS_REPLY_ERROR ? reply->str : "");
+		oidc_cache_redis_reply_free(&reply);
+	}
+}
 
-	/* grab the global lock */
-	if (oidc_cache_mutex_lock(r->server, context->mutex) == FALSE)
-		return FALSE;
+/*
+ * discover the current primary from the first Sentinel that knows about it
+ */
+static void oidc_cache_redis_sentinel_refresh(request_rec *r,
+		oidc_cache_cfg_redis_t *context) {
+	const char *argv[] = { "SENTINEL", "get-master-addr-by-name",
+			context->sentinel_master };
+	oidc_cache_redis_node_t *node = NULL;
+	redisReply *reply = NULL;
+	int i;
+
+	for (i = 0; (node == NULL) && (i < context->servers->nelts); i++) {
+		oidc_cache_redis_server_t *server = &APR_ARRAY_IDX(context->servers, i,
+				oidc_cache_redis_server_t);
+		reply = oidc_cache_redis_server_command(r, context, server, NULL, 3,
+				argv);
+		if (reply == NULL)
+			continue;
+		if ((reply->type == REDIS_REPLY_ARRAY) && (reply->elements == 2)
+				&& (reply->element[0]->type == REDIS_REPLY_STRING)
+				&& (reply->element[1]->type == REDIS_REPLY_STRING)) {
+			oidc_cache_redis_lock(context);
+			node = oidc_cache_redis_node_get(context, reply->element[0]->str,
+					reply->element[0]->len,
+					(apr_port_t) atoi(reply->element[1]->str));
+			context->primary = node;
+			context->refresh = FALSE;
+			oidc_cache_redis_unlock(context);
+			oidc_debug(r, "Redis Sentinel (%s:%d) returned primary %s:%d for \"%s\"",
+					server->host_str, server->port,
+					node ? node->host_str : "", node ? node->port : 0,
+					context->sentinel_master);
+		} else {
+			oidc_error(r,
+					"Redis Sentinel (%s:%d) does not know about primary \"%s\"",
+					server->host_str, server->port, context->sentinel_master);
+		}
+		oidc_cache_redis_reply_free(&reply);
+	}
+}
 
-	/* get */
-	reply = oidc_cache_redis_command(r, context,
-			apr_psprintf(r->pool, "GET %s",
-					oidc_cache_redis_get_key(r->pool, section, key)));
+/*
+ * find the node that serves a key; returns NULL when no node can be determined
+ */
+static oidc_cache_redis_node_t *oidc_cache_redis_route(request_rec *r,
+		oidc_cache_cfg_redis_t *context, const char *key, size_t len,
+		int attempt) {
+	oidc_cache_redis_node_t *node = NULL;
+	apr_byte_t refresh = FALSE;
+	oidc_cache_redis_server_t *server = NULL;
+
+	if (context->mode == OIDC_CACHE_REDIS_MODE_STANDALONE)
+		return context->primary;
+
+	/* refresh the cluster slot map or the Sentinel primary when needed, but not too often */
+	oidc_cache_redis_lock(context);
+	if ((context->refresh == TRUE)
+			&& (apr_time_now() - context->refreshed > OIDC_REDIS_REFRESH_INTERVAL)) {
+		context->refreshed = apr_time_now();
+		refresh = TRUE;
+	}
+	oidc_cache_redis_unlock(context);
+
+	if (context->mode == OIDC_CACHE_REDIS_MODE_SENTINEL) {
+		if (refresh == TRUE)
+			oidc_cache_redis_sentinel_refresh(r, context);
+		oidc_cache_redis_lock(context);
+		node = context->primary;
+		oidc_cache_redis_unlock(context);
+		return node;
+	}
+
+	if (refresh == TRUE)
+		oidc_cache_redis_cluster_refresh(r, context);
+
+	oidc_cache_redis_lock(context);
+	node = context->slots[oidc_cache_redis_key_slot(key, len)];
+	if (node == NULL) {
+		/* the slot is unknown: ask one of the seed nodes, it'll redirect us */
+		server = &APR_ARRAY_IDX(context->servers,
+				attempt % context->servers->nelts, oidc_cache_redis_server_t);
+		node = oidc_cache_redis_node_get(context, server->host_str,
+				strlen(server->host_str), server->port);
+	}
+	oidc_cache_redis_unlock(context);
+
+	return node;
+}
+
+/*
+ * parse the node address from a MOVED or ASK error reply: "MOVED <slot> <host>:<port>"
+ */
+static oidc_cache_redis_node_t *oidc_cache_redis_redirect(
+		oidc_cache_cfg_redis_t *context, const char *str, long *slot) {
+	const char *p = strchr(str, ' ');
+	const char *addr = NULL, *colon = NULL;
+	oidc_cache_redis_node_t *node = NULL;
+	if (p == NULL)
+		return NULL;
+	*slot = strtol(p + 1, NULL, 10);
+	addr = strchr(p + 1, ' ');
+	if (addr == NULL)
+		return NULL;
+	addr++;
+	colon = strrchr(addr, ':');
+	if ((colon == NULL) || (colon == addr))
+		return NULL;
+	oidc_cache_redis_lock(context);
+	node = oidc_cache_redis_node_get(context, addr, colon - addr,
+			(apr_port_t) atoi(colon + 1));
+	oidc_cache_redis_unlock(context);
+	return node;
+}
+
+#define OIDC_REDIS_REPLY_MOVED    "MOVED "
+#define OIDC_REDIS_REPLY_ASK      "ASK "
+#define OIDC_REDIS_REPLY_READONLY "READONLY "
+
+/*
+ * execute a single Redis command on the node that serves its key (argv[1]),
+ * following cluster redirects and Sentinel failovers
+ */
+static redisReply* oidc_cache_redis_command(request_rec *r,
+		oidc_cache_cfg_redis_t *context, oidc_cache_redis_cmd_t *cmd) {
+	oidc_cache_redis_cmd_t cmds[2] = { { 1, { "ASKING" }, { 6 } }, *cmd };
+	oidc_cache_redis_node_t *node = NULL, *ask = NULL;
+	redisReply *replies[2] = { NULL, NULL };
+	long slot = 0;
+	int i, n, failures = 0;
+
+	for (i = 0; i < OIDC_REDIS_MAX_REDIRECTS; i++) {
+
+		node = (ask != NULL) ?
+				ask :
+				oidc_cache_redis_route(r, context, cmd->argv[1],
+						cmd->argvlen[1], i);
+		if (node == NULL) {
+			oidc_error(r, "no Redis node available for command %s",
+					cmd->argv[0]);
+			break;
+		}
+
+		/* an ASK redirect requires an ASKING command in front of the actual command */
+		n = (ask != NULL) ? 2 : 1;
+		ask = NULL;
+
+		if (oidc_cache_redis_pipeline(r, context, node, &cmds[2 - n], n,
+				&replies[2 - n]) == FALSE) {
+			/* the node is unreachable: the cluster or Sentinel may have failed over */
+			if (context->mode == OIDC_CACHE_REDIS_MODE_STANDALONE)
+				break;
+			oidc_cache_redis_lock(context);
+			if (context->mode == OIDC_CACHE_REDIS_MODE_CLUSTER)
+				context->slots[oidc_cache_redis_key_slot(cmd->argv[1],
+						cmd->argvlen[1])] = NULL;
+			else
+				context->primary = NULL;
+			context->refresh = TRUE;
+			oidc_cache_redis_unlock(context);
+			if (++failures >= OIDC_REDIS_MAX_TRIES)
+				break;
+			continue;
+		}
+
+		oidc_cache_redis_reply_free(&replies[0]);
+
+		if (replies[1]->type != REDIS_REPLY_ERROR)
+			return replies[1];
+
+		if ((context->mode == OIDC_CACHE_REDIS_MODE_CLUSTER)
+				&& (strncmp(replies[1]->str, OIDC_REDIS_REPLY_MOVED,
+						strlen(OIDC_REDIS_REPLY_MOVED)) == 0)) {
+			/* the slot has moved permanently: update the map and refresh it in full */
+			node = oidc_cache_redis_redirect(context, replies[1]->str, &slot);
+			oidc_debug(r, "Redis command %s: %s", cmd->argv[0],
+					replies[1]->str);
+			oidc_cache_redis_lock(context);
+			if ((node != NULL) && (slot >= 0)
+					&& (slot < OIDC_REDIS_CLUSTER_SLOTS))
+				context->slots[slot] = node;
+			context->refresh = TRUE;
+			oidc_cache_redis_unlock(context);
+			oidc_cache_redis_reply_free(&replies[1]);
+			continue;
+		}
+
+		if ((context->mode == OIDC_CACHE_REDIS_MODE_CLUSTER)
+				&& (strncmp(replies[1]->str, OIDC_REDIS_REPLY_ASK,
+						strlen(OIDC_REDIS_REPLY_ASK)) == 0)) {
+			/* the slot is being migrated: ask the target node once, don't update the map */
+			ask = oidc_cache_redis_redirect(context, replies[1]->str, &slot);
+			oidc_debug(r, "Redis command %s: %s", cmd->argv[0],
+					replies[1]->str);
+			oidc_cache_redis_reply_free(&replies[1]);
+			if (ask == NULL)
+				break;
+			continue;
+		}
+
+		if ((context->mode == OIDC_CACHE_REDIS_MODE_SENTINEL)
+				&& (strncmp(replies[1]->str, OIDC_REDIS_REPLY_READONLY,
+						strlen(OIDC_REDIS_REPLY_READONLY)) == 0)) {
+			/* the node we talk to has been demoted to a replica */
+			oidc_warn(r, "Redis primary (%s:%d) has become read-only",
+					node->host_str, node->port);
+			oidc_cache_redis_lock(context);
+			context->primary = NULL;
+			context->refresh = TRUE;
+			context->refreshed = 0;
+			oidc_cache_redis_unlock(context);
+			oidc_cache_redis_reply_free(&replies[1]);
+			continue;
+		}
+
+		oidc_error(r, "Redis command %s (to %s:%d) returned an error: '%s'",
+				cmd->argv[0], node->host_str, node->port, replies[1]->str);
+		return replies[1];
+	}
+
+	return NULL;
+}
+
+/*
+ * execute a number of Redis commands, pipelining the ones that go to the same node;
+ * commands that get redirected or whose node fails are retried one by one with
+ * oidc_cache_redis_command; replies that are not NULL must be freed by the caller
+ */
+static void oidc_cache_redis_command_multi(request_rec *r,
+		oidc_cache_cfg_redis_t *context, oidc_cache_redis_cmd_t *cmds, int n,
+		redisReply **replies) {
+	oidc_cache_redis_node_t **nodes = apr_pcalloc(r->pool,
+			n * sizeof(oidc_cache_redis_node_t *));
+	oidc_cache_redis_cmd_t *batch = apr_pcalloc(r->pool,
+			n * sizeof(oidc_cache_redis_cmd_t));
+	redisReply **results = apr_pcalloc(r->pool, n * sizeof(redisReply *));
+	int *index = apr_pcalloc(r->pool, n * sizeof(int));
+	apr_byte_t *done = apr_pcalloc(r->pool, n);
+	int i, j, m;
+
+	for (i = 0; i < n; i++) {
+		replies[i] = NULL;
+		nodes[i] = oidc_cache_redis_route(r, context, cmds[i].argv[1],
+				cmds[i].argvlen[1], 0);
+	}
+
+	for (i = 0; i < n; i++) {
+
+		if ((done[i] == TRUE) || (nodes[i] == NULL))
+			continue;
+
+		/* collect the commands for this node */
+		m = 0;
+		for (j = i; j < n; j++) {
+			if ((done[j] == FALSE) && (nodes[j] == nodes[i])) {
+				batch[m] = cmds[j];
+				index[m] = j;
+				done[j] = TRUE;
+				m++;
+			}
+		}
+
+		if (oidc_cache_redis_pipeline(r, context, nodes[i], batch, m, results)
+				== FALSE)
+			continue;
+
+		for (j = 0; j < m; j++)
+			replies[index[j]] = results[j];
+	}
+
+	/* the slow path for anything that didn't end up with a regular reply */
+	for (i = 0; i < n; i++) {
+		if ((replies[i] != NULL)
+				&& ((replies[i]->type != REDIS_REPLY_ERROR)
+						|| (context->mode == OIDC_CACHE_REDIS_MODE_STANDALONE)))
+			continue;
+		if ((replies[i] == NULL) && (nodes[i] != NULL)
+				&& (context->mode == OIDC_CACHE_REDIS_MODE_STANDALONE))
+			continue;
+		oidc_cache_redis_reply_free(&replies[i]);
+		replies[i] = oidc_cache_redis_command(r, context, &cmds[i]);
+	}
+}
+
+/*
+ * assemble a GET command for a section/key
+ */
+static void oidc_cache_redis_cmd_get(request_rec *r,
+		oidc_cache_redis_cmd_t *cmd, const char *section, const char *key) {
+	oidc_cache_redis_cmd_arg(cmd, "GET");
+	oidc_cache_redis_cmd_arg(cmd,
+			oidc_cache_redis_get_key(r->pool, section, key));
+}
+
+/*
+ * assemble a SETEX or DEL command for a section/key
+ */
+static void oidc_cache_redis_cmd_set(request_rec *r,
+		oidc_cache_redis_cmd_t *cmd, const char *section, const char *key,
+		const char *value, apr_time_t expiry) {
+	apr_time_t timeout;
+
+	/* see if we should be clearing this entry */
+	if (value == NULL) {
+
+		/* delete it */
+		oidc_cache_redis_cmd_arg(cmd, "DEL");
+		oidc_cache_redis_cmd_arg(cmd,
+				oidc_cache_redis_get_key(r->pool, section, key));
+
+	} else {
+
+		/* calculate the timeout from now */
+		timeout = apr_time_sec(expiry - apr_time_now());
+		if (timeout <= 0)
+			timeout = 1;
+
+		/* store it */
+		oidc_cache_redis_cmd_arg(cmd, "SETEX");
+		oidc_cache_redis_cmd_arg(cmd,
+				oidc_cache_redis_get_key(r->pool, section, key));
+		oidc_cache_redis_cmd_arg(cmd,
+				apr_psprintf(r->pool, "%" APR_TIME_T_FMT, timeout));
+		oidc_cache_redis_cmd_arg(cmd, value);
+
+	}
+}
+
+/*
+ * obtain the value from the reply to a GET command
+ */
+static apr_byte_t oidc_cache_redis_reply_value(request_rec *r,
+		redisReply *reply, const char **value) {
 
 	if (reply == NULL)
-		goto end;
+		return FALSE;
 
 	/* check that we got a string back */
 	if (reply->type == REDIS_REPLY_NIL) {
 		/* this is a normal cache miss, so we'll return OK */
-		rv = TRUE;
-		goto end;
+		return TRUE;
 	}
 
 	if (reply->type != REDIS_REPLY_STRING) {
 		oidc_error(r, "redisCommand reply type is not string: %d", reply->type);
-		goto end;
+		return FALSE;
 	}
 
 	/* do a sanity check on the returned value */
@@ -302,22 +1002,37 @@ static apr_byte_t oidc_cache_redis_get(request_rec *r, const char *section,
 		oidc_error(r,
 				"redisCommand reply->len (%d) != strlen(reply->str): '%s'",
 				(int )reply->len, reply->str);
-		goto end;
+		return FALSE;
 	}
 
 	/* copy it in to the request memory pool */
 	*value = apr_pstrdup(r->pool, reply->str);
 
-	/* return success */
-	rv = TRUE;
+	return TRUE;
+}
+
+/*
+ * get a name/value pair from Redis
+ */
+static apr_byte_t oidc_cache_redis_get(request_rec *r, const char *section,
+		const char *key, const char **value) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
+	oidc_cache_redis_cmd_t cmd = { 0 };
+	redisReply *reply = NULL;
+	apr_byte_t rv = FALSE;
+
+	/* get */
+	oidc_cache_redis_cmd_get(r, &cmd, section, key);
+	reply = oidc_cache_redis_command(r, context, &cmd);
+
+	rv = oidc_cache_redis_reply_value(r, reply, value);
 
-end:
 	/* free the reply object resources */
 	oidc_cache_redis_reply_free(&reply);
 
-	/* unlock the global mutex */
-	oidc_cache_mutex_unlock(r->server, context->mutex);
-
 	/* return the status */
 	return rv;
 }
@@ -331,60 +1046,298 @@ static apr_byte_t oidc_cache_redis_set(request_rec *r, const char *section,
 	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
 			&auth_openidc_module);
 	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
+	oidc_cache_redis_cmd_t cmd = { 0 };
 	redisReply *reply = NULL;
 	apr_byte_t rv = FALSE;
-	apr_uint32_t timeout;
 
-	/* grab the global lock */
-	if (oidc_cache_mutex_lock(r->server, context->mutex) == FALSE)
-		return FALSE;
+	/* set or delete */
+	oidc_cache_redis_cmd_set(r, &cmd, section, key, value, expiry);
+	reply = oidc_cache_redis_command(r, context, &cmd);
 
-	/* see if we should be clearing this entry */
-	if (value == NULL) {
-
-		/* delete it */
-		reply = oidc_cache_redis_command(r, context,
-				apr_psprintf(r->pool, "DEL %s",
-						oidc_cache_redis_get_key(r->pool, section, key)));
+	rv = (reply != NULL) && (reply->type != REDIS_REPLY_ERROR);
 
-	} else {
+	/* free the reply object resources */
+	oidc_cache_redis_reply_free(&reply);
 
-		/* calculate the timeout from now */
-		timeout = apr_time_sec(expiry - apr_time_now());
+	/* return the status */
+	return rv;
+}
 
-		/* store it */
-		reply = oidc_cache_redis_command(r, context,
-				apr_psprintf(r->pool, "SETEX %s %d %s",
-						oidc_cache_redis_get_key(r->pool, section, key),
-						timeout, value));
+/*
+ * get a number of name/value pairs from Redis in a single round trip per node
+ */
+static apr_byte_t oidc_cache_redis_get_multi(request_rec *r,
+		oidc_cache_entry_t *entries, int n) {
 
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
+	oidc_cache_redis_cmd_t *cmds = apr_pcalloc(r->pool,
+			n * sizeof(oidc_cache_redis_cmd_t));
+	redisReply **replies = apr_pcalloc(r->pool, n * sizeof(redisReply *));
+	apr_byte_t rv = TRUE;
+	int i;
+
+	for (i = 0; i < n; i++)
+		oidc_cache_redis_cmd_get(r, &cmds[i], entries[i].section,
+				entries[i].key);
+
+	oidc_cache_redis_command_multi(r, context, cmds, n, replies);
+
+	for (i = 0; i < n; i++) {
+		entries[i].value = NULL;
+		if (oidc_cache_redis_reply_value(r, replies[i], &entries[i].value)
+				== FALSE)
+			rv = FALSE;
+		oidc_cache_redis_reply_free(&replies[i]);
 	}
 
-	rv = (reply != NULL) && (reply->type != REDIS_REPLY_ERROR);
+	return rv;
+}
+
+/*
+ * update the expiry of an existing name/value pair in Redis
+ */
+static apr_byte_t oidc_cache_redis_touch(request_rec *r, const char *section,
+		const char *key, apr_time_t expiry) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
+	oidc_cache_redis_cmd_t cmd = { 0 };
+	redisReply *reply = NULL;
+	apr_time_t timeout;
+	apr_byte_t rv = FALSE;
+
+	/* calculate the timeout from now */
+	timeout = apr_time_sec(expiry - apr_time_now());
+	if (timeout <= 0)
+		timeout = 1;
+
+	/* EXPIRE returns 1 when the key exists and 0 when it doesn't */
+	oidc_cache_redis_cmd_arg(&cmd, "EXPIRE");
+	oidc_cache_redis_cmd_arg(&cmd,
+			oidc_cache_redis_get_key(r->pool, section, key));
+	oidc_cache_redis_cmd_arg(&cmd,
+			apr_psprintf(r->pool, "%" APR_TIME_T_FMT, timeout));
+	reply = oidc_cache_redis_command(r, context, &cmd);
+
+	rv = (reply != NULL) && (reply->type == REDIS_REPLY_INTEGER)
+			&& (reply->integer == 1);
 
 	/* free the reply object resources */
 	oidc_cache_redis_reply_free(&reply);
 
-	/* unlock the global mutex */
-	oidc_cache_mutex_unlock(r->server, context->mutex);
-
 	/* return the status */
 	return rv;
 }
 
+/*
+ * store a number of name/value pairs in Redis in a single round trip per node
+ */
+static apr_byte_t oidc_cache_redis_set_multi(request_rec *r,
+		const oidc_cache_entry_t *entries, int n) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
+	oidc_cache_redis_cmd_t *cmds = apr_pcalloc(r->pool,
+			n * sizeof(oidc_cache_redis_cmd_t));
+	redisReply **replies = apr_pcalloc(r->pool, n * sizeof(redisReply *));
+	apr_byte_t rv = TRUE;
+	int i;
+
+	for (i = 0; i < n; i++)
+		oidc_cache_redis_cmd_set(r, &cmds[i], entries[i].section,
+				entries[i].key, entries[i].value, entries[i].expiry);
+
+	oidc_cache_redis_command_multi(r, context, cmds, n, replies);
+
+	for (i = 0; i < n; i++) {
+		if ((replies[i] == NULL) || (replies[i]->type == REDIS_REPLY_ERROR))
+			rv = FALSE;
+		oidc_cache_redis_reply_free(&replies[i]);
+	}
+
+	return rv;
+}
+
+/*
+ * assemble the name of the sorted set that holds an index; it differs from the name of the
+ * regular value that an earlier version stored under the same section/key
+ */
+static char *oidc_cache_redis_get_index_key(apr_pool_t *pool,
+		const char *section, const char *key) {
+	return apr_psprintf(pool, "%s:%s:index", section, key);
+}
+
+/* number of commands used to add a member to an index */
+#define OIDC_REDIS_INDEX_ADD_CMDS 4
+
+/*
+ * update indexes that are stored as sorted sets of members scored by their expiry, in a
+ * single round trip per node; the set expires with the member added last and in the rare
+ * case that another member expires later that is corrected with a second round trip
+ */
+static apr_byte_t oidc_cache_redis_index_update(request_rec *r,
+		const oidc_cache_entry_t *entries, int n) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
+	oidc_cache_redis_cmd_t *cmds = apr_pcalloc(r->pool,
+			OIDC_REDIS_INDEX_ADD_CMDS * n * sizeof(oidc_cache_redis_cmd_t));
+	redisReply **replies = apr_pcalloc(r->pool,
+			OIDC_REDIS_INDEX_ADD_CMDS * n * sizeof(redisReply *));
+	oidc_cache_redis_cmd_t *fix = apr_pcalloc(r->pool,
+			n * sizeof(oidc_cache_redis_cmd_t));
+	int *last = apr_pcalloc(r->pool, n * sizeof(int));
+	redisReply *latest = NULL;
+	const char *index_key = NULL, *expiry = NULL;
+	apr_byte_t rv = TRUE;
+	int i, m = 0, f = 0;
+
+	for (i = 0; i < n; i++) {
+		index_key = oidc_cache_redis_get_index_key(r->pool, entries[i].section,
+				entries[i].key);
+		last[i] = -1;
+
+		if (entries[i].value == NULL) {
+			/* remove the index and a value stored by an earlier version */
+			oidc_cache_redis_cmd_arg(&cmds[m], "DEL");
+			oidc_cache_redis_cmd_arg(&cmds[m++], index_key);
+			oidc_cache_redis_cmd_set(r, &cmds[m++], entries[i].section,
+					entries[i].key, NULL, 0);
+			continue;
+		}
+
+		if (entries[i].expiry == 0) {
+			oidc_cache_redis_cmd_arg(&cmds[m], "ZREM");
+			oidc_cache_redis_cmd_arg(&cmds[m], index_key);
+			oidc_cache_redis_cmd_arg(&cmds[m++], entries[i].value);
+			continue;
+		}
+
+		expiry = apr_psprintf(r->pool, "%" APR_TIME_T_FMT,
+				apr_time_sec(entries[i].expiry));
+
+		/* drop expired members, add this one and expire the set with it */
+		oidc_cache_redis_cmd_arg(&cmds[m], "ZREMRANGEBYSCORE");
+		oidc_cache_redis_cmd_arg(&cmds[m], index_key);
+		oidc_cache_redis_cmd_arg(&cmds[m], "-inf");
+		oidc_cache_redis_cmd_arg(&cmds[m++],
+				apr_psprintf(r->pool, "%" APR_TIME_T_FMT,
+						apr_time_sec(apr_time_now())));
+		oidc_cache_redis_cmd_arg(&cmds[m], "ZADD");
+		oidc_cache_redis_cmd_arg(&cmds[m], index_key);
+		oidc_cache_redis_cmd_arg(&cmds[m], expiry);
+		oidc_cache_redis_cmd_arg(&cmds[m++], entries[i].value);
+		oidc_cache_redis_cmd_arg(&cmds[m], "EXPIREAT");
+		oidc_cache_redis_cmd_arg(&cmds[m], index_key);
+		oidc_cache_redis_cmd_arg(&cmds[m++], expiry);
+		/* get the member that expires last */
+		oidc_cache_redis_cmd_arg(&cmds[m], "ZRANGE");
+		oidc_cache_redis_cmd_arg(&cmds[m], index_key);
+		oidc_cache_redis_cmd_arg(&cmds[m], "-1");
+		oidc_cache_redis_cmd_arg(&cmds[m], "-1");
+		oidc_cache_redis_cmd_arg(&cmds[m], "WITHSCORES");
+		last[i] = m++;
+	}
+
+	oidc_cache_redis_command_multi(r, context, cmds, m, replies);
+
+	for (i = 0; i < m; i++)
+		if ((replies[i] == NULL) || (replies[i]->type == REDIS_REPLY_ERROR))
+			rv = FALSE;
+
+	/* extend the expiry of sets that hold a member that expires later than the one just added */
+	for (i = 0; (rv == TRUE) && (i < n); i++) {
+		if (last[i] < 0)
+			continue;
+		latest = replies[last[i]];
+		if ((latest->type != REDIS_REPLY_ARRAY) || (latest->elements != 2)
+				|| (latest->element[1]->type != REDIS_REPLY_STRING)
+				|| (apr_atoi64(latest->element[1]->str)
+						<= apr_time_sec(entries[i].expiry)))
+			continue;
+		oidc_cache_redis_cmd_arg(&fix[f], "EXPIREAT");
+		oidc_cache_redis_cmd_arg(&fix[f],
+				oidc_cache_redis_get_index_key(r->pool, entries[i].section,
+						entries[i].key));
+		oidc_cache_redis_cmd_arg(&fix[f++],
+				apr_pstrdup(r->pool, latest->element[1]->str));
+	}
+
+	for (i = 0; i < m; i++)
+		oidc_cache_redis_reply_free(&replies[i]);
+
+	if (f > 0) {
+		oidc_cache_redis_command_multi(r, context, fix, f, replies);
+		for (i = 0; i < f; i++) {
+			if ((replies[i] == NULL) || (replies[i]->type == REDIS_REPLY_ERROR))
+				rv = FALSE;
+			oidc_cache_redis_reply_free(&replies[i]);
+		}
+	}
+
+	return rv;
+}
+
+/*
+ * get the non-expired members of an index together with a value that an earlier version
+ * stored under the same section/key, in a single round trip per node
+ */
+static apr_byte_t oidc_cache_redis_index_get(request_rec *r,
+		const char *section, const char *key, apr_array_header_t **members) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
+	oidc_cache_redis_cmd_t cmds[2] = { { 0 }, { 0 } };
+	redisReply *replies[2] = { NULL, NULL };
+	const char *value = NULL;
+	apr_byte_t rv = FALSE;
+	size_t i;
+
+	*members = apr_array_make(r->pool, 4, sizeof(const char *));
+
+	oidc_cache_redis_cmd_arg(&cmds[0], "ZRANGEBYSCORE");
+	oidc_cache_redis_cmd_arg(&cmds[0],
+			oidc_cache_redis_get_index_key(r->pool, section, key));
+	oidc_cache_redis_cmd_arg(&cmds[0],
+			apr_psprintf(r->pool, "(%" APR_TIME_T_FMT,
+					apr_time_sec(apr_time_now())));
+	oidc_cache_redis_cmd_arg(&cmds[0], "+inf");
+	oidc_cache_redis_cmd_get(r, &cmds[1], section, key);
+
+	oidc_cache_redis_command_multi(r, context, cmds, 2, replies);
+
+	if ((replies[0] != NULL) && (replies[0]->type == REDIS_REPLY_ARRAY)
+			&& (oidc_cache_redis_reply_value(r, replies[1], &value) == TRUE)) {
+		for (i = 0; i < replies[0]->elements; i++)
+			if (replies[0]->element[i]->type == REDIS_REPLY_STRING)
+				APR_ARRAY_PUSH(*members, const char *) =
+						apr_pstrdup(r->pool, replies[0]->element[i]->str);
+		if (value != NULL)
+			APR_ARRAY_PUSH(*members, const char *) = value;
+		rv = TRUE;
+	}
+
+	oidc_cache_redis_reply_free(&replies[0]);
+	oidc_cache_redis_reply_free(&replies[1]);
+
+	return rv;
+}
+
 static int oidc_cache_redis_destroy(server_rec *s) {
 	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
 			&auth_openidc_module);
 	oidc_cache_cfg_redis_t *context = (oidc_cache_cfg_redis_t *) cfg->cache_cfg;
 
-	if (context != NULL) {
-		// TODO: why do we need this check...? it is set/checked to null inside of oidc_cache_redis_free, no?
-		if (context->ctx != NULL) {
-			oidc_cache_mutex_lock(s, context->mutex);
-			oidc_cache_redis_free(context);
-			oidc_cache_mutex_unlock(s, context->mutex);
-		}
-		oidc_cache_mutex_destroy(s, context->mutex);
+	if ((context != NULL) && (context->nodes != NULL)) {
+		oidc_cache_redis_lock(context);
+		oidc_cache_redis_nodes_free(context);
+		oidc_cache_redis_unlock(context);
 	}
 
 	return APR_SUCCESS;
@@ -397,5 +1350,10 @@ oidc_cache_t oidc_cache_redis = {
 		oidc_cache_redis_child_init,
 		oidc_cache_redis_get,
 		oidc_cache_redis_set,
-		oidc_cache_redis_destroy
+		oidc_cache_redis_destroy,
+		oidc_cache_redis_get_multi,
+		oidc_cache_redis_set_multi,
+		oidc_cache_redis_touch,
+		oidc_cache_redis_index_update,
+		oidc_cache_redis_index_get
 };
@@ -0,0 +1,543 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/***************************************************************************
+ * Copyright (C) 2017-2020 ZmartZone IAM
+ * Copyright (C) 2013-2017 Ping Identity Corporation
+ * All rights reserved.
+ *
+ * For further information please contact:
+ *
+ *      Ping Identity Corporation
+ *      1099 18th St Suite 2950
+ *      Denver, CO 80202
+ *      303.468.2900
+ *      http://www.pingidentity.com
+ *
+ * DISCLAIMER OF WARRANTIES:
+ *
+ * THE SOFTWARE PROVIDED HEREUNDER IS PROVIDED ON AN "AS IS" BASIS, WITHOUT
+ * ANY WARRANTIES OR REPRESENTATIONS EXPRESS, IMPLIED OR STATUTORY; INCLUDING,
+ * WITHOUT LIMITATION, WARRANTIES OF QUALITY, PERFORMANCE, NONINFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.  NOR ARE THERE ANY
+ * WARRANTIES CREATED BY A COURSE OR DEALING, COURSE OF PERFORMANCE OR TRADE
+ * USAGE.  FURTHERMORE, THERE ARE NO WARRANTIES THAT THE SOFTWARE WILL MEET
+ * YOUR NEEDS OR BE FREE FROM ERRORS, OR THAT THE OPERATION OF THE SOFTWARE
+ * WILL BE UNINTERRUPTED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * replay prevention store for JTI and nonce values: a fixed-size shared memory hash set of digests
+ * with a time wheel of Bloom filters that lets lookups for unknown IDs return without locking
+ *
+ * @Author: Hans Zandbelt - hans.zandbelt@zmartzone.eu
+ */
+
+#include <httpd.h>
+#include <http_config.h>
+#include <http_log.h>
+
+#include "apr_sha1.h"
+#include "apr_shm.h"
+
+#include "../mod_auth_openidc.h"
+
+extern module AP_MODULE_DECLARE_DATA auth_openidc_module;
+
+/* default number of IDs that the store can hold when the shm cache backend is used */
+#define OIDC_CACHE_REPLAY_ENTRIES_DEFAULT 10000
+
+/* number of slots in a bucket of the hash set */
+#define OIDC_CACHE_REPLAY_BUCKET_SIZE 8
+
+/* number of slots in the time wheel, each with its own Bloom filter */
+#define OIDC_CACHE_REPLAY_WHEEL_SIZE 16
+
+/* number of seconds of expiry time covered by a single slot of the time wheel */
+#define OIDC_CACHE_REPLAY_WHEEL_TICK 256
+
+/* number of bits of a Bloom filter that are set for a single ID */
+#define OIDC_CACHE_REPLAY_BLOOM_HASHES 3
+
+/* number of bits per entry in the Bloom filter of a single wheel slot */
+#define OIDC_CACHE_REPLAY_BLOOM_BITS_PER_ENTRY 8
+
+/*
+ * readers check the Bloom filters without taking the lock; that requires a
+ * full memory barrier so on compilers that we can't get one from, every
+ * lookup takes the lock and probes the hash set
+ */
+#if defined(__GNUC__)
+#define OIDC_CACHE_REPLAY_BARRIER() __sync_synchronize()
+#define OIDC_CACHE_REPLAY_FILTER 1
+#else
+#define OIDC_CACHE_REPLAY_BARRIER()
+#define OIDC_CACHE_REPLAY_FILTER 0
+#endif
+
+/* administration at the start of the shared memory segment */
+typedef struct oidc_cache_replay_header_t {
+	/* the tick (expiry in seconds / OIDC_CACHE_REPLAY_WHEEL_TICK) that the Bloom filter of a wheel slot holds IDs for */
+	apr_uint64_t wheel[OIDC_CACHE_REPLAY_WHEEL_SIZE];
+	/* the Bloom filters are bypassed until this time because an ID could not be added to them */
+	apr_time_t bypass_until;
+	/* number of lookups that probed the hash set */
+	apr_uint64_t probes;
+	/* number of lookups that found a non-expired ID */
+	apr_uint64_t hits;
+	/* number of IDs added */
+	apr_uint64_t adds;
+	/* number of IDs that did not fit in their bucket and were stored in the regular cache */
+	apr_uint64_t overflows;
+	/* lookups that miss in the hash set consult the regular cache until this time because IDs were stored there */
+	apr_time_t overflow_until;
+} oidc_cache_replay_header_t;
+
+#define OIDC_CACHE_REPLAY_HEADER_SIZE APR_ALIGN_DEFAULT(sizeof(oidc_cache_replay_header_t))
+
+/* a slot in the hash set */
+typedef struct oidc_cache_replay_entry_t {
+	/* the first 8 bytes of the SHA-1 digest over the section and the ID, 0 for a free slot */
+	apr_uint64_t digest;
+	/* the time at which the ID expires */
+	apr_time_t expires;
+} oidc_cache_replay_entry_t;
+
+/* the context of the store, as kept in the server config */
+typedef struct oidc_cache_cfg_replay_t {
+	apr_shm_t *shm;
+	oidc_cache_mutex_t *mutex;
+	apr_byte_t is_parent;
+	/* number of IDs that the store was configured to hold */
+	int entries;
+	/* number of buckets in the hash set, a power of 2 */
+	apr_uint32_t n_buckets;
+	/* number of bits in the Bloom filter of a single wheel slot, a power of 2 */
+	apr_uint32_t bloom_bits;
+} oidc_cache_cfg_replay_t;
+
+/* the values derived from the digest of an ID */
+typedef struct oidc_cache_replay_hash_t {
+	apr_uint64_t digest;
+	apr_uint32_t bucket;
+	apr_uint32_t h1;
+	apr_uint32_t h2;
+} oidc_cache_replay_hash_t;
+
+/* create the store context */
+static oidc_cache_cfg_replay_t *oidc_cache_replay_cfg_create(apr_pool_t *pool) {
+	oidc_cache_cfg_replay_t *context = apr_pcalloc(pool,
+			sizeof(oidc_cache_cfg_replay_t));
+	context->shm = NULL;
+	context->mutex = oidc_cache_mutex_create(pool);
+	context->is_parent = TRUE;
+	return context;
+}
+
+/* get a pointer to the administration in the shared memory segment */
+#define oidc_cache_replay_header(context) ((oidc_cache_replay_header_t *)apr_shm_baseaddr_get((context)->shm))
+
+/*
+ * get a pointer to the first slot of the bucket that an ID maps to
+ */
+static oidc_cache_replay_entry_t *oidc_cache_replay_bucket(
+		oidc_cache_cfg_replay_t *context, const oidc_cache_replay_hash_t *h) {
+	return (oidc_cache_replay_entry_t *) ((uint8_t *) apr_shm_baseaddr_get(
+			context->shm) + OIDC_CACHE_REPLAY_HEADER_SIZE)
+			+ (apr_size_t) (h->bucket & (context->n_buckets - 1))
+			* OIDC_CACHE_REPLAY_BUCKET_SIZE;
+}
+
+/*
+ * get a pointer to the Bloom filter of a wheel slot; the filters follow the hash set
+ */
+static apr_uint64_t *oidc_cache_replay_bloom(oidc_cache_cfg_replay_t *context,
+		int w) {
+	return (apr_uint64_t *) ((uint8_t *) apr_shm_baseaddr_get(context->shm)
+			+ OIDC_CACHE_REPLAY_HEADER_SIZE
+			+ (apr_size_t) context->n_buckets * OIDC_CACHE_REPLAY_BUCKET_SIZE
+			* sizeof(oidc_cache_replay_entry_t))
+			+ (apr_size_t) w * (context->bloom_bits / 64);
+}
+
+/*
+ * derive the digest, the bucket and the Bloom filter hashes from the section and the ID
+ */
+static void oidc_cache_replay_hash(const char *section, const char *id,
+		oidc_cache_replay_hash_t *h) {
+	unsigned char digest[APR_SHA1_DIGESTSIZE];
+	apr_sha1_ctx_t ctx;
+
+	apr_sha1_init(&ctx);
+	apr_sha1_update(&ctx, section, strlen(section));
+	apr_sha1_update(&ctx, ":", 1);
+	apr_sha1_update(&ctx, id, strlen(id));
+	apr_sha1_final(digest, &ctx);
+
+	memcpy(&h->digest, digest, sizeof(h->digest));
+	memcpy(&h->bucket, digest + 8, sizeof(h->bucket));
+	memcpy(&h->h1, digest + 12, sizeof(h->h1));
+	memcpy(&h->h2, digest + 16, sizeof(h->h2));
+
+	/* 0 marks a free slot */
+	if (h->digest == 0)
+		h->digest = 1;
+}
+
+/*
+ * get the index of the i'th Bloom filter bit for an ID (double hashing)
+ */
+#define oidc_cache_replay_bloom_bit(context, h, i) (((h)->h1 + (i) * (h)->h2) & ((context)->bloom_bits - 1))
+
+/*
+ * check if all Bloom filter bits for an ID are set
+ */
+static apr_byte_t oidc_cache_replay_bloom_test(oidc_cache_cfg_replay_t *context,
+		const apr_uint64_t *bloom, const oidc_cache_replay_hash_t *h) {
+	apr_uint32_t bit;
+	int i;
+	for (i = 0; i < OIDC_CACHE_REPLAY_BLOOM_HASHES; i++) {
+		bit = oidc_cache_replay_bloom_bit(context, h, i);
+		if ((bloom[bit / 64] & ((apr_uint64_t) 1 << (bit % 64))) == 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * check the Bloom filters of the wheel slots that hold non-expired IDs without
+ * taking the lock; returns FALSE only if the ID is definitely not in the store
+ */
+static apr_byte_t oidc_cache_replay_filter(oidc_cache_cfg_replay_t *context,
+		const oidc_cache_replay_hash_t *h, apr_time_t now) {
+#if OIDC_CACHE_REPLAY_FILTER
+	oidc_cache_replay_header_t *header = oidc_cache_replay_header(context);
+	apr_uint64_t tick = apr_time_sec(now) / OIDC_CACHE_REPLAY_WHEEL_TICK;
+	int w;
+
+	if (header->bypass_until > now)
+		return TRUE;
+
+	for (w = 0; w < OIDC_CACHE_REPLAY_WHEEL_SIZE; w++) {
+		/* the IDs in slots of a past tick have all expired */
+		if (header->wheel[w] < tick)
+			continue;
+		OIDC_CACHE_REPLAY_BARRIER();
+		if (oidc_cache_replay_bloom_test(context,
+				oidc_cache_replay_bloom(context, w), h) == TRUE)
+			return TRUE;
+	}
+
+	return FALSE;
+#else
+	return TRUE;
+#endif
+}
+
+/*
+ * add an ID to the Bloom filter of the wheel slot for its expiry time; the caller holds the lock
+ */
+static void oidc_cache_replay_wheel_add(oidc_cache_cfg_replay_t *context,
+		const oidc_cache_replay_hash_t *h, apr_time_t now, apr_time_t expiry) {
+	oidc_cache_replay_header_t *header = oidc_cache_replay_header(context);
+	apr_uint64_t now_tick = apr_time_sec(now) / OIDC_CACHE_REPLAY_WHEEL_TICK;
+	apr_uint64_t tick = apr_time_sec(expiry) / OIDC_CACHE_REPLAY_WHEEL_TICK;
+	int w = tick % OIDC_CACHE_REPLAY_WHEEL_SIZE;
+	apr_uint64_t *bloom = NULL;
+	apr_uint32_t bit;
+	int i;
+
+	/* the ID expires beyond the horizon of the wheel: bypass the filters until it has expired */
+	if (tick - now_tick >= OIDC_CACHE_REPLAY_WHEEL_SIZE) {
+		if (expiry > header->bypass_until)
+			header->bypass_until = expiry;
+		return;
+	}
+
+	/* the clock went backwards and the slot holds IDs that expire later: bypass the filters until they have expired */
+	if (header->wheel[w] > tick) {
+		expiry = apr_time_from_sec(
+				(header->wheel[w] + 1) * OIDC_CACHE_REPLAY_WHEEL_TICK);
+		if (expiry > header->bypass_until)
+			header->bypass_until = expiry;
+		return;
+	}
+
+	/* the slot holds IDs of a past tick that have all expired: reuse it */
+	bloom = oidc_cache_replay_bloom(context, w);
+	if (header->wheel[w] < tick) {
+		memset(bloom, 0, context->bloom_bits / 8);
+		OIDC_CACHE_REPLAY_BARRIER();
+		header->wheel[w] = tick;
+	}
+
+	for (i = 0; i < OIDC_CACHE_REPLAY_BLOOM_HASHES; i++) {
+		bit = oidc_cache_replay_bloom_bit(context, h, i);
+		bloom[bit / 64] |= ((apr_uint64_t) 1 << (bit % 64));
+	}
+	OIDC_CACHE_REPLAY_BARRIER();
+}
+
+/*
+ * check if an ID has been recorded in a section (OIDC_CACHE_SECTION_JTI or OIDC_CACHE_SECTION_NONCE) before
+ */
+apr_byte_t oidc_cache_replay_exists(request_rec *r, const char *section,
+		const char *id) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_replay_t *context =
+			(oidc_cache_cfg_replay_t *) cfg->replay_cache_cfg;
+	oidc_cache_replay_header_t *header = NULL;
+	oidc_cache_replay_entry_t *t = NULL;
+	oidc_cache_replay_hash_t h;
+	apr_time_t now = apr_time_now();
+	apr_byte_t found = FALSE, overflow = FALSE;
+	char *value = NULL;
+	int i;
+
+	if (id == NULL)
+		return FALSE;
+
+	/* no dedicated store: use the regular cache */
+	if ((context == NULL) || (context->shm == NULL)) {
+		oidc_cache_get(r, section, id, &value);
+		return (value != NULL);
+	}
+
+	oidc_cache_replay_hash(section, id, &h);
+
+	if (oidc_cache_replay_filter(context, &h, now) == FALSE)
+		return FALSE;
+
+	if (oidc_cache_mutex_lock(r->server, context->mutex) == FALSE)
+		return FALSE;
+
+	header = oidc_cache_replay_header(context);
+	header->probes++;
+	t = oidc_cache_replay_bucket(context, &h);
+	for (i = 0; i < OIDC_CACHE_REPLAY_BUCKET_SIZE; i++) {
+		if ((t[i].digest == h.digest) && (t[i].expires > now)) {
+			found = TRUE;
+			header->hits++;
+			break;
+		}
+	}
+	overflow = (found == FALSE) && (header->overflow_until > now);
+
+	oidc_cache_mutex_unlock(r->server, context->mutex);
+
+	/* the ID may have been stored in the regular cache because its bucket was full */
+	if (overflow == TRUE) {
+		oidc_cache_get(r, section, id, &value);
+		found = (value != NULL);
+	}
+
+	return found;
+}
+
+/*
+ * record an ID in a section (OIDC_CACHE_SECTION_JTI or OIDC_CACHE_SECTION_NONCE) until it expires
+ */
+apr_byte_t oidc_cache_replay_add(request_rec *r, const char *section,
+		const char *id, apr_time_t expiry) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_replay_t *context =
+			(oidc_cache_cfg_replay_t *) cfg->replay_cache_cfg;
+	oidc_cache_replay_header_t *header = NULL;
+	oidc_cache_replay_entry_t *t = NULL, *match = NULL, *free = NULL;
+	oidc_cache_replay_hash_t h;
+	apr_time_t now = apr_time_now();
+	int i;
+
+	if (id == NULL)
+		return FALSE;
+
+	/* no dedicated store: use the regular cache */
+	if ((context == NULL) || (context->shm == NULL))
+		return oidc_cache_set(r, section, id, id, expiry);
+
+	if (expiry <= now)
+		return TRUE;
+
+	oidc_cache_replay_hash(section, id, &h);
+
+	if (oidc_cache_mutex_lock(r->server, context->mutex) == FALSE)
+		return FALSE;
+
+	header = oidc_cache_replay_header(context);
+
+	/* make the ID visible in the filters before it becomes visible in the hash set */
+	oidc_cache_replay_wheel_add(context, &h, now, expiry);
+
+	t = oidc_cache_replay_bucket(context, &h);
+	for (i = 0; i < OIDC_CACHE_REPLAY_BUCKET_SIZE; i++) {
+		if (t[i].digest == h.digest) {
+			match = &t[i];
+			break;
+		}
+		if ((t[i].expires <= now) && (free == NULL))
+			free = &t[i];
+	}
+
+	if (match != NULL) {
+		/* never shorten the lifetime of a recorded ID */
+		if ((match->expires > now) && (match->expires > expiry))
+			expiry = match->expires;
+	} else if (free != NULL) {
+		match = free;
+	} else {
+		/*
+		 * the bucket is full of non-expired IDs; dropping one would allow it to be
+		 * replayed, so store the new ID in the regular cache instead
+		 */
+		header->overflows++;
+		if (expiry > header->overflow_until)
+			header->overflow_until = expiry;
+		oidc_cache_mutex_unlock(r->server, context->mutex);
+		oidc_warn(r,
+				"replay cache bucket is full, storing the entry in the regular cache; consider increasing the replay cache size (which is %d now) with the (global) " OIDCReplayCacheEntries " setting.",
+				context->entries);
+		return oidc_cache_set(r, section, id, id, expiry);
+	}
+
+	match->digest = h.digest;
+	match->expires = expiry;
+	header->adds++;
+
+	oidc_cache_mutex_unlock(r->server, context->mutex);
+
+	return TRUE;
+}
+
+/*
+ * create and initialize the shared memory segment in the parent process
+ */
+int oidc_cache_replay_post_config(server_rec *s) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_replay_t *context = NULL;
+	int entries = cfg->replay_cache_entries;
+	apr_size_t size;
+
+	if (cfg->replay_cache_cfg != NULL)
+		return OK;
+
+	/*
+	 * by default only use a dedicated store with the shm cache backend since
+	 * the others may share the recorded IDs across servers
+	 */
+	if (entries == OIDC_CONFIG_POS_INT_UNSET)
+		entries = (cfg->cache == &oidc_cache_shm) ?
+				OIDC_CACHE_REPLAY_ENTRIES_DEFAULT : 0;
+	if (entries <= 0)
+		return OK;
+
+	context = oidc_cache_replay_cfg_create(s->process->pool);
+	context->entries = entries;
+	context->n_buckets = 1;
+	while (context->n_buckets * OIDC_CACHE_REPLAY_BUCKET_SIZE < entries)
+		context->n_buckets <<= 1;
+	context->bloom_bits = 64;
+	while (context->bloom_bits
+			< (apr_uint32_t) entries * OIDC_CACHE_REPLAY_BLOOM_BITS_PER_ENTRY)
+		context->bloom_bits <<= 1;
+
+	size = OIDC_CACHE_REPLAY_HEADER_SIZE
+			+ (apr_size_t) context->n_buckets * OIDC_CACHE_REPLAY_BUCKET_SIZE
+			* sizeof(oidc_cache_replay_entry_t)
+			+ (apr_size_t) OIDC_CACHE_REPLAY_WHEEL_SIZE
+			* (context->bloom_bits / 8);
+
+	apr_status_t rv = apr_shm_create(&context->shm, size, NULL,
+			s->process->pool);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s,
+				"apr_shm_create failed to create shared memory segment for the replay cache");
+		return HTTP_INTERNAL_SERVER_ERROR;
+	}
+	memset(apr_shm_baseaddr_get(context->shm), 0, size);
+
+	if (oidc_cache_mutex_post_config(s, context->mutex, "replay") == FALSE)
+		return HTTP_INTERNAL_SERVER_ERROR;
+
+	cfg->replay_cache_cfg = context;
+
+	oidc_sdebug(s,
+			"initialized replay cache for %d entries in %u buckets with %u Bloom filter bits per wheel slot using %" APR_SIZE_T_FMT " bytes",
+			entries, context->n_buckets, context->bloom_bits, size);
+
+	return OK;
+}
+
+/*
+ * initialize the lock in a child process
+ */
+apr_status_t oidc_cache_replay_child_init(apr_pool_t *p, server_rec *s) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_replay_t *context =
+			(oidc_cache_cfg_replay_t *) cfg->replay_cache_cfg;
+
+	if (context == NULL)
+		return APR_SUCCESS;
+
+	context->is_parent = FALSE;
+
+	return oidc_cache_mutex_child_init(p, s, context->mutex);
+}
+
+/*
+ * remove the shared memory segment when the last process is done with it
+ */
+int oidc_cache_replay_destroy(server_rec *s) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_replay_t *context =
+			(oidc_cache_cfg_replay_t *) cfg->replay_cache_cfg;
+	oidc_cache_replay_header_t *header = NULL;
+	apr_status_t rv = APR_SUCCESS;
+
+	if (context == NULL)
+		return rv;
+
+	if ((context->is_parent == TRUE) && (context->shm)) {
+		oidc_cache_mutex_lock(s, context->mutex);
+		header = oidc_cache_replay_header(context);
+		oidc_sdebug(s,
+				"replay cache stats: probes=%" APR_UINT64_T_FMT ", hits=%" APR_UINT64_T_FMT ", adds=%" APR_UINT64_T_FMT ", overflows=%" APR_UINT64_T_FMT,
+				header->probes, header->hits, header->adds, header->overflows);
+		if (*context->mutex->sema == 1) {
+			rv = apr_shm_destroy(context->shm);
+			oidc_sdebug(s, "apr_shm_destroy returned: %d", rv);
+		}
+		context->shm = NULL;
+		oidc_cache_mutex_unlock(s, context->mutex);
+	}
+
+	if (context->mutex != NULL) {
+		oidc_cache_mutex_destroy(s, context->mutex);
+		context->mutex = NULL;
+	}
+
+	return rv;
+}
@@ -46,7 +46,8 @@
  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *
- * caching using a shared memory backend, FIFO-style
+ * caching using a shared memory backend, FIFO-style, with slab classes of different entry sizes, a
+ * bucketed hash index, striped locks and lock-free (seqlock) readers
  * based on mod_auth_mellon code
  *
  * @Author: Hans Zandbelt - hans.zandbelt@zmartzone.eu
@@ -62,76 +63,285 @@
 
 extern module AP_MODULE_DECLARE_DATA auth_openidc_module;
 
+/* number of independently locked stripes that the entries are distributed over */
+#define OIDC_CACHE_SHM_STRIPES 16
+
+/* maximum number of cache sections that we keep an administration for */
+#define OIDC_CACHE_SHM_SECTIONS_MAX 16
+
+/* the cache sections that we keep an entry count for, so quota can be enforced */
+static const char *oidc_cache_shm_sections[] = {
+		OIDC_CACHE_SECTION_SESSION,
+		OIDC_CACHE_SECTION_NONCE,
+		OIDC_CACHE_SECTION_JWKS,
+		OIDC_CACHE_SECTION_ACCESS_TOKEN,
+		OIDC_CACHE_SECTION_PROVIDER,
+		OIDC_CACHE_SECTION_OAUTH_PROVIDER,
+		OIDC_CACHE_SECTION_JTI,
+		OIDC_CACHE_SECTION_REQUEST_URI,
+		OIDC_CACHE_SECTION_SID,
+		OIDC_CACHE_SECTION_SESSION_EXPIRY,
+		OIDC_CACHE_SECTION_LEASE,
+		OIDC_CACHE_SECTION_SUB,
+		NULL };
+
+/* a slab class: a region of the segment holding entries of the same size */
+typedef struct oidc_cache_shm_slab_class_t {
+	/* size in bytes of a single entry in this class */
+	apr_size_t entry_size;
+	/* number of entries in every stripe */
+	int stripe_size;
+	/* offset of the first entry in this class from the start of the segment */
+	apr_size_t offset;
+} oidc_cache_shm_slab_class_t;
+
 typedef struct oidc_cache_cfg_shm_t {
 	apr_shm_t *shm;
-	oidc_cache_mutex_t *mutex;
+	/* one (writer) lock per stripe; the first one also tracks the process count */
+	oidc_cache_mutex_t *mutex[OIDC_CACHE_SHM_STRIPES];
+	/* slab classes, ordered by ascending entry size */
+	oidc_cache_shm_slab_class_t *classes;
+	int n_classes;
+	/* maximum number of entries per section, 0 meaning unlimited */
+	int quota[OIDC_CACHE_SHM_SECTIONS_MAX];
 	apr_byte_t is_parent;
 } oidc_cache_cfg_shm_t;
 
-/* size of key in cached key/value pairs */
+/* maximum size of the key in cached key/value pairs */
 #define OIDC_CACHE_SHM_KEY_MAX 512
 
-/* represents one (fixed size) cache entry, cq. name/value string pair */
+/* number of slots in a hash bucket, i.e. the maximum probe length for a lookup in a slab class */
+#define OIDC_CACHE_SHM_BUCKET_SIZE 8
+
+/* only update the access timestamp on a read when it is older than this */
+#define OIDC_CACHE_SHM_ACCESS_GRANULARITY apr_time_from_sec(1)
+
+/*
+ * readers don't take the stripe lock but use the stripe's sequence counter to
+ * detect concurrent writers (seqlock); that requires a full memory barrier so
+ * on compilers that we can't get one from, readers fall back to locking
+ */
+#if defined(__GNUC__)
+#define OIDC_CACHE_SHM_BARRIER() __sync_synchronize()
+#define OIDC_CACHE_SHM_READ_RETRIES 4
+#else
+#define OIDC_CACHE_SHM_BARRIER()
+#define OIDC_CACHE_SHM_READ_RETRIES 0
+#endif
+
+/*
+ * represents one (fixed size) cache entry, cq. name/value string pair; the data
+ * holds the '\0'-terminated name followed by the '\0'-terminated value
+ */
 typedef struct oidc_cache_shm_entry_t {
-	/* name of the cache entry */
-	char section_key[OIDC_CACHE_SHM_KEY_MAX];
+	/* hash of the name of the cache entry */
+	apr_uint32_t hash;
+	/* length of the name of the cache entry */
+	apr_uint32_t key_len;
 	/* last (read) access timestamp */
 	apr_time_t access;
 	/* expiry timestamp */
 	apr_time_t expires;
-	/* value of the cache entry */
-	char value[];
+	/* name and value of the cache entry, empty when the slot is free */
+	char data[];
 } oidc_cache_shm_entry_t;
 
+/* state of a single stripe */
+typedef struct oidc_cache_shm_stripe_t {
+	/* sequence counter, odd while a writer is modifying the stripe */
+	volatile apr_uint32_t seq;
+	/* number of entries per section stored in this stripe */
+	int count[OIDC_CACHE_SHM_SECTIONS_MAX];
+	/* statistics, exact for writers and approximate for lock-free readers */
+	oidc_cache_shm_stats_t stats;
+} oidc_cache_shm_stripe_t;
+
+/* stripes are kept in separate cache lines to avoid false sharing between them */
+#define OIDC_CACHE_SHM_STRIPE_SIZE APR_ALIGN(sizeof(oidc_cache_shm_stripe_t), 64)
+
+/* the stripes are stored at the start of the shared memory segment, followed by the slab classes */
+#define OIDC_CACHE_SHM_HEADER_SIZE (OIDC_CACHE_SHM_STRIPES * OIDC_CACHE_SHM_STRIPE_SIZE)
+
 /* create the cache context */
 static void *oidc_cache_shm_cfg_create(apr_pool_t *pool) {
+	int i;
 	oidc_cache_cfg_shm_t *context = apr_pcalloc(pool,
 			sizeof(oidc_cache_cfg_shm_t));
 	context->shm = NULL;
-	context->mutex = oidc_cache_mutex_create(pool);
+	for (i = 0; i < OIDC_CACHE_SHM_STRIPES; i++)
+		context->mutex[i] = oidc_cache_mutex_create(pool);
+	context->classes = NULL;
+	context->n_classes = 0;
 	context->is_parent = TRUE;
 	return context;
 }
 
 #define OIDC_CACHE_SHM_ADD_OFFSET(t, size) t = (oidc_cache_shm_entry_t *)((uint8_t *)t + size)
 
+/* get a pointer to the state of a stripe in the shared memory segment */
+static oidc_cache_shm_stripe_t *oidc_cache_shm_stripe(
+		oidc_cache_cfg_shm_t *context, int i) {
+	return (oidc_cache_shm_stripe_t *) ((uint8_t *) apr_shm_baseaddr_get(
+			context->shm) + i * OIDC_CACHE_SHM_STRIPE_SIZE);
+}
+
+/* get the index of the section that a cache entry belongs to (or -1 if we don't keep track of it) */
+static int oidc_cache_shm_section_index(char section) {
+	int i;
+	for (i = 0; oidc_cache_shm_sections[i] != NULL; i++)
+		if (oidc_cache_shm_sections[i][0] == section)
+			return i;
+	return -1;
+}
+
+/*
+ * FNV-1a hash over the section/key name
+ */
+static apr_uint32_t oidc_cache_shm_hash(const char *section_key) {
+	apr_uint32_t hash = 2166136261U;
+	const unsigned char *p = (const unsigned char *) section_key;
+	while (*p != '\0') {
+		hash ^= *p++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/* get the stripe that a hash maps to; it is the same for all slab classes */
+#define oidc_cache_shm_stripe_index(hash) ((hash) % OIDC_CACHE_SHM_STRIPES)
+
+/*
+ * get a pointer to the first slot of the bucket that a hash maps to in a slab
+ * class and the number of slots in it; every slab class is partitioned into
+ * equally sized stripes that are in turn divided into buckets
+ */
+static oidc_cache_shm_entry_t *oidc_cache_shm_bucket(
+		oidc_cache_cfg_shm_t *context, oidc_cache_shm_slab_class_t *cls,
+		apr_uint32_t hash, int *n) {
+	int n_buckets = (cls->stripe_size + OIDC_CACHE_SHM_BUCKET_SIZE - 1)
+					/ OIDC_CACHE_SHM_BUCKET_SIZE;
+	int stripe = oidc_cache_shm_stripe_index(hash);
+	int first = ((hash / OIDC_CACHE_SHM_STRIPES) % n_buckets)
+					* OIDC_CACHE_SHM_BUCKET_SIZE;
+	oidc_cache_shm_entry_t *t =
+			(oidc_cache_shm_entry_t *) ((uint8_t *) apr_shm_baseaddr_get(
+					context->shm) + cls->offset);
+
+	/* the last bucket in a stripe may be smaller than the others */
+	*n = cls->stripe_size - first;
+	if (*n > OIDC_CACHE_SHM_BUCKET_SIZE)
+		*n = OIDC_CACHE_SHM_BUCKET_SIZE;
+
+	OIDC_CACHE_SHM_ADD_OFFSET(t,
+			((apr_size_t ) stripe * cls->stripe_size + first) * cls->entry_size);
+	return t;
+}
+
+/*
+ * order slab classes by ascending entry size
+ */
+static int oidc_cache_shm_slab_class_cmp(const void *a, const void *b) {
+	const oidc_cache_shm_slab_class_t *ca = a, *cb = b;
+	return (ca->entry_size < cb->entry_size) ?
+			-1 : ((ca->entry_size > cb->entry_size) ? 1 : 0);
+}
+
+/*
+ * add a slab class with the specified entry size and number of entries
+ */
+static void oidc_cache_shm_slab_class_add(oidc_cache_cfg_shm_t *context,
+		int i, int entry_size, int size_max) {
+	oidc_cache_shm_slab_class_t *cls = &context->classes[i];
+	cls->entry_size = APR_ALIGN_DEFAULT(entry_size);
+	cls->stripe_size = (size_max + OIDC_CACHE_SHM_STRIPES - 1)
+					/ OIDC_CACHE_SHM_STRIPES;
+}
+
 /*
  * initialized the shared memory block in the parent process
  */
 int oidc_cache_shm_post_config(server_rec *s) {
 	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
 			&auth_openidc_module);
+	apr_size_t size;
+	int i, j, *quota;
 
 	if (cfg->cache_cfg != NULL)
 		return APR_SUCCESS;
 	oidc_cache_cfg_shm_t *context = oidc_cache_shm_cfg_create(s->process->pool);
 	cfg->cache_cfg = context;
 
+	/* the primary class is sized by OIDCCacheShmMax/OIDCCacheShmEntrySizeMax and holds the largest entries */
+	context->n_classes = 1
+			+ (cfg->cache_shm_slabs ? cfg->cache_shm_slabs->nelts : 0);
+	context->classes = apr_pcalloc(s->process->pool,
+			context->n_classes * sizeof(oidc_cache_shm_slab_class_t));
+	oidc_cache_shm_slab_class_add(context, 0,
+			cfg->cache_shm_entry_size_max, cfg->cache_shm_size_max);
+	for (i = 1; i < context->n_classes; i++) {
+		oidc_cache_shm_slab_t *slab =
+				&APR_ARRAY_IDX(cfg->cache_shm_slabs, i - 1, oidc_cache_shm_slab_t);
+		if (slab->entry_size >= cfg->cache_shm_entry_size_max) {
+			oidc_serror(s,
+					"the entry size (%d) of slab class %d in " OIDCCacheShmSlabs " must be smaller than " OIDCCacheShmEntrySizeMax " (%d)",
+					slab->entry_size, i, cfg->cache_shm_entry_size_max);
+			return HTTP_INTERNAL_SERVER_ERROR;
+		}
+		oidc_cache_shm_slab_class_add(context, i, slab->entry_size,
+				slab->size_max);
+	}
+	qsort(context->classes, context->n_classes,
+			sizeof(oidc_cache_shm_slab_class_t), oidc_cache_shm_slab_class_cmp);
+
+	/* lay out the slab classes after the stripe administration */
+	size = OIDC_CACHE_SHM_HEADER_SIZE;
+	for (i = 0; i < context->n_classes; i++) {
+		context->classes[i].offset = size;
+		size += context->classes[i].entry_size * context->classes[i].stripe_size
+				* OIDC_CACHE_SHM_STRIPES;
+	}
+
+	for (i = 0; oidc_cache_shm_sections[i] != NULL; i++) {
+		quota = cfg->cache_shm_quota ?
+				apr_hash_get(cfg->cache_shm_quota, oidc_cache_shm_sections[i],
+						APR_HASH_KEY_STRING) : NULL;
+		context->quota[i] = quota ? *quota : 0;
+	}
+
 	/* create the shared memory segment */
-	apr_status_t rv = apr_shm_create(&context->shm,
-			(apr_size_t) cfg->cache_shm_entry_size_max
-			* cfg->cache_shm_size_max,
-			NULL, s->process->pool);
+	apr_status_t rv = apr_shm_create(&context->shm, size, NULL,
+			s->process->pool);
 	if (rv != APR_SUCCESS) {
 		oidc_serror(s, "apr_shm_create failed to create shared memory segment");
 		return HTTP_INTERNAL_SERVER_ERROR;
 	}
 
 	/* initialize the whole segment to '/0' */
-	int i;
-	oidc_cache_shm_entry_t *t = apr_shm_baseaddr_get(context->shm);
-	for (i = 0; i < cfg->cache_shm_size_max;
-			i++, OIDC_CACHE_SHM_ADD_OFFSET(t, cfg->cache_shm_entry_size_max)) {
-		t->section_key[0] = '\0';
-		t->access = 0;
+	memset(apr_shm_baseaddr_get(context->shm), 0, OIDC_CACHE_SHM_HEADER_SIZE);
+	for (i = 0; i < context->n_classes; i++) {
+		oidc_cache_shm_slab_class_t *cls = &context->classes[i];
+		oidc_cache_shm_entry_t *t =
+				(oidc_cache_shm_entry_t *) ((uint8_t *) apr_shm_baseaddr_get(
+						context->shm) + cls->offset);
+		for (j = 0; j < cls->stripe_size * OIDC_CACHE_SHM_STRIPES;
+				j++, OIDC_CACHE_SHM_ADD_OFFSET(t, cls->entry_size)) {
+			t->data[0] = '\0';
+			t->hash = 0;
+			t->key_len = 0;
+			t->access = 0;
+		}
 	}
 
-	if (oidc_cache_mutex_post_config(s, context->mutex, "shm") == FALSE)
-		return HTTP_INTERNAL_SERVER_ERROR;
+	for (i = 0; i < OIDC_CACHE_SHM_STRIPES; i++) {
+		if (oidc_cache_mutex_post_config(s, context->mutex[i],
+				apr_psprintf(s->process->pool, "shm-%d", i)) == FALSE)
+			return HTTP_INTERNAL_SERVER_ERROR;
+	}
 
 	oidc_sdebug(s,
-			"initialized shared memory with a cache size (# entries) of: %d, and a max (single) entry size of: %d",
-			cfg->cache_shm_size_max, cfg->cache_shm_entry_size_max);
+			"initialized shared memory with a cache size (# entries) of: %d, and a max (single) entry size of: %d, in %d slab class(es) using %" APR_SIZE_T_FMT " bytes",
+			cfg->cache_shm_size_max, cfg->cache_shm_entry_size_max,
+			context->n_classes, size);
 
 	return OK;
 }
@@ -143,11 +353,16 @@ int oidc_cache_shm_child_init(apr_pool_t *p, server_rec *s) {
 	oidc_cfg *cfg = ap_get_module_config(s->module_config,
 			&auth_openidc_module);
 	oidc_cache_cfg_shm_t *context = (oidc_cache_cfg_shm_t *) cfg->cache_cfg;
+	apr_status_t rv = APR_SUCCESS;
+	int i;
 
 	context->is_parent = FALSE;
 
-	/* initialize the lock for the child process */
-	return oidc_cache_mutex_child_init(p, s, context->mutex);
+	/* initialize the locks for the child process */
+	for (i = 0; (i < OIDC_CACHE_SHM_STRIPES) && (rv == APR_SUCCESS); i++)
+		rv = oidc_cache_mutex_child_init(p, s, context->mutex[i]);
+
+	return rv;
 }
 
 /*
@@ -169,6 +384,146 @@ static char *oidc_cache_shm_get_key(request_rec *r, const char *section,
 	return section_key;
 }
 
+/*
+ * record the probe length of a lookup in the statistics
+ */
+static void oidc_cache_shm_stats_probe(oidc_cache_shm_stats_t *stats,
+		int probes, int collisions) {
+	stats->probes += probes;
+	stats->collisions += collisions;
+	if (probes > stats->max_probe)
+		stats->max_probe = probes;
+}
+
+/*
+ * mark the start of a modification of a stripe by a writer that holds its lock
+ */
+static void oidc_cache_shm_write_begin(oidc_cache_shm_stripe_t *stripe) {
+	stripe->seq++;
+	OIDC_CACHE_SHM_BARRIER();
+}
+
+/*
+ * mark the end of a modification of a stripe by a writer that holds its lock
+ */
+static void oidc_cache_shm_write_end(oidc_cache_shm_stripe_t *stripe) {
+	OIDC_CACHE_SHM_BARRIER();
+	stripe->seq++;
+}
+
+/*
+ * check if a slot holds the specified key; when not holding the stripe lock
+ * the slot may change underneath us, so the comparison must be bounded
+ */
+static apr_byte_t oidc_cache_shm_entry_match(oidc_cache_shm_entry_t *t,
+		apr_uint32_t hash, const char *section_key, apr_size_t key_len) {
+	return ((t->data[0] != '\0') && (t->hash == hash) && (t->key_len == key_len)
+			&& (memcmp(t->data, section_key, key_len) == 0));
+}
+
+/*
+ * free a slot, administrating the entry count of its section
+ */
+static void oidc_cache_shm_entry_clear(oidc_cache_shm_stripe_t *stripe,
+		oidc_cache_shm_entry_t *t) {
+	int idx;
+	if (t->data[0] == '\0')
+		return;
+	idx = oidc_cache_shm_section_index(t->data[0]);
+	if (idx >= 0)
+		stripe->count[idx]--;
+	t->data[0] = '\0';
+	t->key_len = 0;
+	t->access = 0;
+}
+
+/*
+ * fill out a slot with the provided data, administrating the entry count of its section
+ */
+static void oidc_cache_shm_entry_fill(oidc_cache_shm_stripe_t *stripe,
+		oidc_cache_shm_entry_t *t, apr_uint32_t hash, const char *section_key,
+		apr_size_t key_len, const char *value, apr_size_t value_len,
+		apr_time_t expiry, apr_time_t current_time) {
+	int idx;
+	oidc_cache_shm_entry_clear(stripe, t);
+	memcpy(t->data + key_len + 1, value, value_len + 1);
+	memcpy(t->data, section_key, key_len + 1);
+	t->hash = hash;
+	t->key_len = key_len;
+	t->expires = expiry;
+	t->access = current_time;
+	idx = oidc_cache_shm_section_index(section_key[0]);
+	if (idx >= 0)
+		stripe->count[idx]++;
+}
+
+/*
+ * look for a key in the bucket of a slab class; when not holding the stripe lock
+ * the contents of the bucket may change underneath us, so all reads are bounded and
+ * the result must be validated against the stripe's sequence counter by the caller
+ */
+static oidc_cache_shm_entry_t *oidc_cache_shm_bucket_read(request_rec *r,
+		oidc_cache_cfg_shm_t *context, oidc_cache_shm_slab_class_t *cls,
+		apr_uint32_t hash, const char *section_key, apr_size_t key_len,
+		const char **value, int *probes, int *collisions) {
+
+	apr_size_t max = cls->entry_size - sizeof(oidc_cache_shm_entry_t);
+	const char *end = NULL;
+	int i, n;
+
+	oidc_cache_shm_entry_t *t = oidc_cache_shm_bucket(context, cls, hash, &n);
+
+	for (i = 0; i < n; i++, OIDC_CACHE_SHM_ADD_OFFSET(t, cls->entry_size)) {
+
+		if (t->data[0] == '\0')
+			continue;
+
+		(*probes)++;
+
+		if (oidc_cache_shm_entry_match(t, hash, section_key, key_len) == FALSE) {
+			(*collisions)++;
+			continue;
+		}
+
+		/* found a match, check if it has expired */
+		if (t->expires <= apr_time_now())
+			return NULL;
+
+		/* a value without a terminating '\0' means that it is being overwritten */
+		end = memchr(t->data + key_len + 1, '\0', max - key_len - 1);
+		if (end == NULL)
+			return NULL;
+
+		*value = apr_pstrmemdup(r->pool, t->data + key_len + 1,
+				end - (t->data + key_len + 1));
+
+		return t;
+	}
+
+	return NULL;
+}
+
+/*
+ * look for a key in all slab classes
+ */
+static oidc_cache_shm_entry_t *oidc_cache_shm_read(request_rec *r,
+		oidc_cache_cfg_shm_t *context, apr_uint32_t hash,
+		const char *section_key, apr_size_t key_len, const char **value,
+		int *probes, int *collisions) {
+	oidc_cache_shm_entry_t *match = NULL;
+	int c;
+
+	*value = NULL;
+	*probes = 0;
+	*collisions = 0;
+
+	for (c = 0; (c < context->n_classes) && (match == NULL); c++)
+		match = oidc_cache_shm_bucket_read(r, context, &context->classes[c],
+				hash, section_key, key_len, value, probes, collisions);
+
+	return match;
+}
+
 /*
  * get a value from the shared memory cache
  */
@@ -179,49 +534,361 @@ static apr_byte_t oidc_cache_shm_get(request_rec *r, const char *section,
 			&auth_openidc_module);
 	oidc_cache_cfg_shm_t *context = (oidc_cache_cfg_shm_t *) cfg->cache_cfg;
 
-	int i;
+	int i, s, probes = 0, collisions = 0;
+	apr_uint32_t seq;
+	apr_byte_t consistent = FALSE;
+	oidc_cache_shm_entry_t *match = NULL;
+	apr_time_t current_time;
+
 	const char *section_key = oidc_cache_shm_get_key(r, section, key);
 	if (section_key == NULL)
 		return FALSE;
 
+	apr_size_t key_len = strlen(section_key);
+	apr_uint32_t hash = oidc_cache_shm_hash(section_key);
+
 	*value = NULL;
 
-	/* grab the global lock */
-	if (oidc_cache_mutex_lock(r->server, context->mutex) == FALSE)
-		return FALSE;
+	s = oidc_cache_shm_stripe_index(hash);
+	oidc_cache_shm_stripe_t *stripe = oidc_cache_shm_stripe(context, s);
 
-	/* get the pointer to the start of the shared memory block */
-	oidc_cache_shm_entry_t *t = apr_shm_baseaddr_get(context->shm);
+	/* optimistically read without locking, retrying when a writer got in the way */
+	for (i = 0; i < OIDC_CACHE_SHM_READ_RETRIES; i++) {
+		seq = stripe->seq;
+		OIDC_CACHE_SHM_BARRIER();
+		if (seq & 1)
+			continue;
+		match = oidc_cache_shm_read(r, context, hash, section_key, key_len,
+				value, &probes, &collisions);
+		OIDC_CACHE_SHM_BARRIER();
+		if (stripe->seq == seq) {
+			consistent = TRUE;
+			break;
+		}
+	}
 
-	/* loop over the block, looking for the key */
-	for (i = 0; i < cfg->cache_shm_size_max;
-			i++, OIDC_CACHE_SHM_ADD_OFFSET(t, cfg->cache_shm_entry_size_max)) {
-		const char *tablekey = t->section_key;
+	/* fall back to reading under the stripe lock so we don't starve on a busy stripe */
+	if (consistent == FALSE) {
+		if (oidc_cache_mutex_lock(r->server, context->mutex[s]) == FALSE)
+			return FALSE;
+		match = oidc_cache_shm_read(r, context, hash, section_key, key_len,
+				value, &probes, &collisions);
+		oidc_cache_mutex_unlock(r->server, context->mutex[s]);
+	}
 
-		if ((tablekey != NULL) && (apr_strnatcmp(tablekey, section_key) == 0)) {
+	/*
+	 * update the access timestamp without the lock; a racing writer may overwrite
+	 * it in which case the LRU administration is slightly off which is fine
+	 */
+	if (match != NULL) {
+		current_time = apr_time_now();
+		if (current_time - match->access > OIDC_CACHE_SHM_ACCESS_GRANULARITY)
+			match->access = current_time;
+		stripe->stats.hits++;
+	}
 
-			/* found a match, check if it has expired */
-			if (t->expires > apr_time_now()) {
+	stripe->stats.lookups++;
+	oidc_cache_shm_stats_probe(&stripe->stats, probes, collisions);
 
-				/* update access timestamp */
-				t->access = apr_time_now();
-				*value = t->value;
+	return TRUE;
+}
 
-			} else {
+/*
+ * get the total number of entries stored for a section, over all stripes
+ */
+static int oidc_cache_shm_section_count(oidc_cache_cfg_shm_t *context,
+		int idx) {
+	int i, count = 0;
+	for (i = 0; i < OIDC_CACHE_SHM_STRIPES; i++)
+		count += oidc_cache_shm_stripe(context, i)->count[idx];
+	return count;
+}
 
-				/* clear the expired entry */
-				t->section_key[0] = '\0';
-				t->access = 0;
+/* a value that is about to be stored in the shared memory cache */
+typedef struct oidc_cache_shm_item_t {
+	const char *section;
+	const char *section_key;
+	apr_size_t key_len;
+	apr_uint32_t hash;
+	const char *value;
+	apr_size_t value_len;
+	apr_time_t expiry;
+	/* index of the slab class to store the value in, -1 when removing it */
+	int target;
+	/* index of the stripe that the key maps to */
+	int stripe;
+} oidc_cache_shm_item_t;
 
+/*
+ * prepare storing a value: compute the hash of its name and find the smallest slab class that can hold it
+ */
+static apr_byte_t oidc_cache_shm_item_prepare(request_rec *r,
+		oidc_cache_cfg_shm_t *context, const char *section, const char *key,
+		const char *value, apr_time_t expiry, oidc_cache_shm_item_t *item) {
+	int c;
+
+	item->section = section;
+	item->section_key = oidc_cache_shm_get_key(r, section, key);
+	if (item->section_key == NULL)
+		return FALSE;
+
+	item->key_len = strlen(item->section_key);
+	item->hash = oidc_cache_shm_hash(item->section_key);
+	item->value = value;
+	item->value_len = 0;
+	item->expiry = expiry;
+	item->target = -1;
+	item->stripe = oidc_cache_shm_stripe_index(item->hash);
+
+	/* find the smallest slab class that can hold the value */
+	if (value != NULL) {
+		item->value_len = strlen(value);
+		for (c = 0; c < context->n_classes; c++) {
+			if (sizeof(oidc_cache_shm_entry_t) + item->key_len + 1
+					+ item->value_len + 1 <= context->classes[c].entry_size) {
+				item->target = c;
+				break;
 			}
+		}
+		if (item->target == -1) {
+			oidc_error(r,
+					"could not store value since value size is too large (%llu > %lu); consider increasing " OIDCCacheShmEntrySizeMax "",
+					(unsigned long long )item->value_len,
+					(unsigned long )(context->classes[context->n_classes - 1].entry_size
+							- sizeof(oidc_cache_shm_entry_t) - item->key_len - 2));
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* the result of scanning the bucket that a key maps to in a slab class */
+typedef struct oidc_cache_shm_slots_t {
+	/* the slot holding the key */
+	oidc_cache_shm_entry_t *match;
+	/* a free or expired slot */
+	oidc_cache_shm_entry_t *free;
+	/* the least recently used slot */
+	oidc_cache_shm_entry_t *lru;
+	/* the least recently used slot of the same section */
+	oidc_cache_shm_entry_t *lru_section;
+} oidc_cache_shm_slots_t;
+
+/*
+ * scan the bucket that a key maps to in a slab class for the slots that can hold it
+ */
+static void oidc_cache_shm_bucket_scan(oidc_cache_cfg_shm_t *context,
+		oidc_cache_shm_slab_class_t *cls, const oidc_cache_shm_item_t *item,
+		apr_time_t current_time, oidc_cache_shm_slots_t *slots, int *probes,
+		int *collisions) {
+	oidc_cache_shm_entry_t *t;
+	int i, n;
+
+	memset(slots, 0, sizeof(oidc_cache_shm_slots_t));
+
+	t = oidc_cache_shm_bucket(context, cls, item->hash, &n);
+	for (i = 0; i < n; i++, OIDC_CACHE_SHM_ADD_OFFSET(t, cls->entry_size)) {
+
+		(*probes)++;
+
+		/* see if this slot is free */
+		if (t->data[0] == '\0') {
+			if (slots->free == NULL)
+				slots->free = t;
+			continue;
+		}
 
-			/* we safely can break now since we would not have found an expired match twice */
+		/* see if a value already exists for this key */
+		if (oidc_cache_shm_entry_match(t, item->hash, item->section_key,
+				item->key_len)) {
+			slots->match = t;
 			break;
 		}
+
+		(*collisions)++;
+
+		/* see if this slot has expired */
+		if (t->expires <= current_time) {
+			if (slots->free == NULL)
+				slots->free = t;
+			continue;
+		}
+
+		/* keep track of the least recently used entry of the same section for quota enforcement */
+		if ((t->data[0] == item->section_key[0])
+				&& ((slots->lru_section == NULL)
+						|| (t->access < slots->lru_section->access)))
+			slots->lru_section = t;
+
+		/* see if this slot was less recently used than the current pointer */
+		if ((slots->lru == NULL) || (t->access < slots->lru->access))
+			slots->lru = t;
+	}
+}
+
+/*
+ * find an existing entry for a key in the slab classes other than the one it is going to be stored in
+ */
+static oidc_cache_shm_entry_t *oidc_cache_shm_item_other(
+		oidc_cache_cfg_shm_t *context, const oidc_cache_shm_item_t *item) {
+	oidc_cache_shm_slab_class_t *cls = NULL;
+	oidc_cache_shm_entry_t *t;
+	int i, c, n;
+
+	for (c = 0; c < context->n_classes; c++) {
+		if (c == item->target)
+			continue;
+		cls = &context->classes[c];
+		t = oidc_cache_shm_bucket(context, cls, item->hash, &n);
+		for (i = 0; i < n; i++, OIDC_CACHE_SHM_ADD_OFFSET(t, cls->entry_size))
+			if (oidc_cache_shm_entry_match(t, item->hash, item->section_key,
+					item->key_len))
+				return t;
+	}
+
+	return NULL;
+}
+
+/*
+ * free the expired entries of a stripe, so they don't count towards the quota of their section anymore,
+ * and return the least recently used (live) entry of the specified section in that stripe
+ */
+static oidc_cache_shm_entry_t *oidc_cache_shm_stripe_reclaim(
+		oidc_cache_cfg_shm_t *context, int s, char section,
+		apr_time_t current_time) {
+	oidc_cache_shm_stripe_t *stripe = oidc_cache_shm_stripe(context, s);
+	oidc_cache_shm_slab_class_t *cls = NULL;
+	oidc_cache_shm_entry_t *t, *lru = NULL;
+	int i, c;
+
+	for (c = 0; c < context->n_classes; c++) {
+		cls = &context->classes[c];
+		t = (oidc_cache_shm_entry_t *) ((uint8_t *) apr_shm_baseaddr_get(
+				context->shm) + cls->offset);
+		OIDC_CACHE_SHM_ADD_OFFSET(t,
+				(apr_size_t ) s * cls->stripe_size * cls->entry_size);
+		for (i = 0; i < cls->stripe_size;
+				i++, OIDC_CACHE_SHM_ADD_OFFSET(t, cls->entry_size)) {
+			if (t->data[0] == '\0')
+				continue;
+			if (t->expires <= current_time) {
+				oidc_cache_shm_entry_clear(stripe, t);
+				continue;
+			}
+			if ((t->data[0] == section)
+					&& ((lru == NULL) || (t->access < lru->access)))
+				lru = t;
+		}
+	}
+
+	return lru;
+}
+
+/*
+ * return whether a section has reached its quota
+ */
+static apr_byte_t oidc_cache_shm_quota_reached(oidc_cache_cfg_shm_t *context,
+		int idx) {
+	return ((idx >= 0) && (context->quota[idx] > 0)
+			&& (oidc_cache_shm_section_count(context, idx)
+					>= context->quota[idx]));
+}
+
+/*
+ * store a prepared value; the caller must hold the lock of the stripe that it maps to
+ * and have marked the start of the modification of the stripe
+ */
+static apr_byte_t oidc_cache_shm_item_store(request_rec *r, oidc_cfg *cfg,
+		oidc_cache_cfg_shm_t *context, const oidc_cache_shm_item_t *item) {
+
+	oidc_cache_shm_entry_t *t, *other, *victim;
+	oidc_cache_shm_stripe_t *stripe = oidc_cache_shm_stripe(context,
+			item->stripe);
+	oidc_cache_shm_slab_class_t *cls = NULL;
+	oidc_cache_shm_slots_t slots;
+	apr_time_t current_time;
+	int idx, probes = 0, collisions = 0;
+	apr_time_t age;
+
+	idx = oidc_cache_shm_section_index(item->section_key[0]);
+
+	/* get the current time */
+	current_time = apr_time_now();
+
+	/* an existing entry for this key in another slab class is only removed once the new value has been stored */
+	other = oidc_cache_shm_item_other(context, item);
+
+	if (item->target == -1) {
+		if (other != NULL)
+			oidc_cache_shm_entry_clear(stripe, other);
+		return TRUE;
+	}
+
+	/* loop over the bucket in the target slab class, looking for the key */
+	cls = &context->classes[item->target];
+	oidc_cache_shm_bucket_scan(context, cls, item, current_time, &slots,
+			&probes, &collisions);
+
+	t = NULL;
+
+	/* a new entry for a section that is at its quota must make room by replacing an entry of the same section */
+	if ((slots.match == NULL) && (other == NULL)
+			&& (oidc_cache_shm_quota_reached(context, idx))) {
+
+		/* expired entries don't count towards the quota, so reclaim those in this stripe first */
+		victim = oidc_cache_shm_stripe_reclaim(context, item->stripe,
+				item->section_key[0], current_time);
+		oidc_cache_shm_bucket_scan(context, cls, item, current_time, &slots,
+				&probes, &collisions);
+
+		if (oidc_cache_shm_quota_reached(context, idx)) {
+			if (slots.lru_section != NULL) {
+				/* prefer replacing an entry of the section in the target bucket */
+				t = slots.lru_section;
+			} else if (slots.free == NULL) {
+				/* the target bucket is full: replacing its least recently used entry is the only eviction */
+				t = slots.lru;
+			} else if (victim != NULL) {
+				/* otherwise evict the least recently used entry of the section in this stripe and use the free slot */
+				oidc_cache_shm_entry_clear(stripe, victim);
+				t = slots.free;
+			} else {
+				oidc_debug(r,
+						"quota (%d) for section \"%s\" has been reached but this stripe holds no entries of it",
+						context->quota[idx], item->section);
+			}
+			if (t != NULL)
+				stripe->stats.evictions++;
+		}
 	}
 
-	/* release the global lock */
-	oidc_cache_mutex_unlock(r->server, context->mutex);
+	if (t == NULL) {
+
+		/* if we have no free slots, issue a warning about the LRU entry */
+		if ((slots.match == NULL) && (slots.free == NULL)) {
+			stripe->stats.evictions++;
+			age = (current_time - slots.lru->access) / 1000000;
+			if (age < 3600) {
+				oidc_warn(r,
+						"dropping LRU entry with age = %" APR_TIME_T_FMT "s, which is less than one hour; consider increasing the shared memory caching space (which is %d now) with the (global) " OIDCCacheShmMax " or " OIDCCacheShmSlabs " setting.",
+						age, cfg->cache_shm_size_max);
+			}
+		}
+
+		/* pick the best slot: choose one with a matching key over a free slot, over a least-recently-used one */
+		t = slots.match ? slots.match : (slots.free ? slots.free : slots.lru);
+	}
+
+	oidc_cache_shm_stats_probe(&stripe->stats, probes, collisions);
+
+	oidc_cache_shm_entry_fill(stripe, t, item->hash, item->section_key,
+			item->key_len, item->value, item->value_len, item->expiry,
+			current_time);
+
+	/* the value now lives in the target slab class */
+	if (other != NULL)
+		oidc_cache_shm_entry_clear(stripe, other);
 
 	return TRUE;
 }
@@ -235,105 +902,225 @@ static apr_byte_t oidc_cache_shm_set(request_rec *r, const char *section,
 	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
 			&auth_openidc_module);
 	oidc_cache_cfg_shm_t *context = (oidc_cache_cfg_shm_t *) cfg->cache_cfg;
+	oidc_cache_shm_stripe_t *stripe;
+	oidc_cache_shm_item_t item;
+	apr_byte_t rc = TRUE;
 
-	oidc_cache_shm_entry_t *match, *free, *lru;
-	oidc_cache_shm_entry_t *t;
-	apr_time_t current_time;
-	int i;
-	apr_time_t age;
-
-	const char *section_key = oidc_cache_shm_get_key(r, section, key);
-	if (section_key == NULL)
+	if (oidc_cache_shm_item_prepare(r, context, section, key, value, expiry,
+			&item) == FALSE)
 		return FALSE;
 
-	/* check that the passed in value is valid */
-	if ((value != NULL)
-			&& (strlen(value)
-					> (cfg->cache_shm_entry_size_max
-							- sizeof(oidc_cache_shm_entry_t)))) {
-		oidc_error(r,
-				"could not store value since value size is too large (%llu > %lu); consider increasing " OIDCCacheShmEntrySizeMax "",
-				(unsigned long long )strlen(value),
-				(unsigned long )(cfg->cache_shm_entry_size_max
-						- sizeof(oidc_cache_shm_entry_t)));
-		return FALSE;
-	}
+	stripe = oidc_cache_shm_stripe(context, item.stripe);
 
-	/* grab the global lock */
-	if (oidc_cache_mutex_lock(r->server, context->mutex) == FALSE)
+	/* grab the lock of the stripe that the key belongs to */
+	if (oidc_cache_mutex_lock(r->server, context->mutex[item.stripe]) == FALSE)
 		return FALSE;
 
-	/* get a pointer to the shared memory block */
-	t = apr_shm_baseaddr_get(context->shm);
+	oidc_cache_shm_write_begin(stripe);
 
-	/* get the current time */
-	current_time = apr_time_now();
+	rc = oidc_cache_shm_item_store(r, cfg, context, &item);
 
-	/* loop over the block, looking for the key */
-	match = NULL;
-	free = NULL;
-	lru = t;
-	for (i = 0; i < cfg->cache_shm_size_max;
-			i++, OIDC_CACHE_SHM_ADD_OFFSET(t, cfg->cache_shm_entry_size_max)) {
+	oidc_cache_shm_write_end(stripe);
 
-		/* see if this slot is free */
-		if (t->section_key[0] == '\0') {
-			if (free == NULL)
-				free = t;
-			continue;
-		}
+	/* release the stripe lock */
+	oidc_cache_mutex_unlock(r->server, context->mutex[item.stripe]);
 
-		/* see if a value already exists for this key */
-		if (apr_strnatcmp(t->section_key, section_key) == 0) {
-			match = t;
-			break;
+	return rc;
+}
+
+/*
+ * store a number of values in the shared memory cache, taking the lock of each stripe involved only once
+ */
+static apr_byte_t oidc_cache_shm_set_multi(request_rec *r,
+		const oidc_cache_entry_t *entries, int n) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_shm_t *context = (oidc_cache_cfg_shm_t *) cfg->cache_cfg;
+	oidc_cache_shm_stripe_t *stripe;
+	oidc_cache_shm_item_t *items = apr_pcalloc(r->pool,
+			n * sizeof(oidc_cache_shm_item_t));
+	apr_byte_t *done = apr_pcalloc(r->pool, n);
+	apr_byte_t rc = TRUE;
+	int i, j, s;
+
+	for (i = 0; i < n; i++) {
+		if (oidc_cache_shm_item_prepare(r, context, entries[i].section,
+				entries[i].key, entries[i].value, entries[i].expiry, &items[i])
+				== FALSE) {
+			done[i] = TRUE;
+			rc = FALSE;
 		}
+	}
 
-		/* see if this slot has expired */
-		if (t->expires <= current_time) {
-			if (free == NULL)
-				free = t;
+	for (i = 0; i < n; i++) {
+
+		if (done[i] == TRUE)
 			continue;
-		}
 
-		/* see if this slot was less recently used than the current pointer */
-		if (t->access < lru->access) {
-			lru = t;
+		s = items[i].stripe;
+		stripe = oidc_cache_shm_stripe(context, s);
+
+		if (oidc_cache_mutex_lock(r->server, context->mutex[s]) == FALSE)
+			return FALSE;
+
+		oidc_cache_shm_write_begin(stripe);
+
+		/* store all values that map to this stripe */
+		for (j = i; j < n; j++) {
+			if ((done[j] == TRUE) || (items[j].stripe != s))
+				continue;
+			if (oidc_cache_shm_item_store(r, cfg, context, &items[j]) == FALSE)
+				rc = FALSE;
+			done[j] = TRUE;
 		}
 
+		oidc_cache_shm_write_end(stripe);
+
+		oidc_cache_mutex_unlock(r->server, context->mutex[s]);
 	}
 
-	/* if we have no free slots, issue a warning about the LRU entry */
-	if (match == NULL && free == NULL) {
-		age = (current_time - lru->access) / 1000000;
-		if (age < 3600) {
-			oidc_warn(r,
-					"dropping LRU entry with age = %" APR_TIME_T_FMT "s, which is less than one hour; consider increasing the shared memory caching space (which is %d now) with the (global) " OIDCCacheShmMax " setting.",
-					age, cfg->cache_shm_size_max);
+	return rc;
+}
+
+/*
+ * update the expiry of an existing, non-expired entry in the shared memory cache
+ */
+static apr_byte_t oidc_cache_shm_touch(request_rec *r, const char *section,
+		const char *key, apr_time_t expiry) {
+
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_shm_t *context = (oidc_cache_cfg_shm_t *) cfg->cache_cfg;
+	oidc_cache_shm_slab_class_t *cls = NULL;
+	oidc_cache_shm_entry_t *t = NULL;
+	apr_byte_t rc = FALSE;
+	int i, c, n, s;
+
+	const char *section_key = oidc_cache_shm_get_key(r, section, key);
+	if (section_key == NULL)
+		return FALSE;
+
+	apr_size_t key_len = strlen(section_key);
+	apr_uint32_t hash = oidc_cache_shm_hash(section_key);
+
+	s = oidc_cache_shm_stripe_index(hash);
+	oidc_cache_shm_stripe_t *stripe = oidc_cache_shm_stripe(context, s);
+
+	if (oidc_cache_mutex_lock(r->server, context->mutex[s]) == FALSE)
+		return FALSE;
+
+	oidc_cache_shm_write_begin(stripe);
+
+	for (c = 0; (c < context->n_classes) && (rc == FALSE); c++) {
+		cls = &context->classes[c];
+		t = oidc_cache_shm_bucket(context, cls, hash, &n);
+		for (i = 0; i < n; i++, OIDC_CACHE_SHM_ADD_OFFSET(t, cls->entry_size)) {
+			if (oidc_cache_shm_entry_match(t, hash, section_key, key_len)) {
+				if (t->expires > apr_time_now()) {
+					t->expires = expiry;
+					rc = TRUE;
+				}
+				break;
+			}
 		}
 	}
 
-	/* pick the best slot: choose one with a matching key over a free slot, over a least-recently-used one */
-	t = match ? match : (free ? free : lru);
+	oidc_cache_shm_write_end(stripe);
 
-	/* see if we need to clear or set the value */
-	if (value != NULL) {
+	oidc_cache_mutex_unlock(r->server, context->mutex[s]);
+
+	return rc;
+}
 
-		/* fill out the entry with the provided data */
-		strcpy(t->section_key, section_key);
-		strcpy(t->value, value);
-		t->expires = expiry;
-		t->access = current_time;
+/*
+ * update indexes in the shared memory cache; every index is stored as a regular value
+ * that is read and rewritten under the lock of its stripe so concurrent updates don't get lost
+ */
+static apr_byte_t oidc_cache_shm_index_update(request_rec *r,
+		const oidc_cache_entry_t *entries, int n) {
 
-	} else {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_shm_t *context = (oidc_cache_cfg_shm_t *) cfg->cache_cfg;
+	oidc_cache_shm_stripe_t *stripe = NULL;
+	oidc_cache_shm_item_t item;
+	const char *section_key = NULL, *value = NULL;
+	char *updated = NULL;
+	apr_time_t index_expiry = 0;
+	apr_uint32_t hash;
+	apr_byte_t rc = TRUE;
+	int i, s, probes = 0, collisions = 0;
+
+	for (i = 0; i < n; i++) {
+
+		section_key = oidc_cache_shm_get_key(r, entries[i].section,
+				entries[i].key);
+		if (section_key == NULL) {
+			rc = FALSE;
+			continue;
+		}
+		hash = oidc_cache_shm_hash(section_key);
+		s = oidc_cache_shm_stripe_index(hash);
+		stripe = oidc_cache_shm_stripe(context, s);
+
+		if (oidc_cache_mutex_lock(r->server, context->mutex[s]) == FALSE)
+			return FALSE;
+
+		updated = NULL;
+		index_expiry = 0;
+		if (entries[i].value != NULL) {
+			oidc_cache_shm_read(r, context, hash, section_key,
+					strlen(section_key), &value, &probes, &collisions);
+			updated = oidc_cache_index_value_update(r->pool, value,
+					entries[i].value, entries[i].expiry, &index_expiry);
+		}
 
-		t->section_key[0] = '\0';
-		t->access = 0;
+		if (oidc_cache_shm_item_prepare(r, context, entries[i].section,
+				entries[i].key, updated, index_expiry, &item) == TRUE) {
+			oidc_cache_shm_write_begin(stripe);
+			if (oidc_cache_shm_item_store(r, cfg, context, &item) == FALSE)
+				rc = FALSE;
+			oidc_cache_shm_write_end(stripe);
+		} else {
+			rc = FALSE;
+		}
 
+		oidc_cache_mutex_unlock(r->server, context->mutex[s]);
 	}
 
-	/* release the global lock */
-	oidc_cache_mutex_unlock(r->server, context->mutex);
+	return rc;
+}
+
+/*
+ * return a snapshot of the hash index statistics of the shared memory cache, aggregated over all stripes
+ */
+apr_byte_t oidc_cache_shm_stats(server_rec *s, oidc_cache_shm_stats_t *stats) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
+			&auth_openidc_module);
+	oidc_cache_cfg_shm_t *context = (oidc_cache_cfg_shm_t *) cfg->cache_cfg;
+	oidc_cache_shm_stats_t *st = NULL;
+	int i;
+
+	if ((cfg->cache != &oidc_cache_shm) || (context == NULL)
+			|| (context->shm == NULL))
+		return FALSE;
+
+	memset(stats, 0, sizeof(oidc_cache_shm_stats_t));
+
+	for (i = 0; i < OIDC_CACHE_SHM_STRIPES; i++) {
+		if (oidc_cache_mutex_lock(s, context->mutex[i]) == FALSE)
+			return FALSE;
+		st = &oidc_cache_shm_stripe(context, i)->stats;
+		stats->lookups += st->lookups;
+		stats->hits += st->hits;
+		stats->probes += st->probes;
+		stats->collisions += st->collisions;
+		stats->evictions += st->evictions;
+		if (st->max_probe > stats->max_probe)
+			stats->max_probe = st->max_probe;
+		oidc_cache_mutex_unlock(s, context->mutex[i]);
+	}
 
 	return TRUE;
 }
@@ -342,26 +1129,34 @@ static int oidc_cache_shm_destroy(server_rec *s) {
 	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(s->module_config,
 			&auth_openidc_module);
 	oidc_cache_cfg_shm_t *context = (oidc_cache_cfg_shm_t *) cfg->cache_cfg;
+	oidc_cache_shm_stats_t stats;
 	apr_status_t rv = APR_SUCCESS;
+	int i;
 
 	if (context == NULL)
 		return rv;
 
 	if ((context->is_parent == TRUE) && (context->shm)) {
-		oidc_cache_mutex_lock(s, context->mutex);
-		if (*context->mutex->sema == 1) {
+		if (oidc_cache_shm_stats(s, &stats) == TRUE)
+			oidc_sdebug(s,
+					"shm cache stats: lookups=%" APR_UINT64_T_FMT ", hits=%" APR_UINT64_T_FMT ", probes=%" APR_UINT64_T_FMT ", max_probe=%" APR_UINT64_T_FMT ", collisions=%" APR_UINT64_T_FMT ", evictions=%" APR_UINT64_T_FMT,
+					stats.lookups, stats.hits, stats.probes, stats.max_probe,
+					stats.collisions, stats.evictions);
+		oidc_cache_mutex_lock(s, context->mutex[0]);
+		if (*context->mutex[0]->sema == 1) {
 			rv = apr_shm_destroy(context->shm);
 			oidc_sdebug(s, "apr_shm_destroy returned: %d", rv);
 		}
 		context->shm = NULL;
-		oidc_cache_mutex_unlock(s, context->mutex);
+		oidc_cache_mutex_unlock(s, context->mutex[0]);
 	}
 
-	if (context->mutex == NULL)
-		return rv;
-
-	oidc_cache_mutex_destroy(s, context->mutex);
-	context->mutex = NULL;
+	for (i = 0; i < OIDC_CACHE_SHM_STRIPES; i++) {
+		if (context->mutex[i] == NULL)
+			continue;
+		oidc_cache_mutex_destroy(s, context->mutex[i]);
+		context->mutex[i] = NULL;
+	}
 
 	return rv;
 }
@@ -373,5 +1168,10 @@ oidc_cache_t oidc_cache_shm = {
 		oidc_cache_shm_child_init,
 		oidc_cache_shm_get,
 		oidc_cache_shm_set,
-		oidc_cache_shm_destroy
+		oidc_cache_shm_destroy,
+		NULL,
+		oidc_cache_shm_set_multi,
+		oidc_cache_shm_touch,
+		oidc_cache_shm_index_update,
+		NULL
 };
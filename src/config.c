@@ -100,6 +100,10 @@
 #define OIDC_DEFAULT_HTTP_TIMEOUT_SHORT  5
 /* default session storage type */
 #define OIDC_DEFAULT_SESSION_TYPE OIDC_SESSION_TYPE_SERVER_CACHE
+/* default session state serialization format */
+#define OIDC_DEFAULT_SESSION_ENCODING OIDC_SESSION_ENCODING_JSON
+/* default minimum size for compression of cookie payloads and cache values; 0 means no compression */
+#define OIDC_DEFAULT_COMPRESS_MIN_SIZE 0
 /* default client-cookie chunking size */
 #define OIDC_DEFAULT_SESSION_CLIENT_COOKIE_CHUNK_SIZE 4000
 /* timeout in seconds after which state expires */
@@ -116,6 +120,12 @@
 #define OIDC_DEFAULT_RESPONSE_TYPE OIDC_PROTO_CODE
 /* default duration in seconds after which retrieved JWS should be refreshed */
 #define OIDC_DEFAULT_JWKS_REFRESH_INTERVAL 3600
+/* default duration in seconds for which locally verified JWT access tokens are cached: don't cache */
+#define OIDC_DEFAULT_OAUTH_VERIFY_CACHE_INTERVAL 0
+/* default duration in seconds for which an inactive introspection result is cached; 0 means not at all */
+#define OIDC_DEFAULT_OAUTH_INTROSPECTION_NEGATIVE_INTERVAL 0
+/* default time in milliseconds to wait for a concurrent introspection of the same token; 0 means don't wait */
+#define OIDC_DEFAULT_OAUTH_INTROSPECTION_COALESCE_TIMEOUT 0
 /* default max cache size for shm */
 #define OIDC_DEFAULT_CACHE_SHM_SIZE 500
 /* default max cache entry size for shm: # value + # key + # overhead */
@@ -126,6 +136,12 @@
 #define OIDC_DEFAULT_IDTOKEN_IAT_SLACK 600
 /* for file-based caching: clean interval in seconds */
 #define OIDC_DEFAULT_CACHE_FILE_CLEAN_INTERVAL 60
+/* for Redis caching: deployment mode */
+#define OIDC_DEFAULT_CACHE_REDIS_MODE OIDC_CACHE_REDIS_MODE_STANDALONE
+/* for Redis caching: connect timeout in seconds */
+#define OIDC_DEFAULT_CACHE_REDIS_CONNECT_TIMEOUT 5
+/* for Redis caching: I/O timeout on an established connection in seconds */
+#define OIDC_DEFAULT_CACHE_REDIS_TIMEOUT 5
 /* set httponly flag on cookies */
 #define OIDC_DEFAULT_COOKIE_HTTPONLY 1
 /* set Same-Site flag on cookies */
@@ -160,6 +176,10 @@
 #define OIDC_DEFAULT_UNAUTZ_ACTION OIDC_UNAUTZ_RETURN403
 /* defines for how long provider metadata will be cached */
 #define OIDC_DEFAULT_PROVIDER_METADATA_REFRESH_INTERVAL 0
+/* defines for how long expired metadata and JWKs may be served while they are being refreshed; 0 means never */
+#define OIDC_DEFAULT_METADATA_STALE_TTL 0
+/* defines how long before expiry metadata and JWKs are refreshed; 0 means on expiry */
+#define OIDC_DEFAULT_METADATA_REFRESH_AHEAD 0
 /* defines the default token binding policy for a provider */
 #define OIDC_DEFAULT_PROVIDER_TOKEN_BINDING_POLICY OIDC_TOKEN_BINDING_POLICY_OPTIONAL
 /* defines the default token binding policy for OAuth 2.0 access tokens */
@@ -239,6 +259,9 @@
 #define OIDCOAuthVerifyCertFiles               "OIDCOAuthVerifyCertFiles"
 #define OIDCOAuthVerifySharedKeys              "OIDCOAuthVerifySharedKeys"
 #define OIDCOAuthVerifyJwksUri                 "OIDCOAuthVerifyJwksUri"
+#define OIDCOAuthVerifyCacheInterval           "OIDCOAuthVerifyCacheInterval"
+#define OIDCOAuthTokenIntrospectionNegativeInterval "OIDCOAuthTokenIntrospectionNegativeInterval"
+#define OIDCOAuthTokenIntrospectionCoalesceTimeout  "OIDCOAuthTokenIntrospectionCoalesceTimeout"
 #define OIDCHTTPTimeoutLong                    "OIDCHTTPTimeoutLong"
 #define OIDCHTTPTimeoutShort                   "OIDCHTTPTimeoutShort"
 #define OIDCStateTimeout                       "OIDCStateTimeout"
@@ -246,13 +269,22 @@
 #define OIDCSessionInactivityTimeout           "OIDCSessionInactivityTimeout"
 #define OIDCMetadataDir                        "OIDCMetadataDir"
 #define OIDCSessionCacheFallbackToCookie       "OIDCSessionCacheFallbackToCookie"
+#define OIDCSessionEncoding                    "OIDCSessionEncoding"
+#define OIDCCompressMinSize                    "OIDCCompressMinSize"
 #define OIDCSessionCookieChunkSize             "OIDCSessionCookieChunkSize"
 #define OIDCScrubRequestHeaders                "OIDCScrubRequestHeaders"
 #define OIDCCacheType                          "OIDCCacheType"
 #define OIDCCacheEncrypt                       "OIDCCacheEncrypt"
 #define OIDCCacheDir                           "OIDCCacheDir"
 #define OIDCCacheFileCleanInterval             "OIDCCacheFileCleanInterval"
+#define OIDCCacheFileLevels                    "OIDCCacheFileLevels"
+#define OIDCCacheFileCleanMax                  "OIDCCacheFileCleanMax"
+#define OIDCCacheL1Max                         "OIDCCacheL1Max"
+#define OIDCCacheL1Section                     "OIDCCacheL1Section"
 #define OIDCRedisCachePassword                 "OIDCRedisCachePassword"
+#define OIDCRedisCacheMode                     "OIDCRedisCacheMode"
+#define OIDCRedisCacheConnectTimeout           "OIDCRedisCacheConnectTimeout"
+#define OIDCRedisCacheTimeout                  "OIDCRedisCacheTimeout"
 #define OIDCHTMLErrorTemplate                  "OIDCHTMLErrorTemplate"
 #define OIDCDiscoverURL                        "OIDCDiscoverURL"
 #define OIDCPassCookies                        "OIDCPassCookies"
@@ -269,8 +301,12 @@
 #define OIDCPassRefreshToken                   "OIDCPassRefreshToken"
 #define OIDCRequestObject                      "OIDCRequestObject"
 #define OIDCProviderMetadataRefreshInterval    "OIDCProviderMetadataRefreshInterval"
+#define OIDCMetadataStaleTTL                   "OIDCMetadataStaleTTL"
+#define OIDCMetadataRefreshAhead               "OIDCMetadataRefreshAhead"
+#define OIDCMetadataPrefetch                   "OIDCMetadataPrefetch"
 #define OIDCProviderAuthRequestMethod          "OIDCProviderAuthRequestMethod"
 #define OIDCBlackListedClaims                  "OIDCBlackListedClaims"
+#define OIDCPassClaimNames                     "OIDCPassClaimNames"
 #define OIDCOAuthServerMetadataURL             "OIDCOAuthServerMetadataURL"
 #define OIDCOAuthAccessTokenBindingPolicy      "OIDCOAuthAccessTokenBindingPolicy"
 #define OIDCRefreshAccessTokenBeforeExpiry     "OIDCRefreshAccessTokenBeforeExpiry"
@@ -492,6 +528,43 @@ static const char *oidc_set_session_type(cmd_parms *cmd, void *ptr,
 	return OIDC_CONFIG_DIR_RV(cmd, rv);
 }
 
+/*
+ * set the session state serialization format
+ */
+static const char *oidc_set_session_encoding(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_session_encoding(cmd->pool, arg,
+			&cfg->session_encoding);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the stale-while-revalidate or refresh-ahead time for metadata and JWKs
+ */
+static const char *oidc_set_metadata_refresh_time(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	int offset = (int) (long) cmd->info;
+	const char *rv = oidc_parse_metadata_refresh_time(cmd->pool, arg,
+			(int *) ((char *) cfg + offset));
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the minimum size of cookie payloads and cache values that get compressed
+ */
+static const char *oidc_set_compress_min_size(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_compress_min_size(cmd->pool, arg,
+			&cfg->compress_min_size);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
 /*
  * set the maximum size of a shared memory cache entry and enforces a minimum
  */
@@ -504,6 +577,128 @@ static const char *oidc_set_cache_shm_entry_size_max(cmd_parms *cmd, void *ptr,
 	return OIDC_CONFIG_DIR_RV(cmd, rv);
 }
 
+#ifdef USE_LIBHIREDIS
+/*
+ * set the Redis deployment mode
+ */
+static const char *oidc_set_cache_redis_mode(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_cache_redis_mode(cmd->pool, arg,
+			&cfg->cache_redis_mode);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the timeout for connecting to the Redis server
+ */
+static const char *oidc_set_cache_redis_connect_timeout(cmd_parms *cmd,
+		void *ptr, const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_cache_redis_timeout(cmd->pool, arg,
+			&cfg->cache_redis_connect_timeout);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the timeout for reading from/writing to the Redis server
+ */
+static const char *oidc_set_cache_redis_timeout(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_cache_redis_timeout(cmd->pool, arg,
+			&cfg->cache_redis_timeout);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+#endif
+
+/*
+ * add an additional slab class to the shared memory cache
+ */
+static const char *oidc_set_cache_shm_slabs(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_cache_shm_slab(cmd->pool, arg,
+			&cfg->cache_shm_slabs);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the maximum number of shared memory cache entries for a cache section
+ */
+static const char *oidc_set_cache_shm_section_quota(cmd_parms *cmd, void *ptr,
+		const char *arg1, const char *arg2) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_cache_shm_section_quota(cmd->pool, arg1, arg2,
+			&cfg->cache_shm_quota);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the number of levels of hashed subdirectories used by the file cache
+ */
+static const char *oidc_set_cache_file_levels(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_cache_file_levels(cmd->pool, arg,
+			&cfg->cache_file_levels);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the maximum number of file cache entries inspected in a single clean cycle
+ */
+static const char *oidc_set_cache_file_clean_max(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_cache_file_clean_max(cmd->pool, arg,
+			&cfg->cache_file_clean_max);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the maximum number of entries in the per-process L1 cache
+ */
+static const char *oidc_set_cache_l1_max(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_cache_l1_max(cmd->pool, arg,
+			&cfg->cache_l1_max);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the maximum number of IDs in the dedicated JTI/nonce replay cache
+ */
+static const char *oidc_set_replay_cache_entries(cmd_parms *cmd, void *ptr,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_replay_cache_entries(cmd->pool, arg,
+			&cfg->replay_cache_entries);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * keep the entries of a cache section in the per-process L1 cache for a maximum time
+ */
+static const char *oidc_set_cache_l1_section(cmd_parms *cmd, void *ptr,
+		const char *arg1, const char *arg2) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_cache_l1_section(cmd->pool, arg1, arg2,
+			&cfg->cache_l1_sections);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
 /*
  * set the cache type
  */
@@ -953,9 +1148,15 @@ static const char *oidc_set_remote_user_claim(cmd_parms *cmd, void *struct_ptr,
 	oidc_remote_user_claim_t *remote_user_claim =
 			(oidc_remote_user_claim_t *) ((char *) cfg + offset);
 
+	char *error_str = NULL;
+
 	remote_user_claim->claim_name = v1;
-	if (v2)
+	if (v2) {
 		remote_user_claim->reg_exp = v2;
+		remote_user_claim->preg = oidc_pcre_compile(cmd->pool, v2, &error_str);
+		if (remote_user_claim->preg == NULL)
+			return OIDC_CONFIG_DIR_RV(cmd, error_str);
+	}
 	if (v3)
 		remote_user_claim->replace = v3;
 
@@ -1019,6 +1220,42 @@ static const char *oidc_set_jwks_refresh_interval(cmd_parms *cmd,
 	return OIDC_CONFIG_DIR_RV(cmd, rv);
 }
 
+/*
+ * set the verified JWT access token cache interval
+ */
+static const char *oidc_set_oauth_verify_cache_interval(cmd_parms *cmd,
+		void *struct_ptr, const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_oauth_verify_cache_interval(cmd->pool, arg,
+			&cfg->oauth.verify_cache_interval);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the duration for which inactive introspection results are cached
+ */
+static const char *oidc_set_oauth_introspection_negative_interval(
+		cmd_parms *cmd, void *struct_ptr, const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_oauth_introspection_negative_interval(cmd->pool,
+			arg, &cfg->oauth.introspection_negative_interval);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
+/*
+ * set the time to wait for a concurrent introspection of the same access token
+ */
+static const char *oidc_set_oauth_introspection_coalesce_timeout(
+		cmd_parms *cmd, void *struct_ptr, const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	const char *rv = oidc_parse_oauth_introspection_coalesce_timeout(cmd->pool,
+			arg, &cfg->oauth.introspection_coalesce_timeout);
+	return OIDC_CONFIG_DIR_RV(cmd, rv);
+}
+
 /*
  * set the ID token "iat" slack
  */
@@ -1067,6 +1304,37 @@ static const char * oidc_set_filtered_claims(cmd_parms *cmd, void *m,
 	return NULL;
 }
 
+/*
+ * add a claim that is passed to the application, optionally as <claim>=<name>
+ */
+static const char * oidc_set_pass_claim_names(cmd_parms *cmd, void *m,
+		const char *arg) {
+	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
+			cmd->server->module_config, &auth_openidc_module);
+	char *claim = apr_pstrdup(cmd->pool, arg);
+	char *name = strchr(claim, '=');
+	const char *p = NULL;
+	if (name != NULL) {
+		*name = '\0';
+		name++;
+		/* the name is used as-is so it must be a valid HTTP header name */
+		for (p = name; *p != '\0'; p++) {
+			if ((*p < 32) || (*p == 127)
+					|| (strchr("()<>@,;:\\\"/[]?={} \t", *p) != NULL))
+				return OIDC_CONFIG_DIR_RV(cmd,
+						apr_psprintf(cmd->pool, "invalid header name: \"%s\"", name));
+		}
+	}
+	if ((*claim == '\0') || ((name != NULL) && (*name == '\0')))
+		return OIDC_CONFIG_DIR_RV(cmd,
+				apr_psprintf(cmd->pool, "invalid claim specification: \"%s\"", arg));
+	if (cfg->pass_claim_names == NULL)
+		cfg->pass_claim_names = apr_hash_make(cmd->pool);
+	apr_hash_set(cfg->pass_claim_names, claim, APR_HASH_KEY_STRING,
+			name ? name : "");
+	return NULL;
+}
+
 /*
  * set the token binding policy
  */
@@ -1167,7 +1435,7 @@ int oidc_cfg_delete_oldest_state_cookies(oidc_cfg *cfg) {
  * set the time in seconds that the access token needs to be valid for
  */
 static const char * oidc_set_refresh_access_token_before_expiry(cmd_parms *cmd,
-		void *m, const char *arg1, const char *arg2) {
+		void *m, const char *arg1, const char *arg2, const char *arg3) {
 	oidc_dir_cfg *dir_cfg = (oidc_dir_cfg *) m;
 	const char *rv1 = oidc_parse_refresh_access_token_before_expiry(cmd->pool,
 			arg1, &dir_cfg->refresh_access_token_before_expiry);
@@ -1175,11 +1443,18 @@ static const char * oidc_set_refresh_access_token_before_expiry(cmd_parms *cmd,
 		return apr_psprintf(cmd->pool, "Invalid value for directive '%s': %s",
 				cmd->directive->directive, rv1);
 
-	if (arg2) {
-		const char *rv2 = oidc_parse_logout_on_error_refresh_as(cmd->pool, arg2,
-				&dir_cfg->logout_on_error_refresh);
-		return OIDC_CONFIG_DIR_RV(cmd, rv2);
+	/* the "logout_on_error" and "async" options may be combined, in any order */
+	const char *options[] = { arg2, arg3 };
+	int i = 0, flag = 0, flags = 0;
+	for (i = 0; (i < 2) && (options[i] != NULL); i++) {
+		const char *rv2 = oidc_parse_logout_on_error_refresh_as(cmd->pool,
+				options[i], &flag);
+		if (rv2 != NULL)
+			return OIDC_CONFIG_DIR_RV(cmd, rv2);
+		flags |= flag;
 	}
+	if (arg2)
+		dir_cfg->logout_on_error_refresh = flags;
 
 	return NULL;
 }
@@ -1200,9 +1475,13 @@ static const char * oidc_set_redirect_urls_allowed(cmd_parms *cmd, void *m,
 		const char *arg) {
 	oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(
 			cmd->server->module_config, &auth_openidc_module);
+	char *error_str = NULL;
+	oidc_pcre_t *preg = oidc_pcre_compile(cmd->pool, arg, &error_str);
+	if (preg == NULL)
+		return OIDC_CONFIG_DIR_RV(cmd, error_str);
 	if (cfg->redirect_urls_allowed == NULL)
 		cfg->redirect_urls_allowed = apr_hash_make(cmd->pool);
-	apr_hash_set(cfg->redirect_urls_allowed, arg, APR_HASH_KEY_STRING, arg);
+	apr_hash_set(cfg->redirect_urls_allowed, arg, APR_HASH_KEY_STRING, preg);
 	return NULL;
 }
 
@@ -1321,11 +1600,17 @@ void *oidc_create_server_config(apr_pool_t *pool, server_rec *svr) {
 	c->oauth.remote_user_claim.claim_name =
 			OIDC_DEFAULT_OAUTH_CLAIM_REMOTE_USER;
 	c->oauth.remote_user_claim.reg_exp = NULL;
+	c->oauth.remote_user_claim.preg = NULL;
 	c->oauth.remote_user_claim.replace = NULL;
 
 	c->oauth.verify_jwks_uri = NULL;
 	c->oauth.verify_public_keys = NULL;
 	c->oauth.verify_shared_keys = NULL;
+	c->oauth.verify_cache_interval = OIDC_DEFAULT_OAUTH_VERIFY_CACHE_INTERVAL;
+	c->oauth.introspection_negative_interval =
+			OIDC_DEFAULT_OAUTH_INTROSPECTION_NEGATIVE_INTERVAL;
+	c->oauth.introspection_coalesce_timeout =
+			OIDC_DEFAULT_OAUTH_INTROSPECTION_COALESCE_TIMEOUT;
 
 	c->oauth.access_token_binding_policy =
 			OIDC_DEFAULT_OAUTH_ACCESS_TOKEN_BINDING_POLICY;
@@ -1336,19 +1621,34 @@ void *oidc_create_server_config(apr_pool_t *pool, server_rec *svr) {
 
 	c->cache_file_dir = NULL;
 	c->cache_file_clean_interval = OIDC_DEFAULT_CACHE_FILE_CLEAN_INTERVAL;
+	c->cache_file_levels = OIDC_CONFIG_POS_INT_UNSET;
+	c->cache_file_clean_max = OIDC_CONFIG_POS_INT_UNSET;
 #ifdef USE_MEMCACHE
 	c->cache_memcache_servers = NULL;
 #endif
 	c->cache_shm_size_max = OIDC_DEFAULT_CACHE_SHM_SIZE;
 	c->cache_shm_entry_size_max = OIDC_DEFAULT_CACHE_SHM_ENTRY_SIZE_MAX;
+	c->cache_shm_slabs = NULL;
+	c->cache_shm_quota = NULL;
+	c->cache_l1_max = OIDC_CONFIG_POS_INT_UNSET;
+	c->cache_l1_sections = NULL;
+	c->replay_cache_entries = OIDC_CONFIG_POS_INT_UNSET;
+	c->replay_cache_cfg = NULL;
+	c->metrics = OIDC_CONFIG_POS_INT_UNSET;
 #ifdef USE_LIBHIREDIS
 	c->cache_redis_server = NULL;
 	c->cache_redis_password = NULL;
+	c->cache_redis_mode = OIDC_DEFAULT_CACHE_REDIS_MODE;
+	c->cache_redis_sentinel_master = NULL;
+	c->cache_redis_connect_timeout = OIDC_DEFAULT_CACHE_REDIS_CONNECT_TIMEOUT;
+	c->cache_redis_timeout = OIDC_DEFAULT_CACHE_REDIS_TIMEOUT;
 #endif
 
 	c->metadata_dir = NULL;
 	c->session_type = OIDC_DEFAULT_SESSION_TYPE;
 	c->session_cache_fallback_to_cookie = OIDC_CONFIG_POS_INT_UNSET;
+	c->session_encoding = OIDC_DEFAULT_SESSION_ENCODING;
+	c->compress_min_size = OIDC_DEFAULT_COMPRESS_MIN_SIZE;
 	c->persistent_session_cookie = 0;
 	c->session_cookie_chunk_size =
 			OIDC_DEFAULT_SESSION_CLIENT_COOKIE_CHUNK_SIZE;
@@ -1365,6 +1665,7 @@ void *oidc_create_server_config(apr_pool_t *pool, server_rec *svr) {
 	c->claim_prefix = NULL;
 	c->remote_user_claim.claim_name = OIDC_DEFAULT_CLAIM_REMOTE_USER;
 	c->remote_user_claim.reg_exp = NULL;
+	c->remote_user_claim.preg = NULL;
 	c->remote_user_claim.replace = NULL;
 	c->pass_idtoken_as = OIDC_PASS_IDTOKEN_AS_CLAIMS;
 	c->pass_userinfo_as = OIDC_PASS_USERINFO_AS_CLAIMS;
@@ -1373,6 +1674,10 @@ void *oidc_create_server_config(apr_pool_t *pool, server_rec *svr) {
 
 	c->outgoing_proxy = NULL;
 	c->crypto_passphrase = NULL;
+	c->crypto_passphrase_jwk = NULL;
+	c->state_cookie_mac_key = NULL;
+	c->state_cookie_mac_key_len = 0;
+	c->cache_crypto = NULL;
 
 	c->error_template = NULL;
 
@@ -1382,6 +1687,9 @@ void *oidc_create_server_config(apr_pool_t *pool, server_rec *svr) {
 
 	c->provider_metadata_refresh_interval =
 			OIDC_DEFAULT_PROVIDER_METADATA_REFRESH_INTERVAL;
+	c->metadata_stale_ttl = OIDC_DEFAULT_METADATA_STALE_TTL;
+	c->metadata_refresh_ahead = OIDC_DEFAULT_METADATA_REFRESH_AHEAD;
+	c->metadata_prefetch = OIDC_CONFIG_POS_INT_UNSET;
 
 	c->provider.token_binding_policy =
 			OIDC_DEFAULT_PROVIDER_TOKEN_BINDING_POLICY;
@@ -1389,6 +1697,7 @@ void *oidc_create_server_config(apr_pool_t *pool, server_rec *svr) {
 	c->info_hook_data = NULL;
 	c->black_listed_claims = NULL;
 	c->white_listed_claims = NULL;
+	c->pass_claim_names = NULL;
 
 	c->provider.issuer_specific_redirect_uri =
 			OIDC_DEFAULT_PROVIDER_ISSUER_SPECIFIC_REDIRECT_URI;
@@ -1673,6 +1982,10 @@ void *oidc_merge_server_config(apr_pool_t *pool, void *BASE, void *ADD) {
 			add->oauth.remote_user_claim.reg_exp != NULL ?
 					add->oauth.remote_user_claim.reg_exp :
 					base->oauth.remote_user_claim.reg_exp;
+	c->oauth.remote_user_claim.preg =
+			add->oauth.remote_user_claim.reg_exp != NULL ?
+					add->oauth.remote_user_claim.preg :
+					base->oauth.remote_user_claim.preg;
 	c->oauth.remote_user_claim.replace =
 			add->oauth.remote_user_claim.replace != NULL ?
 					add->oauth.remote_user_claim.replace :
@@ -1689,6 +2002,21 @@ void *oidc_merge_server_config(apr_pool_t *pool, void *BASE, void *ADD) {
 			add->oauth.verify_shared_keys != NULL ?
 					add->oauth.verify_shared_keys :
 					base->oauth.verify_shared_keys;
+	c->oauth.verify_cache_interval =
+			add->oauth.verify_cache_interval
+			!= OIDC_DEFAULT_OAUTH_VERIFY_CACHE_INTERVAL ?
+					add->oauth.verify_cache_interval :
+					base->oauth.verify_cache_interval;
+	c->oauth.introspection_negative_interval =
+			add->oauth.introspection_negative_interval
+			!= OIDC_DEFAULT_OAUTH_INTROSPECTION_NEGATIVE_INTERVAL ?
+					add->oauth.introspection_negative_interval :
+					base->oauth.introspection_negative_interval;
+	c->oauth.introspection_coalesce_timeout =
+			add->oauth.introspection_coalesce_timeout
+			!= OIDC_DEFAULT_OAUTH_INTROSPECTION_COALESCE_TIMEOUT ?
+					add->oauth.introspection_coalesce_timeout :
+					base->oauth.introspection_coalesce_timeout;
 
 	c->oauth.access_token_binding_policy =
 			add->oauth.access_token_binding_policy
@@ -1739,6 +2067,12 @@ void *oidc_merge_server_config(apr_pool_t *pool, void *BASE, void *ADD) {
 			!= OIDC_DEFAULT_CACHE_FILE_CLEAN_INTERVAL ?
 					add->cache_file_clean_interval :
 					base->cache_file_clean_interval;
+	c->cache_file_levels =
+			add->cache_file_levels != OIDC_CONFIG_POS_INT_UNSET ?
+					add->cache_file_levels : base->cache_file_levels;
+	c->cache_file_clean_max =
+			add->cache_file_clean_max != OIDC_CONFIG_POS_INT_UNSET ?
+					add->cache_file_clean_max : base->cache_file_clean_max;
 
 #ifdef USE_MEMCACHE
 	c->cache_memcache_servers =
@@ -1753,6 +2087,25 @@ void *oidc_merge_server_config(apr_pool_t *pool, void *BASE, void *ADD) {
 			!= OIDC_DEFAULT_CACHE_SHM_ENTRY_SIZE_MAX ?
 					add->cache_shm_entry_size_max :
 					base->cache_shm_entry_size_max;
+	c->cache_shm_slabs =
+			add->cache_shm_slabs != NULL ?
+					add->cache_shm_slabs : base->cache_shm_slabs;
+	c->cache_shm_quota =
+			add->cache_shm_quota != NULL ?
+					add->cache_shm_quota : base->cache_shm_quota;
+	c->cache_l1_max =
+			add->cache_l1_max != OIDC_CONFIG_POS_INT_UNSET ?
+					add->cache_l1_max : base->cache_l1_max;
+	c->cache_l1_sections =
+			add->cache_l1_sections != NULL ?
+					add->cache_l1_sections : base->cache_l1_sections;
+	c->replay_cache_entries =
+			add->replay_cache_entries != OIDC_CONFIG_POS_INT_UNSET ?
+					add->replay_cache_entries : base->replay_cache_entries;
+	c->replay_cache_cfg = NULL;
+	c->metrics =
+			add->metrics != OIDC_CONFIG_POS_INT_UNSET ?
+					add->metrics : base->metrics;
 
 #ifdef USE_LIBHIREDIS
 	c->cache_redis_server =
@@ -1761,6 +2114,21 @@ void *oidc_merge_server_config(apr_pool_t *pool, void *BASE, void *ADD) {
 	c->cache_redis_password =
 			add->cache_redis_password != NULL ?
 					add->cache_redis_password : base->cache_redis_password;
+	c->cache_redis_mode =
+			add->cache_redis_mode != OIDC_DEFAULT_CACHE_REDIS_MODE ?
+					add->cache_redis_mode : base->cache_redis_mode;
+	c->cache_redis_sentinel_master =
+			add->cache_redis_sentinel_master != NULL ?
+					add->cache_redis_sentinel_master :
+					base->cache_redis_sentinel_master;
+	c->cache_redis_connect_timeout =
+			add->cache_redis_connect_timeout
+			!= OIDC_DEFAULT_CACHE_REDIS_CONNECT_TIMEOUT ?
+					add->cache_redis_connect_timeout :
+					base->cache_redis_connect_timeout;
+	c->cache_redis_timeout =
+			add->cache_redis_timeout != OIDC_DEFAULT_CACHE_REDIS_TIMEOUT ?
+					add->cache_redis_timeout : base->cache_redis_timeout;
 #endif
 
 	c->metadata_dir =
@@ -1772,6 +2140,12 @@ void *oidc_merge_server_config(apr_pool_t *pool, void *BASE, void *ADD) {
 			add->session_cache_fallback_to_cookie != OIDC_CONFIG_POS_INT_UNSET ?
 					add->session_cache_fallback_to_cookie :
 					base->session_cache_fallback_to_cookie;
+	c->session_encoding =
+			add->session_encoding != OIDC_DEFAULT_SESSION_ENCODING ?
+					add->session_encoding : base->session_encoding;
+	c->compress_min_size =
+			add->compress_min_size != OIDC_DEFAULT_COMPRESS_MIN_SIZE ?
+					add->compress_min_size : base->compress_min_size;
 	c->persistent_session_cookie =
 			add->persistent_session_cookie != 0 ?
 					add->persistent_session_cookie :
@@ -1799,6 +2173,10 @@ void *oidc_merge_server_config(apr_pool_t *pool, void *BASE, void *ADD) {
 			add->remote_user_claim.reg_exp != NULL ?
 					add->remote_user_claim.reg_exp :
 					base->remote_user_claim.reg_exp;
+	c->remote_user_claim.preg =
+			add->remote_user_claim.reg_exp != NULL ?
+					add->remote_user_claim.preg :
+					base->remote_user_claim.preg;
 	c->remote_user_claim.replace =
 			add->remote_user_claim.replace != NULL ?
 					add->remote_user_claim.replace :
@@ -1843,6 +2221,15 @@ void *oidc_merge_server_config(apr_pool_t *pool, void *BASE, void *ADD) {
 			!= OIDC_DEFAULT_PROVIDER_METADATA_REFRESH_INTERVAL ?
 					add->provider_metadata_refresh_interval :
 					base->provider_metadata_refresh_interval;
+	c->metadata_stale_ttl =
+			add->metadata_stale_ttl != OIDC_DEFAULT_METADATA_STALE_TTL ?
+					add->metadata_stale_ttl : base->metadata_stale_ttl;
+	c->metadata_refresh_ahead =
+			add->metadata_refresh_ahead != OIDC_DEFAULT_METADATA_REFRESH_AHEAD ?
+					add->metadata_refresh_ahead : base->metadata_refresh_ahead;
+	c->metadata_prefetch =
+			add->metadata_prefetch != OIDC_CONFIG_POS_INT_UNSET ?
+					add->metadata_prefetch : base->metadata_prefetch;
 
 	c->provider.token_binding_policy =
 			add->provider.token_binding_policy
@@ -1859,6 +2246,9 @@ void *oidc_merge_server_config(apr_pool_t *pool, void *BASE, void *ADD) {
 	c->white_listed_claims =
 			add->white_listed_claims != NULL ?
 					add->white_listed_claims : base->white_listed_claims;
+	c->pass_claim_names =
+			add->pass_claim_names != NULL ?
+					add->pass_claim_names : base->pass_claim_names;
 
 	c->provider.issuer_specific_redirect_uri =
 			add->provider.issuer_specific_redirect_uri
@@ -2404,6 +2794,9 @@ static apr_status_t oidc_cleanup_child(void *data) {
 				oidc_serror(sp, "cache destroy function failed");
 			}
 		}
+		if (oidc_cache_replay_destroy(sp) != APR_SUCCESS) {
+			oidc_serror(sp, "oidc_cache_replay_destroy failed");
+		}
 
 		// can do this even though we haven't got a deep copy
 		// since references within the object will be set to NULL
@@ -2527,9 +2920,18 @@ static int oidc_post_config(apr_pool_t *pool, apr_pool_t *p1, apr_pool_t *p2,
 			if (cfg->cache->post_config(sp) != OK)
 				return HTTP_INTERNAL_SERVER_ERROR;
 		}
+		if (oidc_util_crypto_passphrase_post_config(pool, sp) == FALSE)
+			return HTTP_INTERNAL_SERVER_ERROR;
+		if (oidc_cache_crypto_post_config(pool, sp) == FALSE)
+			return HTTP_INTERNAL_SERVER_ERROR;
+		if (oidc_cache_replay_post_config(sp) != OK)
+			return HTTP_INTERNAL_SERVER_ERROR;
 		sp = sp->next;
 	}
 
+	if (oidc_metrics_post_config(pool, s) == FALSE)
+		return HTTP_INTERNAL_SERVER_ERROR;
+
 	/*
 	 * Apache has a base vhost that true vhosts derive from.
 	 * There are two startup scenarios:
@@ -2591,8 +2993,34 @@ static void oidc_child_init(apr_pool_t *p, server_rec *s) {
 				oidc_serror(sp, "cfg->cache->child_init failed");
 			}
 		}
+		if (oidc_cache_replay_child_init(p, sp) != APR_SUCCESS) {
+			oidc_serror(sp, "oidc_cache_replay_child_init failed");
+		}
 		sp = sp->next;
 	}
+	if (oidc_util_http_child_init(p, s) != APR_SUCCESS) {
+		oidc_serror(s, "oidc_util_http_child_init failed");
+	}
+	if (oidc_proto_jwks_cache_child_init(p, s) != APR_SUCCESS) {
+		oidc_serror(s, "oidc_proto_jwks_cache_child_init failed");
+	}
+	if (oidc_util_regexp_cache_child_init(p, s) != APR_SUCCESS) {
+		oidc_serror(s, "oidc_util_regexp_cache_child_init failed");
+	}
+	if (oidc_util_app_info_name_cache_child_init(p, s) != APR_SUCCESS) {
+		oidc_serror(s, "oidc_util_app_info_name_cache_child_init failed");
+	}
+	if (oidc_metadata_registry_child_init(p, s) != APR_SUCCESS) {
+		oidc_serror(s, "oidc_metadata_registry_child_init failed");
+	}
+	if (oidc_cache_l1_child_init(p, s) != APR_SUCCESS) {
+		oidc_serror(s, "oidc_cache_l1_child_init failed");
+	}
+#ifdef USE_LIBJQ
+	if (oidc_authz_jq_cache_child_init(p, s) != APR_SUCCESS) {
+		oidc_serror(s, "oidc_authz_jq_cache_child_init failed");
+	}
+#endif
 	apr_pool_cleanup_register(p, s, oidc_cleanup_child, apr_pool_cleanup_null);
 }
 
@@ -2694,6 +3122,8 @@ void oidc_register_hooks(apr_pool_t *pool) {
 	ap_hook_post_config(oidc_post_config, NULL, NULL, APR_HOOK_LAST);
 	ap_hook_child_init(oidc_child_init, NULL, NULL, APR_HOOK_MIDDLE);
 	ap_hook_handler(oidc_content_handler, NULL, NULL, APR_HOOK_FIRST);
+	ap_hook_handler(oidc_metrics_handler, NULL, NULL, APR_HOOK_MIDDLE);
+	ap_hook_log_transaction(oidc_log_transaction, NULL, NULL, APR_HOOK_LAST);
 	ap_hook_insert_filter(oidc_filter_in_insert_filter, NULL, NULL,
 			APR_HOOK_MIDDLE);
 	ap_register_input_filter(oidcFilterName, oidc_filter_in_filter, NULL,
@@ -3086,6 +3516,21 @@ const command_rec oidc_config_cmds[] = {
 				(void *)APR_OFFSETOF(oidc_cfg, oauth.verify_jwks_uri),
 				RSRC_CONF,
 				"The JWKs URL on which the Authorization publishes the keys used to sign its JWT access tokens."),
+		AP_INIT_TAKE1(OIDCOAuthVerifyCacheInterval,
+				oidc_set_oauth_verify_cache_interval,
+				(void *)APR_OFFSETOF(oidc_cfg, oauth.verify_cache_interval),
+				RSRC_CONF,
+				"Duration in seconds for which the result of local JWT access token validation is cached."),
+		AP_INIT_TAKE1(OIDCOAuthTokenIntrospectionNegativeInterval,
+				oidc_set_oauth_introspection_negative_interval,
+				(void *)APR_OFFSETOF(oidc_cfg, oauth.introspection_negative_interval),
+				RSRC_CONF,
+				"Duration in seconds for which an introspection result that says the access token is not active is cached."),
+		AP_INIT_TAKE1(OIDCOAuthTokenIntrospectionCoalesceTimeout,
+				oidc_set_oauth_introspection_coalesce_timeout,
+				(void *)APR_OFFSETOF(oidc_cfg, oauth.introspection_coalesce_timeout),
+				RSRC_CONF,
+				"Time in milliseconds that a request waits for the result of a concurrent introspection of the same access token."),
 
 		AP_INIT_TAKE1(OIDCHTTPTimeoutLong,
 				oidc_set_int_slot,
@@ -3123,6 +3568,16 @@ const command_rec oidc_config_cmds[] = {
 				(void*)APR_OFFSETOF(oidc_cfg, session_type),
 				RSRC_CONF,
 				"OpenID Connect session storage type (Apache 2.0/2.2 only). Must be one of \"server-cache\" or \"client-cookie\" with an optional suffix \":persistent\"."),
+		AP_INIT_TAKE1(OIDCSessionEncoding,
+				oidc_set_session_encoding,
+				(void*)APR_OFFSETOF(oidc_cfg, session_encoding),
+				RSRC_CONF,
+				"Serialization format of the session state; must be one of \"json\" or \"binary\"."),
+		AP_INIT_TAKE1(OIDCCompressMinSize,
+				oidc_set_compress_min_size,
+				(void*)APR_OFFSETOF(oidc_cfg, compress_min_size),
+				RSRC_CONF,
+				"Minimum size in bytes of client-side cookie payloads and cache values that are DEFLATE compressed; 0 disables compression."),
 		AP_INIT_FLAG(OIDCSessionCacheFallbackToCookie,
 				oidc_set_flag_slot,
 				(void*)APR_OFFSETOF(oidc_cfg, session_cache_fallback_to_cookie),
@@ -3153,6 +3608,16 @@ const command_rec oidc_config_cmds[] = {
 				(void*)APR_OFFSETOF(oidc_cfg, cache_file_clean_interval),
 				RSRC_CONF,
 				"Cache file clean interval in seconds."),
+		AP_INIT_TAKE1(OIDCCacheFileLevels,
+				oidc_set_cache_file_levels,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_file_levels),
+				RSRC_CONF,
+				"Number of levels (0-2) of hashed subdirectories that hold the cache files."),
+		AP_INIT_TAKE1(OIDCCacheFileCleanMax,
+				oidc_set_cache_file_clean_max,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_file_clean_max),
+				RSRC_CONF,
+				"Maximum number of cache files inspected in a single clean cycle when using hashed subdirectories."),
 #ifdef USE_MEMCACHE
 		AP_INIT_TAKE1(OIDCMemCacheServers,
 				oidc_set_string_slot,
@@ -3170,17 +3635,67 @@ const command_rec oidc_config_cmds[] = {
 				(void*)APR_OFFSETOF(oidc_cfg, cache_shm_entry_size_max),
 				RSRC_CONF,
 				"Maximum size of a single cache entry used for \"shm\" caching."),
+		AP_INIT_ITERATE(OIDCCacheShmSlabs,
+				oidc_set_cache_shm_slabs,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_shm_slabs),
+				RSRC_CONF,
+				"Additional slab classes for smaller entries used for \"shm\" caching (space separated list of <entry-size>:<number-of-entries> tuples)."),
+		AP_INIT_TAKE2(OIDCCacheShmSectionQuota,
+				oidc_set_cache_shm_section_quota,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_shm_quota),
+				RSRC_CONF,
+				"Maximum number of entries for a cache section (session, nonce, jwks, access_token, provider, oauth_provider, jti, request_uri, sid, sub, session_expiry or lease) used for \"shm\" caching."),
+		AP_INIT_TAKE1(OIDCCacheL1Max,
+				oidc_set_cache_l1_max,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_l1_max),
+				RSRC_CONF,
+				"Maximum number of entries in the per-process L1 cache."),
+		AP_INIT_TAKE2(OIDCCacheL1Section,
+				oidc_set_cache_l1_section,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_l1_sections),
+				RSRC_CONF,
+				"Keep entries of a cache section (nonce, jwks, provider or oauth_provider) in the per-process L1 cache for a maximum number of seconds; the session, session_expiry, lease, sid, sub, access_token, jti and request_uri sections cannot be L1-cached."),
+		AP_INIT_TAKE1(OIDCReplayCacheEntries,
+				oidc_set_replay_cache_entries,
+				(void*)APR_OFFSETOF(oidc_cfg, replay_cache_entries),
+				RSRC_CONF,
+				"Maximum number of JTI and nonce values in the dedicated shared memory replay cache; 0 stores them in the regular cache."),
+		AP_INIT_FLAG(OIDCMetrics,
+				oidc_set_flag_slot,
+				(void*)APR_OFFSETOF(oidc_cfg, metrics),
+				RSRC_CONF,
+				"Collect latency metrics and expose them in Prometheus format on locations with \"SetHandler auth-openidc-metrics\"; must be On or Off"),
 #ifdef USE_LIBHIREDIS
 		AP_INIT_TAKE1(OIDCRedisCacheServer,
 				oidc_set_string_slot,
 				(void*)APR_OFFSETOF(oidc_cfg, cache_redis_server),
 				RSRC_CONF,
-				"Redis server used for caching (<hostname>[:<port>])"),
+				"Redis server(s) used for caching (space separated list of <hostname>[:<port>] tuples)"),
 		AP_INIT_TAKE1(OIDCRedisCachePassword,
 				oidc_set_string_slot,
 				(void*)APR_OFFSETOF(oidc_cfg, cache_redis_password),
 				RSRC_CONF,
 				"Password for authentication to the Redis servers."),
+		AP_INIT_TAKE1(OIDCRedisCacheMode,
+				oidc_set_cache_redis_mode,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_redis_mode),
+				RSRC_CONF,
+				"Redis deployment mode; must be one of \"standalone\", \"cluster\" or \"sentinel\"."),
+		AP_INIT_TAKE1(OIDCRedisCacheSentinelMaster,
+				oidc_set_string_slot,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_redis_sentinel_master),
+				RSRC_CONF,
+				"Name of the primary monitored by the Redis Sentinels."),
+		AP_INIT_TAKE1(OIDCRedisCacheConnectTimeout,
+				oidc_set_cache_redis_connect_timeout,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_redis_connect_timeout),
+				RSRC_CONF,
+				"Timeout in seconds for connecting to the Redis server."),
+		AP_INIT_TAKE1(OIDCRedisCacheTimeout,
+				oidc_set_cache_redis_timeout,
+				(void*)APR_OFFSETOF(oidc_cfg, cache_redis_timeout),
+				RSRC_CONF,
+				"Timeout in seconds for reading from and writing to the Redis server."),
 #endif
 		AP_INIT_TAKE1(OIDCHTMLErrorTemplate,
 				oidc_set_string_slot,
@@ -3267,6 +3782,21 @@ const command_rec oidc_config_cmds[] = {
 				(void*)APR_OFFSETOF(oidc_cfg, provider_metadata_refresh_interval),
 				RSRC_CONF,
 				"Provider metadata refresh interval in seconds."),
+		AP_INIT_TAKE1(OIDCMetadataStaleTTL,
+				oidc_set_metadata_refresh_time,
+				(void*)APR_OFFSETOF(oidc_cfg, metadata_stale_ttl),
+				RSRC_CONF,
+				"Time in seconds that expired provider metadata and JWKs may be served while a single worker refreshes them."),
+		AP_INIT_TAKE1(OIDCMetadataRefreshAhead,
+				oidc_set_metadata_refresh_time,
+				(void*)APR_OFFSETOF(oidc_cfg, metadata_refresh_ahead),
+				RSRC_CONF,
+				"Time in seconds before expiry that provider metadata and JWKs are refreshed by a single worker."),
+		AP_INIT_FLAG(OIDCMetadataPrefetch,
+				oidc_set_flag_slot,
+				(void*)APR_OFFSETOF(oidc_cfg, metadata_prefetch),
+				RSRC_CONF,
+				"Fetch the metadata and JWKs of the configured providers when a child process handles its first request."),
 		AP_INIT_TAKE1(OIDCProviderAuthRequestMethod,
 				oidc_set_auth_request_method,
 				(void*)APR_OFFSETOF(oidc_cfg, provider.auth_request_method),
@@ -3287,6 +3817,11 @@ const command_rec oidc_config_cmds[] = {
 				(void *) APR_OFFSETOF(oidc_cfg, white_listed_claims),
 				RSRC_CONF|ACCESS_CONF|OR_AUTHCFG,
 				"Specify claims from the userinfo and/or id_token that should be stored in the session (all other claims will be discarded)."),
+		AP_INIT_ITERATE(OIDCPassClaimNames,
+				oidc_set_pass_claim_names,
+				(void *) APR_OFFSETOF(oidc_cfg, pass_claim_names),
+				RSRC_CONF,
+				"Specify the claims that are passed to the application, optionally as <claim>=<header-name> (all other claims will not be passed)."),
 		AP_INIT_TAKE1(OIDCOAuthServerMetadataURL,
 				oidc_set_url_slot,
 				(void*)APR_OFFSETOF(oidc_cfg, oauth.metadata_url),
@@ -3298,11 +3833,11 @@ const command_rec oidc_config_cmds[] = {
 				RSRC_CONF,
 				"The token binding policy used for access tokens; must be one of [disabled|optional|required|enforced]"),
 
-		AP_INIT_TAKE12(OIDCRefreshAccessTokenBeforeExpiry,
+		AP_INIT_TAKE123(OIDCRefreshAccessTokenBeforeExpiry,
 				oidc_set_refresh_access_token_before_expiry,
 				(void *)APR_OFFSETOF(oidc_dir_cfg, refresh_access_token_before_expiry),
 				RSRC_CONF|ACCESS_CONF|OR_AUTHCFG,
-				"Ensure the access token is valid for at least <x> seconds by refreshing it if required; must be: <x> [logout_on_error]; the logout_on_error performs a logout on refresh error."),
+				"Ensure the access token is valid for at least <x> seconds by refreshing it if required; must be: <x> [logout_on_error] [async]; the logout_on_error performs a logout on refresh error, async refreshes after the response has been sent."),
 
 		AP_INIT_TAKE1(OIDCStateInputHeaders,
 				oidc_set_state_input_headers_as,
@@ -62,6 +62,8 @@
 #include <openssl/pem.h>
 #include <openssl/rsa.h>
 
+#include <apr_atomic.h>
+
 #ifdef WIN32
 #define snprintf _snprintf
 #endif
@@ -166,9 +168,7 @@ oidc_jwt_t *oidc_jwt_new(apr_pool_t *pool, int create_header,
  * get a header value from a JWT
  */
 const char *oidc_jwt_hdr_get(oidc_jwt_t *jwt, const char *key) {
-	cjose_err cjose_err;
-	cjose_header_t *hdr = cjose_jws_get_protected(jwt->cjose_jws);
-	return hdr ? cjose_header_get(hdr, key, &cjose_err) : NULL;
+	return json_string_value(json_object_get(jwt->header.value.json, key));
 }
 
 /*
@@ -183,7 +183,10 @@ char *oidc_jwt_serialize(apr_pool_t *pool, oidc_jwt_t *jwt,
 		oidc_jose_error_t *err) {
 	cjose_err cjose_err;
 	const char *cser = NULL;
-	if (strcmp(jwt->header.alg, CJOSE_HDR_ALG_NONE) != 0) {
+	if ((jwt->cjose_jws == NULL) && (jwt->cser != NULL)) {
+		/* a parsed JWS that was not touched */
+		cser = jwt->cser;
+	} else if (strcmp(jwt->header.alg, CJOSE_HDR_ALG_NONE) != 0) {
 		if (cjose_jws_export(jwt->cjose_jws, &cser, &cjose_err) == FALSE) {
 			oidc_jose_error(err, "cjose_jws_export failed: %s",
 					oidc_cjose_e2s(pool, cjose_err));
@@ -377,6 +380,10 @@ void oidc_jwk_destroy(oidc_jwk_t *jwk) {
 			cjose_jwk_release(jwk->cjose_jwk);
 			jwk->cjose_jwk = NULL;
 		}
+		if (jwk->evp_pkey) {
+			EVP_PKEY_free(jwk->evp_pkey);
+			jwk->evp_pkey = NULL;
+		}
 	}
 }
 
@@ -758,90 +765,210 @@ static uint8_t *oidc_jwe_decrypt_impl(apr_pool_t *pool, cjose_jwe_t *jwe,
 }
 
 /*
- * decrypt a JSON Web Token
+ * decrypt a JWE, returning the (\0 terminated) plaintext, its length and the "zip" header value
  */
-apr_byte_t oidc_jwe_decrypt(apr_pool_t *pool, const char *input_json,
-		apr_hash_t *keys, char **s_json, oidc_jose_error_t *err,
-		apr_byte_t import_must_succeed) {
+apr_byte_t oidc_jwe_decrypt_bytes(apr_pool_t *pool, const char *input,
+		apr_hash_t *keys, char **plaintext, size_t *plaintext_len, char **zip,
+		oidc_jose_error_t *err, apr_byte_t import_must_succeed) {
 	cjose_err cjose_err;
-	cjose_jwe_t *jwe = cjose_jwe_import(input_json, strlen(input_json),
-			&cjose_err);
+	const char *s_zip = NULL;
+	cjose_jwe_t *jwe = cjose_jwe_import(input, strlen(input), &cjose_err);
+	if (zip != NULL)
+		*zip = NULL;
 	if (jwe != NULL) {
 		size_t content_len = 0;
 		uint8_t *decrypted = oidc_jwe_decrypt_impl(pool, jwe, keys,
 				&content_len, err);
 		if (decrypted != NULL) {
-			*s_json = apr_pcalloc(pool, content_len + 1);
-			memcpy(*s_json, decrypted, content_len);
-			(*s_json)[content_len] = '\0';
+			*plaintext = apr_pcalloc(pool, content_len + 1);
+			memcpy(*plaintext, decrypted, content_len);
+			(*plaintext)[content_len] = '\0';
+			if (plaintext_len != NULL)
+				*plaintext_len = content_len;
 			cjose_get_dealloc()(decrypted);
+			s_zip = cjose_header_get(cjose_jwe_get_protected(jwe),
+					OIDC_JOSE_HDR_ZIP, &cjose_err);
+			if ((zip != NULL) && (s_zip != NULL))
+				*zip = apr_pstrdup(pool, s_zip);
 		}
 		cjose_jwe_release(jwe);
 	} else if (import_must_succeed == FALSE) {
-		*s_json = apr_pstrdup(pool, input_json);
+		*plaintext = apr_pstrdup(pool, input);
+		if (plaintext_len != NULL)
+			*plaintext_len = strlen(input);
 	} else {
 		oidc_jose_error(err, "cjose_jwe_import failed: %s",
 				oidc_cjose_e2s(pool, cjose_err));
 	}
-	return (*s_json != NULL);
+	return (*plaintext != NULL);
 }
 
 /*
- * parse and (optionally) decrypt a JSON Web Token
+ * decrypt a JSON Web Token
  */
-apr_byte_t oidc_jwt_parse(apr_pool_t *pool, const char *input_json,
-		oidc_jwt_t **j_jwt, apr_hash_t *keys, oidc_jose_error_t *err) {
+apr_byte_t oidc_jwe_decrypt(apr_pool_t *pool, const char *input_json,
+		apr_hash_t *keys, char **s_json, oidc_jose_error_t *err,
+		apr_byte_t import_must_succeed) {
+	return oidc_jwe_decrypt_bytes(pool, input_json, keys, s_json, NULL, NULL,
+			err, import_must_succeed);
+}
+
+/* number of "." separated elements in a compact serialized JWS and JWE */
+#define OIDC_JOSE_JWS_COMPACT_ELEMENTS 3
+#define OIDC_JOSE_JWE_COMPACT_ELEMENTS 5
+
+/*
+ * count the "." separated elements in a compact serialization
+ */
+static int oidc_jose_compact_elements(const char *input) {
+	int n = 1;
+	for (; (input != NULL) && (*input != '\0'); input++)
+		if (*input == '.')
+			n++;
+	return n;
+}
+
+/*
+ * return whether a string is a compact serialized JWE
+ */
+apr_byte_t oidc_jwe_is_compact(const char *input) {
+	return (oidc_jose_compact_elements(input) == OIDC_JOSE_JWE_COMPACT_ELEMENTS);
+}
 
+/*
+ * base64url decode an element of a compact serialization in place, i.e. without copying it out first
+ */
+static apr_byte_t oidc_jose_base64url_decode_element(apr_pool_t *pool,
+		const char *input, size_t input_len, char **output, size_t *output_len,
+		oidc_jose_error_t *err) {
 	cjose_err cjose_err;
-	char *s_json = NULL;
+	uint8_t *decoded = NULL;
+	size_t decoded_len = 0;
 
-    oidc_jose_error(err, "input_json: %s", input_json);
-	if (oidc_jwe_decrypt(pool, input_json, keys, &s_json, err, FALSE) == FALSE)
+	if (input_len == 0) {
+		*output = apr_pstrdup(pool, "");
+		*output_len = 0;
+		return TRUE;
+	}
+
+	if (cjose_base64url_decode(input, input_len, &decoded, &decoded_len,
+			&cjose_err) == FALSE) {
+		oidc_jose_error(err, "cjose_base64url_decode failed: %s",
+				oidc_cjose_e2s(pool, cjose_err));
 		return FALSE;
+	}
+
+	*output = apr_pstrmemdup(pool, (const char *) decoded, decoded_len);
+	*output_len = decoded_len;
+	cjose_get_dealloc()(decoded);
+
+	return TRUE;
+}
 
-    oidc_jose_error(err, "oidc_jwe_decrypt json: %s", s_json);
-	*j_jwt = oidc_jwt_new(pool, FALSE, FALSE);
-	if (*j_jwt == NULL)
+/*
+ * parse and (optionally) decrypt a JSON Web Token, decoding only the header;
+ * the signature can be verified before the payload is parsed with oidc_jwt_parse_payload
+ */
+apr_byte_t oidc_jwt_parse_header(apr_pool_t *pool, const char *input_json,
+		oidc_jwt_t **j_jwt, apr_hash_t *keys, oidc_jose_error_t *err) {
+
+	char *s_json = NULL, *s_header = NULL;
+	const char *p = NULL;
+	size_t s_header_len = 0;
+	json_error_t json_error;
+	json_t *header = NULL;
+	oidc_jwt_t *jwt = NULL;
+
+	*j_jwt = NULL;
+
+	/* only a compact serialized JWE needs decrypting, anything else is parsed as a JWS */
+	if (oidc_jwe_is_compact(input_json)) {
+		if (oidc_jwe_decrypt(pool, input_json, keys, &s_json, err,
+				TRUE) == FALSE)
+			return FALSE;
+	} else {
+		s_json = (char *) input_json;
+	}
+
+	if (oidc_jose_compact_elements(s_json) != OIDC_JOSE_JWS_COMPACT_ELEMENTS) {
+		oidc_jose_error(err, "input is not a compact serialized JWS");
 		return FALSE;
-	oidc_jwt_t *jwt = *j_jwt;
+	}
 
-	oidc_jose_error(err, "oidc_jwt_new jwt: %s", j_jwt);
+	p = strchr(s_json, '.');
+	if (oidc_jose_base64url_decode_element(pool, s_json, p - s_json, &s_header,
+			&s_header_len, err) == FALSE)
+		return FALSE;
 
-	jwt->cjose_jws = cjose_jws_import(s_json, strlen(s_json), &cjose_err);
-	if (jwt->cjose_jws == NULL) {
-		oidc_jose_error(err, "cjose_jws_import failed: %s",
-				oidc_cjose_e2s(pool, cjose_err));
+	header = json_loadb(s_header, s_header_len, 0, &json_error);
+	if ((header == NULL) || (!json_is_object(header))) {
+		oidc_jose_error(err, "JWS header is not a JSON object: %s",
+				header ? "" : json_error.text);
+		if (header)
+			json_decref(header);
+		return FALSE;
+	}
+
+	jwt = oidc_jwt_new(pool, FALSE, FALSE);
+	jwt->header.value.json = header;
+	jwt->header.value.str = s_header;
+	oidc_jose_get_string(pool, header, CJOSE_HDR_ALG, FALSE, &jwt->header.alg,
+			NULL);
+	oidc_jose_get_string(pool, header, CJOSE_HDR_ENC, FALSE, &jwt->header.enc,
+			NULL);
+	oidc_jose_get_string(pool, header, CJOSE_HDR_KID, FALSE, &jwt->header.kid,
+			NULL);
+
+	if (jwt->header.alg == NULL) {
+		oidc_jose_error(err, "no \"%s\" found in JWS header", CJOSE_HDR_ALG);
 		oidc_jwt_destroy(jwt);
-		*j_jwt = NULL;
 		return FALSE;
 	}
 
-	cjose_header_t *hdr = cjose_jws_get_protected(jwt->cjose_jws);
-	jwt->header.value.json = json_deep_copy((json_t *) hdr);
-	char *str = json_dumps(jwt->header.value.json,
-			JSON_PRESERVE_ORDER | JSON_COMPACT);
-	jwt->header.value.str = apr_pstrdup(pool, str);
-	free(str);
-
-	jwt->header.alg = apr_pstrdup(pool,
-			cjose_header_get(hdr, CJOSE_HDR_ALG, &cjose_err));
-	jwt->header.enc = apr_pstrdup(pool,
-			cjose_header_get(hdr, CJOSE_HDR_ENC, &cjose_err));
-	jwt->header.kid = apr_pstrdup(pool,
-			cjose_header_get(hdr, CJOSE_HDR_KID, &cjose_err));
-
-	uint8_t *plaintext = NULL;
-	size_t plaintext_len = 0;
-	if (cjose_jws_get_plaintext(jwt->cjose_jws, &plaintext, &plaintext_len,
-			&cjose_err) == FALSE) {
-		oidc_jose_error(err, "cjose_jws_get_plaintext failed: %s",
-				oidc_cjose_e2s(pool, cjose_err));
+	jwt->cser = s_json;
+	*j_jwt = jwt;
+
+	return TRUE;
+}
+
+/*
+ * parse the payload of a JSON Web Token that was parsed with oidc_jwt_parse_header
+ */
+apr_byte_t oidc_jwt_parse_payload(apr_pool_t *pool, oidc_jwt_t *jwt,
+		oidc_jose_error_t *err) {
+	const char *p = NULL, *q = NULL;
+	char *s_payload = NULL;
+	size_t s_payload_len = 0;
+
+	if (jwt->payload.value.json != NULL)
+		return TRUE;
+
+	p = jwt->cser ? strchr(jwt->cser, '.') : NULL;
+	q = p ? strchr(p + 1, '.') : NULL;
+	if (q == NULL) {
+		oidc_jose_error(err, "no compact serialized JWS to parse the payload from");
 		return FALSE;
 	}
 
-	if (oidc_jose_parse_payload(pool, (const char *) plaintext, plaintext_len,
-			&jwt->payload, err) == FALSE) {
-		oidc_jwt_destroy(jwt);
+	if (oidc_jose_base64url_decode_element(pool, p + 1, q - p - 1, &s_payload,
+			&s_payload_len, err) == FALSE)
+		return FALSE;
+
+	return oidc_jose_parse_payload(pool, s_payload, s_payload_len,
+			&jwt->payload, err);
+}
+
+/*
+ * parse and (optionally) decrypt a JSON Web Token
+ */
+apr_byte_t oidc_jwt_parse(apr_pool_t *pool, const char *input_json,
+		oidc_jwt_t **j_jwt, apr_hash_t *keys, oidc_jose_error_t *err) {
+
+	if (oidc_jwt_parse_header(pool, input_json, j_jwt, keys, err) == FALSE)
+		return FALSE;
+
+	if (oidc_jwt_parse_payload(pool, *j_jwt, err) == FALSE) {
+		oidc_jwt_destroy(*j_jwt);
 		*j_jwt = NULL;
 		return FALSE;
 	}
@@ -849,6 +976,31 @@ apr_byte_t oidc_jwt_parse(apr_pool_t *pool, const char *input_json,
 	return TRUE;
 }
 
+/*
+ * import the compact serialization of a parsed JWS into a cjose JWS structure
+ */
+static apr_byte_t oidc_jwt_cjose_import(apr_pool_t *pool, oidc_jwt_t *jwt,
+		oidc_jose_error_t *err) {
+	cjose_err cjose_err;
+
+	if (jwt->cjose_jws != NULL)
+		return TRUE;
+
+	if (jwt->cser == NULL) {
+		oidc_jose_error(err, "no JWS to import");
+		return FALSE;
+	}
+
+	jwt->cjose_jws = cjose_jws_import(jwt->cser, strlen(jwt->cser), &cjose_err);
+	if (jwt->cjose_jws == NULL) {
+		oidc_jose_error(err, "cjose_jws_import failed: %s",
+				oidc_cjose_e2s(pool, cjose_err));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 /* destroy resources allocated for JWT */
 void oidc_jwt_destroy(oidc_jwt_t *jwt) {
 	if (jwt) {
@@ -886,6 +1038,7 @@ apr_byte_t oidc_jwt_sign(apr_pool_t *pool, oidc_jwt_t *jwt, oidc_jwk_t *jwk,
 
 	if (jwt->cjose_jws)
 		cjose_jws_release(jwt->cjose_jws);
+	jwt->cser = NULL;
 
 	cjose_err cjose_err;
 	char *s_payload = json_dumps(jwt->payload.value.json,
@@ -915,10 +1068,11 @@ void EVP_MD_CTX_free(EVP_MD_CTX *ctx) {
 #endif
 
 /*
- * encrypt JWT
+ * encrypt a binary payload
  */
-apr_byte_t oidc_jwt_encrypt(apr_pool_t *pool, oidc_jwt_t *jwe, oidc_jwk_t *jwk,
-		const char *payload, char **serialized, oidc_jose_error_t *err) {
+apr_byte_t oidc_jwe_encrypt_bytes(apr_pool_t *pool, oidc_jwt_t *jwe,
+		oidc_jwk_t *jwk, const char *payload, size_t payload_len,
+		char **serialized, oidc_jose_error_t *err) {
 
 	cjose_header_t *hdr = (cjose_header_t *) jwe->header.value.json;
 
@@ -928,10 +1082,12 @@ apr_byte_t oidc_jwt_encrypt(apr_pool_t *pool, oidc_jwt_t *jwe, oidc_jwk_t *jwk,
 		oidc_jwt_hdr_set(jwe, CJOSE_HDR_KID, jwe->header.kid);
 	if (jwe->header.enc)
 		oidc_jwt_hdr_set(jwe, CJOSE_HDR_ENC, jwe->header.enc);
+	if (jwe->header.zip)
+		oidc_jwt_hdr_set(jwe, OIDC_JOSE_HDR_ZIP, jwe->header.zip);
 
 	cjose_err cjose_err;
 	cjose_jwe_t *cjose_jwe = cjose_jwe_encrypt(jwk->cjose_jwk, hdr,
-			(const uint8_t *) payload, strlen(payload), &cjose_err);
+			(const uint8_t *) payload, payload_len, &cjose_err);
 	if (cjose_jwe == NULL) {
 		oidc_jose_error(err, "cjose_jwe_encrypt failed: %s",
 				oidc_cjose_e2s(pool, cjose_err));
@@ -952,6 +1108,15 @@ apr_byte_t oidc_jwt_encrypt(apr_pool_t *pool, oidc_jwt_t *jwe, oidc_jwk_t *jwk,
 	return TRUE;
 }
 
+/*
+ * encrypt JWT
+ */
+apr_byte_t oidc_jwt_encrypt(apr_pool_t *pool, oidc_jwt_t *jwe, oidc_jwk_t *jwk,
+		const char *payload, char **serialized, oidc_jose_error_t *err) {
+	return oidc_jwe_encrypt_bytes(pool, jwe, jwk, payload, strlen(payload),
+			serialized, err);
+}
+
 #define OIDC_JOSE_CJOSE_VERSION_DEPRECATED "0.4."
 
 /*
@@ -963,28 +1128,203 @@ apr_byte_t oidc_jose_version_deprecated(apr_pool_t *pool) {
 	return (strstr(version, OIDC_JOSE_CJOSE_VERSION_DEPRECATED) == version);
 }
 
+static char *oidc_jose_alg_to_openssl_digest(const char *alg);
+
+/* the signing input and signature of a parsed JWS for verification with OpenSSL */
+typedef struct oidc_jws_signature_t {
+	const char *input;
+	size_t input_len;
+	char *value;
+	size_t value_len;
+	const EVP_MD *digest;
+	int kty;
+	int pss;
+} oidc_jws_signature_t;
+
 /*
- * verify the signature on a JWT
+ * prepare the verification of a parsed RSA or HMAC signed JWS with OpenSSL;
+ * returns FALSE for other algorithms, which are left to cjose
  */
-apr_byte_t oidc_jwt_verify(apr_pool_t *pool, oidc_jwt_t *jwt, apr_hash_t *keys,
+static apr_byte_t oidc_jws_signature_init(apr_pool_t *pool, oidc_jwt_t *jwt,
+		oidc_jws_signature_t *sig) {
+	const char *alg = jwt->header.alg;
+	const char *digest = NULL, *p = NULL;
+
+	if ((jwt->cser == NULL) || (alg == NULL))
+		return FALSE;
+
+	sig->kty = oidc_alg2kty(alg);
+	if ((sig->kty != CJOSE_JWK_KTY_RSA) && (sig->kty != CJOSE_JWK_KTY_OCT))
+		return FALSE;
+	sig->pss = (alg[0] == 'P');
+
+	digest = oidc_jose_alg_to_openssl_digest(alg);
+	if ((digest == NULL) || ((sig->digest = EVP_get_digestbyname(digest)) == NULL))
+		return FALSE;
+
+	/* the signing input is the compact serialization up to the second "." */
+	p = strchr(jwt->cser, '.');
+	p = p ? strchr(p + 1, '.') : NULL;
+	if (p == NULL)
+		return FALSE;
+	sig->input = jwt->cser;
+	sig->input_len = p - jwt->cser;
+
+	return oidc_jose_base64url_decode_element(pool, p + 1, strlen(p + 1),
+			&sig->value, &sig->value_len, NULL);
+}
+
+/*
+ * get the OpenSSL public key for an RSA JWK, creating it on first use so it can be reused across requests
+ */
+static EVP_PKEY *oidc_jwk_evp_pkey(oidc_jwk_t *jwk) {
+	cjose_err cjose_err;
+	EVP_PKEY *pkey = jwk->evp_pkey;
+	RSA *rsa = NULL;
+
+	if (pkey != NULL)
+		return pkey;
+
+	rsa = cjose_jwk_get_keydata(jwk->cjose_jwk, &cjose_err);
+	if ((rsa == NULL) || ((pkey = EVP_PKEY_new()) == NULL))
+		return NULL;
+	if (EVP_PKEY_set1_RSA(pkey, rsa) != 1) {
+		EVP_PKEY_free(pkey);
+		return NULL;
+	}
+
+	/* another thread may have set it in the meantime */
+	if (apr_atomic_casptr((volatile void **) &jwk->evp_pkey, pkey, NULL) != NULL) {
+		EVP_PKEY_free(pkey);
+		pkey = jwk->evp_pkey;
+	}
+
+	return pkey;
+}
+
+/*
+ * verify a RSA or HMAC signature with OpenSSL; returns FALSE if the key cannot be used for it,
+ * in which case the verification is left to cjose, and sets the result of the verification in rc otherwise
+ */
+static apr_byte_t oidc_jws_signature_verify(apr_pool_t *pool,
+		oidc_jws_signature_t *sig, oidc_jwk_t *jwk, apr_byte_t *rc,
 		oidc_jose_error_t *err) {
+	cjose_err cjose_err;
+	EVP_PKEY *pkey = NULL;
+	EVP_PKEY_CTX *pctx = NULL;
+	EVP_MD_CTX *ctx = NULL;
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	const unsigned char *key = NULL;
+
+	if ((jwk == NULL) || (jwk->kty != sig->kty) || (jwk->cjose_jwk == NULL))
+		return FALSE;
+
+	*rc = FALSE;
+
+	if (sig->kty == CJOSE_JWK_KTY_OCT) {
+		key = cjose_jwk_get_keydata(jwk->cjose_jwk, &cjose_err);
+		if (key == NULL)
+			return FALSE;
+		if (HMAC(sig->digest, key,
+				cjose_jwk_get_keysize(jwk->cjose_jwk, &cjose_err) / 8,
+				(const unsigned char *) sig->input, sig->input_len, md,
+				&md_len) == NULL) {
+			oidc_jose_error_openssl(err, "HMAC");
+			return TRUE;
+		}
+		*rc = ((md_len == sig->value_len)
+				&& (CRYPTO_memcmp(md, sig->value, md_len) == 0));
+		if (*rc == FALSE)
+			oidc_jose_error(err, "HMAC signature verification failed");
+		return TRUE;
+	}
+
+	pkey = oidc_jwk_evp_pkey(jwk);
+	if (pkey == NULL)
+		return FALSE;
+
+	ctx = EVP_MD_CTX_new();
+	if (ctx == NULL) {
+		oidc_jose_error_openssl(err, "EVP_MD_CTX_new");
+		return TRUE;
+	}
+
+	if (EVP_DigestVerifyInit(ctx, &pctx, sig->digest, NULL, pkey) != 1) {
+		oidc_jose_error_openssl(err, "EVP_DigestVerifyInit");
+		goto end;
+	}
+	/* RSASSA-PSS as used in JWS has a salt of the same length as the digest (-1) */
+	if ((sig->pss)
+			&& ((EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PSS_PADDING) != 1)
+					|| (EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, -1) != 1))) {
+		oidc_jose_error_openssl(err, "EVP_PKEY_CTX_set_rsa_padding");
+		goto end;
+	}
+	if (EVP_DigestVerifyUpdate(ctx, sig->input, sig->input_len) != 1) {
+		oidc_jose_error_openssl(err, "EVP_DigestVerifyUpdate");
+		goto end;
+	}
+	*rc = (EVP_DigestVerifyFinal(ctx, (unsigned char *) sig->value,
+			sig->value_len) == 1);
+	if (*rc == FALSE) {
+		oidc_jose_error(err, "RSA signature verification failed");
+		ERR_clear_error();
+	}
+
+end:
+	EVP_MD_CTX_free(ctx);
+
+	return TRUE;
+}
+
+/*
+ * verify the signature on a JWT with cjose
+ */
+static apr_byte_t oidc_jwt_verify_cjose(apr_pool_t *pool, oidc_jwt_t *jwt,
+		oidc_jwk_t *jwk, apr_byte_t *released, oidc_jose_error_t *err) {
+	cjose_err cjose_err;
 	apr_byte_t rc = FALSE;
 
+	if (oidc_jwt_cjose_import(pool, jwt, err) == FALSE) {
+		*released = TRUE;
+		return FALSE;
+	}
+
+	rc = cjose_jws_verify(jwt->cjose_jws, jwk->cjose_jwk, &cjose_err);
+	if (rc == FALSE) {
+		oidc_jose_error(err, "cjose_jws_verify failed: %s",
+				oidc_cjose_e2s(pool, cjose_err));
+		if (oidc_jose_version_deprecated(pool)) {
+			jwt->cjose_jws = NULL;
+			*released = TRUE;
+		}
+	}
+
+	return rc;
+}
+
+/*
+ * verify the signature on a JWT; RSA and HMAC signatures of a parsed JWS are verified
+ * directly with OpenSSL, before the payload needs to be parsed
+ */
+apr_byte_t oidc_jwt_verify(apr_pool_t *pool, oidc_jwt_t *jwt, apr_hash_t *keys,
+		oidc_jose_error_t *err) {
+	apr_byte_t rc = FALSE, released = FALSE;
+
 	oidc_jwk_t *jwk = NULL;
 	apr_hash_index_t *hi;
-	cjose_err cjose_err;
+	oidc_jws_signature_t sig;
+	apr_byte_t is_native = oidc_jws_signature_init(pool, jwt, &sig);
 
 	if (jwt->header.kid != NULL) {
 
 		jwk = apr_hash_get(keys, jwt->header.kid, APR_HASH_KEY_STRING);
 		if (jwk != NULL) {
-			rc = cjose_jws_verify(jwt->cjose_jws, jwk->cjose_jwk, &cjose_err);
-			if (rc == FALSE) {
-				oidc_jose_error(err, "cjose_jws_verify failed: %s",
-						oidc_cjose_e2s(pool, cjose_err));
-				if (oidc_jose_version_deprecated(pool))
-					jwt->cjose_jws = NULL;
-			}
+			if ((is_native == FALSE)
+					|| (oidc_jws_signature_verify(pool, &sig, jwk, &rc, err)
+							== FALSE))
+				rc = oidc_jwt_verify_cjose(pool, jwt, jwk, &released, err);
 		} else {
 			oidc_jose_error(err, "could not find key with kid: %s",
 					jwt->header.kid);
@@ -996,16 +1336,12 @@ apr_byte_t oidc_jwt_verify(apr_pool_t *pool, oidc_jwt_t *jwt, apr_hash_t *keys,
 		for (hi = apr_hash_first(pool, keys); hi; hi = apr_hash_next(hi)) {
 			apr_hash_this(hi, NULL, NULL, (void **) &jwk);
 			if (jwk->kty == oidc_jwt_alg2kty(jwt)) {
-				rc = cjose_jws_verify(jwt->cjose_jws, jwk->cjose_jwk,
-						&cjose_err);
-				if (rc == FALSE) {
-					oidc_jose_error(err, "cjose_jws_verify failed: %s",
-							oidc_cjose_e2s(pool, cjose_err));
-					if (oidc_jose_version_deprecated(pool))
-						jwt->cjose_jws = NULL;
-				}
+				if ((is_native == FALSE)
+						|| (oidc_jws_signature_verify(pool, &sig, jwk, &rc,
+								err) == FALSE))
+					rc = oidc_jwt_verify_cjose(pool, jwt, jwk, &released, err);
 			}
-			if ((rc == TRUE) || (jwt->cjose_jws == NULL))
+			if ((rc == TRUE) || (released == TRUE))
 				break;
 		}
 
@@ -64,6 +64,8 @@
 
 #include "cjose/cjose.h"
 
+#include <openssl/evp.h>
+
 #define OIDC_JOSE_ALG_SHA1 "sha1"
 #define OIDC_JOSE_ALG_SHA256 "sha256"
 
@@ -84,6 +86,10 @@
 #define OIDC_JOSE_JWK_X5T_STR "x5t" //X509 SHA-1 thumbprint
 #define OIDC_JOSE_JWK_X5T256_STR "x5t#S256" //X509 SHA-256 thumbprint
 
+/* JWE "zip" header name and the value that indicates a DEFLATE compressed plaintext */
+#define OIDC_JOSE_HDR_ZIP "zip"
+#define OIDC_JOSE_ZIP_DEFLATE "DEF"
+
 /* struct for returning errors to the caller */
 typedef struct {
 	char source[OIDC_JOSE_ERROR_SOURCE_LENGTH];
@@ -163,12 +169,18 @@ typedef struct oidc_jwk_t {
 	char *x5t_S256;
 	/* cjose JWK structure */
 	cjose_jwk_t *cjose_jwk;
+	/* OpenSSL public key created from the RSA key material on first use for signature verification */
+	EVP_PKEY *evp_pkey;
 } oidc_jwk_t;
 
 /* decrypt a JWT */
 apr_byte_t oidc_jwe_decrypt(apr_pool_t *pool, const char *input_json,
 		apr_hash_t *keys, char **s_json, oidc_jose_error_t *err,
 		apr_byte_t import_must_succeed);
+/* decrypt a JWE with a binary plaintext, returning its length and "zip" header value */
+apr_byte_t oidc_jwe_decrypt_bytes(apr_pool_t *pool, const char *input,
+		apr_hash_t *keys, char **plaintext, size_t *plaintext_len, char **zip,
+		oidc_jose_error_t *err, apr_byte_t import_must_succeed);
 /* parse a JSON string to a JWK struct */
 oidc_jwk_t *oidc_jwk_parse(apr_pool_t *pool, const char *s_json,
 		oidc_jose_error_t *err);
@@ -211,6 +223,8 @@ typedef struct oidc_jwt_hdr_t {
 	char *kid;
 	/* JWT "enc" claim value; encryption algorithm */
 	char *enc;
+	/* JWE "zip" header value; compression algorithm applied to the plaintext */
+	char *zip;
 } oidc_jwt_hdr_t;
 
 /* parsed JWT payload */
@@ -235,11 +249,21 @@ typedef struct oidc_jwt_t {
 	oidc_jwt_payload_t payload;
 	/* cjose JWS structure */
 	cjose_jws_t *cjose_jws;
+	/* compact serialization of a parsed JWS; imported into cjose_jws only when needed */
+	const char *cser;
 } oidc_jwt_t;
 
 /* parse a string into a JSON Web Token struct and (optionally) decrypt it */
 apr_byte_t oidc_jwt_parse(apr_pool_t *pool, const char *s_json,
 		oidc_jwt_t **j_jwt, apr_hash_t *keys, oidc_jose_error_t *err);
+/* parse (and optionally decrypt) a JSON Web Token but leave the payload to oidc_jwt_parse_payload */
+apr_byte_t oidc_jwt_parse_header(apr_pool_t *pool, const char *s_json,
+		oidc_jwt_t **j_jwt, apr_hash_t *keys, oidc_jose_error_t *err);
+/* parse the payload of a JSON Web Token that was parsed with oidc_jwt_parse_header */
+apr_byte_t oidc_jwt_parse_payload(apr_pool_t *pool, oidc_jwt_t *jwt,
+		oidc_jose_error_t *err);
+/* return whether a string is a compact serialized JWE */
+apr_byte_t oidc_jwe_is_compact(const char *input);
 /* sign a JWT with a JWK */
 apr_byte_t oidc_jwt_sign(apr_pool_t *pool, oidc_jwt_t *jwt, oidc_jwk_t *jwk,
 		oidc_jose_error_t *err);
@@ -252,6 +276,10 @@ char *oidc_jwt_serialize(apr_pool_t *pool, oidc_jwt_t *jwt,
 /* encrypt JWT */
 apr_byte_t oidc_jwt_encrypt(apr_pool_t *pool, oidc_jwt_t *jwe, oidc_jwk_t *jwk,
 		const char *payload, char **serialized, oidc_jose_error_t *err);
+/* encrypt a binary payload */
+apr_byte_t oidc_jwe_encrypt_bytes(apr_pool_t *pool, oidc_jwt_t *jwe,
+		oidc_jwk_t *jwk, const char *payload, size_t payload_len,
+		char **serialized, oidc_jose_error_t *err);
 
 /* create a new JWT */
 oidc_jwt_t *oidc_jwt_new(apr_pool_t *pool, int create_header,
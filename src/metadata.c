@@ -55,6 +55,8 @@
 #include <apr_time.h>
 #include <apr_strings.h>
 #include <apr_pools.h>
+#include <apr_lib.h>
+#include <apr_thread_mutex.h>
 
 #include <httpd.h>
 #include <http_log.h>
@@ -597,7 +599,8 @@ static apr_byte_t oidc_metadata_client_register(request_rec *r, oidc_cfg *cfg,
 	}
 
 	/* dynamically register the client with the specified parameters */
-	if (oidc_util_http_post_json(r, provider->registration_endpoint_url, data,
+	if (oidc_util_http_post_json(r, OIDC_METRICS_HTTP_REGISTRATION,
+			provider->registration_endpoint_url, data,
 			NULL, provider->registration_token, provider->ssl_validate_server, response,
 			cfg->http_timeout_short, cfg->outgoing_proxy,
 			oidc_dir_cfg_pass_cookies(r),
@@ -618,43 +621,150 @@ static apr_byte_t oidc_metadata_client_register(request_rec *r, oidc_cfg *cfg,
 }
 
 /*
- * helper function to get the JWKs for the specified issuer
+ * store a metadata document in the cache for ttl seconds; when stale copies may be
+ * served or refreshed ahead of time, the document is kept for longer and prefixed
+ * with the time until which it is fresh
  */
-static apr_byte_t oidc_metadata_jwks_retrieve_and_cache(request_rec *r,
-		oidc_cfg *cfg, const oidc_jwks_uri_t *jwks_uri, json_t **j_jwks) {
+static void oidc_metadata_cache_set(request_rec *r, oidc_cfg *cfg,
+		const char *section, const char *key, const char *value, int ttl) {
+	apr_time_t fresh_until = apr_time_now() + apr_time_from_sec(ttl);
+
+	if ((cfg->metadata_stale_ttl <= 0) && (cfg->metadata_refresh_ahead <= 0)) {
+		oidc_cache_set(r, section, key, value, fresh_until);
+		return;
+	}
+
+	oidc_cache_set(r, section, key,
+			apr_psprintf(r->pool, "%" APR_TIME_T_FMT ":%s",
+					apr_time_sec(fresh_until), value),
+			fresh_until + apr_time_from_sec(cfg->metadata_stale_ttl));
+}
+
+/*
+ * get a metadata document from the cache and fetch (and cache) it when it is not there;
+ * when it is stale or about to expire a single worker refreshes it while the others keep
+ * using the cached copy, which is also used when the refresh fails
+ */
+apr_byte_t oidc_metadata_cache_get_or_fetch(request_rec *r, oidc_cfg *cfg,
+		const char *section, const char *key, int ttl,
+		oidc_metadata_fetch_function fetch, const void *data, char **value,
+		apr_byte_t *fetched) {
+	char *cached = NULL, *p = NULL, *response = NULL;
+	apr_time_t fresh_until = 0;
+
+	if (fetched != NULL)
+		*fetched = FALSE;
+
+	oidc_cache_get(r, section, key, &cached);
+
+	if (cached != NULL) {
+
+		/* documents written without stale/refresh-ahead support have no prefix and are fresh */
+		if ((apr_isdigit(*cached)) && ((p = strchr(cached, ':')) != NULL)) {
+			*p = '\0';
+			fresh_until = apr_time_from_sec(apr_atoi64(cached));
+			cached = p + 1;
+		}
+
+		if ((fresh_until == 0)
+				|| (apr_time_now()
+						< fresh_until
+						- apr_time_from_sec(cfg->metadata_refresh_ahead))) {
+			*value = cached;
+			return TRUE;
+		}
+
+		/* the lease is not released but expires, which throttles retries when the refresh fails */
+		if (oidc_cache_lease_acquire(r, section, key,
+				apr_time_now() + apr_time_from_sec(cfg->http_timeout_long))
+				== FALSE) {
+			oidc_debug(r, "serving cached copy of %s while it is being refreshed",
+					key);
+			*value = cached;
+			return TRUE;
+		}
 
+		oidc_debug(r, "refreshing %s (expires in %" APR_TIME_T_FMT " seconds)",
+				key, apr_time_sec(fresh_until - apr_time_now()));
+	}
+
+	if (fetch(r, cfg, data, &response) == FALSE) {
+		if (cached == NULL)
+			return FALSE;
+		oidc_warn(r, "refresh of %s failed, serving the cached copy", key);
+		*value = cached;
+		return TRUE;
+	}
+
+	oidc_metadata_cache_set(r, cfg, section, key, response, ttl);
+
+	if (fetched != NULL)
+		*fetched = TRUE;
+	*value = response;
+
+	return TRUE;
+}
+
+/*
+ * retrieve and validate the JWKs at the specified URI
+ */
+static apr_byte_t oidc_metadata_jwks_retrieve(request_rec *r, oidc_cfg *cfg,
+		const void *data, char **value) {
+
+	const oidc_jwks_uri_t *jwks_uri = (const oidc_jwks_uri_t *) data;
 	char *response = NULL;
+	json_t *j_jwks = NULL;
 
 	/* no valid provider metadata, get it at the specified URL with the specified parameters */
-	if (oidc_util_http_get(r, jwks_uri->url, NULL, NULL,
+	if (oidc_util_http_get(r, OIDC_METRICS_HTTP_JWKS, jwks_uri->url, NULL, NULL,
 			NULL, jwks_uri->ssl_validate_server, &response, cfg->http_timeout_long,
 			cfg->outgoing_proxy, oidc_dir_cfg_pass_cookies(r), NULL,
 			NULL) == FALSE)
 		return FALSE;
 
 	/* decode and see if it is not an error response somehow */
-	if (oidc_util_decode_json_and_check_error(r, response, j_jwks) == FALSE) {
+	if (oidc_util_decode_json_and_check_error(r, response, &j_jwks) == FALSE) {
 		oidc_error(r, "JSON parsing of JWKs published at the jwks_uri failed");
 		return FALSE;
 	}
 
 	/* check to see if it is valid metadata */
-	if (oidc_metadata_jwks_is_valid(r, jwks_uri, *j_jwks) == FALSE)
+	if (oidc_metadata_jwks_is_valid(r, jwks_uri, j_jwks) == FALSE) {
+		json_decref(j_jwks);
+		return FALSE;
+	}
+
+	json_decref(j_jwks);
+
+	*value = response;
+
+	return TRUE;
+}
+
+/*
+ * helper function to get the JWKs for the specified issuer
+ */
+static apr_byte_t oidc_metadata_jwks_retrieve_and_cache(request_rec *r,
+		oidc_cfg *cfg, const oidc_jwks_uri_t *jwks_uri, char **value) {
+
+	if (oidc_metadata_jwks_retrieve(r, cfg, jwks_uri, value) == FALSE)
 		return FALSE;
 
 	/* store the JWKs in the cache */
-	oidc_cache_set_jwks(r, oidc_metadata_jwks_cache_key(r, jwks_uri->url),
-			response,
-			apr_time_now() + apr_time_from_sec(jwks_uri->refresh_interval));
+	oidc_metadata_cache_set(r, cfg, OIDC_CACHE_SECTION_JWKS,
+			oidc_metadata_jwks_cache_key(r, jwks_uri->url), *value,
+			jwks_uri->refresh_interval);
 
 	return TRUE;
 }
 
 /*
- * return JWKs for the specified issuer
+ * return the (unparsed) JWKs for the specified issuer
  */
-apr_byte_t oidc_metadata_jwks_get(request_rec *r, oidc_cfg *cfg,
-		const oidc_jwks_uri_t *jwks_uri, json_t **j_jwks, apr_byte_t *refresh) {
+apr_byte_t oidc_metadata_jwks_get_value(request_rec *r, oidc_cfg *cfg,
+		const oidc_jwks_uri_t *jwks_uri, char **value, apr_byte_t *refresh) {
+
+	apr_byte_t fetched = FALSE;
 
 	oidc_debug(r, "enter, jwks_uri=%s, refresh=%d", jwks_uri->url, *refresh);
 
@@ -663,21 +773,37 @@ apr_byte_t oidc_metadata_jwks_get(request_rec *r, oidc_cfg *cfg,
 		oidc_debug(r, "doing a forced refresh of the JWKs from URI \"%s\"",
 				jwks_uri->url);
 		if (oidc_metadata_jwks_retrieve_and_cache(r, cfg, jwks_uri,
-				j_jwks) == TRUE)
+				value) == TRUE)
 			return TRUE;
 		// else: fallback on any cached JWKs
 	}
 
-	/* see if the JWKs is cached */
-	char *value = NULL;
-	oidc_cache_get_jwks(r, oidc_metadata_jwks_cache_key(r, jwks_uri->url),
-			&value);
+	/* see if the JWKs is cached; if it is non-existing or expired it is refreshed */
+	*value = NULL;
+	if (oidc_metadata_cache_get_or_fetch(r, cfg, OIDC_CACHE_SECTION_JWKS,
+			oidc_metadata_jwks_cache_key(r, jwks_uri->url),
+			jwks_uri->refresh_interval, oidc_metadata_jwks_retrieve, jwks_uri,
+			value, &fetched) == FALSE)
+		return FALSE;
 
-	if (value == NULL) {
-		/* it is non-existing or expired: do a forced refresh */
+	/* a freshly retrieved JWKs doesn't need another forced refresh */
+	if (fetched == TRUE)
 		*refresh = TRUE;
-		return oidc_metadata_jwks_retrieve_and_cache(r, cfg, jwks_uri, j_jwks);
-	}
+
+	return TRUE;
+}
+
+/*
+ * return JWKs for the specified issuer
+ */
+apr_byte_t oidc_metadata_jwks_get(request_rec *r, oidc_cfg *cfg,
+		const oidc_jwks_uri_t *jwks_uri, json_t **j_jwks, apr_byte_t *refresh) {
+
+	char *value = NULL;
+
+	if (oidc_metadata_jwks_get_value(r, cfg, jwks_uri, &value,
+			refresh) == FALSE)
+		return FALSE;
 
 	/* decode and see if it is not an error response somehow */
 	if (oidc_util_decode_json_and_check_error(r, value, j_jwks) == FALSE) {
@@ -696,7 +822,7 @@ apr_byte_t oidc_metadata_provider_retrieve(request_rec *r, oidc_cfg *cfg,
 		char **response) {
 
 	/* get provider metadata from the specified URL with the specified parameters */
-	if (oidc_util_http_get(r, url, NULL, NULL, NULL,
+	if (oidc_util_http_get(r, OIDC_METRICS_HTTP_DISCOVERY, url, NULL, NULL, NULL,
 			cfg->provider.ssl_validate_server, response,
 			cfg->http_timeout_short, cfg->outgoing_proxy,
 			oidc_dir_cfg_pass_cookies(r),
@@ -735,6 +861,7 @@ static apr_byte_t oidc_metadata_provider_get(request_rec *r, oidc_cfg *cfg,
 	apr_finfo_t fi;
 	json_t *j_cache = NULL;
 	apr_byte_t have_cache = FALSE;
+	apr_time_t fresh_until = 0;
 
 	/* see if we are refreshing metadata and we need a refresh */
 	if (cfg->provider_metadata_refresh_interval > 0) {
@@ -742,11 +869,27 @@ static apr_byte_t oidc_metadata_provider_get(request_rec *r, oidc_cfg *cfg,
 		have_cache = (apr_stat(&fi, provider_path, APR_FINFO_MTIME, r->pool)
 				== APR_SUCCESS);
 
-		if (have_cache == TRUE)
+		if (have_cache == TRUE) {
+			fresh_until = fi.mtime
+					+ apr_time_from_sec(cfg->provider_metadata_refresh_interval);
 			use_cache = (apr_time_now()
-					< fi.mtime
-					+ apr_time_from_sec(
-							cfg->provider_metadata_refresh_interval));
+					< fresh_until
+					- apr_time_from_sec(cfg->metadata_refresh_ahead));
+
+			/* let a single worker refresh it while others use the (stale) copy */
+			if ((use_cache == FALSE)
+					&& ((cfg->metadata_stale_ttl > 0)
+							|| (cfg->metadata_refresh_ahead > 0))
+					&& (apr_time_now()
+							< fresh_until
+							+ apr_time_from_sec(cfg->metadata_stale_ttl))
+					&& (oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_PROVIDER,
+							provider_path,
+							apr_time_now()
+							+ apr_time_from_sec(cfg->http_timeout_long))
+							== FALSE))
+				use_cache = TRUE;
+		}
 
 		oidc_debug(r, "use_cache: %s", use_cache ? "yes" : "no");
 	}
@@ -875,28 +1018,138 @@ static apr_byte_t oidc_metadata_client_get(request_rec *r, oidc_cfg *cfg,
 	return TRUE;
 }
 
+/* a provider parsed from the metadata directory, shared between the requests in a child process */
+typedef struct oidc_metadata_entry_t {
+	/* pool from which the entry and the parsed provider are allocated */
+	apr_pool_t *pool;
+	/* registry key: the issuer as used in the metadata filenames */
+	const char *key;
+	oidc_provider_t *provider;
+	/* modification times of the .provider, .conf and .client files it was parsed from */
+	apr_time_t mtime[3];
+	/* last time at which the files were checked for modifications */
+	apr_time_t checked;
+	/* time at which a provider metadata refresh or a client secret expiry requires a full reload */
+	apr_time_t valid_until;
+	/* number of requests using this entry */
+	int refcount;
+	/* whether this is still the most recent entry for the issuer */
+	apr_byte_t current;
+} oidc_metadata_entry_t;
+
+/* minimum interval between checks of the metadata files for modifications */
+#define OIDC_METADATA_REGISTRY_CHECK_INTERVAL apr_time_from_sec(1)
+
+/* per-process registry of parsed providers and the issuers in the metadata directory */
+static apr_pool_t *oidc_metadata_registry_pool = NULL;
+static apr_hash_t *oidc_metadata_registry = NULL;
+static apr_pool_t *oidc_metadata_registry_list_pool = NULL;
+static apr_array_header_t *oidc_metadata_registry_list = NULL;
+static apr_time_t oidc_metadata_registry_list_mtime = 0;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *oidc_metadata_registry_mutex = NULL;
+#endif
+
+#if APR_HAS_THREADS
+#define oidc_metadata_registry_lock() apr_thread_mutex_lock(oidc_metadata_registry_mutex)
+#define oidc_metadata_registry_unlock() apr_thread_mutex_unlock(oidc_metadata_registry_mutex)
+#else
+#define oidc_metadata_registry_lock()
+#define oidc_metadata_registry_unlock()
+#endif
+
 /*
- * get a list of configured OIDC providers based on the entries in the provider metadata directory
+ * initialize the per-process registry of providers in the metadata directory in a child process
  */
-apr_byte_t oidc_metadata_list(request_rec *r, oidc_cfg *cfg,
-		apr_array_header_t **list) {
+apr_status_t oidc_metadata_registry_child_init(apr_pool_t *p, server_rec *s) {
+	apr_status_t rv = APR_SUCCESS;
+#if APR_HAS_THREADS
+	rv = apr_thread_mutex_create(&oidc_metadata_registry_mutex,
+			APR_THREAD_MUTEX_DEFAULT, p);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s, "apr_thread_mutex_create failed: %d", rv);
+		return rv;
+	}
+#endif
+	oidc_metadata_registry = apr_hash_make(p);
+	oidc_metadata_registry_pool = p;
+	return rv;
+}
+
+/*
+ * release a registry entry at the end of the request that used it
+ */
+static apr_status_t oidc_metadata_registry_release(void *data) {
+	oidc_metadata_entry_t *entry = (oidc_metadata_entry_t *) data;
+	oidc_metadata_registry_lock();
+	entry->refcount--;
+	if ((entry->refcount == 0) && (entry->current == FALSE))
+		apr_pool_destroy(entry->pool);
+	oidc_metadata_registry_unlock();
+	return APR_SUCCESS;
+}
+
+/*
+ * get the modification times of the .provider, .conf and .client files of an issuer
+ */
+static void oidc_metadata_registry_mtimes(request_rec *r, const char *issuer,
+		apr_time_t *mtime) {
+	const char *paths[] = { oidc_metadata_provider_file_path(r, issuer),
+			oidc_metadata_conf_path(r, issuer), oidc_metadata_client_file_path(
+					r, issuer) };
+	apr_finfo_t fi;
+	int i;
+	for (i = 0; i < 3; i++)
+		mtime[i] = (apr_stat(&fi, paths[i], APR_FINFO_MTIME, r->pool)
+				== APR_SUCCESS) ? fi.mtime : 0;
+}
+
+/*
+ * get the directory listing of the provider metadata directory, re-reading it only when it was modified
+ */
+static apr_byte_t oidc_metadata_registry_list_get(request_rec *r,
+		oidc_cfg *cfg, apr_array_header_t **names) {
 	apr_status_t rc;
 	apr_dir_t *dir;
 	apr_finfo_t fi;
+	apr_time_t mtime = 0;
+	apr_pool_t *pool = r->pool;
 	char s_err[128];
+	int i;
 
-	oidc_debug(r, "enter");
+	if (apr_stat(&fi, cfg->metadata_dir, APR_FINFO_MTIME, r->pool)
+			== APR_SUCCESS)
+		mtime = fi.mtime;
+
+	/* copy the issuers from the cached listing */
+	if (oidc_metadata_registry != NULL) {
+		oidc_metadata_registry_lock();
+		if ((oidc_metadata_registry_list != NULL)
+				&& (mtime == oidc_metadata_registry_list_mtime)) {
+			*names = apr_array_make(r->pool,
+					oidc_metadata_registry_list->nelts, sizeof(const char*));
+			for (i = 0; i < oidc_metadata_registry_list->nelts; i++)
+				*(const char**) apr_array_push(*names) = apr_pstrdup(r->pool,
+						APR_ARRAY_IDX(oidc_metadata_registry_list, i,
+								const char*));
+			oidc_metadata_registry_unlock();
+			return TRUE;
+		}
+		apr_pool_create(&pool, oidc_metadata_registry_pool);
+		oidc_metadata_registry_unlock();
+	}
 
 	/* open the metadata directory */
 	if ((rc = apr_dir_open(&dir, cfg->metadata_dir, r->pool)) != APR_SUCCESS) {
 		oidc_error(r, "error opening metadata directory '%s' (%s)",
 				cfg->metadata_dir, apr_strerror(rc, s_err, sizeof(s_err)));
+		if (pool != r->pool)
+			apr_pool_destroy(pool);
 		return FALSE;
 	}
 
-	/* allocate some space in the array that will hold the list of providers */
-	*list = apr_array_make(r->pool, 5, sizeof(const char*));
-	/* BTW: we could estimate the number in the array based on # directory entries... */
+	/* allocate some space in the array that will hold the list of issuers */
+	*names = apr_array_make(pool, 5, sizeof(const char*));
 
 	/* loop over the entries in the provider metadata directory */
 	while (apr_dir_read(&fi, APR_FINFO_NAME, dir) == APR_SUCCESS) {
@@ -911,19 +1164,59 @@ apr_byte_t oidc_metadata_list(request_rec *r, oidc_cfg *cfg,
 			continue;
 
 		/* get the issuer from the filename */
-		const char *issuer = oidc_metadata_filename_to_issuer(r, fi.name);
+		*(const char**) apr_array_push(*names) = apr_pstrdup(pool,
+				oidc_metadata_filename_to_issuer(r, fi.name));
+	}
+
+	/* we're done, cleanup now */
+	apr_dir_close(dir);
+
+	if (pool == r->pool)
+		return TRUE;
+
+	/* replace the cached listing and hand out a copy of it */
+	oidc_metadata_registry_lock();
+	if (oidc_metadata_registry_list_pool != NULL)
+		apr_pool_destroy(oidc_metadata_registry_list_pool);
+	oidc_metadata_registry_list_pool = pool;
+	oidc_metadata_registry_list = *names;
+	oidc_metadata_registry_list_mtime = mtime;
+	*names = apr_array_copy(r->pool, oidc_metadata_registry_list);
+	for (i = 0; i < (*names)->nelts; i++)
+		APR_ARRAY_IDX(*names, i, const char*) = apr_pstrdup(r->pool,
+				APR_ARRAY_IDX(*names, i, const char*));
+	oidc_metadata_registry_unlock();
+
+	return TRUE;
+}
+
+/*
+ * get a list of configured OIDC providers based on the entries in the provider metadata directory
+ */
+apr_byte_t oidc_metadata_list(request_rec *r, oidc_cfg *cfg,
+		apr_array_header_t **list) {
+	apr_array_header_t *names = NULL;
+	int i;
+
+	oidc_debug(r, "enter");
+
+	if (oidc_metadata_registry_list_get(r, cfg, &names) == FALSE)
+		return FALSE;
+
+	/* allocate some space in the array that will hold the list of providers */
+	*list = apr_array_make(r->pool, names->nelts, sizeof(const char*));
+
+	for (i = 0; i < names->nelts; i++) {
 
 		/* get the provider and client metadata, do all checks and registration if possible */
 		oidc_provider_t *provider = NULL;
-		if (oidc_metadata_get(r, cfg, issuer, &provider, FALSE) == TRUE) {
+		if (oidc_metadata_get(r, cfg, APR_ARRAY_IDX(names, i, const char*),
+				&provider, FALSE) == TRUE) {
 			/* push the decoded issuer filename in to the array */
 			*(const char**) apr_array_push(*list) = provider->issuer;
 		}
 	}
 
-	/* we're done, cleanup now */
-	apr_dir_close(dir);
-
 	return TRUE;
 }
 
@@ -1438,13 +1731,15 @@ apr_byte_t oidc_metadata_client_parse(request_rec *r, oidc_cfg *cfg,
 }
 
 /*
- * get the metadata for a specified issuer
+ * read the metadata for a specified issuer from the metadata directory and parse it
  *
  * this fill the oidc_provider_t struct based on the issuer filename by reading and merging
- * contents from both provider metadata directory and client metadata directory
+ * contents from both provider metadata directory and client metadata directory; the struct
+ * is allocated from the pool of request "pr", which may differ from the processing request "r"
  */
-apr_byte_t oidc_metadata_get(request_rec *r, oidc_cfg *cfg, const char *issuer,
-		oidc_provider_t **provider, apr_byte_t allow_discovery) {
+static apr_byte_t oidc_metadata_load(request_rec *r, request_rec *pr,
+		oidc_cfg *cfg, const char *issuer, oidc_provider_t **provider,
+		apr_byte_t allow_discovery, apr_time_t *valid_until) {
 
 	apr_byte_t rc = FALSE;
 
@@ -1452,9 +1747,10 @@ apr_byte_t oidc_metadata_get(request_rec *r, oidc_cfg *cfg, const char *issuer,
 	json_t *j_provider = NULL;
 	json_t *j_client = NULL;
 	json_t *j_conf = NULL;
+	json_t *j_expires_at = NULL;
 
 	/* allocate space for a parsed-and-merged metadata struct */
-	*provider = apr_pcalloc(r->pool, sizeof(oidc_provider_t));
+	*provider = apr_pcalloc(pr->pool, sizeof(oidc_provider_t));
 	oidc_cfg_provider_init(*provider);
 
 	/*
@@ -1465,19 +1761,27 @@ apr_byte_t oidc_metadata_get(request_rec *r, oidc_cfg *cfg, const char *issuer,
 	if (oidc_metadata_provider_get(r, cfg, issuer, &j_provider,
 			allow_discovery) == FALSE)
 		goto end;
-	if (oidc_metadata_provider_parse(r, cfg, j_provider, *provider) == FALSE)
+	if (oidc_metadata_provider_parse(pr, cfg, j_provider, *provider) == FALSE)
 		goto end;
 
 	if (oidc_metadata_conf_get(r, cfg, issuer, &j_conf) == FALSE)
 		goto end;
-	if (oidc_metadata_conf_parse(r, cfg, j_conf, *provider) == FALSE)
+	if (oidc_metadata_conf_parse(pr, cfg, j_conf, *provider) == FALSE)
 		goto end;
 
 	if (oidc_metadata_client_get(r, cfg, issuer, *provider, &j_client) == FALSE)
 		goto end;
-	if (oidc_metadata_client_parse(r, cfg, j_client, *provider) == FALSE)
+	if (oidc_metadata_client_parse(pr, cfg, j_client, *provider) == FALSE)
 		goto end;
 
+	/* the parsed provider must be reloaded when the client secret expires */
+	*valid_until = 0;
+	j_expires_at = json_object_get(j_client,
+			OIDC_METADATA_CLIENT_SECRET_EXPIRES_AT);
+	if ((j_expires_at != NULL) && (json_is_integer(j_expires_at))
+			&& (json_integer_value(j_expires_at) > 0))
+		*valid_until = apr_time_from_sec(json_integer_value(j_expires_at));
+
 	rc = TRUE;
 
 end:
@@ -1491,3 +1795,129 @@ end:
 
 	return rc;
 }
+
+/*
+ * get a current entry for an issuer from the registry, checking the metadata files for modifications
+ */
+static oidc_metadata_entry_t *oidc_metadata_registry_get(request_rec *r,
+		const char *key, const char *issuer) {
+	oidc_metadata_entry_t *entry = NULL;
+	apr_time_t mtime[3];
+	apr_time_t now = apr_time_now();
+	apr_byte_t check = FALSE;
+
+	oidc_metadata_registry_lock();
+	entry = apr_hash_get(oidc_metadata_registry, key, APR_HASH_KEY_STRING);
+	if ((entry != NULL)
+			&& ((entry->valid_until == 0) || (now < entry->valid_until))) {
+		entry->refcount++;
+		check = (now >= entry->checked + OIDC_METADATA_REGISTRY_CHECK_INTERVAL);
+		if (check)
+			entry->checked = now;
+	} else {
+		entry = NULL;
+	}
+	oidc_metadata_registry_unlock();
+
+	if (entry == NULL)
+		return NULL;
+
+	apr_pool_cleanup_register(r->pool, entry, oidc_metadata_registry_release,
+			apr_pool_cleanup_null);
+
+	/* stat the files outside of the lock */
+	if (check) {
+		oidc_metadata_registry_mtimes(r, issuer, mtime);
+		if (memcmp(mtime, entry->mtime, sizeof(mtime)) != 0) {
+			oidc_debug(r, "metadata files for issuer %s were modified", issuer);
+			return NULL;
+		}
+	}
+
+	return entry;
+}
+
+/*
+ * get the metadata for a specified issuer
+ *
+ * in a child process the parsed provider is kept in a registry indexed by server config and issuer, so the
+ * metadata files are only read and parsed again when they have been modified; the returned
+ * provider is shared and remains valid for the lifetime of the request
+ */
+apr_byte_t oidc_metadata_get(request_rec *r, oidc_cfg *cfg, const char *issuer,
+		oidc_provider_t **provider, apr_byte_t allow_discovery) {
+	oidc_metadata_entry_t *entry = NULL, *old = NULL;
+	apr_pool_t *pool = NULL;
+	apr_time_t valid_until = 0;
+	request_rec pr;
+
+	/* not running in a child process: read and parse the metadata for this request */
+	if (oidc_metadata_registry == NULL)
+		return oidc_metadata_load(r, r, cfg, issuer, provider, allow_discovery,
+				&valid_until);
+
+	/* the provider is parsed with the defaults and the metadata directory of this (virtual) server */
+	const char *key = apr_psprintf(r->pool, "%pp:%s", cfg,
+			oidc_metadata_issuer_to_filename(r, issuer));
+
+	entry = oidc_metadata_registry_get(r, key, issuer);
+	if (entry != NULL) {
+		*provider = entry->provider;
+		return TRUE;
+	}
+
+	oidc_metadata_registry_lock();
+	apr_pool_create(&pool, oidc_metadata_registry_pool);
+	oidc_metadata_registry_unlock();
+
+	entry = apr_pcalloc(pool, sizeof(oidc_metadata_entry_t));
+	entry->pool = pool;
+	entry->key = apr_pstrdup(pool, key);
+	entry->checked = apr_time_now();
+
+	/* record the modification times before reading so a concurrent modification triggers a reload */
+	oidc_metadata_registry_mtimes(r, issuer, entry->mtime);
+
+	/* parse in to the pool of the entry, using a copy of the request with that pool */
+	pr = *r;
+	pr.pool = pool;
+	if (oidc_metadata_load(r, &pr, cfg, issuer, &entry->provider,
+			allow_discovery, &valid_until) == FALSE) {
+		oidc_metadata_registry_lock();
+		apr_pool_destroy(pool);
+		oidc_metadata_registry_unlock();
+		return FALSE;
+	}
+
+	/* a full reload is also required when the provider metadata needs to be refreshed */
+	if ((cfg->provider_metadata_refresh_interval > 0) && (entry->mtime[0] > 0)) {
+		apr_time_t refresh_at = entry->mtime[0]
+				+ apr_time_from_sec(cfg->provider_metadata_refresh_interval)
+				- apr_time_from_sec(cfg->metadata_refresh_ahead);
+		if ((valid_until == 0) || (refresh_at < valid_until))
+			valid_until = refresh_at;
+	}
+	entry->valid_until = valid_until;
+
+	oidc_metadata_registry_lock();
+	old = apr_hash_get(oidc_metadata_registry, key, APR_HASH_KEY_STRING);
+	if (old != NULL) {
+		/* remove the entry first since its key is allocated from the old pool */
+		apr_hash_set(oidc_metadata_registry, key, APR_HASH_KEY_STRING, NULL);
+		old->current = FALSE;
+		if (old->refcount == 0)
+			apr_pool_destroy(old->pool);
+	}
+	entry->current = TRUE;
+	entry->refcount = 1;
+	apr_hash_set(oidc_metadata_registry, entry->key, APR_HASH_KEY_STRING,
+			entry);
+	oidc_metadata_registry_unlock();
+
+	apr_pool_cleanup_register(r->pool, entry, oidc_metadata_registry_release,
+			apr_pool_cleanup_null);
+
+	*provider = entry->provider;
+
+	return TRUE;
+}
@@ -0,0 +1,530 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/***************************************************************************
+ * Copyright (C) 2017-2020 ZmartZone IAM
+ * Copyright (C) 2013-2017 Ping Identity Corporation
+ * All rights reserved.
+ *
+ * For further information please contact:
+ *
+ *      Ping Identity Corporation
+ *      1099 18th St Suite 2950
+ *      Denver, CO 80202
+ *      303.468.2900
+ *      http://www.pingidentity.com
+ *
+ * DISCLAIMER OF WARRANTIES:
+ *
+ * THE SOFTWARE PROVIDED HEREUNDER IS PROVIDED ON AN "AS IS" BASIS, WITHOUT
+ * ANY WARRANTIES OR REPRESENTATIONS EXPRESS, IMPLIED OR STATUTORY; INCLUDING,
+ * WITHOUT LIMITATION, WARRANTIES OF QUALITY, PERFORMANCE, NONINFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.  NOR ARE THERE ANY
+ * WARRANTIES CREATED BY A COURSE OR DEALING, COURSE OF PERFORMANCE OR TRADE
+ * USAGE.  FURTHERMORE, THERE ARE NO WARRANTIES THAT THE SOFTWARE WILL MEET
+ * YOUR NEEDS OR BE FREE FROM ERRORS, OR THAT THE OPERATION OF THE SOFTWARE
+ * WILL BE UNINTERRUPTED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * latency/size histograms and counters for outbound HTTP calls, cache operations, JWT verification and
+ * session storage, kept in shared memory and exposed in Prometheus text format and in request notes
+ *
+ * @Author: Hans Zandbelt - hans.zandbelt@zmartzone.eu
+ */
+
+#include <httpd.h>
+#include <http_config.h>
+#include <http_log.h>
+
+#include "apr_shm.h"
+
+#include "mod_auth_openidc.h"
+
+extern module AP_MODULE_DECLARE_DATA auth_openidc_module;
+
+/*
+ * children update the counters in the shared memory segment with atomic
+ * additions instead of taking a lock; on compilers that we can't get those
+ * from, metrics are not collected
+ */
+#if defined(__GNUC__)
+#define OIDC_METRICS_ADD(p, v) __sync_fetch_and_add(p, v)
+#define OIDC_METRICS_ATOMIC 1
+#else
+#define OIDC_METRICS_ADD(p, v)
+#define OIDC_METRICS_ATOMIC 0
+#endif
+
+/* number of upper bounds of a histogram; there is an additional +Inf bucket */
+#define OIDC_METRICS_BOUNDS 14
+
+/* upper bounds of the latency histograms in microseconds */
+static const apr_uint64_t oidc_metrics_time_bounds[OIDC_METRICS_BOUNDS] = {
+		500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+		1000000, 2500000, 5000000, 10000000 };
+
+/* the same upper bounds in seconds, as used in the "le" label */
+static const char *oidc_metrics_time_les[OIDC_METRICS_BOUNDS] = {
+		"0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1",
+		"0.25", "0.5", "1", "2.5", "5", "10" };
+
+/* upper bounds of the size histograms in bytes */
+static const apr_uint64_t oidc_metrics_size_bounds[OIDC_METRICS_BOUNDS] = {
+		128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536, 131072,
+		262144, 524288, 1048576 };
+
+static const char *oidc_metrics_size_les[OIDC_METRICS_BOUNDS] = {
+		"128", "256", "512", "1024", "2048", "4096", "8192", "16384", "32768",
+		"65536", "131072", "262144", "524288", "1048576" };
+
+/* label values of the outbound HTTP call types, indexed by OIDC_METRICS_HTTP_* */
+static const char *oidc_metrics_http_types[OIDC_METRICS_HTTP_MAX] = {
+		"token", "userinfo", "introspection", "jwks", "discovery",
+		"registration", "revocation", "other" };
+
+/* the cache backends that metrics are kept for, the last one is the per-process L1 cache */
+static const char *oidc_metrics_cache_backends[] = {
+		"shm", "file", "memcache", "redis", "l1", NULL };
+#define OIDC_METRICS_CACHE_BACKENDS 5
+
+/* the cache sections that metrics are kept for and their label values */
+static const char *oidc_metrics_cache_sections[] = {
+		OIDC_CACHE_SECTION_SESSION,
+		OIDC_CACHE_SECTION_NONCE,
+		OIDC_CACHE_SECTION_JWKS,
+		OIDC_CACHE_SECTION_ACCESS_TOKEN,
+		OIDC_CACHE_SECTION_PROVIDER,
+		OIDC_CACHE_SECTION_OAUTH_PROVIDER,
+		OIDC_CACHE_SECTION_JTI,
+		OIDC_CACHE_SECTION_REQUEST_URI,
+		OIDC_CACHE_SECTION_SID,
+		OIDC_CACHE_SECTION_SESSION_EXPIRY,
+		OIDC_CACHE_SECTION_LEASE,
+		OIDC_CACHE_SECTION_SUB,
+		NULL };
+static const char *oidc_metrics_cache_section_names[] = {
+		"session", "nonce", "jwks", "access_token", "provider",
+		"oauth_provider", "jti", "request_uri", "sid", "session_expiry",
+		"lease", "sub", NULL };
+#define OIDC_METRICS_CACHE_SECTIONS 12
+
+/* label values of the cache operations and results, indexed by OIDC_METRICS_CACHE_* */
+static const char *oidc_metrics_cache_ops[OIDC_METRICS_CACHE_OP_MAX] = {
+		"get", "set" };
+static const char *oidc_metrics_cache_results[OIDC_METRICS_CACHE_RESULT_MAX] =
+		{ "hit", "miss", "ok", "error" };
+
+/* the JWS algorithms that metrics are kept for, the last one is used for all others */
+static const char *oidc_metrics_jwt_algs[] = {
+		"HS256", "HS384", "HS512", "RS256", "RS384", "RS512", "PS256", "PS384",
+		"PS512", "ES256", "ES384", "ES512", "other", NULL };
+#define OIDC_METRICS_JWT_ALGS 13
+
+/* label values of the session operations, indexed by OIDC_METRICS_SESSION_* */
+static const char *oidc_metrics_session_ops[OIDC_METRICS_SESSION_OP_MAX] = {
+		"load", "save" };
+
+/* names of the request notes with the time spent in microseconds, indexed by OIDC_METRICS_NOTE_* */
+static const char *oidc_metrics_notes[] = {
+		"oidc-http-usec", "oidc-cache-usec", "oidc-jwt-verify-usec",
+		"oidc-session-usec" };
+#define OIDC_METRICS_NOTE_HTTP    0
+#define OIDC_METRICS_NOTE_CACHE   1
+#define OIDC_METRICS_NOTE_JWT     2
+#define OIDC_METRICS_NOTE_SESSION 3
+#define OIDC_METRICS_NOTE_MAX     4
+
+#define OIDC_METRICS_USERDATA_KEY "mod_auth_openidc_metrics"
+
+/* a histogram with non-cumulative bucket counts and the sum of the observed values */
+typedef struct oidc_metrics_histogram_t {
+	apr_uint64_t buckets[OIDC_METRICS_BOUNDS + 1];
+	apr_uint64_t sum;
+} oidc_metrics_histogram_t;
+
+/* the contents of the shared memory segment */
+typedef struct oidc_metrics_t {
+	oidc_metrics_histogram_t http[OIDC_METRICS_HTTP_MAX];
+	apr_uint64_t http_errors[OIDC_METRICS_HTTP_MAX];
+	oidc_metrics_histogram_t cache[OIDC_METRICS_CACHE_BACKENDS][OIDC_METRICS_CACHE_SECTIONS][OIDC_METRICS_CACHE_OP_MAX];
+	apr_uint64_t cache_results[OIDC_METRICS_CACHE_BACKENDS][OIDC_METRICS_CACHE_SECTIONS][OIDC_METRICS_CACHE_RESULT_MAX];
+	oidc_metrics_histogram_t jwt[OIDC_METRICS_JWT_ALGS];
+	apr_uint64_t jwt_errors[OIDC_METRICS_JWT_ALGS];
+	oidc_metrics_histogram_t session[OIDC_METRICS_SESSION_OP_MAX];
+	oidc_metrics_histogram_t session_size[OIDC_METRICS_SESSION_OP_MAX];
+} oidc_metrics_t;
+
+/* the shared memory segment, inherited by the children; NULL when metrics are not collected */
+static apr_shm_t *oidc_metrics_shm = NULL;
+static oidc_metrics_t *oidc_metrics = NULL;
+
+/*
+ * forget about the shared memory segment when the configuration pool that holds it is cleared
+ */
+static apr_status_t oidc_metrics_cleanup(void *data) {
+	oidc_metrics_shm = NULL;
+	oidc_metrics = NULL;
+	return APR_SUCCESS;
+}
+
+/*
+ * create the shared memory segment in the parent process when any server has metrics enabled
+ */
+apr_byte_t oidc_metrics_post_config(apr_pool_t *pool, server_rec *s) {
+	server_rec *sp = s;
+	apr_status_t rv = APR_SUCCESS;
+
+	while (sp != NULL) {
+		oidc_cfg *cfg = (oidc_cfg *) ap_get_module_config(sp->module_config,
+				&auth_openidc_module);
+		if (cfg->metrics == 1)
+			break;
+		sp = sp->next;
+	}
+	if (sp == NULL)
+		return TRUE;
+
+	if (OIDC_METRICS_ATOMIC == 0) {
+		oidc_swarn(s,
+				"metrics are not supported on this platform; " OIDCMetrics " is ignored");
+		return TRUE;
+	}
+
+	/* the segment is created in the configuration pool so it is removed on a restart */
+	rv = apr_shm_create(&oidc_metrics_shm, sizeof(oidc_metrics_t), NULL, pool);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s,
+				"apr_shm_create failed to create shared memory segment for metrics");
+		oidc_metrics_shm = NULL;
+		return FALSE;
+	}
+	oidc_metrics = apr_shm_baseaddr_get(oidc_metrics_shm);
+	memset(oidc_metrics, 0, sizeof(oidc_metrics_t));
+	apr_pool_cleanup_register(pool, NULL, oidc_metrics_cleanup,
+			apr_pool_cleanup_null);
+
+	oidc_sdebug(s,
+			"initialized shared memory for metrics using %" APR_SIZE_T_FMT " bytes",
+			sizeof(oidc_metrics_t));
+
+	return TRUE;
+}
+
+/*
+ * add an observation to a histogram
+ */
+static void oidc_metrics_observe(oidc_metrics_histogram_t *h,
+		const apr_uint64_t *bounds, apr_uint64_t value) {
+	int i = 0;
+	while ((i < OIDC_METRICS_BOUNDS) && (value > bounds[i]))
+		i++;
+	OIDC_METRICS_ADD(&h->buckets[i], 1);
+	OIDC_METRICS_ADD(&h->sum, value);
+}
+
+/*
+ * add the time elapsed since start to a request note so it can be logged with %{...}n
+ */
+static apr_uint64_t oidc_metrics_note(request_rec *r, int note,
+		apr_time_t start) {
+	apr_time_t elapsed = apr_time_now() - start;
+	apr_time_t *totals = NULL;
+
+	if (elapsed < 0)
+		elapsed = 0;
+
+	/* subrequests account for the main request */
+	while (r->main != NULL)
+		r = r->main;
+
+	apr_pool_userdata_get((void **) &totals, OIDC_METRICS_USERDATA_KEY,
+			r->pool);
+	if (totals == NULL) {
+		totals = apr_pcalloc(r->pool, OIDC_METRICS_NOTE_MAX * sizeof(apr_time_t));
+		apr_pool_userdata_setn(totals, OIDC_METRICS_USERDATA_KEY, NULL,
+				r->pool);
+	}
+	totals[note] += elapsed;
+	apr_table_setn(r->notes, oidc_metrics_notes[note],
+			apr_psprintf(r->pool, "%" APR_TIME_T_FMT, totals[note]));
+
+	return (apr_uint64_t) elapsed;
+}
+
+/*
+ * get the index of a string in a NULL terminated list, or -1 if it is not in there
+ */
+static int oidc_metrics_index(const char *list[], const char *value) {
+	int i;
+	if (value == NULL)
+		return -1;
+	for (i = 0; list[i] != NULL; i++)
+		if (apr_strnatcmp(list[i], value) == 0)
+			return i;
+	return -1;
+}
+
+/*
+ * record an outbound HTTP call that was started at the specified time
+ */
+void oidc_metrics_http(request_rec *r, int type, apr_time_t start,
+		apr_byte_t success) {
+	apr_uint64_t elapsed;
+
+	if ((oidc_metrics == NULL) || (type < 0) || (type >= OIDC_METRICS_HTTP_MAX))
+		return;
+
+	elapsed = oidc_metrics_note(r, OIDC_METRICS_NOTE_HTTP, start);
+	oidc_metrics_observe(&oidc_metrics->http[type], oidc_metrics_time_bounds,
+			elapsed);
+	if (success == FALSE)
+		OIDC_METRICS_ADD(&oidc_metrics->http_errors[type], 1);
+}
+
+/*
+ * record the time spent in a cache backend operation that was started at the specified time
+ */
+void oidc_metrics_cache_timing(request_rec *r, const char *backend,
+		const char *section, int op, apr_time_t start) {
+	apr_uint64_t elapsed;
+	int b, s;
+
+	if ((oidc_metrics == NULL) || (op < 0) || (op >= OIDC_METRICS_CACHE_OP_MAX))
+		return;
+
+	b = oidc_metrics_index(oidc_metrics_cache_backends, backend);
+	s = oidc_metrics_index(oidc_metrics_cache_sections, section);
+	if ((b < 0) || (s < 0))
+		return;
+
+	elapsed = oidc_metrics_note(r, OIDC_METRICS_NOTE_CACHE, start);
+	oidc_metrics_observe(&oidc_metrics->cache[b][s][op],
+			oidc_metrics_time_bounds, elapsed);
+}
+
+/*
+ * record the result of a cache operation on a single entry
+ */
+void oidc_metrics_cache_result(request_rec *r, const char *backend,
+		const char *section, int result) {
+	int b, s;
+
+	if ((oidc_metrics == NULL) || (result < 0)
+			|| (result >= OIDC_METRICS_CACHE_RESULT_MAX))
+		return;
+
+	b = oidc_metrics_index(oidc_metrics_cache_backends, backend);
+	s = oidc_metrics_index(oidc_metrics_cache_sections, section);
+	if ((b < 0) || (s < 0))
+		return;
+
+	OIDC_METRICS_ADD(&oidc_metrics->cache_results[b][s][result], 1);
+}
+
+/*
+ * record a JWT signature verification that was started at the specified time
+ */
+void oidc_metrics_jwt_verify(request_rec *r, const char *alg,
+		apr_time_t start, apr_byte_t success) {
+	apr_uint64_t elapsed;
+	int a;
+
+	if (oidc_metrics == NULL)
+		return;
+
+	a = oidc_metrics_index(oidc_metrics_jwt_algs, alg);
+	if (a < 0)
+		a = OIDC_METRICS_JWT_ALGS - 1;
+
+	elapsed = oidc_metrics_note(r, OIDC_METRICS_NOTE_JWT, start);
+	oidc_metrics_observe(&oidc_metrics->jwt[a], oidc_metrics_time_bounds,
+			elapsed);
+	if (success == FALSE)
+		OIDC_METRICS_ADD(&oidc_metrics->jwt_errors[a], 1);
+}
+
+/*
+ * record a session load or save that was started at the specified time
+ */
+void oidc_metrics_session(request_rec *r, int op, apr_time_t start) {
+	apr_uint64_t elapsed;
+
+	if ((oidc_metrics == NULL) || (op < 0) || (op >= OIDC_METRICS_SESSION_OP_MAX))
+		return;
+
+	elapsed = oidc_metrics_note(r, OIDC_METRICS_NOTE_SESSION, start);
+	oidc_metrics_observe(&oidc_metrics->session[op], oidc_metrics_time_bounds,
+			elapsed);
+}
+
+/*
+ * record the size of the serialized session state that was loaded or saved
+ */
+void oidc_metrics_session_size(request_rec *r, int op, apr_size_t size) {
+	if ((oidc_metrics == NULL) || (op < 0) || (op >= OIDC_METRICS_SESSION_OP_MAX))
+		return;
+	oidc_metrics_observe(&oidc_metrics->session_size[op],
+			oidc_metrics_size_bounds, size);
+}
+
+/*
+ * add the HELP and TYPE lines of a metric family
+ */
+static void oidc_metrics_family(apr_array_header_t *lines, const char *name,
+		const char *type, const char *help) {
+	APR_ARRAY_PUSH(lines, const char *) = apr_psprintf(lines->pool,
+			"# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/*
+ * add the lines of a histogram; the bucket counts are made cumulative, the
+ * _count is taken from the +Inf bucket so that they are always consistent
+ * even though the counters are not read atomically
+ */
+static void oidc_metrics_histogram_lines(apr_array_header_t *lines,
+		const char *name, const char *labels,
+		const oidc_metrics_histogram_t *h, const char **les, double scale) {
+	apr_uint64_t count = 0;
+	int i;
+
+	for (i = 0; i <= OIDC_METRICS_BOUNDS; i++)
+		count += h->buckets[i];
+	/* leave out series that have not been observed */
+	if (count == 0)
+		return;
+
+	count = 0;
+	for (i = 0; i < OIDC_METRICS_BOUNDS; i++) {
+		count += h->buckets[i];
+		APR_ARRAY_PUSH(lines, const char *) = apr_psprintf(lines->pool,
+				"%s_bucket{%s,le=\"%s\"} %" APR_UINT64_T_FMT "\n", name, labels,
+				les[i], count);
+	}
+	count += h->buckets[OIDC_METRICS_BOUNDS];
+	APR_ARRAY_PUSH(lines, const char *) = apr_psprintf(lines->pool,
+			"%s_bucket{%s,le=\"+Inf\"} %" APR_UINT64_T_FMT "\n%s_sum{%s} %.6f\n%s_count{%s} %" APR_UINT64_T_FMT "\n",
+			name, labels, count, name, labels, h->sum / scale, name, labels,
+			count);
+}
+
+/*
+ * add the line of a counter that has a non-zero value
+ */
+static void oidc_metrics_counter_line(apr_array_header_t *lines,
+		const char *name, const char *labels, apr_uint64_t value) {
+	if (value == 0)
+		return;
+	APR_ARRAY_PUSH(lines, const char *) = apr_psprintf(lines->pool,
+			"%s{%s} %" APR_UINT64_T_FMT "\n", name, labels, value);
+}
+
+#define OIDC_METRICS_USEC 1000000.0
+
+/*
+ * return a snapshot of the metrics in Prometheus text exposition format, or NULL when metrics are not collected
+ */
+char *oidc_metrics_prometheus(request_rec *r) {
+	apr_array_header_t *lines = NULL;
+	const char *labels = NULL;
+	int i, b, s, o;
+
+	if (oidc_metrics == NULL)
+		return NULL;
+
+	lines = apr_array_make(r->pool, 64, sizeof(const char *));
+
+	oidc_metrics_family(lines, "oidc_http_request_duration_seconds",
+			"histogram", "Duration of outbound HTTP calls by type.");
+	for (i = 0; i < OIDC_METRICS_HTTP_MAX; i++)
+		oidc_metrics_histogram_lines(lines,
+				"oidc_http_request_duration_seconds",
+				apr_psprintf(r->pool, "type=\"%s\"", oidc_metrics_http_types[i]),
+				&oidc_metrics->http[i], oidc_metrics_time_les,
+				OIDC_METRICS_USEC);
+	oidc_metrics_family(lines, "oidc_http_request_errors_total", "counter",
+			"Number of outbound HTTP calls that failed, by type.");
+	for (i = 0; i < OIDC_METRICS_HTTP_MAX; i++)
+		oidc_metrics_counter_line(lines, "oidc_http_request_errors_total",
+				apr_psprintf(r->pool, "type=\"%s\"", oidc_metrics_http_types[i]),
+				oidc_metrics->http_errors[i]);
+
+	oidc_metrics_family(lines, "oidc_cache_operation_duration_seconds",
+			"histogram",
+			"Duration of cache backend operations by backend, section and operation.");
+	for (b = 0; b < OIDC_METRICS_CACHE_BACKENDS; b++)
+		for (s = 0; s < OIDC_METRICS_CACHE_SECTIONS; s++)
+			for (o = 0; o < OIDC_METRICS_CACHE_OP_MAX; o++) {
+				labels = apr_psprintf(r->pool,
+						"backend=\"%s\",section=\"%s\",op=\"%s\"",
+						oidc_metrics_cache_backends[b],
+						oidc_metrics_cache_section_names[s],
+						oidc_metrics_cache_ops[o]);
+				oidc_metrics_histogram_lines(lines,
+						"oidc_cache_operation_duration_seconds", labels,
+						&oidc_metrics->cache[b][s][o], oidc_metrics_time_les,
+						OIDC_METRICS_USEC);
+			}
+	oidc_metrics_family(lines, "oidc_cache_operations_total", "counter",
+			"Number of cache entries read or written by backend, section and result.");
+	for (b = 0; b < OIDC_METRICS_CACHE_BACKENDS; b++)
+		for (s = 0; s < OIDC_METRICS_CACHE_SECTIONS; s++)
+			for (o = 0; o < OIDC_METRICS_CACHE_RESULT_MAX; o++) {
+				labels = apr_psprintf(r->pool,
+						"backend=\"%s\",section=\"%s\",result=\"%s\"",
+						oidc_metrics_cache_backends[b],
+						oidc_metrics_cache_section_names[s],
+						oidc_metrics_cache_results[o]);
+				oidc_metrics_counter_line(lines, "oidc_cache_operations_total",
+						labels, oidc_metrics->cache_results[b][s][o]);
+			}
+
+	oidc_metrics_family(lines, "oidc_jwt_verify_duration_seconds", "histogram",
+			"Duration of JWT signature verification by algorithm.");
+	for (i = 0; i < OIDC_METRICS_JWT_ALGS; i++)
+		oidc_metrics_histogram_lines(lines, "oidc_jwt_verify_duration_seconds",
+				apr_psprintf(r->pool, "alg=\"%s\"", oidc_metrics_jwt_algs[i]),
+				&oidc_metrics->jwt[i], oidc_metrics_time_les,
+				OIDC_METRICS_USEC);
+	oidc_metrics_family(lines, "oidc_jwt_verify_errors_total", "counter",
+			"Number of JWT signature verifications that failed, by algorithm.");
+	for (i = 0; i < OIDC_METRICS_JWT_ALGS; i++)
+		oidc_metrics_counter_line(lines, "oidc_jwt_verify_errors_total",
+				apr_psprintf(r->pool, "alg=\"%s\"", oidc_metrics_jwt_algs[i]),
+				oidc_metrics->jwt_errors[i]);
+
+	oidc_metrics_family(lines, "oidc_session_duration_seconds", "histogram",
+			"Duration of session loads and saves.");
+	for (i = 0; i < OIDC_METRICS_SESSION_OP_MAX; i++)
+		oidc_metrics_histogram_lines(lines, "oidc_session_duration_seconds",
+				apr_psprintf(r->pool, "op=\"%s\"", oidc_metrics_session_ops[i]),
+				&oidc_metrics->session[i], oidc_metrics_time_les,
+				OIDC_METRICS_USEC);
+	oidc_metrics_family(lines, "oidc_session_size_bytes", "histogram",
+			"Size of the serialized session state that was loaded or saved.");
+	for (i = 0; i < OIDC_METRICS_SESSION_OP_MAX; i++)
+		oidc_metrics_histogram_lines(lines, "oidc_session_size_bytes",
+				apr_psprintf(r->pool, "op=\"%s\"", oidc_metrics_session_ops[i]),
+				&oidc_metrics->session_size[i], oidc_metrics_size_les, 1.0);
+
+	return apr_array_pstrcat(r->pool, lines, 0);
+}
@@ -64,6 +64,10 @@
 #include "apr_file_io.h"
 #include "apr_sha1.h"
 #include "apr_base64.h"
+#include "apr_atomic.h"
+
+#include <openssl/crypto.h>
+#include <openssl/hmac.h>
 
 #include "httpd.h"
 #include "http_core.h"
@@ -89,12 +93,36 @@ static int oidc_handle_logout_request(request_rec *r, oidc_cfg *c,
 extern module AP_MODULE_DECLARE_DATA auth_openidc_module;
 
 /*
- * clean any suspicious headers in the HTTP request sent by the user agent
+ * convert a header name to the environment variable form that it would be passed on as
  */
-static void oidc_scrub_request_headers(request_rec *r, const char *claim_prefix,
-		apr_hash_t *scrub) {
+static const char *oidc_scrub_env_name(apr_pool_t *pool, const char *name) {
+	char *env = apr_pstrdup(pool, name);
+	char *p;
+	for (p = env; *p != '\0'; p++)
+		*p = oidc_char_to_env(*p);
+	return env;
+}
 
-	const int prefix_len = claim_prefix ? strlen(claim_prefix) : 0;
+/*
+ * see if a header name starts with a prefix that is in environment variable form already
+ */
+static apr_byte_t oidc_scrub_prefix_matches(const char *name,
+		const char *prefix) {
+	while (*prefix != '\0') {
+		if ((*name == '\0') || (oidc_char_to_env(*name) != *prefix))
+			return FALSE;
+		name++;
+		prefix++;
+	}
+	return TRUE;
+}
+
+/*
+ * clean any suspicious headers in the HTTP request sent by the user agent in a single pass;
+ * the (non-empty) prefixes and the keys of the scrub hash must be in environment variable form
+ */
+static void oidc_scrub_request_headers(request_rec *r,
+		const char * const *prefixes, int n, apr_hash_t *scrub) {
 
 	/* get an array representation of the incoming HTTP headers */
 	const apr_array_header_t * const h = apr_table_elts(r->headers_in);
@@ -104,29 +132,25 @@ static void oidc_scrub_request_headers(request_rec *r, const char *claim_prefix,
 
 	/* loop over the incoming HTTP headers */
 	const apr_table_entry_t * const e = (const apr_table_entry_t *) h->elts;
-	int i;
+	int i, j;
 	for (i = 0; i < h->nelts; i++) {
 		const char * const k = e[i].key;
-
-		/* is this header's name equivalent to a header that needs scrubbing? */
-		const char *hdr =
-				(k != NULL) && (scrub != NULL) ?
-						apr_hash_get(scrub, k, APR_HASH_KEY_STRING) : NULL;
-		const int header_matches = (hdr != NULL)
-						&& (oidc_strnenvcmp(k, hdr, -1) == 0);
-
-		/*
-		 * would this header be interpreted as a mod_auth_openidc attribute? Note
-		 * that prefix_len will be zero if no attr_prefix is defined,
-		 * so this will always be false. Also note that we do not
-		 * scrub headers if the prefix is empty because every header
-		 * would match.
-		 */
-		const int prefix_matches = (k != NULL) && prefix_len
-				&& (oidc_strnenvcmp(k, claim_prefix, prefix_len) == 0);
+		apr_byte_t matches = FALSE;
+
+		if (k != NULL) {
+			/* would this header be interpreted as a mod_auth_openidc attribute? */
+			for (j = 0; (j < n) && (matches == FALSE); j++)
+				matches = oidc_scrub_prefix_matches(k, prefixes[j]);
+
+			/* is this header's name equivalent to a header that needs scrubbing? */
+			if ((matches == FALSE) && (apr_hash_count(scrub) > 0))
+				matches = (apr_hash_get(scrub,
+						oidc_scrub_env_name(r->pool, k), APR_HASH_KEY_STRING)
+						!= NULL);
+		}
 
 		/* add to the clean_headers if non-suspicious, skip and report otherwise */
-		if (!prefix_matches && !header_matches) {
+		if (matches == FALSE) {
 			apr_table_addn(clean_headers, k, e[i].val);
 		} else {
 			oidc_warn(r, "scrubbed suspicious request header (%s: %.32s)", k,
@@ -147,32 +171,51 @@ void oidc_scrub_headers(request_rec *r) {
 
 	const char *prefix = oidc_cfg_claim_prefix(r);
 	apr_hash_t *hdrs = apr_hash_make(r->pool);
+	apr_hash_index_t *hi = NULL;
+	const char *name = NULL;
+	const char *prefixes[2];
+	int n = 0;
 
 	if (apr_strnatcmp(prefix, "") == 0) {
 		if ((cfg->white_listed_claims != NULL)
-				&& (apr_hash_count(cfg->white_listed_claims) > 0))
-			hdrs = apr_hash_overlay(r->pool, cfg->white_listed_claims, hdrs);
-		else
+				&& (apr_hash_count(cfg->white_listed_claims) > 0)) {
+			for (hi = apr_hash_first(r->pool, cfg->white_listed_claims); hi;
+					hi = apr_hash_next(hi)) {
+				apr_hash_this(hi, (const void **) &name, NULL, NULL);
+				apr_hash_set(hdrs, oidc_scrub_env_name(r->pool, name),
+						APR_HASH_KEY_STRING, name);
+			}
+		} else
 			oidc_warn(r,
 					"both " OIDCClaimPrefix " and " OIDCWhiteListedClaims " are empty: this renders an insecure setup!");
 	}
 
+	/* claims passed under an explicit name are not covered by the prefix */
+	if (cfg->pass_claim_names != NULL) {
+		for (hi = apr_hash_first(r->pool, cfg->pass_claim_names); hi;
+				hi = apr_hash_next(hi)) {
+			apr_hash_this(hi, NULL, NULL, (void **) &name);
+			if (*name != '\0')
+				apr_hash_set(hdrs, oidc_scrub_env_name(r->pool, name),
+						APR_HASH_KEY_STRING, name);
+		}
+	}
+
 	char *authn_hdr = oidc_cfg_dir_authn_header(r);
 	if (authn_hdr != NULL)
-		apr_hash_set(hdrs, authn_hdr, APR_HASH_KEY_STRING, authn_hdr);
+		apr_hash_set(hdrs, oidc_scrub_env_name(r->pool, authn_hdr),
+				APR_HASH_KEY_STRING, authn_hdr);
 
 	/*
-	 * scrub all headers starting with OIDC_ first
+	 * scrub all headers starting with OIDC_ and the claim headers on top of that
+	 * (i.e. when the prefix does not start with the default OIDC_); we do not
+	 * scrub on the prefix if it is empty because every header would match
 	 */
-	oidc_scrub_request_headers(r, OIDC_DEFAULT_HEADER_PREFIX, hdrs);
+	prefixes[n++] = OIDC_DEFAULT_HEADER_PREFIX;
+	if ((*prefix != '\0') && (strstr(prefix, OIDC_DEFAULT_HEADER_PREFIX) != prefix))
+		prefixes[n++] = oidc_scrub_env_name(r->pool, prefix);
 
-	/*
-	 * then see if the claim headers need to be removed on top of that
-	 * (i.e. the prefix does not start with the default OIDC_)
-	 */
-	if ((strstr(prefix, OIDC_DEFAULT_HEADER_PREFIX) != prefix)) {
-		oidc_scrub_request_headers(r, prefix, NULL);
-	}
+	oidc_scrub_request_headers(r, prefixes, n, hdrs);
 }
 
 /*
@@ -293,6 +336,98 @@ static char *oidc_get_state_cookie_name(request_rec *r, const char *state) {
 			state);
 }
 
+/* separates the plaintext timestamp, its MAC and the encrypted state in a state cookie value */
+#define OIDC_STATE_COOKIE_SEPARATOR '.'
+/* number of bytes of the HMAC-SHA256 MAC over the state cookie timestamp */
+#define OIDC_STATE_COOKIE_MAC_LEN   16
+
+/*
+ * calculate the MAC over the name of a state cookie and its plaintext timestamp, so that timestamp
+ * can be trusted for expiry and ordering without decrypting the state
+ */
+static char *oidc_state_cookie_mac(request_rec *r, oidc_cfg *c,
+		const char *name, const char *s_timestamp) {
+	unsigned char mac[EVP_MAX_MD_SIZE];
+	unsigned int mac_len = 0, key_len = 0;
+	char *result = NULL;
+	const unsigned char *key = oidc_util_state_cookie_mac_key(r, &key_len);
+	const char *input = apr_psprintf(r->pool, "%s%c%s", name,
+			OIDC_STATE_COOKIE_SEPARATOR, s_timestamp);
+	if ((key == NULL)
+			|| (HMAC(EVP_sha256(), key, key_len, (const unsigned char *) input,
+					strlen(input), mac, &mac_len) == NULL))
+		return NULL;
+	oidc_base64url_encode(r, &result, (const char *) mac,
+			OIDC_STATE_COOKIE_MAC_LEN, TRUE);
+	return result;
+}
+
+/*
+ * prefix the encrypted state with its timestamp and the MAC over that timestamp
+ */
+char *oidc_state_cookie_value(request_rec *r, oidc_cfg *c,
+		const char *name, apr_time_t timestamp, const char *encrypted) {
+	const char *s_timestamp = apr_psprintf(r->pool, "%" APR_TIME_T_FMT,
+			apr_time_sec(timestamp));
+	char *mac = oidc_state_cookie_mac(r, c, name, s_timestamp);
+	if (mac == NULL)
+		return NULL;
+	return apr_psprintf(r->pool, "%s%c%s%c%s", s_timestamp,
+			OIDC_STATE_COOKIE_SEPARATOR, mac, OIDC_STATE_COOKIE_SEPARATOR,
+			encrypted);
+}
+
+/*
+ * get the authenticated timestamp and the encrypted state from a state cookie value;
+ * returns FALSE if there's no valid prefix, e.g. for a cookie created by an older version
+ */
+apr_byte_t oidc_state_cookie_parse(request_rec *r, oidc_cfg *c,
+		const char *name, const char *value, apr_time_t *timestamp,
+		const char **encrypted) {
+	const char *p = value, *mac = NULL;
+	char *s_timestamp = NULL, *calc = NULL;
+
+	/* an encrypted state (JWE) always starts with a base64url encoded JSON object, never with a digit */
+	while (apr_isdigit(*p))
+		p++;
+	if ((p == value) || (*p != OIDC_STATE_COOKIE_SEPARATOR))
+		return FALSE;
+	s_timestamp = apr_pstrmemdup(r->pool, value, p - value);
+
+	mac = p + 1;
+	p = strchr(mac, OIDC_STATE_COOKIE_SEPARATOR);
+	if (p == NULL)
+		return FALSE;
+
+	calc = oidc_state_cookie_mac(r, c, name, s_timestamp);
+	if ((calc == NULL) || (strlen(calc) != (size_t) (p - mac))
+			|| (CRYPTO_memcmp(calc, mac, p - mac) != 0)) {
+		oidc_warn(r, "MAC of state cookie %s does not match", name);
+		return FALSE;
+	}
+
+	*timestamp = apr_time_from_sec(apr_atoi64(s_timestamp));
+	*encrypted = p + 1;
+
+	return TRUE;
+}
+
+/*
+ * retrieve the metadata of the static provider from its metadata URL
+ */
+static apr_byte_t oidc_provider_static_config_retrieve(request_rec *r,
+		oidc_cfg *c, const void *data, char **s_json) {
+	json_t *j_provider = NULL;
+	if (oidc_metadata_provider_retrieve(r, c, NULL, c->provider.metadata_url,
+			&j_provider, s_json) == FALSE) {
+		if (j_provider)
+			json_decref(j_provider);
+		return FALSE;
+	}
+	json_decref(j_provider);
+	return TRUE;
+}
+
 /*
  * return the static provider configuration, i.e. from a metadata URL or configuration primitives
  */
@@ -308,31 +443,27 @@ static apr_byte_t oidc_provider_static_config(request_rec *r, oidc_cfg *c,
 		return TRUE;
 	}
 
-	oidc_cache_get_provider(r, c->provider.metadata_url, &s_json);
-
-	if (s_json == NULL) {
-
-		if (oidc_metadata_provider_retrieve(r, c, NULL,
-				c->provider.metadata_url, &j_provider, &s_json) == FALSE) {
-			oidc_error(r, "could not retrieve metadata from url: %s",
-					c->provider.metadata_url);
-			return FALSE;
-		}
-
-		oidc_cache_set_provider(r, c->provider.metadata_url, s_json,
-				apr_time_now() + (c->provider_metadata_refresh_interval <= 0 ? apr_time_from_sec( OIDC_CACHE_PROVIDER_METADATA_EXPIRY_DEFAULT) : c->provider_metadata_refresh_interval));
-
-	} else {
+	if (oidc_metadata_cache_get_or_fetch(r, c, OIDC_CACHE_SECTION_PROVIDER,
+			c->provider.metadata_url,
+			c->provider_metadata_refresh_interval <= 0 ?
+					OIDC_CACHE_PROVIDER_METADATA_EXPIRY_DEFAULT :
+					c->provider_metadata_refresh_interval,
+			oidc_provider_static_config_retrieve, NULL, &s_json, NULL) == FALSE) {
+		oidc_error(r, "could not retrieve metadata from url: %s",
+				c->provider.metadata_url);
+		return FALSE;
+	}
 
-		oidc_util_decode_json_object(r, s_json, &j_provider);
+	oidc_util_decode_json_object(r, s_json, &j_provider);
 
-		/* check to see if it is valid metadata */
-		if (oidc_metadata_provider_is_valid(r, c, j_provider, NULL) == FALSE) {
-			oidc_error(r,
-					"cache corruption detected: invalid metadata from url: %s",
-					c->provider.metadata_url);
-			return FALSE;
-		}
+	/* check to see if it is valid metadata */
+	if (oidc_metadata_provider_is_valid(r, c, j_provider, NULL) == FALSE) {
+		oidc_error(r,
+				"cache corruption detected: invalid metadata from url: %s",
+				c->provider.metadata_url);
+		if (j_provider)
+			json_decref(j_provider);
+		return FALSE;
 	}
 
 	*provider = apr_pcalloc(r->pool, sizeof(oidc_provider_t));
@@ -643,9 +774,7 @@ static apr_byte_t oidc_unsolicited_proto_state(request_rec *r, oidc_cfg *c,
 		}
 	}
 
-	char *replay = NULL;
-	oidc_cache_get_jti(r, jti, &replay);
-	if (replay != NULL) {
+	if (oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_JTI, jti) == TRUE) {
 		oidc_error(r,
 				"the \"%s\" value (%s) passed in the browser state was found in the cache already; possible replay attack!?",
 				OIDC_CLAIM_JTI, jti);
@@ -658,7 +787,8 @@ static apr_byte_t oidc_unsolicited_proto_state(request_rec *r, oidc_cfg *c,
 			provider->idtoken_iat_slack * 2 + 10);
 
 	/* store it in the cache for the calculated duration */
-	oidc_cache_set_jti(r, jti, jti, apr_time_now() + jti_cache_duration);
+	oidc_cache_replay_add(r, OIDC_CACHE_SECTION_JTI, jti,
+			apr_time_now() + jti_cache_duration);
 
 	oidc_warn(r,
 			"jti \"%s\" validated successfully and is now cached for %" APR_TIME_T_FMT " seconds",
@@ -737,7 +867,7 @@ static int oidc_delete_oldest_state_cookies(request_rec *r,
  * successfully and return the number of remaining valid cookies/outstanding-requests while
  * doing so
  */
-static int oidc_clean_expired_state_cookies(request_rec *r, oidc_cfg *c,
+int oidc_clean_expired_state_cookies(request_rec *r, oidc_cfg *c,
 		const char *currentCookieName, int delete_oldest) {
 	int number_of_valid_state_cookies = 0;
 	oidc_state_cookies_t *first = NULL, *last = NULL;
@@ -758,41 +888,46 @@ static int oidc_clean_expired_state_cookies(request_rec *r, oidc_cfg *c,
 					if ((currentCookieName == NULL)
 							|| (apr_strnatcmp(cookieName, currentCookieName)
 									!= 0)) {
-						oidc_proto_state_t *proto_state =
-								oidc_proto_state_from_cookie(r, c, cookie);
-						if (proto_state != NULL) {
-							json_int_t ts = oidc_proto_state_get_timestamp(
-									proto_state);
-							if (apr_time_now() > ts + apr_time_from_sec(c->state_timeout)) {
-								oidc_warn(r,
-										"state (%s) has expired (original_url=%s)",
-										cookieName,
-										oidc_proto_state_get_original_url(
-												proto_state));
-								oidc_util_set_cookie(r, cookieName, "", 0,
-										OIDC_COOKIE_EXT_SAME_SITE_NONE);
-							} else {
-								if (first == NULL) {
-									first = apr_pcalloc(r->pool,
-											sizeof(oidc_state_cookies_t));
-									last = first;
-								} else {
-									last->next = apr_pcalloc(r->pool,
-											sizeof(oidc_state_cookies_t));
-									last = last->next;
-								}
-								last->name = cookieName;
-								last->timestamp = ts;
-								last->next = NULL;
-								number_of_valid_state_cookies++;
+						apr_time_t ts = 0;
+						const char *encrypted = NULL;
+						apr_byte_t valid = oidc_state_cookie_parse(r, c,
+								cookieName, cookie, &ts, &encrypted);
+						if (valid == FALSE) {
+							/* no authenticated timestamp, so decrypt the state to get it */
+							oidc_proto_state_t *proto_state =
+									oidc_proto_state_from_cookie(r, c, cookie);
+							if (proto_state != NULL) {
+								ts = oidc_proto_state_get_timestamp(
+										proto_state);
+								oidc_proto_state_destroy(proto_state);
+								valid = TRUE;
 							}
-							oidc_proto_state_destroy(proto_state);
-						} else {
+						}
+						if (valid == FALSE) {
 							oidc_warn(r,
 									"state cookie could not be retrieved/decoded, deleting: %s",
 									cookieName);
 							oidc_util_set_cookie(r, cookieName, "", 0,
 									OIDC_COOKIE_EXT_SAME_SITE_NONE);
+						} else if (apr_time_now()
+								> ts + apr_time_from_sec(c->state_timeout)) {
+							oidc_warn(r, "state (%s) has expired", cookieName);
+							oidc_util_set_cookie(r, cookieName, "", 0,
+									OIDC_COOKIE_EXT_SAME_SITE_NONE);
+						} else {
+							if (first == NULL) {
+								first = apr_pcalloc(r->pool,
+										sizeof(oidc_state_cookies_t));
+								last = first;
+							} else {
+								last->next = apr_pcalloc(r->pool,
+										sizeof(oidc_state_cookies_t));
+								last = last->next;
+							}
+							last->name = cookieName;
+							last->timestamp = ts;
+							last->next = NULL;
+							number_of_valid_state_cookies++;
 						}
 					}
 				}
@@ -836,7 +971,13 @@ static apr_byte_t oidc_restore_proto_state(request_rec *r, oidc_cfg *c,
 	/* clear state cookie because we don't need it anymore */
 	oidc_util_set_cookie(r, cookieName, "", 0, OIDC_COOKIE_EXT_SAME_SITE_NONE);
 
-	*proto_state = oidc_proto_state_from_cookie(r, c, cookieValue);
+	/* skip the authenticated timestamp prefix; the timestamp is checked against the decrypted state below */
+	apr_time_t prefix_ts = 0;
+	const char *encrypted = cookieValue;
+	oidc_state_cookie_parse(r, c, cookieName, cookieValue, &prefix_ts,
+			&encrypted);
+
+	*proto_state = oidc_proto_state_from_cookie(r, c, encrypted);
 	if (*proto_state == NULL)
 		return FALSE;
 
@@ -899,6 +1040,16 @@ static int oidc_authorization_request_set_cookie(request_rec *r, oidc_cfg *c,
 	if (cookieValue == NULL)
 		return HTTP_INTERNAL_SERVER_ERROR;
 
+	/* assemble the cookie name for the state cookie */
+	const char *cookieName = oidc_get_state_cookie_name(r, state);
+
+	/* prefix it with the timestamp so other requests can expire and order it without decrypting it */
+	apr_time_t ts = oidc_proto_state_get_timestamp(proto_state);
+	cookieValue = oidc_state_cookie_value(r, c, cookieName,
+			(ts > 0) ? ts : apr_time_now(), cookieValue);
+	if (cookieValue == NULL)
+		return HTTP_INTERNAL_SERVER_ERROR;
+
 	/*
 	 * clean expired state cookies to avoid pollution and optionally
 	 * try to avoid the number of state cookies exceeding a max
@@ -934,9 +1085,6 @@ static int oidc_authorization_request_set_cookie(request_rec *r, oidc_cfg *c,
 		return HTTP_SERVICE_UNAVAILABLE;
 	}
 
-	/* assemble the cookie name for the state cookie */
-	const char *cookieName = oidc_get_state_cookie_name(r, state);
-
 	/* set it as a cookie */
 	oidc_util_set_cookie(r, cookieName, cookieValue, -1,
 			OIDC_COOKIE_SAMESITE_LAX(c));
@@ -993,31 +1141,102 @@ const char*oidc_request_state_get(request_rec *r, const char *key) {
 	return apr_table_get(state, key);
 }
 
+/* a parsed JSON value in the request context, valid for as long as the string value it was parsed from is current */
+typedef struct oidc_request_state_json_t {
+	const char *s_json;
+	json_t *json;
+} oidc_request_state_json_t;
+
+static apr_status_t oidc_request_state_json_cleanup(void *data) {
+	json_decref((json_t *) data);
+	return APR_SUCCESS;
+}
+
+/*
+ * store a parsed JSON value in the request context, taking over the reference
+ */
+static void oidc_request_state_json_put(request_rec *rr, const char *key,
+		const char *s_json, json_t *json) {
+
+	/* our state is always stored in the main request */
+	request_rec *r = (rr->main != NULL) ? rr->main : rr;
+
+	apr_hash_t *parsed = NULL;
+	apr_pool_userdata_get((void **) &parsed, OIDC_USERDATA_JSON_KEY, r->pool);
+	if (parsed == NULL) {
+		parsed = apr_hash_make(r->pool);
+		apr_pool_userdata_set(parsed, OIDC_USERDATA_JSON_KEY, NULL, r->pool);
+	}
+
+	oidc_request_state_json_t *entry = apr_pcalloc(r->pool,
+			sizeof(oidc_request_state_json_t));
+	entry->s_json = s_json;
+	entry->json = json;
+	apr_pool_cleanup_register(r->pool, json, oidc_request_state_json_cleanup,
+			apr_pool_cleanup_null);
+	apr_hash_set(parsed, key, APR_HASH_KEY_STRING, entry);
+}
+
+/*
+ * set a name/value pair in the request context together with the JSON object that the value
+ * is the serialization of, so it does not need to be decoded again
+ */
+void oidc_request_state_set_json(request_rec *r, const char *key,
+		const char *s_json, json_t *json) {
+	oidc_request_state_set(r, key, s_json);
+	if (json != NULL)
+		oidc_request_state_json_put(r, key, oidc_request_state_get(r, key),
+				json_incref(json));
+}
+
+/*
+ * get the JSON object that a value in the request context decodes to, decoding it at most once
+ * per request; the result is owned by the request context and must not be modified or released
+ */
+json_t *oidc_request_state_get_json(request_rec *rr, const char *key) {
+	request_rec *r = (rr->main != NULL) ? rr->main : rr;
+	apr_hash_t *parsed = NULL;
+	oidc_request_state_json_t *entry = NULL;
+	json_t *json = NULL;
+
+	const char *s_json = oidc_request_state_get(r, key);
+	if (s_json == NULL)
+		return NULL;
+
+	apr_pool_userdata_get((void **) &parsed, OIDC_USERDATA_JSON_KEY, r->pool);
+	if (parsed != NULL)
+		entry = apr_hash_get(parsed, key, APR_HASH_KEY_STRING);
+
+	/* apr_table_set copies the value, so a new value never has the same address */
+	if ((entry != NULL) && (entry->s_json == s_json))
+		return entry->json;
+
+	if (oidc_util_decode_json_object(r, s_json, &json) == FALSE)
+		return NULL;
+
+	oidc_request_state_json_put(r, key, s_json, json);
+
+	return json;
+}
+
 /*
  * set the claims from a JSON object (c.q. id_token or user_info response) stored
  * in the session in to HTTP headers passed on to the application
  */
 static apr_byte_t oidc_set_app_claims(request_rec *r,
 		const oidc_cfg * const cfg, oidc_session_t *session,
-		const char *s_claims) {
+		const char *key) {
 
-	json_t *j_claims = NULL;
-
-	/* decode the string-encoded attributes in to a JSON structure */
-	if (s_claims != NULL) {
-		if (oidc_util_decode_json_object(r, s_claims, &j_claims) == FALSE)
-			return FALSE;
-	}
+	/* get the attributes decoded in to a JSON structure, shared with the authz routines */
+	json_t *j_claims = oidc_request_state_get_json(r, key);
+	if ((j_claims == NULL) && (oidc_request_state_get(r, key) != NULL))
+		return FALSE;
 
 	/* set the resolved claims a HTTP headers for the application */
 	if (j_claims != NULL) {
-		oidc_warn(r, "j_claims: %s", j_claims);
 		oidc_util_set_app_infos(r, j_claims, oidc_cfg_claim_prefix(r),
 				cfg->claim_delimiter, oidc_cfg_dir_pass_info_in_headers(r),
 				oidc_cfg_dir_pass_info_in_envvars(r));
-
-		/* release resources */
-		json_decref(j_claims);
 	}
 
 	return TRUE;
@@ -1494,6 +1713,29 @@ static apr_byte_t oidc_session_pass_tokens(request_rec *r, oidc_cfg *cfg,
 	return TRUE;
 }
 
+/*
+ * schedule a refresh of the access token of a session after the response has been sent;
+ * returns TRUE if this request holds the lease and will run the refresh in oidc_log_transaction
+ */
+apr_byte_t oidc_refresh_access_token_defer(request_rec *r, oidc_cfg *cfg,
+		oidc_session_t *session) {
+
+	if (oidc_request_state_get(r, OIDC_REQUEST_STATE_KEY_REFRESH) != NULL)
+		return FALSE;
+
+	if (oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_SESSION, session->uuid,
+			apr_time_now() + apr_time_from_sec(cfg->http_timeout_long))
+			== FALSE) {
+		oidc_debug(r, "access token of session %s is already being refreshed",
+				session->uuid);
+		return FALSE;
+	}
+
+	oidc_request_state_set(r, OIDC_REQUEST_STATE_KEY_REFRESH, session->uuid);
+
+	return TRUE;
+}
+
 static apr_byte_t oidc_refresh_access_token_before_expiry(request_rec *r,
 		oidc_cfg *cfg, oidc_session_t *session, int ttl_minimum,
 		int logout_on_error) {
@@ -1534,6 +1776,17 @@ static apr_byte_t oidc_refresh_access_token_before_expiry(request_rec *r,
 	if (t_expires > apr_time_now())
 		return FALSE;
 
+	/*
+	 * as long as the access token is still valid the refresh can be deferred until after the
+	 * response has been sent; the lease makes sure only one request refreshes this session
+	 */
+	if ((logout_on_error & OIDC_REFRESH_ACCESS_TOKEN_ASYNC)
+			&& (cfg->session_type == OIDC_SESSION_TYPE_SERVER_CACHE)
+			&& (t_expires + apr_time_from_sec(ttl_minimum) > apr_time_now())) {
+		oidc_refresh_access_token_defer(r, cfg, session);
+		return FALSE;
+	}
+
 	if (oidc_get_provider_from_session(r, cfg, session, &provider) == FALSE)
 		return FALSE;
 
@@ -1550,6 +1803,52 @@ static apr_byte_t oidc_refresh_access_token_before_expiry(request_rec *r,
 	return TRUE;
 }
 
+/*
+ * refresh the access token of a session after the response has been sent to the client,
+ * when deferred by oidc_refresh_access_token_before_expiry in "async" mode
+ */
+int oidc_log_transaction(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_session_t *session = NULL;
+	oidc_provider_t *provider = NULL;
+
+	const char *uuid = oidc_request_state_get(r,
+			OIDC_REQUEST_STATE_KEY_REFRESH);
+	if (uuid == NULL)
+		return DECLINED;
+
+	oidc_debug(r, "enter: refreshing the access token of session %s", uuid);
+
+	/* reload the session so that changes made by concurrent requests are not overwritten */
+	session = apr_pcalloc(r->pool, sizeof(oidc_session_t));
+	if ((oidc_session_load_cache_by_uuid(r, cfg, uuid, session) == FALSE)
+			|| (oidc_session_extract(r, session) == FALSE)) {
+		oidc_warn(r, "session %s could not be restored for refresh", uuid);
+		goto out;
+	}
+
+	if (oidc_get_provider_from_session(r, cfg, session, &provider) == FALSE)
+		goto out;
+
+	if (oidc_refresh_access_token(r, cfg, session, provider, NULL) == FALSE) {
+		/* the next request retries; once the token has expired the refresh is synchronous */
+		oidc_warn(r, "access_token could not be refreshed in the background");
+		goto out;
+	}
+
+	if (oidc_session_save(r, session, FALSE) == FALSE)
+		oidc_error(r, "could not save the session after the background refresh");
+
+out:
+
+	oidc_cache_lease_release(r, OIDC_CACHE_SECTION_SESSION, uuid);
+	if (session != NULL)
+		oidc_session_free(r, session);
+
+	return DECLINED;
+}
+
 /*
  * handle the case where we have identified an existing authentication session for a user
  */
@@ -1625,7 +1924,8 @@ static int oidc_handle_existing_session(request_rec *r, oidc_cfg *cfg,
 
 	if ((cfg->pass_userinfo_as & OIDC_PASS_USERINFO_AS_CLAIMS)) {
 		/* set the userinfo claims in the app headers */
-		if (oidc_set_app_claims(r, cfg, session, s_claims) == FALSE)
+		if (oidc_set_app_claims(r, cfg, session,
+				OIDC_REQUEST_STATE_KEY_CLAIMS) == FALSE)
 			return HTTP_INTERNAL_SERVER_ERROR;
 	}
 
@@ -1657,7 +1957,8 @@ static int oidc_handle_existing_session(request_rec *r, oidc_cfg *cfg,
 
 	if ((cfg->pass_idtoken_as & OIDC_PASS_IDTOKEN_AS_CLAIMS)) {
 		/* set the id_token in the app headers */
-		if (oidc_set_app_claims(r, cfg, session, s_id_token) == FALSE)
+		if (oidc_set_app_claims(r, cfg, session,
+				OIDC_REQUEST_STATE_KEY_IDTOKEN) == FALSE)
 			return HTTP_INTERNAL_SERVER_ERROR;
 	}
 
@@ -1756,7 +2057,7 @@ static int oidc_authorization_response_error(request_rec *r, oidc_cfg *c,
  * get the r->user for this request based on the configuration for OIDC/OAuth
  */
 apr_byte_t oidc_get_remote_user(request_rec *r, const char *claim_name,
-		const char *reg_exp, const char *replace, json_t *json,
+		const oidc_pcre_t *preg, const char *replace, json_t *json,
 		char **request_user) {
 
 	/* get the claim value from the JSON object */
@@ -1768,13 +2069,13 @@ apr_byte_t oidc_get_remote_user(request_rec *r, const char *claim_name,
 
 	*request_user = apr_pstrdup(r->pool, json_string_value(username));
 
-	if (reg_exp != NULL) {
+	if (preg != NULL) {
 
 		char *error_str = NULL;
 
 		if (replace == NULL) {
 
-			if (oidc_util_regexp_first_match(r->pool, *request_user, reg_exp,
+			if (oidc_util_regexp_first_match_pcre(r->pool, *request_user, preg,
 					request_user, &error_str) == FALSE) {
 				oidc_error(r, "oidc_util_regexp_first_match failed: %s",
 						error_str);
@@ -1782,8 +2083,8 @@ apr_byte_t oidc_get_remote_user(request_rec *r, const char *claim_name,
 				return FALSE;
 			}
 
-		} else if (oidc_util_regexp_substitute(r->pool, *request_user, reg_exp,
-				replace, request_user, &error_str) == FALSE) {
+		} else if (oidc_util_regexp_substitute_pcre(r->pool, *request_user,
+				preg, replace, request_user, &error_str) == FALSE) {
 
 			oidc_error(r, "oidc_util_regexp_substitute failed: %s", error_str);
 			*request_user = NULL;
@@ -1819,12 +2120,12 @@ static apr_byte_t oidc_set_request_user(request_rec *r, oidc_cfg *c,
 	json_t *claims = NULL;
 	oidc_util_decode_json_object(r, s_claims, &claims);
 	if (claims == NULL) {
-		rc = oidc_get_remote_user(r, claim_name, c->remote_user_claim.reg_exp,
+		rc = oidc_get_remote_user(r, claim_name, c->remote_user_claim.preg,
 				c->remote_user_claim.replace, jwt->payload.value.json,
 				&remote_user);
 	} else {
 		oidc_util_json_merge(r, jwt->payload.value.json, claims);
-		rc = oidc_get_remote_user(r, claim_name, c->remote_user_claim.reg_exp,
+		rc = oidc_get_remote_user(r, claim_name, c->remote_user_claim.preg,
 				c->remote_user_claim.replace, claims, &remote_user);
 		json_decref(claims);
 	}
@@ -1950,11 +2251,14 @@ static apr_byte_t oidc_save_in_session(request_rec *r, oidc_cfg *c,
 	oidc_debug(r, "provider->backchannel_logout_supported=%d",
 			provider->backchannel_logout_supported);
 	if (provider->backchannel_logout_supported > 0) {
+		/* index the session by sid and by sub so back-channel logout can find all sessions for either */
 		oidc_jose_get_string(r->pool, id_token_jwt->payload.value.json,
 				OIDC_CLAIM_SID, FALSE, &sid, NULL);
-		if (sid == NULL)
-			sid = id_token_jwt->payload.sub;
-		session->sid = oidc_make_sid_iss_unique(r, sid, provider->issuer);
+		if (sid != NULL)
+			session->sid = oidc_make_sid_iss_unique(r, sid, provider->issuer);
+		if (id_token_jwt->payload.sub != NULL)
+			session->sub = oidc_make_sid_iss_unique(r,
+					id_token_jwt->payload.sub, provider->issuer);
 	}
 
 	/* store the session */
@@ -2796,7 +3100,8 @@ static void oidc_revoke_tokens(request_rec *r, oidc_cfg *c,
 		apr_table_addn(params, "token_type_hint", "refresh_token");
 		apr_table_addn(params, "token", token);
 
-		if (oidc_util_http_post_form(r, provider->revocation_endpoint_url,
+		if (oidc_util_http_post_form(r, OIDC_METRICS_HTTP_REVOCATION,
+				provider->revocation_endpoint_url,
 				params, basic_auth, bearer_auth, c->oauth.ssl_validate_server,
 				&response, c->http_timeout_long, c->outgoing_proxy,
 				oidc_dir_cfg_pass_cookies(r), NULL,
@@ -2811,7 +3116,8 @@ static void oidc_revoke_tokens(request_rec *r, oidc_cfg *c,
 		apr_table_addn(params, "token_type_hint", "access_token");
 		apr_table_addn(params, "token", token);
 
-		if (oidc_util_http_post_form(r, provider->revocation_endpoint_url,
+		if (oidc_util_http_post_form(r, OIDC_METRICS_HTTP_REVOCATION,
+				provider->revocation_endpoint_url,
 				params, basic_auth, bearer_auth, c->oauth.ssl_validate_server,
 				&response, c->http_timeout_long, c->outgoing_proxy,
 				oidc_dir_cfg_pass_cookies(r), NULL,
@@ -2897,9 +3203,11 @@ static int oidc_handle_logout_backchannel(request_rec *r, oidc_cfg *cfg) {
 	oidc_jose_error_t err;
 	oidc_jwk_t *jwk = NULL;
 	oidc_provider_t *provider = NULL;
-	char *sid = NULL, *uuid = NULL;
-	oidc_session_t session;
-	int rc = HTTP_BAD_REQUEST;
+	char *sid = NULL;
+	const char *section = OIDC_CACHE_SECTION_SID;
+	apr_array_header_t *uuids = NULL;
+	oidc_session_t *sessions = NULL;
+	int i, rc = HTTP_BAD_REQUEST;
 
 	apr_table_t *params = apr_table_make(r->pool, 8);
 	if (oidc_util_read_post_params(r, params, FALSE, NULL) == FALSE) {
@@ -2991,9 +3299,7 @@ static int oidc_handle_logout_backchannel(request_rec *r, oidc_cfg *cfg) {
 	oidc_json_object_get_string(r->pool, jwt->payload.value.json,
 			OIDC_CLAIM_JTI, &jti, NULL);
 	if (jti != NULL) {
-		char *replay = NULL;
-		oidc_cache_get_jti(r, jti, &replay);
-		if (replay != NULL) {
+		if (oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_JTI, jti) == TRUE) {
 			oidc_error(r,
 					"the \"%s\" value (%s) passed in logout token was found in the cache already; possible replay attack!?",
 					OIDC_CLAIM_JTI, jti);
@@ -3006,23 +3312,16 @@ static int oidc_handle_logout_backchannel(request_rec *r, oidc_cfg *cfg) {
 			provider->idtoken_iat_slack * 2 + 10);
 
 	/* store it in the cache for the calculated duration */
-	oidc_cache_set_jti(r, jti, jti, apr_time_now() + jti_cache_duration);
-
-	oidc_json_object_get_string(r->pool, jwt->payload.value.json,
-			OIDC_CLAIM_EVENTS, &sid, NULL);
-
-	// TODO: by-spec we should cater for the fact that "sid" has been provided
-	//       in the id_token returned in the authentication request, but "sub"
-	//       is used in the logout token but that requires a 2nd entry in the
-	//       cache and a separate session "sub" member, ugh; we'll just assume
-	//       that is "sid" is specified in the id_token, the OP will actually use
-	//       this for logout
-	//       (and probably call us multiple times or the same sub if needed)
+	oidc_cache_replay_add(r, OIDC_CACHE_SECTION_JTI, jti,
+			apr_time_now() + jti_cache_duration);
 
+	/* a logout token with a sid ends the sessions of that OP session, one with only a sub all sessions of the user */
 	oidc_json_object_get_string(r->pool, jwt->payload.value.json,
 			OIDC_CLAIM_SID, &sid, NULL);
-	if (sid == NULL)
+	if (sid == NULL) {
 		sid = jwt->payload.sub;
+		section = OIDC_CACHE_SECTION_SUB;
+	}
 
 	if (sid == NULL) {
 		oidc_error(r, "no \"sub\" and no \"sid\" claim found in logout token");
@@ -3037,8 +3336,14 @@ static int oidc_handle_logout_backchannel(request_rec *r, oidc_cfg *cfg) {
 	//       - it will result in 400 errors returned from backchannel logout calls to the other hosts...
 
 	sid = oidc_make_sid_iss_unique(r, sid, provider->issuer);
-	oidc_cache_get_sid(r, sid, &uuid);
-	if (uuid == NULL) {
+	oidc_cache_index_get(r, section, sid, &uuids);
+	if ((uuids->nelts == 0)
+			&& (apr_strnatcmp(section, OIDC_CACHE_SECTION_SUB) == 0)) {
+		/* sessions created before the sub index existed were indexed by sub in the sid index */
+		section = OIDC_CACHE_SECTION_SID;
+		oidc_cache_index_get(r, section, sid, &uuids);
+	}
+	if (uuids->nelts == 0) {
 		oidc_error(r,
 				"could not find session based on sid/sub provided in logout token: %s",
 				sid);
@@ -3048,16 +3353,23 @@ static int oidc_handle_logout_backchannel(request_rec *r, oidc_cfg *cfg) {
 		goto out;
 	}
 
-	// revoke tokens if we can get a handle on those
-	if (cfg->session_type != OIDC_SESSION_TYPE_CLIENT_COOKIE) {
-		if (oidc_session_load_cache_by_uuid(r, cfg, uuid, &session) != FALSE)
-			if (oidc_session_extract(r, &session) != FALSE)
-				oidc_revoke_tokens(r, cfg, &session);
+	oidc_debug(r, "found %d session(s) for sid/sub: %s", uuids->nelts, sid);
+
+	// revoke tokens if we can get a handle on those; loading the sessions is only needed for that
+	if ((cfg->session_type != OIDC_SESSION_TYPE_CLIENT_COOKIE)
+			&& (provider->revocation_endpoint_url != NULL)
+			&& (oidc_session_load_cache_multi(r, cfg, uuids, &sessions)
+					!= FALSE)) {
+		for (i = 0; i < uuids->nelts; i++) {
+			if ((sessions[i].state != NULL)
+					&& (oidc_session_extract(r, &sessions[i]) != FALSE))
+				oidc_revoke_tokens(r, cfg, &sessions[i]);
+			oidc_session_free(r, &sessions[i]);
+		}
 	}
 
-	// clear the session cache
-	oidc_cache_set_sid(r, sid, NULL, 0);
-	oidc_cache_set_session(r, uuid, NULL, 0);
+	// clear the sessions and the index in the cache
+	oidc_session_kill_cache_multi(r, uuids, section, sid);
 
 	// terminate with DONE instead of OK
 	// to avoid Apache returning auth/authz error 500 for the redirect URI
@@ -3087,6 +3399,7 @@ static apr_byte_t oidc_validate_redirect_url(request_rec *r, oidc_cfg *c,
 		char **err_desc) {
 	apr_uri_t uri;
 	const char *c_host = NULL;
+	oidc_pcre_t *preg = NULL;
 	apr_hash_index_t *hi = NULL;
 
 	if (apr_uri_parse(r->pool, url, &uri) != APR_SUCCESS) {
@@ -3099,8 +3412,8 @@ static apr_byte_t oidc_validate_redirect_url(request_rec *r, oidc_cfg *c,
 	if (c->redirect_urls_allowed != NULL) {
 		for (hi = apr_hash_first(NULL, c->redirect_urls_allowed); hi; hi =
 				apr_hash_next(hi)) {
-			apr_hash_this(hi, (const void**) &c_host, NULL, NULL);
-			if (oidc_util_regexp_first_match(r->pool, url, c_host,
+			apr_hash_this(hi, (const void**) &c_host, NULL, (void **) &preg);
+			if (oidc_util_regexp_first_match_pcre(r->pool, url, preg,
 					NULL, err_str) == TRUE)
 				break;
 		}
@@ -3276,6 +3589,22 @@ int oidc_handle_jwks(request_rec *r, oidc_cfg *c) {
 			OK);
 }
 
+/*
+ * handle request for the metrics collected in shared memory
+ */
+static int oidc_handle_metrics(request_rec *r, oidc_cfg *c) {
+
+	if (c->metrics != 1)
+		return HTTP_NOT_FOUND;
+
+	char *metrics = oidc_metrics_prometheus(r);
+	if (metrics == NULL)
+		return HTTP_NOT_FOUND;
+
+	return oidc_util_http_send(r, metrics, strlen(metrics),
+			OIDC_METRICS_CONTENT_TYPE, OK);
+}
+
 static int oidc_handle_session_management_iframe_op(request_rec *r, oidc_cfg *c,
 		oidc_session_t *session, const char *check_session_iframe) {
 	oidc_debug(r, "enter");
@@ -4019,6 +4348,56 @@ static int oidc_check_mixed_userid_oauth(request_rec *r, oidc_cfg *c) {
 /*
  * generic Apache authentication hook for this module: dispatches to OpenID Connect or OAuth 2.0 specific routines
  */
+/* set once the first request in this child process has prefetched the metadata */
+static volatile apr_uint32_t oidc_metadata_prefetched = 0;
+
+/*
+ * fetch the JWKs at the specified URI in to the cache
+ */
+static void oidc_prefetch_jwks(request_rec *r, oidc_cfg *c, const char *url,
+		int refresh_interval, int ssl_validate_server) {
+	oidc_jwks_uri_t jwks_uri = { url, refresh_interval, ssl_validate_server };
+	apr_byte_t refresh = FALSE;
+	char *value = NULL;
+	if (url != NULL)
+		oidc_metadata_jwks_get_value(r, c, &jwks_uri, &value, &refresh);
+}
+
+/*
+ * fetch the metadata and JWKs of the configured provider(s) in to the cache;
+ * done on the first request of a child process since there's no request to
+ * run the HTTP calls in at child_init time
+ */
+static void oidc_prefetch_metadata(request_rec *r, oidc_cfg *c) {
+	oidc_provider_t *provider = NULL;
+	apr_array_header_t *issuers = NULL;
+	int i = 0;
+
+	if (apr_atomic_cas32(&oidc_metadata_prefetched, 1, 0) != 0)
+		return;
+
+	oidc_debug(r, "prefetching provider metadata and JWKs");
+
+	if (c->metadata_dir != NULL) {
+		if (oidc_metadata_list(r, c, &issuers) == TRUE) {
+			for (i = 0; i < issuers->nelts; i++) {
+				if (oidc_metadata_get(r, c,
+						((const char**) issuers->elts)[i], &provider,
+						FALSE) == TRUE)
+					oidc_prefetch_jwks(r, c, provider->jwks_uri,
+							provider->jwks_refresh_interval,
+							provider->ssl_validate_server);
+			}
+		}
+	} else if (oidc_provider_static_config(r, c, &provider) == TRUE) {
+		oidc_prefetch_jwks(r, c, provider->jwks_uri,
+				provider->jwks_refresh_interval, provider->ssl_validate_server);
+	}
+
+	oidc_prefetch_jwks(r, c, c->oauth.verify_jwks_uri,
+			c->provider.jwks_refresh_interval, c->oauth.ssl_validate_server);
+}
+
 int oidc_check_user_id(request_rec *r) {
 
 	oidc_cfg *c = ap_get_module_config(r->server->module_config,
@@ -4033,6 +4412,9 @@ int oidc_check_user_id(request_rec *r) {
 	if (current_auth == NULL)
 		return DECLINED;
 
+	if (c->metadata_prefetch == 1)
+		oidc_prefetch_metadata(r, c);
+
 	/* see if we've configured OpenID Connect user authentication for this request */
 	if (strcasecmp(current_auth, OIDC_AUTH_TYPE_OPENID_CONNECT) == 0) {
 
@@ -4056,22 +4438,27 @@ int oidc_check_user_id(request_rec *r) {
 }
 
 /*
- * get the claims and id_token from request state
+ * get the claims from request state with the id_token claims (e.g. "iss") merged in to them;
+ * returns a new reference, the (parsed) objects in request state itself are left untouched
  */
-static void oidc_authz_get_claims_and_idtoken(request_rec *r, json_t **claims,
-		json_t **id_token) {
+static json_t *oidc_authz_get_claims(request_rec *r) {
 
-	const char *s_claims = oidc_request_state_get(r,
+	json_t *claims = oidc_request_state_get_json(r,
 			OIDC_REQUEST_STATE_KEY_CLAIMS);
-	if (s_claims != NULL) {
-		oidc_util_decode_json_object(r, s_claims, claims);
-	}
-
-	const char *s_id_token = oidc_request_state_get(r,
+	json_t *id_token = oidc_request_state_get_json(r,
 			OIDC_REQUEST_STATE_KEY_IDTOKEN);
-	if (s_id_token != NULL) {
-		oidc_util_decode_json_object(r, s_id_token, id_token);
-	}
+
+	if (claims == NULL)
+		return (id_token != NULL) ? json_incref(id_token) : NULL;
+
+	if (id_token == NULL)
+		return json_incref(claims);
+
+	/* a shallow copy suffices since merging only adds references to the values */
+	claims = json_copy(claims);
+	oidc_util_json_merge(r, id_token, claims);
+
+	return claims;
 }
 
 #if MODULE_MAGIC_NUMBER_MAJOR >= 20100714
@@ -4153,22 +4540,15 @@ authz_status oidc_authz_checker(request_rec *r, const char *require_args,
 	}
 
 	/* get the set of claims from the request state (they've been set in the authentication part earlier */
-	json_t *claims = NULL, *id_token = NULL;
-	oidc_authz_get_claims_and_idtoken(r, &claims, &id_token);
-
-	/* merge id_token claims (e.g. "iss") in to claims json object */
-	if (claims)
-		oidc_util_json_merge(r, id_token, claims);
+	json_t *claims = oidc_authz_get_claims(r);
 
 	/* dispatch to the >=2.4 specific authz routine */
-	authz_status rc = oidc_authz_worker24(r, claims ? claims : id_token,
-			require_args, parsed_require_args, match_claim_fn);
+	authz_status rc = oidc_authz_worker24(r, claims, require_args,
+			parsed_require_args, match_claim_fn);
 
 	/* cleanup */
 	if (claims)
 		json_decref(claims);
-	if (id_token)
-		json_decref(id_token);
 
 	if ((rc == AUTHZ_DENIED) && ap_auth_type(r))
 		rc = oidc_handle_unauthorized_user24(r);
@@ -4236,10 +4616,6 @@ int oidc_auth_checker(request_rec *r) {
 			return OK;
 	}
 
-	/* get the set of claims from the request state (they've been set in the authentication part earlier */
-	json_t *claims = NULL, *id_token = NULL;
-	oidc_authz_get_claims_and_idtoken(r, &claims, &id_token);
-
 	/* get the Require statements */
 	const apr_array_header_t * const reqs_arr = ap_requires(r);
 
@@ -4252,19 +4628,15 @@ int oidc_auth_checker(request_rec *r) {
 		return DECLINED;
 	}
 
-	/* merge id_token claims (e.g. "iss") in to claims json object */
-	if (claims)
-		oidc_util_json_merge(r, id_token, claims);
+	/* get the set of claims from the request state (they've been set in the authentication part earlier */
+	json_t *claims = oidc_authz_get_claims(r);
 
 	/* dispatch to the <2.4 specific authz routine */
-	int rc = oidc_authz_worker22(r, claims ? claims : id_token, reqs,
-			reqs_arr->nelts);
+	int rc = oidc_authz_worker22(r, claims, reqs, reqs_arr->nelts);
 
 	/* cleanup */
 	if (claims)
 		json_decref(claims);
-	if (id_token)
-		json_decref(id_token);
 
 	if ((rc == HTTP_UNAUTHORIZED) && ap_auth_type(r))
 		rc = oidc_handle_unauthorized_user22(r);
@@ -4331,6 +4703,21 @@ int oidc_content_handler(request_rec *r) {
 	return rc;
 }
 
+/*
+ * serve the metrics for locations configured with "SetHandler auth-openidc-metrics",
+ * so that access to them can be restricted with the regular access control directives
+ */
+int oidc_metrics_handler(request_rec *r) {
+	oidc_cfg *c = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+
+	if ((r->handler == NULL)
+			|| (apr_strnatcmp(r->handler, OIDC_METRICS_HANDLER) != 0))
+		return DECLINED;
+
+	return oidc_handle_metrics(r, c);
+}
+
 extern const command_rec oidc_config_cmds[];
 
 module AP_MODULE_DECLARE_DATA auth_openidc_module = {
@@ -95,6 +95,7 @@ APLOG_USE_MODULE(auth_openidc);
 /* keys for storing info in the request state */
 #define OIDC_REQUEST_STATE_KEY_IDTOKEN "i"
 #define OIDC_REQUEST_STATE_KEY_CLAIMS  "c"
+#define OIDC_REQUEST_STATE_KEY_REFRESH "f"
 
 /* parameter name of the callback URL in the discovery response */
 #define OIDC_DISC_CB_PARAM "oidc_callback"
@@ -118,6 +119,18 @@ APLOG_USE_MODULE(auth_openidc);
 /* value that indicates to use client cookie based session tracking */
 #define OIDC_SESSION_TYPE_CLIENT_COOKIE 1
 
+/* value that indicates to serialize the session state as JSON text */
+#define OIDC_SESSION_ENCODING_JSON   0
+/* value that indicates to serialize the session state in a (versioned) binary format */
+#define OIDC_SESSION_ENCODING_BINARY 1
+
+/* value that indicates to use a single Redis server */
+#define OIDC_CACHE_REDIS_MODE_STANDALONE 0
+/* value that indicates to use a Redis Cluster and shard entries across its nodes */
+#define OIDC_CACHE_REDIS_MODE_CLUSTER    1
+/* value that indicates to use the Redis primary monitored by Sentinel */
+#define OIDC_CACHE_REDIS_MODE_SENTINEL   2
+
 /* nonce bytes length */
 #define OIDC_PROTO_NONCE_LENGTH 32
 
@@ -140,6 +153,8 @@ APLOG_USE_MODULE(auth_openidc);
 
 /* logout on refresh error before expiry */
 #define OIDC_LOGOUT_ON_ERROR_REFRESH 1
+/* refresh the access token before expiry after the response has been sent */
+#define OIDC_REFRESH_ACCESS_TOKEN_ASYNC 2
 
 #define OIDC_OAUTH_ACCEPT_TOKEN_IN_DEFAULT 0
 /* accept bearer token in header (default) */
@@ -169,6 +184,7 @@ APLOG_USE_MODULE(auth_openidc);
 
 /* the (global) key for the mod_auth_openidc related state that is stored in the request userdata context */
 #define OIDC_USERDATA_KEY "mod_auth_openidc_state"
+#define OIDC_USERDATA_JSON_KEY "mod_auth_openidc_state_json"
 #define OIDC_USERDATA_POST_PARAMS_KEY "oidc_userdata_post_params"
 
 /* input filter hook name */
@@ -311,9 +327,14 @@ typedef struct oidc_provider_t {
 	int issuer_specific_redirect_uri;
 } oidc_provider_t ;
 
+/* a compiled regular expression */
+typedef struct oidc_pcre_t oidc_pcre_t;
+
 typedef struct oidc_remote_user_claim_t {
 	const char *claim_name;
 	const char *reg_exp;
+	/* reg_exp compiled at configuration time */
+	oidc_pcre_t *preg;
 	const char *replace;
 } oidc_remote_user_claim_t;
 
@@ -337,6 +358,9 @@ typedef struct oidc_oauth_t {
 	apr_hash_t *verify_shared_keys;
 	char *verify_jwks_uri;
 	apr_hash_t *verify_public_keys;
+	int verify_cache_interval;
+	int introspection_negative_interval;
+	int introspection_coalesce_timeout;
 	int access_token_binding_policy;
 } oidc_oauth_t;
 
@@ -381,6 +405,10 @@ typedef struct oidc_cfg {
 	char *cache_file_dir;
 	/* cache_type = file: clean interval */
 	int cache_file_clean_interval;
+	/* cache_type = file: number of levels of hashed subdirectories that hold the cache files */
+	int cache_file_levels;
+	/* cache_type = file: maximum number of entries inspected in a single clean cycle */
+	int cache_file_clean_max;
 #ifdef USE_MEMCACHE
 	/* cache_type= memcache: list of memcache host/port servers to use */
 	char *cache_memcache_servers;
@@ -389,10 +417,25 @@ typedef struct oidc_cfg {
 	int cache_shm_size_max;
 	/* cache_type = shm: maximum size in bytes of a cache entry */
 	int cache_shm_entry_size_max;
+	/* cache_type = shm: additional slab classes (oidc_cache_shm_slab_t) for entries smaller than cache_shm_entry_size_max */
+	apr_array_header_t *cache_shm_slabs;
+	/* cache_type = shm: maximum number of entries per cache section (int *), keyed by section */
+	apr_hash_t *cache_shm_quota;
+	int cache_l1_max;
+	apr_hash_t *cache_l1_sections;
+	/* maximum number of IDs in the dedicated JTI/nonce replay store, 0 to use the regular cache */
+	int replay_cache_entries;
+	void *replay_cache_cfg;
+	/* whether metrics are collected and served on the redirect URI */
+	int metrics;
 #ifdef USE_LIBHIREDIS
 	/* cache_type= redis: Redis host/port server to use */
 	char *cache_redis_server;
 	char *cache_redis_password;
+	int cache_redis_mode;
+	char *cache_redis_sentinel_master;
+	int cache_redis_connect_timeout;
+	int cache_redis_timeout;
 #endif
 	int cache_encrypt;
 
@@ -403,6 +446,8 @@ typedef struct oidc_cfg {
 	int delete_oldest_state_cookies;
 	int session_inactivity_timeout;
 	int session_cache_fallback_to_cookie;
+	int session_encoding;
+	int compress_min_size;
 
 	char *cookie_domain;
 	char *claim_delimiter;
@@ -416,12 +461,23 @@ typedef struct oidc_cfg {
 	char *outgoing_proxy;
 
 	char *crypto_passphrase;
+	/* derived from crypto_passphrase at startup */
+	oidc_jwk_t *crypto_passphrase_jwk;
+	/* derived from crypto_passphrase at startup, for the MAC over state cookie timestamps */
+	unsigned char *state_cookie_mac_key;
+	unsigned int state_cookie_mac_key_len;
+	oidc_cache_crypto_t *cache_crypto;
 
 	int provider_metadata_refresh_interval;
+	int metadata_stale_ttl;
+	int metadata_refresh_ahead;
+	int metadata_prefetch;
 
 	apr_hash_t *info_hook_data;
 	apr_hash_t *black_listed_claims;
 	apr_hash_t *white_listed_claims;
+	/* claims passed to the application, mapped to a normalized output name or "" for prefix+claim */
+	apr_hash_t *pass_claim_names;
 
 	apr_byte_t state_input_headers;
 
@@ -430,6 +486,17 @@ typedef struct oidc_cfg {
 	char *ca_bundle_path;
 } oidc_cfg;
 
+/* the state of a user session, see oidc_session.c */
+typedef struct {
+	char uuid[APR_UUID_FORMATTED_LENGTH + 1]; /* unique id */
+    const char *remote_user;                  /* user who owns this particular session */
+    json_t *state;                            /* the state for this session, encoded in a JSON object */
+    apr_time_t expiry;                        /* if > 0, the time of expiry of this session */
+    const char *sid;                          /* the issuer-unique sid under which the session is indexed */
+    const char *sub;                          /* the issuer-unique sub under which the session is indexed */
+    apr_byte_t dirty;                         /* whether the state was modified since it was loaded/saved */
+} oidc_session_t;
+
 int oidc_check_user_id(request_rec *r);
 #if MODULE_MAGIC_NUMBER_MAJOR >= 20100714
 authz_status oidc_authz_checker_claim(request_rec *r, const char *require_args, const void *parsed_require_args);
@@ -441,15 +508,25 @@ int oidc_auth_checker(request_rec *r);
 #endif
 void oidc_request_state_set(request_rec *r, const char *key, const char *value);
 const char*oidc_request_state_get(request_rec *r, const char *key);
+void oidc_request_state_set_json(request_rec *r, const char *key, const char *s_json, json_t *json);
+json_t *oidc_request_state_get_json(request_rec *r, const char *key);
 int oidc_handle_jwks(request_rec *r, oidc_cfg *c);
 int oidc_handle_remove_at_cache(request_rec *r, oidc_cfg *c);
 apr_byte_t oidc_post_preserve_javascript(request_rec *r, const char *location, char **javascript, char **javascript_method);
 void oidc_scrub_headers(request_rec *r);
 void oidc_strip_cookies(request_rec *r);
 int oidc_content_handler(request_rec *r);
-apr_byte_t oidc_get_remote_user(request_rec *r, const char *claim_name, const char *replace, const char *reg_exp,
+int oidc_metrics_handler(request_rec *r);
+int oidc_log_transaction(request_rec *r);
+apr_byte_t oidc_get_remote_user(request_rec *r, const char *claim_name, const oidc_pcre_t *preg, const char *replace,
                                 json_t *json, char **request_user);
 
+// non-static for test.c
+char *oidc_state_cookie_value(request_rec *r, oidc_cfg *c, const char *name, apr_time_t timestamp, const char *encrypted);
+apr_byte_t oidc_state_cookie_parse(request_rec *r, oidc_cfg *c, const char *name, const char *value, apr_time_t *timestamp, const char **encrypted);
+int oidc_clean_expired_state_cookies(request_rec *r, oidc_cfg *c, const char *currentCookieName, int delete_oldest);
+apr_byte_t oidc_refresh_access_token_defer(request_rec *r, oidc_cfg *cfg, oidc_session_t *session);
+
 #define OIDC_REDIRECT_URI_REQUEST_INFO             "info"
 #define OIDC_REDIRECT_URI_REQUEST_LOGOUT           "logout"
 #define OIDC_REDIRECT_URI_REQUEST_JWKS             "jwks"
@@ -461,6 +538,13 @@ apr_byte_t oidc_get_remote_user(request_rec *r, const char *claim_name, const ch
 // oidc_oauth
 int oidc_oauth_check_userid(request_rec *r, oidc_cfg *c, const char *access_token);
 apr_byte_t oidc_oauth_get_bearer_token(request_rec *r, const char **access_token);
+apr_byte_t oidc_oauth_cache_access_token(request_rec *r, oidc_cfg *c, apr_time_t cache_until, const char *access_token, json_t *json);
+/* call the introspection endpoint for an access token, returning the response */
+typedef apr_byte_t (*oidc_oauth_introspect_function)(request_rec *r, oidc_cfg *c, const char *token, char **response);
+apr_byte_t oidc_oauth_resolve_access_token(request_rec *r, oidc_cfg *c, const char *access_token, oidc_oauth_introspect_function introspect, json_t **token, char **response);
+char *oidc_oauth_jwt_access_token_cache_key(request_rec *r, oidc_cfg *c, const char *access_token);
+void oidc_oauth_cache_jwt_access_token(request_rec *r, oidc_cfg *c, const char *cache_key, oidc_jwt_t *jwt);
+apr_byte_t oidc_oauth_validate_jwt_access_token(request_rec *r, oidc_cfg *c, const char *access_token, json_t **token, char **response);
 
 // oidc_proto.c
 #define OIDC_PROTO_ISS                   "iss"
@@ -652,6 +736,7 @@ int oidc_proto_javascript_implicit(request_rec *r, oidc_cfg *c);
 apr_array_header_t *oidc_proto_supported_flows(apr_pool_t *pool);
 apr_byte_t oidc_proto_flow_is_supported(apr_pool_t *pool, const char *flow);
 apr_byte_t oidc_proto_validate_authorization_response(request_rec *r, const char *response_type, const char *requested_response_mode, char **code, char **id_token, char **access_token, char **token_type, const char *used_response_mode);
+apr_status_t oidc_proto_jwks_cache_child_init(apr_pool_t *p, server_rec *s);
 apr_byte_t oidc_proto_jwt_verify(request_rec *r, oidc_cfg *cfg, oidc_jwt_t *jwt, const oidc_jwks_uri_t *jwks_uri, apr_hash_t *symmetric_keys, const char *alg);
 apr_byte_t oidc_proto_validate_jwt(request_rec *r, oidc_jwt_t *jwt, const char *iss, apr_byte_t exp_is_mandatory, apr_byte_t iat_is_mandatory, int iat_slack, int token_binding_policy);
 apr_byte_t oidc_proto_generate_nonce(request_rec *r, char **nonce, int len);
@@ -673,6 +758,7 @@ apr_byte_t oidc_proto_validate_nonce(request_rec *r, oidc_cfg *cfg, oidc_provide
 typedef apr_byte_t (*oidc_authz_match_claim_fn_type)(request_rec *, const char * const, const json_t * const);
 apr_byte_t oidc_authz_match_claim(request_rec *r, const char * const attr_spec, const json_t * const claims);
 #ifdef USE_LIBJQ
+apr_status_t oidc_authz_jq_cache_child_init(apr_pool_t *p, server_rec *s);
 apr_byte_t oidc_authz_match_claims_expr(request_rec *r, const char * const attr_spec, const json_t * const claims);
 #endif
 #if MODULE_MAGIC_NUMBER_MAJOR < 20100714
@@ -695,7 +781,12 @@ int oidc_oauth_return_www_authenticate(request_rec *r, const char *error, const
 #define OIDCMemCacheServers                  "OIDCMemCacheServers"
 #define OIDCCacheShmMax                      "OIDCCacheShmMax"
 #define OIDCCacheShmEntrySizeMax             "OIDCCacheShmEntrySizeMax"
+#define OIDCCacheShmSlabs                    "OIDCCacheShmSlabs"
+#define OIDCCacheShmSectionQuota             "OIDCCacheShmSectionQuota"
+#define OIDCReplayCacheEntries               "OIDCReplayCacheEntries"
+#define OIDCMetrics                          "OIDCMetrics"
 #define OIDCRedisCacheServer                 "OIDCRedisCacheServer"
+#define OIDCRedisCacheSentinelMaster         "OIDCRedisCacheSentinelMaster"
 #define OIDCCookiePath                       "OIDCCookiePath"
 #define OIDCInfoHook                         "OIDCInfoHook"
 #define OIDCWhiteListedClaims                "OIDCWhiteListedClaims"
@@ -736,6 +827,21 @@ int oidc_cfg_delete_oldest_state_cookies(oidc_cfg *cfg);
 void oidc_cfg_provider_init(oidc_provider_t *provider);
 
 // oidc_util.c
+/* a HTTP call that is executed together with other independent calls in oidc_util_http_multi */
+typedef struct oidc_http_call_t {
+	int metric;                               /* the OIDC_METRICS_HTTP_* endpoint type */
+	const char *url;
+	const char *data;                         /* if not NULL, POST this data instead of a GET */
+	const char *content_type;
+	const char *basic_auth;
+	const char *bearer_token;
+	int ssl_validate_server;
+	const char *ssl_cert;
+	const char *ssl_key;
+	char *response;                           /* the response body on success */
+	apr_byte_t rc;                            /* whether the call succeeded */
+} oidc_http_call_t;
+
 int oidc_strnenvcmp(const char *a, const char *b, int len);
 int oidc_base64url_encode(request_rec *r, char **dst, const char *src, int src_len, int remove_padding);
 int oidc_base64url_decode(apr_pool_t *pool, char **dst, const char *src);
@@ -747,14 +853,20 @@ char *oidc_url_encode(const request_rec *r, const char *str, const char *charsTo
 char *oidc_normalize_header_name(const request_rec *r, const char *str);
 void oidc_util_set_cookie(request_rec *r, const char *cookieName, const char *cookieValue, apr_time_t expires, const char *ext);
 char *oidc_util_get_cookie(request_rec *r, const char *cookieName);
-apr_byte_t oidc_util_http_get(request_rec *r, const char *url, const apr_table_t *params, const char *basic_auth, const char *bearer_token, int ssl_validate_server, char **response, int timeout, const char *outgoing_proxy, apr_array_header_t *pass_cookies, const char *ssl_cert, const char *ssl_key);
-apr_byte_t oidc_util_http_post_form(request_rec *r, const char *url, const apr_table_t *params, const char *basic_auth, const char *bearer_token, int ssl_validate_server, char **response, int timeout, const char *outgoing_proxy, apr_array_header_t *pass_cookies, const char *ssl_cert, const char *ssl_key);
-apr_byte_t oidc_util_http_post_json(request_rec *r, const char *url, json_t *data, const char *basic_auth, const char *bearer_token, int ssl_validate_server, char **response, int timeout, const char *outgoing_proxy, apr_array_header_t *pass_cookies, const char *ssl_cert, const char *ssl_key);
+apr_status_t oidc_util_http_child_init(apr_pool_t *p, server_rec *s);
+apr_byte_t oidc_util_http_get(request_rec *r, int metric, const char *url, const apr_table_t *params, const char *basic_auth, const char *bearer_token, int ssl_validate_server, char **response, int timeout, const char *outgoing_proxy, apr_array_header_t *pass_cookies, const char *ssl_cert, const char *ssl_key);
+apr_byte_t oidc_util_http_post_form(request_rec *r, int metric, const char *url, const apr_table_t *params, const char *basic_auth, const char *bearer_token, int ssl_validate_server, char **response, int timeout, const char *outgoing_proxy, apr_array_header_t *pass_cookies, const char *ssl_cert, const char *ssl_key);
+apr_byte_t oidc_util_http_post_json(request_rec *r, int metric, const char *url, json_t *data, const char *basic_auth, const char *bearer_token, int ssl_validate_server, char **response, int timeout, const char *outgoing_proxy, apr_array_header_t *pass_cookies, const char *ssl_cert, const char *ssl_key);
+apr_byte_t oidc_util_http_multi(request_rec *r, oidc_http_call_t *calls, int n, int timeout, const char *outgoing_proxy, apr_array_header_t *pass_cookies);
 apr_byte_t oidc_util_request_matches_url(request_rec *r, const char *url);
 apr_byte_t oidc_util_request_has_parameter(request_rec *r, const char* param);
 apr_byte_t oidc_util_get_request_parameter(request_rec *r, char *name, char **value);
 char *oidc_util_encode_json_object(request_rec *r, json_t *json, size_t flags);
 apr_byte_t oidc_util_decode_json_object(request_rec *r, const char *str, json_t **json);
+apr_byte_t oidc_util_msgpack_encode(request_rec *r, json_t *json, char **dst, apr_size_t *dst_len);
+apr_byte_t oidc_util_msgpack_decode(request_rec *r, const char *src, apr_size_t src_len, json_t **json);
+apr_byte_t oidc_util_deflate(request_rec *r, const char *src, apr_size_t src_len, char **dst, apr_size_t *dst_len);
+apr_byte_t oidc_util_inflate(request_rec *r, const char *src, apr_size_t src_len, char **dst, apr_size_t *dst_len);
 apr_byte_t oidc_util_decode_json_and_check_error(request_rec *r, const char *str, json_t **json);
 int oidc_util_http_send(request_rec *r, const char *data, size_t data_len, const char *content_type, int success_rvalue);
 int oidc_util_html_send(request_rec *r, const char *title, const char *html_head, const char *on_load, const char *html_body, int status_code);
@@ -767,6 +879,8 @@ apr_byte_t oidc_util_file_write(request_rec *r, const char *path, const char *da
 apr_byte_t oidc_util_issuer_match(const char *a, const char *b);
 int oidc_util_html_send_error(request_rec *r, const char *html_template, const char *error, const char *description, int status_code);
 apr_byte_t oidc_util_json_array_has_value(request_rec *r, json_t *haystack, const char *needle);
+const char *oidc_util_app_info_name(request_rec *r, const char *claim_prefix, const char *s_key);
+apr_status_t oidc_util_app_info_name_cache_child_init(apr_pool_t *p, server_rec *s);
 void oidc_util_set_app_info(request_rec *r, const char *s_key, const char *s_value, const char *claim_prefix, apr_byte_t as_header, apr_byte_t as_env_var);
 void oidc_util_set_app_infos(request_rec *r, const json_t *j_attrs, const char *claim_prefix, const char *claim_delimiter, apr_byte_t as_header, apr_byte_t as_env_var);
 apr_hash_t *oidc_util_spaced_string_to_hashtable(apr_pool_t *pool, const char *str);
@@ -780,11 +894,21 @@ void oidc_util_table_add_query_encoded_params(apr_pool_t *pool, apr_table_t *tab
 apr_hash_t * oidc_util_merge_key_sets(apr_pool_t *pool, apr_hash_t *k1, apr_hash_t *k2);
 apr_byte_t oidc_util_regexp_substitute(apr_pool_t *pool, const char *input, const char *regexp, const char *replace, char **output, char **error_str);
 apr_byte_t oidc_util_regexp_first_match(apr_pool_t *pool, const char *input, const char *regexp, char **output, char **error_str);
+oidc_pcre_t *oidc_pcre_compile(apr_pool_t *pool, const char *regexp, char **error_str);
+apr_byte_t oidc_pcre_match(const oidc_pcre_t *preg, const char *input);
+apr_status_t oidc_util_regexp_cache_child_init(apr_pool_t *p, server_rec *s);
+const oidc_pcre_t *oidc_util_regexp_get(request_rec *r, const char *regexp, char **error_str);
+apr_byte_t oidc_util_regexp_substitute_pcre(apr_pool_t *pool, const char *input, const oidc_pcre_t *preg, const char *replace, char **output, char **error_str);
+apr_byte_t oidc_util_regexp_first_match_pcre(apr_pool_t *pool, const char *input, const oidc_pcre_t *preg, char **output, char **error_str);
 apr_byte_t oidc_util_json_merge(request_rec *r, json_t *src, json_t *dst);
 int oidc_util_cookie_domain_valid(const char *hostname, char *cookie_domain);
 apr_byte_t oidc_util_hash_string_and_base64url_encode(request_rec *r, const char *openssl_hash_algo, const char *input, char **output);
+apr_byte_t oidc_util_crypto_passphrase_post_config(apr_pool_t *pool, server_rec *s);
+const unsigned char *oidc_util_state_cookie_mac_key(request_rec *r, unsigned int *key_len);
 apr_byte_t oidc_util_jwt_create(request_rec *r, const char *secret, json_t *payload, char **compact_encoded_jwt);
 apr_byte_t oidc_util_jwt_verify(request_rec *r, const char *secret, const char *compact_encoded_jwt, json_t **result);
+apr_byte_t oidc_util_jwe_encrypt_string(request_rec *r, const char *secret, const char *plaintext, char **compact_encoded_jwe);
+apr_byte_t oidc_util_jwe_decrypt_string(request_rec *r, const char *secret, const char *compact_encoded_jwe, char **plaintext);
 char *oidc_util_get_chunked_cookie(request_rec *r, const char *cookieName, int cookie_chunk_size);
 void oidc_util_set_chunked_cookie(request_rec *r, const char *cookieName, const char *cookieValue, apr_time_t expires, int chunkSize, const char *ext);
 apr_byte_t oidc_util_create_symmetric_key(request_rec *r, const char *client_secret, unsigned int r_key_len, const char *hash_algo, apr_byte_t set_kid, oidc_jwk_t **jwk);
@@ -846,19 +970,53 @@ apr_byte_t oidc_metadata_provider_retrieve(request_rec *r, oidc_cfg *cfg, const
 apr_byte_t oidc_metadata_provider_parse(request_rec *r, oidc_cfg *cfg, json_t *j_provider, oidc_provider_t *provider);
 apr_byte_t oidc_metadata_provider_is_valid(request_rec *r, oidc_cfg *cfg, json_t *j_provider, const char *issuer);
 apr_byte_t oidc_metadata_list(request_rec *r, oidc_cfg *cfg, apr_array_header_t **arr);
+apr_status_t oidc_metadata_registry_child_init(apr_pool_t *p, server_rec *s);
 apr_byte_t oidc_metadata_get(request_rec *r, oidc_cfg *cfg, const char *selected, oidc_provider_t **provider, apr_byte_t allow_discovery);
 apr_byte_t oidc_metadata_jwks_get(request_rec *r, oidc_cfg *cfg, const oidc_jwks_uri_t *jwks_uri, json_t **j_jwks, apr_byte_t *refresh);
+apr_byte_t oidc_metadata_jwks_get_value(request_rec *r, oidc_cfg *cfg, const oidc_jwks_uri_t *jwks_uri, char **value, apr_byte_t *refresh);
+/* fetch and validate a metadata document, returning it in serialized form */
+typedef apr_byte_t (*oidc_metadata_fetch_function)(request_rec *r, oidc_cfg *cfg, const void *data, char **value);
+apr_byte_t oidc_metadata_cache_get_or_fetch(request_rec *r, oidc_cfg *cfg, const char *section, const char *key, int ttl, oidc_metadata_fetch_function fetch, const void *data, char **value, apr_byte_t *fetched);
 apr_byte_t oidc_oauth_metadata_provider_parse(request_rec *r, oidc_cfg *c, json_t *j_provider);
 
-// oidc_session.c
-typedef struct {
-	char uuid[APR_UUID_FORMATTED_LENGTH + 1]; /* unique id */
-    const char *remote_user;                  /* user who owns this particular session */
-    json_t *state;                            /* the state for this session, encoded in a JSON object */
-    apr_time_t expiry;                        /* if > 0, the time of expiry of this session */
-    const char *sid;
-} oidc_session_t;
+// oidc_metrics.c
+#define OIDC_METRICS_HTTP_TOKEN               0
+#define OIDC_METRICS_HTTP_USERINFO            1
+#define OIDC_METRICS_HTTP_INTROSPECTION       2
+#define OIDC_METRICS_HTTP_JWKS                3
+#define OIDC_METRICS_HTTP_DISCOVERY           4
+#define OIDC_METRICS_HTTP_REGISTRATION        5
+#define OIDC_METRICS_HTTP_REVOCATION          6
+#define OIDC_METRICS_HTTP_OTHER               7
+#define OIDC_METRICS_HTTP_MAX                 8
+
+#define OIDC_METRICS_CACHE_OP_GET             0
+#define OIDC_METRICS_CACHE_OP_SET             1
+#define OIDC_METRICS_CACHE_OP_MAX             2
+
+#define OIDC_METRICS_CACHE_RESULT_HIT         0
+#define OIDC_METRICS_CACHE_RESULT_MISS        1
+#define OIDC_METRICS_CACHE_RESULT_OK          2
+#define OIDC_METRICS_CACHE_RESULT_ERROR       3
+#define OIDC_METRICS_CACHE_RESULT_MAX         4
+
+#define OIDC_METRICS_SESSION_OP_LOAD          0
+#define OIDC_METRICS_SESSION_OP_SAVE          1
+#define OIDC_METRICS_SESSION_OP_MAX           2
+
+#define OIDC_METRICS_CONTENT_TYPE             "text/plain; version=0.0.4"
+#define OIDC_METRICS_HANDLER                  "auth-openidc-metrics"
+
+apr_byte_t oidc_metrics_post_config(apr_pool_t *pool, server_rec *s);
+void oidc_metrics_http(request_rec *r, int type, apr_time_t start, apr_byte_t success);
+void oidc_metrics_cache_timing(request_rec *r, const char *backend, const char *section, int op, apr_time_t start);
+void oidc_metrics_cache_result(request_rec *r, const char *backend, const char *section, int result);
+void oidc_metrics_jwt_verify(request_rec *r, const char *alg, apr_time_t start, apr_byte_t success);
+void oidc_metrics_session(request_rec *r, int op, apr_time_t start);
+void oidc_metrics_session_size(request_rec *r, int op, apr_size_t size);
+char *oidc_metrics_prometheus(request_rec *r);
 
+// oidc_session.c
 apr_byte_t oidc_session_load(request_rec *r, oidc_session_t **z);
 apr_byte_t oidc_session_get(request_rec *r, oidc_session_t *z, const char *key, const char **value);
 apr_byte_t oidc_session_set(request_rec *r, oidc_session_t *z, const char *key, const char *value);
@@ -867,6 +1025,8 @@ apr_byte_t oidc_session_kill(request_rec *r, oidc_session_t *z);
 apr_byte_t oidc_session_free(request_rec *r, oidc_session_t *z);
 apr_byte_t oidc_session_extract(request_rec *r, oidc_session_t *z);
 apr_byte_t oidc_session_load_cache_by_uuid(request_rec *r, oidc_cfg *c, const char *uuid, oidc_session_t *z);
+apr_byte_t oidc_session_load_cache_multi(request_rec *r, oidc_cfg *c, const apr_array_header_t *uuids, oidc_session_t **sessions);
+apr_byte_t oidc_session_kill_cache_multi(request_rec *r, const apr_array_header_t *uuids, const char *section, const char *key);
 
 void oidc_session_set_userinfo_jwt(request_rec *r, oidc_session_t *z, const char *userinfo_jwt);
 const char * oidc_session_get_userinfo_jwt(request_rec *r, oidc_session_t *z);
@@ -64,7 +64,7 @@ apr_byte_t oidc_oauth_metadata_provider_retrieve(request_rec *r, oidc_cfg *cfg,
 		char **response) {
 
 	/* get provider metadata from the specified URL with the specified parameters */
-	if (oidc_util_http_get(r, url, NULL, NULL, NULL,
+	if (oidc_util_http_get(r, OIDC_METRICS_HTTP_DISCOVERY, url, NULL, NULL, NULL,
 			cfg->oauth.ssl_validate_server, response, cfg->http_timeout_short,
 			cfg->outgoing_proxy, oidc_dir_cfg_pass_cookies(r),
 			NULL, NULL) == FALSE)
@@ -87,6 +87,20 @@ apr_byte_t oidc_oauth_metadata_provider_retrieve(request_rec *r, oidc_cfg *cfg,
 	return TRUE;
 }
 
+/*
+ * retrieve the metadata of the OAuth 2.0 Authorization Server from its metadata URL
+ */
+static apr_byte_t oidc_oauth_provider_config_retrieve(request_rec *r,
+		oidc_cfg *c, const void *data, char **s_json) {
+	json_t *j_provider = NULL;
+	if (oidc_oauth_metadata_provider_retrieve(r, c, NULL, c->oauth.metadata_url,
+			&j_provider, s_json) == FALSE)
+		return FALSE;
+	if (j_provider)
+		json_decref(j_provider);
+	return TRUE;
+}
+
 static apr_byte_t oidc_oauth_provider_config(request_rec *r, oidc_cfg *c) {
 
 	json_t *j_provider = NULL;
@@ -96,34 +110,28 @@ static apr_byte_t oidc_oauth_provider_config(request_rec *r, oidc_cfg *c) {
 	if (c->oauth.metadata_url == NULL)
 		return TRUE;
 
-	oidc_cache_get_oauth_provider(r, c->oauth.metadata_url, &s_json);
-
-	if (s_json == NULL) {
-
-		if (oidc_oauth_metadata_provider_retrieve(r, c, NULL,
-				c->oauth.metadata_url, &j_provider, &s_json) == FALSE) {
-			oidc_error(r, "could not retrieve metadata from url: %s",
-					c->oauth.metadata_url);
-			return FALSE;
-		}
-
-		oidc_cache_set_oauth_provider(r, c->oauth.metadata_url, s_json,
-				apr_time_now() + (c->provider_metadata_refresh_interval <= 0 ? apr_time_from_sec( OIDC_CACHE_PROVIDER_METADATA_EXPIRY_DEFAULT) : c->provider_metadata_refresh_interval));
-
-	} else {
+	if (oidc_metadata_cache_get_or_fetch(r, c,
+			OIDC_CACHE_SECTION_OAUTH_PROVIDER, c->oauth.metadata_url,
+			c->provider_metadata_refresh_interval <= 0 ?
+					OIDC_CACHE_PROVIDER_METADATA_EXPIRY_DEFAULT :
+					c->provider_metadata_refresh_interval,
+			oidc_oauth_provider_config_retrieve, NULL, &s_json, NULL) == FALSE) {
+		oidc_error(r, "could not retrieve metadata from url: %s",
+				c->oauth.metadata_url);
+		return FALSE;
+	}
 
-		oidc_util_decode_json_object(r, s_json, &j_provider);
+	oidc_util_decode_json_object(r, s_json, &j_provider);
 
-		/* check to see if it is valid metadata */
-		/*
-		 if (oidc_oauth_metadata_provider_is_valid(r, c, j_provider, NULL) == FALSE) {
-		 oidc_error(r,
-		 "cache corruption detected: invalid metadata from url: %s",
-		 c->provider.metadata_url);
-		 return FALSE;
-		 }
-		 */
-	}
+	/* check to see if it is valid metadata */
+	/*
+	 if (oidc_oauth_metadata_provider_is_valid(r, c, j_provider, NULL) == FALSE) {
+	 oidc_error(r,
+	 "cache corruption detected: invalid metadata from url: %s",
+	 c->provider.metadata_url);
+	 return FALSE;
+	 }
+	 */
 
 	if (oidc_oauth_metadata_provider_parse(r, c, j_provider) == FALSE) {
 		oidc_error(r, "could not parse metadata from url: %s",
@@ -176,13 +184,13 @@ static apr_byte_t oidc_oauth_validate_access_token(request_rec *r, oidc_cfg *c,
 	/* call the endpoint with the constructed parameter set and return the resulting response */
 	return apr_strnatcmp(c->oauth.introspection_endpoint_method,
 			OIDC_INTROSPECTION_METHOD_GET) == 0 ?
-					oidc_util_http_get(r, c->oauth.introspection_endpoint_url, params,
+					oidc_util_http_get(r, OIDC_METRICS_HTTP_INTROSPECTION, c->oauth.introspection_endpoint_url, params,
 							basic_auth, bearer_auth, c->oauth.ssl_validate_server, response,
 							c->http_timeout_long, c->outgoing_proxy,
 							oidc_dir_cfg_pass_cookies(r),
 							oidc_util_get_full_path(r->pool, c->oauth.introspection_endpoint_tls_client_cert),
 							oidc_util_get_full_path(r->pool, c->oauth.introspection_endpoint_tls_client_key)) :
-							oidc_util_http_post_form(r, c->oauth.introspection_endpoint_url,
+							oidc_util_http_post_form(r, OIDC_METRICS_HTTP_INTROSPECTION, c->oauth.introspection_endpoint_url,
 									params, basic_auth, bearer_auth, c->oauth.ssl_validate_server,
 									response, c->http_timeout_long, c->outgoing_proxy,
 									oidc_dir_cfg_pass_cookies(r),
@@ -386,7 +394,7 @@ static apr_byte_t oidc_oauth_parse_and_cache_token_expiry(request_rec *r,
 #define OIDC_OAUTH_CACHE_KEY_RESPONSE  "r"
 #define OIDC_OAUTH_CACHE_KEY_TIMESTAMP "t"
 
-static apr_byte_t oidc_oauth_cache_access_token(request_rec *r, oidc_cfg *c,
+apr_byte_t oidc_oauth_cache_access_token(request_rec *r, oidc_cfg *c,
 		apr_time_t cache_until, const char *access_token, json_t *json) {
 
 	/* no cache mode */
@@ -461,7 +469,7 @@ static apr_byte_t oidc_oauth_get_cached_access_token(request_rec *r,
 			s_cache_entry);
 
 	/* we've got a cached introspection result that is still valid for this path's requirements */
-	*json = json_deep_copy(
+	*json = json_incref(
 			json_object_get(cache_entry, OIDC_OAUTH_CACHE_KEY_RESPONSE));
 
 	json_decref(cache_entry);
@@ -469,95 +477,180 @@ static apr_byte_t oidc_oauth_get_cached_access_token(request_rec *r,
 }
 
 /*
- * resolve and validate an access_token against the configured Authorization Server
+ * check the "active" claim of an introspection result; returns 1 when the token is
+ * active, 0 when it is not and -1 when there's no such claim (non-spec introspection)
  */
-static apr_byte_t oidc_oauth_resolve_access_token(request_rec *r, oidc_cfg *c,
-		const char *access_token, json_t **token, char **response) {
+static int oidc_oauth_introspection_active(request_rec *r, json_t *result) {
+	json_t *active = json_object_get(result, OIDC_PROTO_ACTIVE);
 
-	json_t *result = NULL;
+	if (active == NULL)
+		return -1;
 
-	/* see if we've got the claims for this access_token cached already */
-	oidc_oauth_get_cached_access_token(r, c, access_token, &result);
+	if (json_is_boolean(active)) {
+		if (!json_is_true(active)) {
+			oidc_debug(r,
+					"\"%s\" boolean object with value \"false\" found in response JSON object",
+					OIDC_PROTO_ACTIVE);
+			return 0;
+		}
+	} else if (json_is_string(active)) {
+		if (apr_strnatcasecmp(json_string_value(active), "true") != 0) {
+			oidc_debug(r,
+					"\"%s\" string object with value that is not equal to \"true\" found in response JSON object: %s",
+					OIDC_PROTO_ACTIVE, json_string_value(active));
+			return 0;
+		}
+	} else {
+		oidc_debug(r,
+				"no \"%s\" boolean or string object found in response JSON object",
+				OIDC_PROTO_ACTIVE);
+		return 0;
+	}
 
-	if (result == NULL) {
+	return 1;
+}
+
+/*
+ * go out and validate the access_token against the Authorization server, get the JSON
+ * claims back and cache them
+ */
+static apr_byte_t oidc_oauth_introspect_access_token(request_rec *r,
+		oidc_cfg *c, const char *access_token,
+		oidc_oauth_introspect_function introspect, json_t **result) {
 
-		char *s_json = NULL;
+	char *s_json = NULL;
+	apr_time_t cache_until;
 
-		/* not cached, go out and validate the access_token against the Authorization server and get the JSON claims back */
-		if (oidc_oauth_validate_access_token(r, c, access_token,
-				&s_json) == FALSE) {
-			oidc_error(r,
-					"could not get a validation response from the Authorization server");
+	if (introspect(r, c, access_token, &s_json) == FALSE) {
+		oidc_error(r,
+				"could not get a validation response from the Authorization server");
+		return FALSE;
+	}
+
+	/* decode and see if it is not an error response somehow */
+	if (oidc_util_decode_json_and_check_error(r, s_json, result) == FALSE)
+		return FALSE;
+
+	/* check the token binding ID in the introspection result */
+	if (oidc_util_json_validate_cnf(r, *result,
+			c->oauth.access_token_binding_policy) == FALSE)
+		return FALSE;
+
+	switch (oidc_oauth_introspection_active(r, *result)) {
+	case 0:
+		/* remember that the token is not active so it isn't introspected again right away */
+		if (c->oauth.introspection_negative_interval > 0)
+			oidc_oauth_cache_access_token(r, c,
+					apr_time_now()
+					+ apr_time_from_sec(
+							c->oauth.introspection_negative_interval),
+					access_token, *result);
+		json_decref(*result);
+		*result = NULL;
+		return FALSE;
+	case 1:
+		if (oidc_oauth_parse_and_cache_token_expiry(r, c, *result,
+				OIDC_CLAIM_EXP,
+				TRUE, FALSE, &cache_until) == FALSE) {
+			json_decref(*result);
+			*result = NULL;
 			return FALSE;
 		}
-
-		/* decode and see if it is not an error response somehow */
-		if (oidc_util_decode_json_and_check_error(r, s_json, &result) == FALSE)
+		break;
+	default:
+		if (oidc_oauth_parse_and_cache_token_expiry(r, c, *result,
+				c->oauth.introspection_token_expiry_claim_name,
+				apr_strnatcmp(c->oauth.introspection_token_expiry_claim_format,
+						OIDC_CLAIM_FORMAT_ABSOLUTE) == 0,
+						c->oauth.introspection_token_expiry_claim_required,
+						&cache_until) == FALSE) {
+			json_decref(*result);
+			*result = NULL;
 			return FALSE;
+		}
+		break;
+	}
 
-		/* check the token binding ID in the introspection result */
-		if (oidc_util_json_validate_cnf(r, result,
-				c->oauth.access_token_binding_policy) == FALSE)
+	/* set it in the cache so subsequent request don't need to validate the access_token and get the claims anymore */
+	oidc_oauth_cache_access_token(r, c, cache_until, access_token, *result);
+
+	return TRUE;
+}
+
+/* interval between checks for the result of a concurrent introspection call */
+#define OIDC_OAUTH_INTROSPECTION_COALESCE_POLL apr_time_from_msec(20)
+
+/*
+ * wait for a concurrent request that introspects the same access token to cache its
+ * result; returns TRUE when this request holds the lease and should do the call itself
+ */
+static apr_byte_t oidc_oauth_introspection_coalesce(request_rec *r,
+		oidc_cfg *c, const char *access_token, json_t **result) {
+
+	apr_time_t deadline = apr_time_now()
+					+ apr_time_from_msec(c->oauth.introspection_coalesce_timeout);
+
+	if ((c->oauth.introspection_coalesce_timeout <= 0)
+			|| (oidc_cfg_token_introspection_interval(r) == -1))
+		return FALSE;
+
+	/* the leader's lease lasts for as long as its HTTP call may take */
+	while (oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_ACCESS_TOKEN,
+			access_token,
+			apr_time_now() + apr_time_from_sec(c->http_timeout_long)) == FALSE) {
+		if (apr_time_now() >= deadline) {
+			oidc_debug(r,
+					"concurrent introspection did not finish in time, introspecting the token now");
+			return FALSE;
+		}
+		apr_sleep(OIDC_OAUTH_INTROSPECTION_COALESCE_POLL);
+		if (oidc_oauth_get_cached_access_token(r, c, access_token,
+				result) == TRUE) {
+			oidc_debug(r, "using the result of a concurrent introspection");
 			return FALSE;
+		}
+	}
 
-		json_t *active = json_object_get(result, OIDC_PROTO_ACTIVE);
-		apr_time_t cache_until;
-		if (active != NULL) {
-
-			if (json_is_boolean(active)) {
-				if (!json_is_true(active)) {
-					oidc_debug(r,
-							"\"%s\" boolean object with value \"false\" found in response JSON object",
-							OIDC_PROTO_ACTIVE);
-					json_decref(result);
-					return FALSE;
-				}
-			} else if (json_is_string(active)) {
-				if (apr_strnatcasecmp(json_string_value(active), "true") != 0) {
-					oidc_debug(r,
-							"\"%s\" string object with value that is not equal to \"true\" found in response JSON object: %s",
-							OIDC_PROTO_ACTIVE, json_string_value(active));
-					json_decref(result);
-					return FALSE;
-				}
-			} else {
-				oidc_debug(r,
-						"no \"%s\" boolean or string object found in response JSON object",
-						OIDC_PROTO_ACTIVE);
-				json_decref(result);
-				return FALSE;
-			}
+	return TRUE;
+}
 
-			if (oidc_oauth_parse_and_cache_token_expiry(r, c, result,
-					OIDC_CLAIM_EXP,
-					TRUE, FALSE, &cache_until) == FALSE) {
-				json_decref(result);
-				return FALSE;
-			}
+/*
+ * resolve and validate an access_token against the configured Authorization Server,
+ * using the introspect function to call its introspection endpoint
+ */
+apr_byte_t oidc_oauth_resolve_access_token(request_rec *r, oidc_cfg *c,
+		const char *access_token, oidc_oauth_introspect_function introspect,
+		json_t **token, char **response) {
 
-			/* set it in the cache so subsequent request don't need to validate the access_token and get the claims anymore */
-			oidc_oauth_cache_access_token(r, c, cache_until, access_token,
-					result);
+	json_t *result = NULL;
+	apr_byte_t leader = FALSE, rc = FALSE;
 
-		} else {
+	/* see if we've got the claims for this access_token cached already */
+	oidc_oauth_get_cached_access_token(r, c, access_token, &result);
 
-			if (oidc_oauth_parse_and_cache_token_expiry(r, c, result,
-					c->oauth.introspection_token_expiry_claim_name,
-					apr_strnatcmp(
-							c->oauth.introspection_token_expiry_claim_format,
-							OIDC_CLAIM_FORMAT_ABSOLUTE) == 0,
-							c->oauth.introspection_token_expiry_claim_required,
-							&cache_until) == FALSE) {
-				json_decref(result);
-				return FALSE;
-			}
+	/* see if another request is introspecting this access_token already */
+	if (result == NULL)
+		leader = oidc_oauth_introspection_coalesce(r, c, access_token, &result);
 
-			/* set it in the cache so subsequent request don't need to validate the access_token and get the claims anymore */
-			oidc_oauth_cache_access_token(r, c, cache_until, access_token,
-					result);
+	if (result == NULL) {
 
-		}
+		/* not cached, go out and validate the access_token against the Authorization server and get the JSON claims back */
+		rc = oidc_oauth_introspect_access_token(r, c, access_token, introspect,
+				&result);
+
+		if (leader == TRUE)
+			oidc_cache_lease_release(r, OIDC_CACHE_SECTION_ACCESS_TOKEN,
+					access_token);
 
+		if (rc == FALSE)
+			return FALSE;
+
+	} else if (oidc_oauth_introspection_active(r, result) == 0) {
+
+		/* a cached negative introspection result */
+		oidc_debug(r, "access token was found to be inactive in the cache");
+		json_decref(result);
+		return FALSE;
 	}
 
 	/* return the access_token JSON object */
@@ -576,7 +669,7 @@ static apr_byte_t oidc_oauth_resolve_access_token(request_rec *r, oidc_cfg *c,
 		//oidc_oauth_spaced_string_to_array(r, result, OIDC_PROTO_SCOPE, tkn, "scopes");
 
 		/* return only the pimped access_token results */
-		*token = json_deep_copy(tkn);
+		*token = json_incref(tkn);
 
 		json_decref(result);
 
@@ -595,6 +688,72 @@ static apr_byte_t oidc_oauth_resolve_access_token(request_rec *r, oidc_cfg *c,
 	return TRUE;
 }
 
+#define OIDC_OAUTH_CACHE_KEY_JWT_PREFIX "jwt:"
+
+/*
+ * get the cache key for the result of local validation of a JWT access token;
+ * it binds the result to the (virtual) server whose key material was used to validate it
+ */
+char *oidc_oauth_jwt_access_token_cache_key(request_rec *r, oidc_cfg *c,
+		const char *access_token) {
+	char *key = NULL;
+	const char *input = apr_psprintf(r->pool, "%s:%d:%s:%s",
+			r->server->server_hostname ? r->server->server_hostname : "",
+					r->server->port,
+					c->oauth.verify_jwks_uri ? c->oauth.verify_jwks_uri : "",
+							access_token);
+	if (oidc_util_hash_string_and_base64url_encode(r, OIDC_JOSE_ALG_SHA256,
+			input, &key) == FALSE)
+		return NULL;
+	return apr_pstrcat(r->pool, OIDC_OAUTH_CACHE_KEY_JWT_PREFIX, key, NULL);
+}
+
+/*
+ * get the claims of a previously validated JWT access token from the cache
+ */
+static apr_byte_t oidc_oauth_get_cached_jwt_access_token(request_rec *r,
+		oidc_cfg *c, const char *cache_key, json_t **token, char **response) {
+	char *s_payload = NULL;
+	json_t *payload = NULL;
+
+	oidc_cache_get_access_token(r, cache_key, &s_payload);
+	if (s_payload == NULL)
+		return FALSE;
+
+	if (oidc_util_decode_json_object(r, s_payload, &payload) == FALSE)
+		return FALSE;
+
+	/* the token binding ID is a property of the request, so check it again */
+	if (oidc_util_json_validate_cnf(r, payload,
+			c->oauth.access_token_binding_policy) == FALSE) {
+		json_decref(payload);
+		return FALSE;
+	}
+
+	oidc_debug(r, "returning cached result of JWT access token validation");
+
+	*token = payload;
+	*response = s_payload;
+
+	return TRUE;
+}
+
+/*
+ * cache the claims of a validated JWT access token, no longer than its expiry
+ */
+void oidc_oauth_cache_jwt_access_token(request_rec *r, oidc_cfg *c,
+		const char *cache_key, oidc_jwt_t *jwt) {
+	apr_time_t cache_until = apr_time_now()
+					+ apr_time_from_sec(c->oauth.verify_cache_interval);
+	if ((jwt->payload.exp != OIDC_JWT_CLAIM_TIME_EMPTY)
+			&& (apr_time_from_sec(jwt->payload.exp) < cache_until))
+		cache_until = apr_time_from_sec(jwt->payload.exp);
+	if (cache_until <= apr_time_now())
+		return;
+	oidc_cache_set_access_token(r, cache_key, jwt->payload.value.str,
+			cache_until);
+}
+
 /*
  * validate a JWT access token (locally)
  *
@@ -606,22 +765,32 @@ static apr_byte_t oidc_oauth_resolve_access_token(request_rec *r, oidc_cfg *c,
  * # 32x 61 hex
  * OIDCOAuthVerifySharedKeys aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa
  */
-static apr_byte_t oidc_oauth_validate_jwt_access_token(request_rec *r,
+apr_byte_t oidc_oauth_validate_jwt_access_token(request_rec *r,
 		oidc_cfg *c, const char *access_token, json_t **token, char **response) {
 
-	oidc_debug(r, "enter: JWT access_token header=%s",
-			oidc_proto_peek_jwt_header(r, access_token, NULL));
+	oidc_debug(r, "enter");
 
 	oidc_jose_error_t err;
 	oidc_jwk_t *jwk = NULL;
+	char *cache_key = NULL;
+
+	/* see if we've validated this access_token before */
+	if (c->oauth.verify_cache_interval > 0) {
+		cache_key = oidc_oauth_jwt_access_token_cache_key(r, c, access_token);
+		if ((cache_key != NULL)
+				&& (oidc_oauth_get_cached_jwt_access_token(r, c, cache_key,
+						token, response) == TRUE))
+			return TRUE;
+	}
 
 	// TODO: replace this OIDC client secret with OIDCOAuthDecryptSharedKeys
 	if (oidc_util_create_symmetric_key(r, c->provider.client_secret, 0, NULL,
 			TRUE, &jwk) == FALSE)
 		return FALSE;
 
+	/* verify the signature before parsing the payload so that forged tokens are rejected early */
 	oidc_jwt_t *jwt = NULL;
-	if (oidc_jwt_parse(r->pool, access_token, &jwt,
+	if (oidc_jwt_parse_header(r->pool, access_token, &jwt,
 			oidc_util_merge_symmetric_key(r->pool, c->private_keys, jwk),
 			&err) == FALSE) {
 		oidc_error(r, "could not parse JWT from access_token: %s",
@@ -633,16 +802,6 @@ static apr_byte_t oidc_oauth_validate_jwt_access_token(request_rec *r,
 	oidc_debug(r, "successfully parsed JWT with header: %s",
 			jwt->header.value.str);
 
-	/*
-	 * validate the access token JWT by validating the (optional) exp claim
-	 * don't enforce anything around iat since it doesn't make much sense for access tokens
-	 */
-	if (oidc_proto_validate_jwt(r, jwt, NULL, FALSE, FALSE, -1,
-			c->oauth.access_token_binding_policy) == FALSE) {
-		oidc_jwt_destroy(jwt);
-		return FALSE;
-	}
-
 	oidc_debug(r,
 			"verify JWT against %d statically configured public keys and %d shared keys, with JWKs URI set to %s",
 			c->oauth.verify_public_keys ?
@@ -662,10 +821,31 @@ static apr_byte_t oidc_oauth_validate_jwt_access_token(request_rec *r,
 		return FALSE;
 	}
 
+	if (oidc_jwt_parse_payload(r->pool, jwt, &err) == FALSE) {
+		oidc_error(r, "could not parse JWT payload from access_token: %s",
+				oidc_jose_e2s(r->pool, err));
+		oidc_jwt_destroy(jwt);
+		return FALSE;
+	}
+
+	/*
+	 * validate the access token JWT by validating the (optional) exp claim
+	 * don't enforce anything around iat since it doesn't make much sense for access tokens
+	 */
+	if (oidc_proto_validate_jwt(r, jwt, NULL, FALSE, FALSE, -1,
+			c->oauth.access_token_binding_policy) == FALSE) {
+		oidc_jwt_destroy(jwt);
+		return FALSE;
+	}
+
 	oidc_debug(r, "successfully verified JWT access token: %s",
 			jwt->payload.value.str);
 
-	*token = json_deep_copy(jwt->payload.value.json);
+	/* set it in the cache so subsequent requests don't need to validate the access_token anymore */
+	if (cache_key != NULL)
+		oidc_oauth_cache_jwt_access_token(r, c, cache_key, jwt);
+
+	*token = json_incref(jwt->payload.value.json);
 	*response = jwt->payload.value.str;
 
 	oidc_jwt_destroy(jwt);
@@ -707,7 +887,7 @@ static apr_byte_t oidc_oauth_set_request_user(request_rec *r, oidc_cfg *c,
 	char *remote_user = NULL;
 
 	if (oidc_get_remote_user(r, c->oauth.remote_user_claim.claim_name,
-			c->oauth.remote_user_claim.reg_exp,
+			c->oauth.remote_user_claim.preg,
 			c->oauth.remote_user_claim.replace, token, &remote_user) == FALSE) {
 		oidc_error(r,
 				"" OIDCOAuthRemoteUserClaim " is set to \"%s\", but could not set the remote user based the available claims for the user",
@@ -798,8 +978,8 @@ int oidc_oauth_check_userid(request_rec *r, oidc_cfg *c,
 	/* check if an introspection endpoint is set */
 	if (c->oauth.introspection_endpoint_url != NULL) {
 		/* we'll validate the token remotely */
-		if (oidc_oauth_resolve_access_token(r, c, access_token, &token,
-				&s_token) == FALSE)
+		if (oidc_oauth_resolve_access_token(r, c, access_token,
+				oidc_oauth_validate_access_token, &token, &s_token) == FALSE)
 			return oidc_oauth_return_www_authenticate(r,
 					OIDC_PROTO_ERR_INVALID_TOKEN,
 					"Reference token could not be introspected");
@@ -820,8 +1000,8 @@ int oidc_oauth_check_userid(request_rec *r, oidc_cfg *c,
 	}
 
 	/* store the parsed token (cq. the claims from the response) in the request state so it can be accessed by the authz routines */
-	oidc_request_state_set(r, OIDC_REQUEST_STATE_KEY_CLAIMS,
-			(const char *) s_token);
+	oidc_request_state_set_json(r, OIDC_REQUEST_STATE_KEY_CLAIMS,
+			(const char *) s_token, token);
 
 	/* set the request user */
 	if (oidc_oauth_set_request_user(r, c, token) == FALSE) {
@@ -340,6 +340,65 @@ const char *oidc_parse_session_type(apr_pool_t *pool, const char *arg,
 	return NULL;
 }
 
+#define OIDC_SESSION_ENCODING_JSON_STR   "json"
+#define OIDC_SESSION_ENCODING_BINARY_STR "binary"
+
+/*
+ * parse the serialization format of the session state
+ */
+const char *oidc_parse_session_encoding(apr_pool_t *pool, const char *arg,
+		int *encoding) {
+	static char *options[] = {
+			OIDC_SESSION_ENCODING_JSON_STR,
+			OIDC_SESSION_ENCODING_BINARY_STR,
+			NULL };
+	const char *rv = oidc_valid_string_option(pool, arg, options);
+	if (rv != NULL)
+		return rv;
+
+	if (apr_strnatcmp(arg, OIDC_SESSION_ENCODING_JSON_STR) == 0)
+		*encoding = OIDC_SESSION_ENCODING_JSON;
+	else if (apr_strnatcmp(arg, OIDC_SESSION_ENCODING_BINARY_STR) == 0)
+		*encoding = OIDC_SESSION_ENCODING_BINARY;
+
+	return NULL;
+}
+
+/* minimum/maximum size in bytes above which payloads are compressed */
+#define OIDC_MINIMUM_COMPRESS_MIN_SIZE 0
+#define OIDC_MAXIMUM_COMPRESS_MIN_SIZE 1024 * 1024
+
+/*
+ * parse the minimum size of cookie payloads and cache values that get compressed
+ */
+const char *oidc_parse_compress_min_size(apr_pool_t *pool, const char *arg,
+		int *int_value) {
+	const char *rv = oidc_parse_int_min_max(pool, arg, int_value,
+			OIDC_MINIMUM_COMPRESS_MIN_SIZE, OIDC_MAXIMUM_COMPRESS_MIN_SIZE);
+	if (rv != NULL)
+		return rv;
+#ifndef USE_ZLIB
+	if (*int_value > 0)
+		return apr_psprintf(pool,
+				"compression is not supported: this module was built without zlib");
+#endif
+	return NULL;
+}
+
+/* minimum/maximum stale-while-revalidate and refresh-ahead time in seconds */
+#define OIDC_MINIMUM_METADATA_REFRESH_TIME 0
+#define OIDC_MAXIMUM_METADATA_REFRESH_TIME 3600 * 24 * 7
+
+/*
+ * parse the time in seconds that stale metadata may be served or that it is refreshed ahead of expiry
+ */
+const char *oidc_parse_metadata_refresh_time(apr_pool_t *pool, const char *arg,
+		int *int_value) {
+	return oidc_parse_int_min_max(pool, arg, int_value,
+			OIDC_MINIMUM_METADATA_REFRESH_TIME,
+			OIDC_MAXIMUM_METADATA_REFRESH_TIME);
+}
+
 /* minimum size of a SHM cache entry */
 #define OIDC_MINIMUM_CACHE_SHM_ENTRY_SIZE_MAX 8192 + 512 + 17 // 8Kb plus overhead
 /* maximum size of a SHM cache entry */
@@ -355,6 +414,266 @@ const char *oidc_parse_cache_shm_entry_size_max(apr_pool_t *pool,
 			OIDC_MAXIMUM_CACHE_SHM_ENTRY_SIZE_MAX);
 }
 
+/* minimum size of a SHM cache entry in an additional slab class */
+#define OIDC_MINIMUM_CACHE_SHM_SLAB_ENTRY_SIZE 128
+/* maximum number of entries in a single SHM slab class */
+#define OIDC_MAXIMUM_CACHE_SHM_SLAB_SIZE 1024 * 1024 * 16
+
+/*
+ * parse an additional SHM slab class specified as <entry-size>:<number-of-entries>
+ */
+const char *oidc_parse_cache_shm_slab(apr_pool_t *pool, const char *arg,
+		apr_array_header_t **slabs) {
+	oidc_cache_shm_slab_t slab;
+	const char *rv = NULL;
+	char *s = apr_pstrdup(pool, arg);
+	char *p = strchr(s, ':');
+
+	if (p == NULL)
+		return apr_psprintf(pool,
+				"invalid slab class \"%s\": must be specified as <entry-size>:<number-of-entries>",
+				arg);
+	*p = '\0';
+	p++;
+
+	rv = oidc_parse_int_min_max(pool, s, &slab.entry_size,
+			OIDC_MINIMUM_CACHE_SHM_SLAB_ENTRY_SIZE,
+			OIDC_MAXIMUM_CACHE_SHM_ENTRY_SIZE_MAX);
+	if (rv != NULL)
+		return rv;
+
+	rv = oidc_parse_int_min_max(pool, p, &slab.size_max, 1,
+			OIDC_MAXIMUM_CACHE_SHM_SLAB_SIZE);
+	if (rv != NULL)
+		return rv;
+
+	if (*slabs == NULL)
+		*slabs = apr_array_make(pool, 4, sizeof(oidc_cache_shm_slab_t));
+	APR_ARRAY_PUSH(*slabs, oidc_cache_shm_slab_t) = slab;
+
+	return NULL;
+}
+
+#define OIDC_CACHE_SECTION_SESSION_STR        "session"
+#define OIDC_CACHE_SECTION_NONCE_STR          "nonce"
+#define OIDC_CACHE_SECTION_JWKS_STR           "jwks"
+#define OIDC_CACHE_SECTION_ACCESS_TOKEN_STR   "access_token"
+#define OIDC_CACHE_SECTION_PROVIDER_STR       "provider"
+#define OIDC_CACHE_SECTION_OAUTH_PROVIDER_STR "oauth_provider"
+#define OIDC_CACHE_SECTION_JTI_STR            "jti"
+#define OIDC_CACHE_SECTION_REQUEST_URI_STR    "request_uri"
+#define OIDC_CACHE_SECTION_SID_STR            "sid"
+#define OIDC_CACHE_SECTION_SESSION_EXPIRY_STR "session_expiry"
+#define OIDC_CACHE_SECTION_LEASE_STR          "lease"
+#define OIDC_CACHE_SECTION_SUB_STR            "sub"
+
+/*
+ * parse a cache section name in to the section identifier used in the cache
+ */
+static const char *oidc_parse_cache_section(apr_pool_t *pool, const char *arg,
+		const char **section) {
+	static char *options[] = {
+			OIDC_CACHE_SECTION_SESSION_STR,
+			OIDC_CACHE_SECTION_NONCE_STR,
+			OIDC_CACHE_SECTION_JWKS_STR,
+			OIDC_CACHE_SECTION_ACCESS_TOKEN_STR,
+			OIDC_CACHE_SECTION_PROVIDER_STR,
+			OIDC_CACHE_SECTION_OAUTH_PROVIDER_STR,
+			OIDC_CACHE_SECTION_JTI_STR,
+			OIDC_CACHE_SECTION_REQUEST_URI_STR,
+			OIDC_CACHE_SECTION_SID_STR,
+			OIDC_CACHE_SECTION_SESSION_EXPIRY_STR,
+			OIDC_CACHE_SECTION_LEASE_STR,
+			OIDC_CACHE_SECTION_SUB_STR,
+			NULL };
+	static char *sections[] = {
+			OIDC_CACHE_SECTION_SESSION,
+			OIDC_CACHE_SECTION_NONCE,
+			OIDC_CACHE_SECTION_JWKS,
+			OIDC_CACHE_SECTION_ACCESS_TOKEN,
+			OIDC_CACHE_SECTION_PROVIDER,
+			OIDC_CACHE_SECTION_OAUTH_PROVIDER,
+			OIDC_CACHE_SECTION_JTI,
+			OIDC_CACHE_SECTION_REQUEST_URI,
+			OIDC_CACHE_SECTION_SID,
+			OIDC_CACHE_SECTION_SESSION_EXPIRY,
+			OIDC_CACHE_SECTION_LEASE,
+			OIDC_CACHE_SECTION_SUB,
+			NULL };
+	int i = 0;
+
+	const char *rv = oidc_valid_string_option(pool, arg, options);
+	if (rv != NULL)
+		return rv;
+
+	while (apr_strnatcmp(options[i], arg) != 0)
+		i++;
+
+	*section = sections[i];
+
+	return NULL;
+}
+
+/* maximum number of entries that a quota can be set to */
+#define OIDC_MAXIMUM_CACHE_SHM_SECTION_QUOTA 1024 * 1024 * 16
+
+/*
+ * parse the maximum number of SHM cache entries for a named cache section
+ */
+const char *oidc_parse_cache_shm_section_quota(apr_pool_t *pool,
+		const char *section, const char *arg, apr_hash_t **quota) {
+	const char *s = NULL;
+	int *v = apr_pcalloc(pool, sizeof(int));
+
+	const char *rv = oidc_parse_cache_section(pool, section, &s);
+	if (rv != NULL)
+		return rv;
+
+	rv = oidc_parse_int_min_max(pool, arg, v, 1,
+			OIDC_MAXIMUM_CACHE_SHM_SECTION_QUOTA);
+	if (rv != NULL)
+		return rv;
+
+	if (*quota == NULL)
+		*quota = apr_hash_make(pool);
+	apr_hash_set(*quota, s, APR_HASH_KEY_STRING, v);
+
+	return NULL;
+}
+
+/* maximum number of levels of hashed subdirectories in the file cache */
+#define OIDC_MAXIMUM_CACHE_FILE_LEVELS 2
+
+/*
+ * parse the number of levels of hashed subdirectories in the file cache
+ */
+const char *oidc_parse_cache_file_levels(apr_pool_t *pool, const char *arg,
+		int *int_value) {
+	return oidc_parse_int_min_max(pool, arg, int_value, 0,
+			OIDC_MAXIMUM_CACHE_FILE_LEVELS);
+}
+
+/* minimum/maximum number of file cache entries inspected in a single clean cycle */
+#define OIDC_MINIMUM_CACHE_FILE_CLEAN_MAX 1
+#define OIDC_MAXIMUM_CACHE_FILE_CLEAN_MAX 1024 * 1024
+
+/*
+ * parse the maximum number of file cache entries inspected in a single clean cycle
+ */
+const char *oidc_parse_cache_file_clean_max(apr_pool_t *pool, const char *arg,
+		int *int_value) {
+	return oidc_parse_int_min_max(pool, arg, int_value,
+			OIDC_MINIMUM_CACHE_FILE_CLEAN_MAX,
+			OIDC_MAXIMUM_CACHE_FILE_CLEAN_MAX);
+}
+
+/* minimum/maximum number of entries in the per-process L1 cache */
+#define OIDC_MINIMUM_CACHE_L1_MAX 1
+#define OIDC_MAXIMUM_CACHE_L1_MAX 1024 * 64
+
+/*
+ * parse the maximum number of entries in the per-process L1 cache
+ */
+const char *oidc_parse_cache_l1_max(apr_pool_t *pool, const char *arg,
+		int *int_value) {
+	return oidc_parse_int_min_max(pool, arg, int_value,
+			OIDC_MINIMUM_CACHE_L1_MAX, OIDC_MAXIMUM_CACHE_L1_MAX);
+}
+
+/* maximum number of IDs in the dedicated replay cache */
+#define OIDC_MAXIMUM_REPLAY_CACHE_ENTRIES 1024 * 1024
+
+/*
+ * parse the maximum number of IDs in the dedicated replay cache (0 to disable it)
+ */
+const char *oidc_parse_replay_cache_entries(apr_pool_t *pool, const char *arg,
+		int *int_value) {
+	return oidc_parse_int_min_max(pool, arg, int_value, 0,
+			OIDC_MAXIMUM_REPLAY_CACHE_ENTRIES);
+}
+
+/* minimum/maximum time in seconds that an entry can be served from the L1 cache */
+#define OIDC_MINIMUM_CACHE_L1_STALENESS 1
+#define OIDC_MAXIMUM_CACHE_L1_STALENESS 3600
+
+/*
+ * parse the maximum staleness of L1 cache entries for a named cache section;
+ * sessions are excluded so that changes are immediately visible in all processes
+ */
+const char *oidc_parse_cache_l1_section(apr_pool_t *pool, const char *section,
+		const char *arg, apr_hash_t **sections) {
+	const char *s = NULL;
+	int *v = apr_pcalloc(pool, sizeof(int));
+
+	const char *rv = oidc_parse_cache_section(pool, section, &s);
+	if (rv != NULL)
+		return rv;
+
+	if ((apr_strnatcmp(s, OIDC_CACHE_SECTION_SESSION) == 0)
+			|| (apr_strnatcmp(s, OIDC_CACHE_SECTION_SESSION_EXPIRY) == 0)
+			|| (apr_strnatcmp(s, OIDC_CACHE_SECTION_LEASE) == 0)
+			|| (apr_strnatcmp(s, OIDC_CACHE_SECTION_SID) == 0)
+			|| (apr_strnatcmp(s, OIDC_CACHE_SECTION_SUB) == 0)
+			|| (apr_strnatcmp(s, OIDC_CACHE_SECTION_ACCESS_TOKEN) == 0)
+			|| (apr_strnatcmp(s, OIDC_CACHE_SECTION_JTI) == 0)
+			|| (apr_strnatcmp(s, OIDC_CACHE_SECTION_REQUEST_URI) == 0))
+		return apr_psprintf(pool,
+				"section \"%s\" cannot be kept in the L1 cache", section);
+
+	rv = oidc_parse_int_min_max(pool, arg, v, OIDC_MINIMUM_CACHE_L1_STALENESS,
+			OIDC_MAXIMUM_CACHE_L1_STALENESS);
+	if (rv != NULL)
+		return rv;
+
+	if (*sections == NULL)
+		*sections = apr_hash_make(pool);
+	apr_hash_set(*sections, s, APR_HASH_KEY_STRING, v);
+
+	return NULL;
+}
+
+#define OIDC_CACHE_REDIS_MODE_STANDALONE_STR "standalone"
+#define OIDC_CACHE_REDIS_MODE_CLUSTER_STR    "cluster"
+#define OIDC_CACHE_REDIS_MODE_SENTINEL_STR   "sentinel"
+
+/*
+ * parse the Redis deployment mode
+ */
+const char *oidc_parse_cache_redis_mode(apr_pool_t *pool, const char *arg,
+		int *mode) {
+	static char *options[] = {
+			OIDC_CACHE_REDIS_MODE_STANDALONE_STR,
+			OIDC_CACHE_REDIS_MODE_CLUSTER_STR,
+			OIDC_CACHE_REDIS_MODE_SENTINEL_STR,
+			NULL };
+	const char *rv = oidc_valid_string_option(pool, arg, options);
+	if (rv != NULL)
+		return rv;
+
+	if (apr_strnatcmp(arg, OIDC_CACHE_REDIS_MODE_STANDALONE_STR) == 0)
+		*mode = OIDC_CACHE_REDIS_MODE_STANDALONE;
+	else if (apr_strnatcmp(arg, OIDC_CACHE_REDIS_MODE_CLUSTER_STR) == 0)
+		*mode = OIDC_CACHE_REDIS_MODE_CLUSTER;
+	else if (apr_strnatcmp(arg, OIDC_CACHE_REDIS_MODE_SENTINEL_STR) == 0)
+		*mode = OIDC_CACHE_REDIS_MODE_SENTINEL;
+
+	return NULL;
+}
+
+/* minimum Redis (connect) timeout in seconds */
+#define OIDC_MINIMUM_CACHE_REDIS_TIMEOUT 1
+/* maximum Redis (connect) timeout in seconds */
+#define OIDC_MAXIMUM_CACHE_REDIS_TIMEOUT 3600
+
+/*
+ * parse a Redis connect or I/O timeout value in seconds
+ */
+const char *oidc_parse_cache_redis_timeout(apr_pool_t *pool, const char *arg,
+		int *int_value) {
+	return oidc_parse_int_min_max(pool, arg, int_value,
+			OIDC_MINIMUM_CACHE_REDIS_TIMEOUT, OIDC_MAXIMUM_CACHE_REDIS_TIMEOUT);
+}
+
 /*
  * parse a boolean value from a provided string
  */
@@ -783,23 +1102,27 @@ const char *oidc_parse_pass_userinfo_as(apr_pool_t *pool, const char *v1,
 }
 
 #define OIDC_LOGOUT_ON_ERROR_REFRESH_STR "logout_on_error"
+#define OIDC_REFRESH_ACCESS_TOKEN_ASYNC_STR "async"
 
 /*
- * convert a "logout_on_error" to an integer
+ * convert a "logout_on_error" or "async" value to an integer
  */
 static int oidc_parse_logout_on_error_refresh_as_str2int(const char *v) {
 	if (apr_strnatcmp(v, OIDC_LOGOUT_ON_ERROR_REFRESH_STR) == 0)
 		return OIDC_LOGOUT_ON_ERROR_REFRESH;
+	if (apr_strnatcmp(v, OIDC_REFRESH_ACCESS_TOKEN_ASYNC_STR) == 0)
+		return OIDC_REFRESH_ACCESS_TOKEN_ASYNC;
 	return OIDC_CONFIG_POS_INT_UNSET;
 }
 
 /*
- * parse a "logout_on_error" value from the provided strings
+ * parse a "logout_on_error" or "async" value from the provided strings
  */
 const char *oidc_parse_logout_on_error_refresh_as(apr_pool_t *pool, const char *v1,
 		int *int_value) {
 	static char *options[] = {
 			OIDC_LOGOUT_ON_ERROR_REFRESH_STR,
+			OIDC_REFRESH_ACCESS_TOKEN_ASYNC_STR,
 			NULL };
 	const char *rv = NULL;
 	rv = oidc_valid_string_option(pool, v1, options);
@@ -1112,6 +1435,52 @@ const char *oidc_parse_jwks_refresh_interval(apr_pool_t *pool, const char *arg,
 			oidc_valid_jwks_refresh_interval);
 }
 
+#define OIDC_OAUTH_VERIFY_CACHE_INTERVAL_MIN 0
+#define OIDC_OAUTH_VERIFY_CACHE_INTERVAL_MAX 3600 * 24
+
+/*
+ * check the boundaries for the verified JWT access token cache interval
+ */
+const char *oidc_valid_oauth_verify_cache_interval(apr_pool_t *pool, int v) {
+	return oidc_valid_int_min_max(pool, v, OIDC_OAUTH_VERIFY_CACHE_INTERVAL_MIN,
+			OIDC_OAUTH_VERIFY_CACHE_INTERVAL_MAX);
+}
+
+/*
+ * parse the verified JWT access token cache interval
+ */
+const char *oidc_parse_oauth_verify_cache_interval(apr_pool_t *pool,
+		const char *arg, int *int_value) {
+	return oidc_parse_int_valid(pool, arg, int_value,
+			oidc_valid_oauth_verify_cache_interval);
+}
+
+#define OIDC_OAUTH_INTROSPECTION_NEGATIVE_INTERVAL_MIN 0
+#define OIDC_OAUTH_INTROSPECTION_NEGATIVE_INTERVAL_MAX 3600
+
+/*
+ * parse the duration for which inactive introspection results are cached
+ */
+const char *oidc_parse_oauth_introspection_negative_interval(apr_pool_t *pool,
+		const char *arg, int *int_value) {
+	return oidc_parse_int_min_max(pool, arg, int_value,
+			OIDC_OAUTH_INTROSPECTION_NEGATIVE_INTERVAL_MIN,
+			OIDC_OAUTH_INTROSPECTION_NEGATIVE_INTERVAL_MAX);
+}
+
+#define OIDC_OAUTH_INTROSPECTION_COALESCE_TIMEOUT_MIN 0
+#define OIDC_OAUTH_INTROSPECTION_COALESCE_TIMEOUT_MAX 60000
+
+/*
+ * parse the time in milliseconds to wait for a concurrent introspection call
+ */
+const char *oidc_parse_oauth_introspection_coalesce_timeout(apr_pool_t *pool,
+		const char *arg, int *int_value) {
+	return oidc_parse_int_min_max(pool, arg, int_value,
+			OIDC_OAUTH_INTROSPECTION_COALESCE_TIMEOUT_MIN,
+			OIDC_OAUTH_INTROSPECTION_COALESCE_TIMEOUT_MAX);
+}
+
 #define OIDC_IDTOKEN_IAT_SLACK_MIN 0
 #define OIDC_IDTOKEN_IAT_SLACK_MAX 3600
 
@@ -87,6 +87,7 @@ const char *oidc_valid_claim_format(apr_pool_t *pool, const char *arg);
 const char *oidc_valid_introspection_method(apr_pool_t *pool, const char *arg);
 const char *oidc_valid_session_max_duration(apr_pool_t *pool,  int v);
 const char *oidc_valid_jwks_refresh_interval(apr_pool_t *pool, int v);
+const char *oidc_valid_oauth_verify_cache_interval(apr_pool_t *pool, int v);
 const char *oidc_valid_idtoken_iat_slack(apr_pool_t *pool, int v);
 const char *oidc_valid_userinfo_refresh_interval(apr_pool_t *pool, int v);
 const char *oidc_valid_userinfo_token_method(apr_pool_t *pool, const char *arg);
@@ -99,7 +100,19 @@ const char *oidc_parse_boolean(apr_pool_t *pool, const char *arg, int *bool_valu
 
 const char *oidc_parse_cache_type(apr_pool_t *pool, const char *arg, oidc_cache_t **type);
 const char *oidc_parse_session_type(apr_pool_t *pool, const char *arg, int *type, int *persistent);
+const char *oidc_parse_session_encoding(apr_pool_t *pool, const char *arg, int *encoding);
+const char *oidc_parse_compress_min_size(apr_pool_t *pool, const char *arg, int *int_value);
+const char *oidc_parse_metadata_refresh_time(apr_pool_t *pool, const char *arg, int *int_value);
 const char *oidc_parse_cache_shm_entry_size_max(apr_pool_t *pool, const char *arg, int *int_value);
+const char *oidc_parse_cache_shm_slab(apr_pool_t *pool, const char *arg, apr_array_header_t **slabs);
+const char *oidc_parse_cache_shm_section_quota(apr_pool_t *pool, const char *section, const char *arg, apr_hash_t **quota);
+const char *oidc_parse_cache_file_levels(apr_pool_t *pool, const char *arg, int *int_value);
+const char *oidc_parse_cache_file_clean_max(apr_pool_t *pool, const char *arg, int *int_value);
+const char *oidc_parse_cache_l1_max(apr_pool_t *pool, const char *arg, int *int_value);
+const char *oidc_parse_replay_cache_entries(apr_pool_t *pool, const char *arg, int *int_value);
+const char *oidc_parse_cache_l1_section(apr_pool_t *pool, const char *section, const char *arg, apr_hash_t **sections);
+const char *oidc_parse_cache_redis_mode(apr_pool_t *pool, const char *arg, int *mode);
+const char *oidc_parse_cache_redis_timeout(apr_pool_t *pool, const char *arg, int *int_value);
 const char *oidc_parse_session_inactivity_timeout(apr_pool_t *pool, const char *arg, int *int_value);
 const char *oidc_parse_session_max_duration(apr_pool_t *pool, const char *arg, int *int_value);
 const char *oidc_parse_enc_kid_key_tuple(apr_pool_t *pool, const char *tuple, char **kid, char **key, int *key_len, apr_byte_t triplet);
@@ -113,6 +126,9 @@ const char *oidc_parse_set_claims_as(apr_pool_t *pool, const char *arg, int *in_
 const char *oidc_parse_unauth_action(apr_pool_t *pool, const char *arg, int *action);
 const char *oidc_parse_unautz_action(apr_pool_t *pool, const char *arg, int *action);
 const char *oidc_parse_jwks_refresh_interval(apr_pool_t *pool, const char *arg, int *int_value);
+const char *oidc_parse_oauth_verify_cache_interval(apr_pool_t *pool, const char *arg, int *int_value);
+const char *oidc_parse_oauth_introspection_negative_interval(apr_pool_t *pool, const char *arg, int *int_value);
+const char *oidc_parse_oauth_introspection_coalesce_timeout(apr_pool_t *pool, const char *arg, int *int_value);
 const char *oidc_parse_idtoken_iat_slack(apr_pool_t *pool, const char *arg, int *int_value);
 const char *oidc_parse_userinfo_refresh_interval(apr_pool_t *pool, const char *arg, int *int_value);
 const char *oidc_parse_userinfo_token_method(apr_pool_t *pool, const char *arg, int *int_value);
@@ -54,6 +54,8 @@
 #include <http_log.h>
 #include <http_request.h>
 
+#include <apr_thread_mutex.h>
+
 #include "mod_auth_openidc.h"
 #include "parse.h"
 
@@ -197,8 +199,7 @@ static int oidc_proto_copy_from_request(void* rec, const char* name,
 			result = json_string(value);
 		if (result) {
 			json_object_set_new(ctx->request_object->payload.value.json, name,
-					json_deep_copy(result));
-			json_decref(result);
+					result);
 		}
 
 		if (oidc_proto_param_needs_action(ctx->request_object_config, name,
@@ -1099,9 +1100,7 @@ apr_byte_t oidc_proto_validate_nonce(request_rec *r, oidc_cfg *cfg,
 	oidc_jose_error_t err;
 
 	/* see if we have this nonce cached already */
-	char *replay = NULL;
-	oidc_cache_get_nonce(r, nonce, &replay);
-	if (replay != NULL) {
+	if (oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_NONCE, nonce) == TRUE) {
 		oidc_error(r,
 				"the nonce value (%s) passed in the browser state was found in the cache already; possible replay attack!?",
 				nonce);
@@ -1135,7 +1134,7 @@ apr_byte_t oidc_proto_validate_nonce(request_rec *r, oidc_cfg *cfg,
 			provider->idtoken_iat_slack * 2 + 10);
 
 	/* store it in the cache for the calculated duration */
-	oidc_cache_set_nonce(r, nonce, nonce,
+	oidc_cache_replay_add(r, OIDC_CACHE_SECTION_NONCE, nonce,
 			apr_time_now() + nonce_cache_duration);
 
 	oidc_debug(r,
@@ -1375,125 +1374,313 @@ static apr_byte_t oidc_proto_validate_idtoken(request_rec *r,
 	return TRUE;
 }
 
+/* a parsed JWK with the attributes needed to match it against a JWT header */
+typedef struct oidc_proto_jwks_key_t {
+	oidc_jwk_t *jwk;
+	char *x5t;
+	char *use;
+} oidc_proto_jwks_key_t;
+
+/* a set of parsed JWKs, shared by the requests in a process for as long as the cached JWKs don't change */
+typedef struct oidc_proto_jwks_t {
+	/* pool that the keys are allocated from, NULL when it is the request pool */
+	apr_pool_t *pool;
+	/* the jwks_uri that the keys were obtained from */
+	const char *url;
+	/* the cached JWKs (string) value that the keys were parsed from */
+	const char *value;
+	/* the parsed keys (oidc_proto_jwks_key_t) */
+	apr_array_header_t *keys;
+	/* index into the keys by kid */
+	apr_hash_t *kids;
+	/* number of requests using the keys */
+	int refcount;
+	/* whether this is still the most recent set of keys for the jwks_uri */
+	apr_byte_t current;
+} oidc_proto_jwks_t;
+
+/* per-process cache of parsed JWKs, keyed by jwks_uri */
+static apr_pool_t *oidc_proto_jwks_cache_pool = NULL;
+static apr_hash_t *oidc_proto_jwks_cache = NULL;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *oidc_proto_jwks_cache_mutex = NULL;
+#endif
+
+#if APR_HAS_THREADS
+#define oidc_proto_jwks_cache_lock() apr_thread_mutex_lock(oidc_proto_jwks_cache_mutex)
+#define oidc_proto_jwks_cache_unlock() apr_thread_mutex_unlock(oidc_proto_jwks_cache_mutex)
+#else
+#define oidc_proto_jwks_cache_lock()
+#define oidc_proto_jwks_cache_unlock()
+#endif
+
 /*
- * get the key from the JWKs that corresponds with the key specified in the header
+ * destroy a set of parsed JWKs
  */
-static apr_byte_t oidc_proto_get_key_from_jwks(request_rec *r, oidc_jwt_t *jwt,
-		json_t *j_jwks, apr_hash_t *result) {
+static void oidc_proto_jwks_destroy(oidc_proto_jwks_t *jwks) {
+	int i;
+	for (i = 0; i < jwks->keys->nelts; i++)
+		oidc_jwk_destroy(
+				APR_ARRAY_IDX(jwks->keys, i, oidc_proto_jwks_key_t).jwk);
+	if (jwks->pool != NULL)
+		apr_pool_destroy(jwks->pool);
+}
 
-	apr_byte_t rc = TRUE;
-	oidc_jwk_t *jwk = NULL;
+/*
+ * release a set of parsed JWKs at the end of the request that used them
+ */
+static apr_status_t oidc_proto_jwks_release(void *data) {
+	oidc_proto_jwks_t *jwks = (oidc_proto_jwks_t *) data;
+	oidc_proto_jwks_cache_lock();
+	jwks->refcount--;
+	if ((jwks->refcount == 0) && (jwks->current == FALSE))
+		oidc_proto_jwks_destroy(jwks);
+	oidc_proto_jwks_cache_unlock();
+	return APR_SUCCESS;
+}
+
+/*
+ * initialize the per-process cache of parsed JWKs in a child process
+ */
+apr_status_t oidc_proto_jwks_cache_child_init(apr_pool_t *p, server_rec *s) {
+	apr_status_t rv = APR_SUCCESS;
+#if APR_HAS_THREADS
+	rv = apr_thread_mutex_create(&oidc_proto_jwks_cache_mutex,
+			APR_THREAD_MUTEX_DEFAULT, p);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s, "apr_thread_mutex_create failed: %d", rv);
+		return rv;
+	}
+#endif
+	oidc_proto_jwks_cache = apr_hash_make(p);
+	oidc_proto_jwks_cache_pool = p;
+	return rv;
+}
+
+/*
+ * parse the keys in a JWKs value
+ */
+static oidc_proto_jwks_t *oidc_proto_jwks_parse(request_rec *r,
+		apr_pool_t *pool, const char *url, const char *value) {
+
+	oidc_proto_jwks_t *jwks = apr_pcalloc(pool, sizeof(oidc_proto_jwks_t));
+	oidc_proto_jwks_key_t *key = NULL;
 	oidc_jose_error_t err;
-	char *jwk_json = NULL;
+	json_t *j_jwks = NULL;
+	oidc_jwk_t *jwk = NULL;
+	int i;
 
-	/* get the (optional) thumbprint for comparison */
-	const char *x5t = oidc_jwt_hdr_get(jwt, OIDC_JWK_X5T);
-	oidc_debug(r, "search for kid \"%s\" or thumbprint x5t \"%s\"",
-			jwt->header.kid, x5t);
+	jwks->pool = pool;
+	jwks->url = apr_pstrdup(pool, url);
+	jwks->value = apr_pstrdup(pool, value);
+	jwks->keys = apr_array_make(pool, 4, sizeof(oidc_proto_jwks_key_t));
+	jwks->kids = apr_hash_make(pool);
+
+	/* decode and see if it is not an error response somehow */
+	if (oidc_util_decode_json_and_check_error(r, value, &j_jwks) == FALSE) {
+		oidc_error(r, "JSON parsing of cached JWKs data failed");
+		return jwks;
+	}
 
 	/* get the "keys" JSON array from the JWKs object */
 	json_t *keys = json_object_get(j_jwks, OIDC_JWK_KEYS);
 	if ((keys == NULL) || !(json_is_array(keys))) {
 		oidc_error(r, "\"%s\" array element is not a JSON array",
 				OIDC_JWK_KEYS);
-		return FALSE;
+		json_decref(j_jwks);
+		return jwks;
 	}
 
-	int i;
 	for (i = 0; i < json_array_size(keys); i++) {
 
 		/* get the next element in the array */
 		json_t *elem = json_array_get(keys, i);
 
-		if (oidc_jwk_parse_json(r->pool, elem, &jwk, &err) == FALSE) {
+		if (oidc_jwk_parse_json(pool, elem, &jwk, &err) == FALSE) {
 			oidc_warn(r, "oidc_jwk_parse_json failed: %s",
 					oidc_jose_e2s(r->pool, err));
 			continue;
 		}
 
+		key = &APR_ARRAY_PUSH(jwks->keys, oidc_proto_jwks_key_t);
+		key->jwk = jwk;
+		key->x5t = NULL;
+		oidc_json_object_get_string(pool, elem, OIDC_JWK_X5T,
+				&key->x5t, NULL);
+		key->use = apr_pstrdup(pool,
+				json_string_value(json_object_get(elem, OIDC_JWK_USE)));
+
+		if ((jwk->kid != NULL)
+				&& (apr_hash_get(jwks->kids, jwk->kid, APR_HASH_KEY_STRING)
+						== NULL))
+			apr_hash_set(jwks->kids, jwk->kid, APR_HASH_KEY_STRING, key);
+	}
+
+	json_decref(j_jwks);
+
+	oidc_debug(r, "parsed %d key(s) from the JWKs obtained from: %s",
+			jwks->keys->nelts, url);
+
+	return jwks;
+}
+
+/*
+ * get the parsed keys for a JWKs value, from the per-process cache if it was parsed before
+ */
+static oidc_proto_jwks_t *oidc_proto_jwks_get(request_rec *r, const char *url,
+		const char *value) {
+	oidc_proto_jwks_t *jwks = NULL, *old = NULL;
+	apr_pool_t *pool = NULL;
+
+	/* not running in a child process: parse the keys for the lifetime of this request */
+	if (oidc_proto_jwks_cache == NULL) {
+		jwks = oidc_proto_jwks_parse(r, r->pool, url, value);
+		jwks->pool = NULL;
+		jwks->refcount = 1;
+		jwks->current = FALSE;
+		apr_pool_cleanup_register(r->pool, jwks, oidc_proto_jwks_release,
+				apr_pool_cleanup_null);
+		return jwks;
+	}
+
+	oidc_proto_jwks_cache_lock();
+	jwks = apr_hash_get(oidc_proto_jwks_cache, url, APR_HASH_KEY_STRING);
+	if ((jwks != NULL) && (apr_strnatcmp(jwks->value, value) == 0)) {
+		jwks->refcount++;
+		oidc_proto_jwks_cache_unlock();
+		apr_pool_cleanup_register(r->pool, jwks, oidc_proto_jwks_release,
+				apr_pool_cleanup_null);
+		return jwks;
+	}
+	apr_pool_create(&pool, oidc_proto_jwks_cache_pool);
+	oidc_proto_jwks_cache_unlock();
+
+	/* parse outside of the lock; it is the expensive part */
+	jwks = oidc_proto_jwks_parse(r, pool, url, value);
+
+	oidc_proto_jwks_cache_lock();
+	old = apr_hash_get(oidc_proto_jwks_cache, url, APR_HASH_KEY_STRING);
+	if (old != NULL) {
+		/* remove the entry first since its key is allocated from the old pool */
+		apr_hash_set(oidc_proto_jwks_cache, url, APR_HASH_KEY_STRING, NULL);
+		old->current = FALSE;
+		if (old->refcount == 0)
+			oidc_proto_jwks_destroy(old);
+	}
+	jwks->current = TRUE;
+	jwks->refcount = 1;
+	apr_hash_set(oidc_proto_jwks_cache, jwks->url, APR_HASH_KEY_STRING, jwks);
+	oidc_proto_jwks_cache_unlock();
+
+	apr_pool_cleanup_register(r->pool, jwks, oidc_proto_jwks_release,
+			apr_pool_cleanup_null);
+
+	return jwks;
+}
+
+/*
+ * get the key from the JWKs that corresponds with the key specified in the header
+ */
+static apr_byte_t oidc_proto_get_key_from_jwks(request_rec *r, oidc_jwt_t *jwt,
+		oidc_proto_jwks_t *jwks, apr_hash_t *result) {
+
+	oidc_proto_jwks_key_t *key = NULL;
+	int i;
+
+	/* get the (optional) thumbprint for comparison */
+	const char *x5t = oidc_jwt_hdr_get(jwt, OIDC_JWK_X5T);
+	oidc_debug(r, "search for kid \"%s\" or thumbprint x5t \"%s\"",
+			jwt->header.kid, x5t);
+
+	/* fast path: look up the key by kid */
+	if (jwt->header.kid != NULL) {
+		key = apr_hash_get(jwks->kids, jwt->header.kid, APR_HASH_KEY_STRING);
+		if ((key != NULL) && (oidc_jwt_alg2kty(jwt) == key->jwk->kty)) {
+			oidc_debug(r, "found matching kid: \"%s\"", jwt->header.kid);
+			apr_hash_set(result, jwt->header.kid, APR_HASH_KEY_STRING,
+					key->jwk);
+			return TRUE;
+		}
+	}
+
+	for (i = 0; i < jwks->keys->nelts; i++) {
+
+		key = &APR_ARRAY_IDX(jwks->keys, i, oidc_proto_jwks_key_t);
+
 		/* get the key type and see if it is the type that we are looking for */
-		if (oidc_jwt_alg2kty(jwt) != jwk->kty) {
+		if (oidc_jwt_alg2kty(jwt) != key->jwk->kty) {
 			oidc_debug(r,
 					"skipping non matching kty=%d for kid=%s because it doesn't match requested kty=%d, kid=%s",
-					jwk->kty, jwk->kid, oidc_jwt_alg2kty(jwt), jwt->header.kid);
-			oidc_jwk_destroy(jwk);
+					key->jwk->kty, key->jwk->kid, oidc_jwt_alg2kty(jwt),
+					jwt->header.kid);
 			continue;
 		}
 
 		/* see if we were looking for a specific kid, if not we'll include any key that matches the type */
 		if ((jwt->header.kid == NULL) && (x5t == NULL)) {
-			const char *use = json_string_value(
-					json_object_get(elem, OIDC_JWK_USE));
-			if ((use != NULL) && (strcmp(use, OIDC_JWK_SIG) != 0)) {
+			if ((key->use != NULL) && (strcmp(key->use, OIDC_JWK_SIG) != 0)) {
 				oidc_debug(r,
 						"skipping key because of non-matching \"%s\": \"%s\"",
-						OIDC_JWK_USE, use);
-				oidc_jwk_destroy(jwk);
+						OIDC_JWK_USE, key->use);
 			} else {
-				oidc_jwk_to_json(r->pool, jwk, &jwk_json, &err);
 				oidc_debug(r,
-						"no kid/x5t to match, include matching key type: %s",
-						jwk_json);
-				if (jwk->kid != NULL)
-					apr_hash_set(result, jwk->kid, APR_HASH_KEY_STRING, jwk);
+						"no kid/x5t to match, include matching key type: kid=%s",
+						key->jwk->kid);
+				if (key->jwk->kid != NULL)
+					apr_hash_set(result, key->jwk->kid, APR_HASH_KEY_STRING,
+							key->jwk);
 				else
 					// can do this because we never remove anything from the list
 					apr_hash_set(result,
 							apr_psprintf(r->pool, "%d", apr_hash_count(result)),
-							APR_HASH_KEY_STRING, jwk);
+							APR_HASH_KEY_STRING, key->jwk);
 			}
 			continue;
 		}
 
-		/* we are looking for a specific kid, get the kid from the current element */
-		/* compare the requested kid against the current element */
-		if ((jwt->header.kid != NULL) && (jwk->kid != NULL)
-				&& (apr_strnatcmp(jwt->header.kid, jwk->kid) == 0)) {
-			oidc_jwk_to_json(r->pool, jwk, &jwk_json, &err);
-			oidc_debug(r, "found matching kid: \"%s\" for jwk: %s",
-					jwt->header.kid, jwk_json);
-			apr_hash_set(result, jwt->header.kid, APR_HASH_KEY_STRING, jwk);
+		/* we are looking for a specific kid, compare the requested kid against the current element */
+		if ((jwt->header.kid != NULL) && (key->jwk->kid != NULL)
+				&& (apr_strnatcmp(jwt->header.kid, key->jwk->kid) == 0)) {
+			oidc_debug(r, "found matching kid: \"%s\"", jwt->header.kid);
+			apr_hash_set(result, jwt->header.kid, APR_HASH_KEY_STRING,
+					key->jwk);
 			break;
 		}
 
-		/* we are looking for a specific x5t, get the x5t from the current element */
-		char *s_x5t = NULL;
-		oidc_json_object_get_string(r->pool, elem, OIDC_JWK_X5T, &s_x5t,
-				NULL);
-		/* compare the requested thumbprint against the current element */
-		if ((s_x5t != NULL) && (x5t != NULL)
-				&& (apr_strnatcmp(x5t, s_x5t) == 0)) {
-			oidc_jwk_to_json(r->pool, jwk, &jwk_json, &err);
-			oidc_debug(r, "found matching %s: \"%s\" for jwk: %s", OIDC_JWK_X5T,
-					x5t, jwk_json);
-			apr_hash_set(result, x5t, APR_HASH_KEY_STRING, jwk);
+		/* we are looking for a specific x5t, compare the requested thumbprint against the current element */
+		if ((key->x5t != NULL) && (x5t != NULL)
+				&& (apr_strnatcmp(x5t, key->x5t) == 0)) {
+			oidc_debug(r, "found matching %s: \"%s\"", OIDC_JWK_X5T, x5t);
+			apr_hash_set(result, x5t, APR_HASH_KEY_STRING, key->jwk);
 			break;
 		}
-
-		/* the right key type but no matching kid/x5t */
-		oidc_jwk_destroy(jwk);
 	}
 
-	return rc;
+	return TRUE;
 }
 
 /*
- * get the keys from the (possibly cached) set of JWKs on the jwk_uri that corresponds with the key specified in the header
+ * get the keys from the (possibly cached) set of JWKs on the jwk_uri that corresponds with the key specified in the header;
+ * the returned keys are owned by the per-process JWKs cache and remain valid for the lifetime of the request
  */
 apr_byte_t oidc_proto_get_keys_from_jwks_uri(request_rec *r, oidc_cfg *cfg,
 		oidc_jwt_t *jwt, const oidc_jwks_uri_t *jwks_uri, apr_hash_t *keys,
 		apr_byte_t *force_refresh) {
 
-	json_t *j_jwks = NULL;
+	char *value = NULL;
+	oidc_proto_jwks_t *jwks = NULL;
 
 	/* get the set of JSON Web Keys for this provider (possibly by downloading them from the specified provider->jwk_uri) */
-	oidc_metadata_jwks_get(r, cfg, jwks_uri, &j_jwks, force_refresh);
-	if (j_jwks == NULL) {
+	oidc_metadata_jwks_get_value(r, cfg, jwks_uri, &value, force_refresh);
+	if (value == NULL) {
 		oidc_error(r, "could not %s JSON Web Keys",
 				*force_refresh ? "refresh" : "get");
 		return FALSE;
 	}
 
+	/* get the parsed keys, which only requires parsing when the JWKs value has changed */
+	jwks = oidc_proto_jwks_get(r, jwks_uri->url, value);
+
 	/*
 	 * get the key corresponding to the kid from the header, referencing the key that
 	 * was used to sign this message (or get all keys in case no kid was set)
@@ -1502,10 +1689,7 @@ apr_byte_t oidc_proto_get_keys_from_jwks_uri(request_rec *r, oidc_cfg *cfg,
 	 * way as "key not found" i.e. by refreshing the keys from the JWKs URI if not
 	 * already done
 	 */
-	oidc_proto_get_key_from_jwks(r, jwt, j_jwks, keys);
-
-	/* no need anymore for the parsed json_t contents, release the it */
-	json_decref(j_jwks);
+	oidc_proto_get_key_from_jwks(r, jwt, jwks, keys);
 
 	/* if we've got no keys and we did not do a fresh download, then the cache may be stale */
 	if ((apr_hash_count(keys) < 1) && (*force_refresh == FALSE)) {
@@ -1560,19 +1744,19 @@ apr_byte_t oidc_proto_jwt_verify(request_rec *r, oidc_cfg *cfg, oidc_jwt_t *jwt,
 		 /* get the key from the JWKs that corresponds with the key specified in the header */
 		 if (oidc_proto_get_keys_from_jwks_uri(r, cfg, jwt, jwks_uri,
 				 dynamic_keys, &force_refresh) == FALSE) {
-			 oidc_jwk_list_destroy(r->pool, dynamic_keys);
 			 return FALSE;
 		 }
 	 }
 
 	/* do the actual JWS verification with the locally and remotely provided key material */
 	// TODO: now static keys "win" if the same `kid` was used in both local and remote key sets
-	if (oidc_jwt_verify(r->pool, jwt,
-			oidc_util_merge_key_sets(r->pool, static_keys, dynamic_keys),
-			&err) == FALSE) {
+	apr_time_t start = apr_time_now();
+	apr_byte_t rc = oidc_jwt_verify(r->pool, jwt,
+			oidc_util_merge_key_sets(r->pool, static_keys, dynamic_keys), &err);
+	oidc_metrics_jwt_verify(r, jwt->header.alg, start, rc);
+	if (rc == FALSE) {
 		oidc_error(r, "JWT signature verification failed: %s",
 				oidc_jose_e2s(r->pool, err));
-		oidc_jwk_list_destroy(r->pool, dynamic_keys);
 		return FALSE;
 	}
 
@@ -1580,7 +1764,7 @@ apr_byte_t oidc_proto_jwt_verify(request_rec *r, oidc_cfg *cfg, oidc_jwt_t *jwt,
 			"JWT signature verification with algorithm \"%s\" was successful",
 			jwt->header.alg);
 
-	oidc_jwk_list_destroy(r->pool, dynamic_keys);
+	/* the dynamic keys are owned by the JWKs cache, so we don't destroy them here */
 	return TRUE;
 }
 
@@ -1589,19 +1773,25 @@ apr_byte_t oidc_proto_jwt_verify(request_rec *r, oidc_cfg *cfg, oidc_jwt_t *jwt,
  */
 char *oidc_proto_peek_jwt_header(request_rec *r,
 		const char *compact_encoded_jwt, char **alg) {
-	char *input = NULL, *result = NULL;
+	char *result = NULL;
+	uint8_t *decoded = NULL;
+	size_t decoded_len = 0;
+	cjose_err cjose_err;
 	char *p = strstr(compact_encoded_jwt ? compact_encoded_jwt : "", ".");
-	if (p == NULL) {
+	if ((p == NULL) || (p == compact_encoded_jwt)) {
 		oidc_warn(r,
 				"could not parse first element separated by \".\" from input");
 		return NULL;
 	}
-	input = apr_pstrmemdup(r->pool, compact_encoded_jwt,
-			strlen(compact_encoded_jwt) - strlen(p));
-	if (oidc_base64url_decode(r->pool, &result, input) <= 0) {
-		oidc_warn(r, "oidc_base64url_decode returned an error");
+	/* decode the header element straight from the input */
+	if (cjose_base64url_decode(compact_encoded_jwt, p - compact_encoded_jwt,
+			&decoded, &decoded_len, &cjose_err) == FALSE) {
+		oidc_warn(r, "cjose_base64url_decode returned an error: %s",
+				cjose_err.message);
 		return NULL;
 	}
+	result = apr_pstrmemdup(r->pool, (const char *) decoded, decoded_len);
+	cjose_get_dealloc()(decoded);
 	if (alg) {
 		json_t *json = NULL;
 		oidc_util_decode_json_object(r, result, &json);
@@ -1622,13 +1812,17 @@ apr_byte_t oidc_proto_parse_idtoken(request_rec *r, oidc_cfg *cfg,
 		oidc_jwt_t **jwt, apr_byte_t is_code_flow) {
 
 	char *alg = NULL;
-	oidc_debug(r, "enter: id_token header=%s",
-			oidc_proto_peek_jwt_header(r, id_token, &alg));
+	oidc_debug(r, "enter");
 	apr_hash_t *decryption_keys = NULL;
 
 	char buf[APR_RFC822_DATE_LEN + 1];
 	oidc_jose_error_t err;
 	oidc_jwk_t *jwk = NULL;
+
+	/* the "alg" is only needed to size the client_secret based key for decrypting an encrypted id_token */
+	if (oidc_jwe_is_compact(id_token))
+		oidc_proto_peek_jwt_header(r, id_token, &alg);
+
 	if (oidc_util_create_symmetric_key(r, provider->client_secret,
 			oidc_alg2keysize(alg), OIDC_JOSE_ALG_SHA256,
 			TRUE, &jwk) == FALSE)
@@ -1640,7 +1834,9 @@ apr_byte_t oidc_proto_parse_idtoken(request_rec *r, oidc_cfg *cfg,
 		decryption_keys = oidc_util_merge_key_sets(r->pool, decryption_keys,
 				provider->client_encryption_keys);
 
-	if (oidc_jwt_parse(r->pool, id_token, jwt, decryption_keys, &err) == FALSE) {
+	/* verify the signature before parsing the payload so that forged tokens are rejected early */
+	if (oidc_jwt_parse_header(r->pool, id_token, jwt, decryption_keys,
+			&err) == FALSE) {
 		oidc_error(r, "oidc_jwt_parse failed: %s", oidc_jose_e2s(r->pool, err));
 		oidc_jwt_destroy(*jwt);
 		*jwt = NULL;
@@ -1649,8 +1845,8 @@ apr_byte_t oidc_proto_parse_idtoken(request_rec *r, oidc_cfg *cfg,
 
 	oidc_jwk_destroy(jwk);
 	oidc_debug(r,
-			"successfully parsed (and possibly decrypted) JWT with header=%s, and payload=%s",
-			(*jwt)->header.value.str, (*jwt)->payload.value.str);
+			"successfully parsed (and possibly decrypted) JWT with header=%s",
+			(*jwt)->header.value.str);
 
 	// make signature validation exception for 'code' flow and the algorithm NONE
 	if (is_code_flow == FALSE || strcmp((*jwt)->header.alg, "none") != 0) {
@@ -1676,6 +1872,16 @@ apr_byte_t oidc_proto_parse_idtoken(request_rec *r, oidc_cfg *cfg,
 		oidc_jwk_destroy(jwk);
 	}
 
+	if (oidc_jwt_parse_payload(r->pool, *jwt, &err) == FALSE) {
+		oidc_error(r, "oidc_jwt_parse_payload failed: %s",
+				oidc_jose_e2s(r->pool, err));
+		oidc_jwt_destroy(*jwt);
+		*jwt = NULL;
+		return FALSE;
+	}
+
+	oidc_debug(r, "id_token payload=%s", (*jwt)->payload.value.str);
+
 	/* this is where the meat is */
 	if (oidc_proto_validate_idtoken(r, provider, *jwt, nonce) == FALSE) {
 		oidc_error(r, "id_token payload could not be validated, aborting");
@@ -1993,7 +2199,8 @@ static apr_byte_t oidc_proto_token_endpoint_request(request_rec *r,
 			provider->token_endpoint_params);
 
 	/* send the refresh request to the token endpoint */
-	if (oidc_util_http_post_form(r, provider->token_endpoint_url, params,
+	if (oidc_util_http_post_form(r, OIDC_METRICS_HTTP_TOKEN,
+			provider->token_endpoint_url, params,
 			basic_auth, bearer_auth, provider->ssl_validate_server, &response,
 			cfg->http_timeout_long, cfg->outgoing_proxy,
 			oidc_dir_cfg_pass_cookies(r),
@@ -2178,7 +2385,7 @@ static apr_byte_t oidc_user_info_response_validate(request_rec *r,
 				jwt->payload.value.str);
 
 		*userinfo_jwt = apr_pstrdup(r->pool, *response);
-		*claims = json_deep_copy(jwt->payload.value.json);
+		*claims = json_incref(jwt->payload.value.json);
 		*response = apr_pstrdup(r->pool, jwt->payload.value.str);
 		oidc_jwt_destroy(jwt);
 
@@ -2204,6 +2411,11 @@ static apr_byte_t oidc_proto_resolve_composite_claims(request_rec *r,
 	json_t *sources, *names, *decoded;
 	oidc_jose_error_t err;
 	oidc_jwk_t *jwk = NULL;
+	const char **keys = NULL;
+	char **s_jsons = NULL;
+	oidc_http_call_t *calls = NULL;
+	int *idx = NULL;
+	int i = 0, n = 0, n_calls = 0;
 
 	oidc_debug(r, "enter");
 
@@ -2218,17 +2430,21 @@ static apr_byte_t oidc_proto_resolve_composite_claims(request_rec *r,
 		return FALSE;
 	}
 
-	decoded = json_object();
+	/* collect the distributed claims endpoints so they can be fetched in parallel */
+	n = json_object_size(sources);
+	keys = apr_pcalloc(r->pool, n * sizeof(const char *));
+	s_jsons = apr_pcalloc(r->pool, n * sizeof(char *));
+	calls = apr_pcalloc(r->pool, n * sizeof(oidc_http_call_t));
+	idx = apr_pcalloc(r->pool, n * sizeof(int));
 
 	iter = json_object_iter(sources);
-	while (iter) {
-		key = json_object_iter_key(iter);
+	while ((iter) && (i < n)) {
+		keys[i] = json_object_iter_key(iter);
 		value = json_object_iter_value(iter);
 		if ((value != NULL) && (json_is_object(value))) {
 			json_t *jwt = json_object_get(value, OIDC_COMPOSITE_CLAIM_JWT);
-			char *s_json = NULL;
 			if ((jwt != NULL) && (json_is_string(jwt))) {
-				s_json = apr_pstrdup(r->pool, json_string_value(jwt));
+				s_jsons[i] = apr_pstrdup(r->pool, json_string_value(jwt));
 			} else {
 				const char *access_token = json_string_value(
 						json_object_get(value,
@@ -2236,33 +2452,49 @@ static apr_byte_t oidc_proto_resolve_composite_claims(request_rec *r,
 				const char *endpoint = json_string_value(json_object_get(value,
 						OIDC_COMPOSITE_CLAIM_ENDPOINT));
 				if ((access_token != NULL) && (endpoint != NULL)) {
-					oidc_util_http_get(r, endpoint,
-							NULL, NULL, access_token, cfg->provider.ssl_validate_server,
-							&s_json, cfg->http_timeout_long,
-							cfg->outgoing_proxy, oidc_dir_cfg_pass_cookies(r),
-							NULL, NULL);
+					calls[n_calls].metric = OIDC_METRICS_HTTP_OTHER;
+					calls[n_calls].url = endpoint;
+					calls[n_calls].bearer_token = access_token;
+					calls[n_calls].ssl_validate_server =
+							cfg->provider.ssl_validate_server;
+					idx[n_calls++] = i;
 				}
 			}
-			if ((s_json != NULL) && (strcmp(s_json, "") != 0)) {
-				oidc_jwt_t *jwt = NULL;
-				if (oidc_jwt_parse(r->pool, s_json, &jwt,
-						oidc_util_merge_symmetric_key(r->pool,
-								cfg->private_keys, jwk), &err) == FALSE) {
-					oidc_error(r,
-							"could not parse JWT from aggregated claim \"%s\": %s",
-							key, oidc_jose_e2s(r->pool, err));
-				} else {
-					json_t *v = json_object_get(decoded, key);
-					if (v == NULL) {
-						v = json_object();
-						json_object_set_new(decoded, key, v);
-					}
-					oidc_util_json_merge(r, jwt->payload.value.json, v);
+		}
+		iter = json_object_iter_next(sources, iter);
+		i++;
+	}
+
+	if (n_calls > 0) {
+		oidc_util_http_multi(r, calls, n_calls, cfg->http_timeout_long,
+				cfg->outgoing_proxy, oidc_dir_cfg_pass_cookies(r));
+		for (i = 0; i < n_calls; i++)
+			s_jsons[idx[i]] = calls[i].response;
+	}
+
+	decoded = json_object();
+
+	for (i = 0; i < n; i++) {
+		key = keys[i];
+		char *s_json = s_jsons[i];
+		if ((s_json != NULL) && (strcmp(s_json, "") != 0)) {
+			oidc_jwt_t *jwt = NULL;
+			if (oidc_jwt_parse(r->pool, s_json, &jwt,
+					oidc_util_merge_symmetric_key(r->pool,
+							cfg->private_keys, jwk), &err) == FALSE) {
+				oidc_error(r,
+						"could not parse JWT from aggregated claim \"%s\": %s",
+						key, oidc_jose_e2s(r->pool, err));
+			} else {
+				json_t *v = json_object_get(decoded, key);
+				if (v == NULL) {
+					v = json_object();
+					json_object_set_new(decoded, key, v);
 				}
-				oidc_jwt_destroy(jwt);
+				oidc_util_json_merge(r, jwt->payload.value.json, v);
 			}
+			oidc_jwt_destroy(jwt);
 		}
-		iter = json_object_iter_next(sources, iter);
 	}
 
 	iter = json_object_iter(names);
@@ -2302,7 +2534,8 @@ apr_byte_t oidc_proto_resolve_userinfo(request_rec *r, oidc_cfg *cfg,
 
 	/* get the JSON response */
 	if (provider->userinfo_token_method == OIDC_USER_INFO_TOKEN_METHOD_HEADER) {
-		if (oidc_util_http_get(r, provider->userinfo_endpoint_url,
+		if (oidc_util_http_get(r, OIDC_METRICS_HTTP_USERINFO,
+				provider->userinfo_endpoint_url,
 				NULL, NULL, access_token, provider->ssl_validate_server, response,
 				cfg->http_timeout_long, cfg->outgoing_proxy,
 				oidc_dir_cfg_pass_cookies(r), NULL, NULL) == FALSE)
@@ -2311,7 +2544,8 @@ apr_byte_t oidc_proto_resolve_userinfo(request_rec *r, oidc_cfg *cfg,
 			== OIDC_USER_INFO_TOKEN_METHOD_POST) {
 		apr_table_t *params = apr_table_make(r->pool, 4);
 		apr_table_setn(params, OIDC_PROTO_ACCESS_TOKEN, access_token);
-		if (oidc_util_http_post_form(r, provider->userinfo_endpoint_url, params,
+		if (oidc_util_http_post_form(r, OIDC_METRICS_HTTP_USERINFO,
+				provider->userinfo_endpoint_url, params,
 				NULL, NULL, provider->ssl_validate_server, response,
 				cfg->http_timeout_long, cfg->outgoing_proxy,
 				oidc_dir_cfg_pass_cookies(r), NULL, NULL) == FALSE)
@@ -2367,7 +2601,7 @@ static apr_byte_t oidc_proto_webfinger_discovery(request_rec *r, oidc_cfg *cfg,
 	apr_table_setn(params, "rel", "http://openid.net/specs/connect/1.0/issuer");
 
 	char *response = NULL;
-	if (oidc_util_http_get(r, url, params, NULL, NULL,
+	if (oidc_util_http_get(r, OIDC_METRICS_HTTP_DISCOVERY, url, params, NULL, NULL,
 			cfg->provider.ssl_validate_server, &response,
 			cfg->http_timeout_short, cfg->outgoing_proxy,
 			oidc_dir_cfg_pass_cookies(r), NULL, NULL) == FALSE) {
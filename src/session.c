@@ -74,30 +74,149 @@ extern module AP_MODULE_DECLARE_DATA auth_openidc_module;
 /* the name of the sid attribute in the session */
 #define OIDC_SESSION_SID_KEY                      "sid"
 
+/*
+ * session object keys
+ */
+/* key for storing the userinfo claims in the session context */
+#define OIDC_SESSION_KEY_USERINFO_CLAIMS "uic"
+/* key for storing the userinfo JWT in the session context */
+#define OIDC_SESSION_KEY_USERINFO_JWT "uij"
+/* key for storing the id_token in the session context */
+#define OIDC_SESSION_KEY_IDTOKEN_CLAIMS "idc"
+/* key for storing the raw id_token in the session context */
+#define OIDC_SESSION_KEY_IDTOKEN "idt"
+/* key for storing the access_token in the session context */
+#define OIDC_SESSION_KEY_ACCESSTOKEN "at"
+/* key for storing the access_token expiry in the session context */
+#define OIDC_SESSION_KEY_ACCESSTOKEN_EXPIRES "ate"
+/* key for storing the refresh_token in the session context */
+#define OIDC_SESSION_KEY_REFRESH_TOKEN "rt"
+/* key for storing maximum session duration in the session context */
+#define OIDC_SESSION_KEY_SESSION_EXPIRES "se"
+/* key for storing the cookie domain in the session context */
+#define OIDC_SESSION_KEY_COOKIE_DOMAIN "cd"
+/* key for storing last user info refresh timestamp in the session context */
+#define OIDC_SESSION_KEY_USERINFO_LAST_REFRESH "uilr"
+/* key for storing last access token refresh timestamp in the session context */
+#define OIDC_SESSION_KEY_ACCESS_TOKEN_LAST_REFRESH "atlr"
+/* key for storing request state */
+#define OIDC_SESSION_KEY_REQUEST_STATE "rs"
+/* key for storing the original URL */
+#define OIDC_SESSION_KEY_ORIGINAL_URL "ou"
+/* key for storing the session_state in the session context */
+#define OIDC_SESSION_KEY_SESSION_STATE "ss"
+/* key for storing the issuer in the session context */
+#define OIDC_SESSION_KEY_ISSUER "iss"
+
+/* prefix of session state serialized in the binary format, including the format version */
+#define OIDC_SESSION_BINARY_PREFIX "b1."
+
+/* keys of session values that hold JSON objects, which the binary format stores natively */
+static const char *oidc_session_json_keys[] = {
+		OIDC_SESSION_KEY_IDTOKEN_CLAIMS,
+		OIDC_SESSION_KEY_USERINFO_CLAIMS,
+		NULL };
+
+/*
+ * serialize the session state in the binary format: MessagePack, transfer encoded with base64url
+ * since cache and cookie values are strings
+ */
+static apr_byte_t oidc_session_encode_binary(request_rec *r, oidc_session_t *z,
+		char **s_value) {
+	json_t *j_value = NULL, *j_object = NULL;
+	char *buf = NULL, *enc = NULL;
+	apr_size_t len = 0;
+	int i;
+
+	/* replace JSON objects that are stored as a string by the objects themselves */
+	for (i = 0; oidc_session_json_keys[i] != NULL; i++) {
+		j_value = json_object_get(z->state, oidc_session_json_keys[i]);
+		if (!json_is_string(j_value))
+			continue;
+		j_object = json_loads(json_string_value(j_value), 0, NULL);
+		if (json_is_object(j_object))
+			json_object_set_new(z->state, oidc_session_json_keys[i], j_object);
+		else if (j_object != NULL)
+			json_decref(j_object);
+	}
+
+	if (oidc_util_msgpack_encode(r, z->state, &buf, &len) == FALSE)
+		return FALSE;
+
+	if (oidc_base64url_encode(r, &enc, buf, len, TRUE) <= 0)
+		return FALSE;
+
+	*s_value = apr_pstrcat(r->pool, OIDC_SESSION_BINARY_PREFIX, enc, NULL);
+
+	return TRUE;
+}
+
+/*
+ * deserialize session state in the binary format
+ */
+static apr_byte_t oidc_session_decode_binary(request_rec *r, oidc_session_t *z,
+		const char *s_value) {
+	char *buf = NULL;
+	int len = oidc_base64url_decode(r->pool, &buf,
+			s_value + strlen(OIDC_SESSION_BINARY_PREFIX));
+	if (len <= 0) {
+		oidc_error(r, "could not base64url decode binary session state");
+		return FALSE;
+	}
+	return oidc_util_msgpack_decode(r, buf, len, &z->state);
+}
+
 static apr_byte_t oidc_session_encode(request_rec *r, oidc_cfg *c,
 		oidc_session_t *z, char **s_value, apr_byte_t encrypt) {
 
-	if (encrypt == FALSE) {
+	apr_byte_t rc = FALSE;
+
+	if (c->session_encoding == OIDC_SESSION_ENCODING_BINARY) {
+		/* a binary client-side cookie is encrypted (and thus integrity protected) as is */
+		rc = (oidc_session_encode_binary(r, z, s_value) == TRUE)
+				&& ((encrypt == FALSE)
+						|| oidc_util_jwe_encrypt_string(r,
+								c->crypto_passphrase, *s_value, s_value));
+	} else if (encrypt == FALSE) {
 		*s_value = oidc_util_encode_json_object(r, z->state, JSON_COMPACT);
-		return (*s_value != NULL);
+		rc = (*s_value != NULL);
+	} else {
+		rc = oidc_util_jwt_create(r, c->crypto_passphrase, z->state, s_value);
 	}
 
-	if (oidc_util_jwt_create(r, c->crypto_passphrase, z->state,
-			s_value) == FALSE)
-		return FALSE;
+	if (rc == TRUE)
+		oidc_metrics_session_size(r, OIDC_METRICS_SESSION_OP_SAVE,
+				strlen(*s_value));
 
-	return TRUE;
+	return rc;
 }
 
+/*
+ * decode session state in either format, regardless of the configured one
+ */
 static apr_byte_t oidc_session_decode(request_rec *r, oidc_cfg *c,
 		oidc_session_t *z, const char *s_json, apr_byte_t encrypt) {
+	char *s_value = NULL;
+
+	oidc_metrics_session_size(r, OIDC_METRICS_SESSION_OP_LOAD, strlen(s_json));
 
 	if (encrypt == FALSE) {
+		if (strncmp(s_json, OIDC_SESSION_BINARY_PREFIX,
+				strlen(OIDC_SESSION_BINARY_PREFIX)) == 0)
+			return oidc_session_decode_binary(r, z, s_json);
 		return oidc_util_decode_json_object(r, s_json, &z->state);
 	}
 
-	if (oidc_util_jwt_verify(r, c->crypto_passphrase, s_json,
-			&z->state) == FALSE) {
+	/* the plaintext is either binary session state or a signed JWT holding JSON session state */
+	if ((oidc_util_jwe_decrypt_string(r, c->crypto_passphrase, s_json,
+			&s_value) == TRUE)
+			&& (strncmp(s_value, OIDC_SESSION_BINARY_PREFIX,
+					strlen(OIDC_SESSION_BINARY_PREFIX)) == 0))
+		return oidc_session_decode_binary(r, z, s_value);
+
+	if ((s_value == NULL)
+			|| (oidc_util_jwt_verify(r, c->crypto_passphrase, s_value,
+					&z->state) == FALSE)) {
 		oidc_error(r,
 				"could not verify secure JWT: cache value possibly corrupted");
 		return FALSE;
@@ -120,25 +239,39 @@ static void oidc_session_uuid_new(request_rec *r, oidc_session_t *z) {
 static void oidc_session_clear(request_rec *r, oidc_session_t *z) {
 	z->uuid[0] = '\0';
 	z->remote_user = NULL;
-	// NB: don't clear sid
+	// NB: don't clear sid and sub
 	z->expiry = 0;
+	z->dirty = FALSE;
 	if (z->state) {
 		json_decref(z->state);
 		z->state = NULL;
 	}
 }
 
-apr_byte_t oidc_session_load_cache_by_uuid(request_rec *r, oidc_cfg *c,
-		const char *uuid, oidc_session_t *z) {
+/*
+ * restore a session from the session and touched expiry entries retrieved from the cache
+ */
+static apr_byte_t oidc_session_load_cache_entries(request_rec *r, oidc_cfg *c,
+		const char *uuid, const oidc_cache_entry_t *entries, oidc_session_t *z) {
 	const char *stored_uuid = NULL;
-	char *s_json = NULL;
-	apr_byte_t rc = FALSE;
-
-	rc = oidc_cache_get_session(r, uuid, &s_json);
+	const char *s_json = entries[0].value;
+	apr_time_t expiry = 0;
+	apr_byte_t rc = TRUE;
 
-	if ((rc == TRUE) && (s_json != NULL)) {
+	if (s_json != NULL) {
 		rc = oidc_session_decode(r, c, z, s_json, FALSE);
 		if (rc == TRUE) {
+			/* apply a touched expiry; this doesn't change the session contents */
+			if ((entries[1].value != NULL)
+					&& (sscanf(entries[1].value, "%" APR_TIME_T_FMT, &expiry)
+							== 1)
+					&& (expiry
+							> json_integer_value(
+									json_object_get(z->state,
+											OIDC_SESSION_EXPIRY_KEY))))
+				json_object_set_new(z->state, OIDC_SESSION_EXPIRY_KEY,
+						json_integer(expiry));
+
 			strncpy(z->uuid, uuid, APR_UUID_FORMATTED_LENGTH);
 			z->uuid[APR_UUID_FORMATTED_LENGTH] = '\0';
 
@@ -150,8 +283,10 @@ apr_byte_t oidc_session_load_cache_by_uuid(request_rec *r, oidc_cfg *c,
 						"cache corruption detected: stored session id (%s) is not equal to requested session id (%s)",
 						stored_uuid, uuid);
 
-				/* delete the cache entry */
+				/* delete the cache entries */
 				oidc_cache_set_session(r, z->uuid, NULL, 0);
+				oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION_EXPIRY, z->uuid,
+						NULL, 0);
 				/* clear the session */
 				oidc_session_clear(r, z);
 
@@ -163,6 +298,114 @@ apr_byte_t oidc_session_load_cache_by_uuid(request_rec *r, oidc_cfg *c,
 	return rc;
 }
 
+apr_byte_t oidc_session_load_cache_by_uuid(request_rec *r, oidc_cfg *c,
+		const char *uuid, oidc_session_t *z) {
+
+	/* get the session together with the expiry that it may have been touched with since it was last written */
+	oidc_cache_entry_t entries[] = {
+			{ OIDC_CACHE_SECTION_SESSION, uuid, NULL, 0 },
+			{ OIDC_CACHE_SECTION_SESSION_EXPIRY, uuid, NULL, 0 } };
+	if (oidc_cache_get_multi(r, entries, 2) == FALSE)
+		return FALSE;
+
+	return oidc_session_load_cache_entries(r, c, uuid, entries, z);
+}
+
+/*
+ * load a number of sessions from the cache in a single cache operation; sessions that
+ * could not be found or restored are returned with their state set to NULL
+ */
+apr_byte_t oidc_session_load_cache_multi(request_rec *r, oidc_cfg *c,
+		const apr_array_header_t *uuids, oidc_session_t **sessions) {
+	oidc_cache_entry_t *entries = apr_pcalloc(r->pool,
+			2 * uuids->nelts * sizeof(oidc_cache_entry_t));
+	const char *uuid = NULL;
+	int i;
+
+	*sessions = apr_pcalloc(r->pool, uuids->nelts * sizeof(oidc_session_t));
+
+	if (uuids->nelts == 0)
+		return TRUE;
+
+	for (i = 0; i < uuids->nelts; i++) {
+		uuid = APR_ARRAY_IDX(uuids, i, const char *);
+		entries[2 * i].section = OIDC_CACHE_SECTION_SESSION;
+		entries[2 * i].key = uuid;
+		entries[2 * i + 1].section = OIDC_CACHE_SECTION_SESSION_EXPIRY;
+		entries[2 * i + 1].key = uuid;
+	}
+
+	if (oidc_cache_get_multi(r, entries, 2 * uuids->nelts) == FALSE)
+		return FALSE;
+
+	for (i = 0; i < uuids->nelts; i++)
+		if (oidc_session_load_cache_entries(r, c,
+				APR_ARRAY_IDX(uuids, i, const char *), &entries[2 * i],
+				&(*sessions)[i]) == FALSE)
+			oidc_session_clear(r, &(*sessions)[i]);
+
+	return TRUE;
+}
+
+/*
+ * remove a number of sessions from the cache in a single cache operation, followed by
+ * the index that they were found in
+ */
+apr_byte_t oidc_session_kill_cache_multi(request_rec *r,
+		const apr_array_header_t *uuids, const char *section, const char *key) {
+	oidc_cache_entry_t *entries = apr_pcalloc(r->pool,
+			2 * uuids->nelts * sizeof(oidc_cache_entry_t));
+	oidc_cache_entry_t index = { section, key, NULL, 0 };
+	apr_byte_t rc = TRUE;
+	int i;
+
+	for (i = 0; i < uuids->nelts; i++) {
+		entries[2 * i].section = OIDC_CACHE_SECTION_SESSION;
+		entries[2 * i].key = APR_ARRAY_IDX(uuids, i, const char *);
+		entries[2 * i + 1].section = OIDC_CACHE_SECTION_SESSION_EXPIRY;
+		entries[2 * i + 1].key = APR_ARRAY_IDX(uuids, i, const char *);
+	}
+
+	if ((uuids->nelts > 0)
+			&& (oidc_cache_set_multi(r, entries, 2 * uuids->nelts) == FALSE))
+		rc = FALSE;
+
+	if (oidc_cache_index_update(r, &index, 1) == FALSE)
+		rc = FALSE;
+
+	return rc;
+}
+
+/*
+ * add the session to, or with expiry 0 remove it from, the indexes by sid and sub that
+ * back-channel logout uses to find all sessions of an OP session or user
+ */
+static apr_byte_t oidc_session_index_update(request_rec *r, oidc_session_t *z,
+		apr_time_t expiry) {
+	oidc_cache_entry_t entries[2];
+	int n = 0;
+
+	if (apr_strnatcmp(z->uuid, "") == 0)
+		return TRUE;
+
+	if (z->sid != NULL) {
+		entries[n].section = OIDC_CACHE_SECTION_SID;
+		entries[n].key = z->sid;
+		entries[n].value = z->uuid;
+		entries[n].expiry = expiry;
+		n++;
+	}
+	if (z->sub != NULL) {
+		entries[n].section = OIDC_CACHE_SECTION_SUB;
+		entries[n].key = z->sub;
+		entries[n].value = z->uuid;
+		entries[n].expiry = expiry;
+		n++;
+	}
+
+	return (n == 0) || oidc_cache_index_update(r, entries, n);
+}
+
 /*
  * load the session from the cache using the cookie as the index
  */
@@ -190,6 +433,23 @@ static apr_byte_t oidc_session_load_cache(request_rec *r, oidc_session_t *z) {
 	return rc;
 }
 
+/*
+ * extend the expiry of an unmodified session in the cache without rewriting it; the new
+ * expiry is recorded in a small companion entry that is applied when loading the session
+ */
+static apr_byte_t oidc_session_touch_cache(request_rec *r, oidc_session_t *z) {
+
+	if (oidc_cache_touch(r, OIDC_CACHE_SECTION_SESSION, z->uuid, z->expiry)
+			== FALSE)
+		return FALSE;
+
+	oidc_session_index_update(r, z, z->expiry);
+
+	return oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION_EXPIRY, z->uuid,
+			apr_psprintf(r->pool, "%" APR_TIME_T_FMT, apr_time_sec(z->expiry)),
+			z->expiry);
+}
+
 /*
  * save the session to the cache using a cookie for the index
  */
@@ -209,17 +469,27 @@ static apr_byte_t oidc_session_save_cache(request_rec *r, oidc_session_t *z,
 			oidc_session_set(r, z, OIDC_SESSION_SESSION_ID, z->uuid);
 		}
 
-		if (z->sid != NULL) {
-			oidc_cache_set_sid(r, z->sid, z->uuid, z->expiry);
+		if (z->sid != NULL)
 			oidc_session_set(r, z, OIDC_SESSION_SID_KEY, z->sid);
+		if (z->sub != NULL)
+			oidc_session_set(r, z, OIDC_SESSION_SUB_KEY, z->sub);
+
+		/* an unmodified session only needs its expiry to be extended */
+		if ((first_time == TRUE) || (z->dirty == TRUE)
+				|| (oidc_session_touch_cache(r, z) == FALSE)) {
+
+			/* store the string-encoded session in the cache; encryption depends on cache backend settings */
+			char *s_value = NULL;
+			if (oidc_session_encode(r, c, z, &s_value, FALSE) == FALSE)
+				return FALSE;
+
+			rc = oidc_cache_set_session(r, z->uuid, s_value, z->expiry);
+			if (rc == TRUE) {
+				z->dirty = FALSE;
+				oidc_session_index_update(r, z, z->expiry);
+			}
 		}
 
-		/* store the string-encoded session in the cache; encryption depends on cache backend settings */
-		char *s_value = NULL;
-		if (oidc_session_encode(r, c, z, &s_value, FALSE) == FALSE)
-			return FALSE;
-		rc = oidc_cache_set_session(r, z->uuid, s_value, z->expiry);
-
 		if (rc == TRUE)
 			/* set the uuid in the cookie */
 			oidc_util_set_cookie(r, oidc_cfg_dir_cookie(r), z->uuid,
@@ -232,15 +502,16 @@ static apr_byte_t oidc_session_save_cache(request_rec *r, oidc_session_t *z,
 
 	} else {
 
-		if (z->sid != NULL)
-			oidc_cache_set_sid(r, z->sid, NULL, 0);
-
 		/* clear the cookie */
 		oidc_util_set_cookie(r, oidc_cfg_dir_cookie(r), "", 0,
 				OIDC_COOKIE_EXT_SAME_SITE_NONE);
 
-		/* remove the session from the cache */
-		rc = oidc_cache_set_session(r, z->uuid, NULL, 0);
+		/* remove the session and its touched expiry from the cache and from the indexes */
+		oidc_cache_entry_t entries[] = {
+				{ OIDC_CACHE_SECTION_SESSION, z->uuid, NULL, 0 },
+				{ OIDC_CACHE_SECTION_SESSION_EXPIRY, z->uuid, NULL, 0 } };
+		rc = oidc_cache_set_multi(r, entries, 2);
+		oidc_session_index_update(r, z, 0);
 	}
 
 	return rc;
@@ -319,6 +590,7 @@ apr_byte_t oidc_session_extract(request_rec *r, oidc_session_t *z) {
 
 	oidc_session_get(r, z, OIDC_SESSION_REMOTE_USER_KEY, &z->remote_user);
 	oidc_session_get(r, z, OIDC_SESSION_SID_KEY, &z->sid);
+	oidc_session_get(r, z, OIDC_SESSION_SUB_KEY, &z->sub);
 
 	rc = TRUE;
 
@@ -335,11 +607,13 @@ apr_byte_t oidc_session_load(request_rec *r, oidc_session_t **zz) {
 			&auth_openidc_module);
 
 	apr_byte_t rc = FALSE;
+	apr_time_t start = apr_time_now();
 
 	/* allocate space for the session object and fill it */
 	oidc_session_t *z = (*zz = apr_pcalloc(r->pool, sizeof(oidc_session_t)));
 	oidc_session_clear(r, z);
 	z->sid = NULL;
+	z->sub = NULL;
 
 	if (c->session_type == OIDC_SESSION_TYPE_SERVER_CACHE)
 		/* load the session from the cache */
@@ -354,6 +628,8 @@ apr_byte_t oidc_session_load(request_rec *r, oidc_session_t **zz) {
 	if (rc == TRUE)
 		rc = oidc_session_extract(r, z);
 
+	oidc_metrics_session(r, OIDC_METRICS_SESSION_OP_LOAD, start);
+
 	return rc;
 }
 
@@ -366,6 +642,7 @@ apr_byte_t oidc_session_save(request_rec *r, oidc_session_t *z,
 			&auth_openidc_module);
 
 	apr_byte_t rc = FALSE;
+	apr_time_t start = apr_time_now();
 	const char *p_tb_id = oidc_util_get_provided_token_binding_id(r);
 
 	if (z->state != NULL) {
@@ -391,6 +668,8 @@ apr_byte_t oidc_session_save(request_rec *r, oidc_session_t *z,
 		/* store the session in a self-contained cookie */
 		rc = oidc_session_save_cookie(r, z, first_time);
 
+	oidc_metrics_session(r, OIDC_METRICS_SESSION_OP_SAVE, start);
+
 	return rc;
 }
 
@@ -406,7 +685,13 @@ apr_byte_t oidc_session_free(request_rec *r, oidc_session_t *z) {
  * terminate a session
  */
 apr_byte_t oidc_session_kill(request_rec *r, oidc_session_t *z) {
+	char uuid[APR_UUID_FORMATTED_LENGTH + 1];
+
+	/* keep the session id so the session is removed from the cache and the indexes */
+	apr_cpystrn(uuid, z->uuid, sizeof(uuid));
 	oidc_session_free(r, z);
+	apr_cpystrn(z->uuid, uuid, sizeof(z->uuid));
+
 	return oidc_session_save(r, z, FALSE);
 }
 
@@ -428,58 +713,29 @@ apr_byte_t oidc_session_get(request_rec *r, oidc_session_t *z, const char *key,
 apr_byte_t oidc_session_set(request_rec *r, oidc_session_t *z, const char *key,
 		const char *value) {
 
+	json_t *j_value = (z->state != NULL) ? json_object_get(z->state, key) : NULL;
+
 	/* only set it if non-NULL, otherwise delete the entry */
 	if (value) {
+		/* setting the same value doesn't modify the session */
+		if ((j_value != NULL) && json_is_string(j_value)
+				&& (strcmp(json_string_value(j_value), value) == 0))
+			return TRUE;
 		if (z->state == NULL)
 			z->state = json_object();
 		json_object_set_new(z->state, key, json_string(value));
-	} else if (z->state != NULL) {
+		z->dirty = TRUE;
+	} else if (j_value != NULL) {
 		json_object_del(z->state, key);
+		z->dirty = TRUE;
 	}
 
 	return TRUE;
 }
 
-/*
- * session object keys
- */
-/* key for storing the userinfo claims in the session context */
-#define OIDC_SESSION_KEY_USERINFO_CLAIMS "uic"
-/* key for storing the userinfo JWT in the session context */
-#define OIDC_SESSION_KEY_USERINFO_JWT "uij"
-/* key for storing the id_token in the session context */
-#define OIDC_SESSION_KEY_IDTOKEN_CLAIMS "idc"
-/* key for storing the raw id_token in the session context */
-#define OIDC_SESSION_KEY_IDTOKEN "idt"
-/* key for storing the access_token in the session context */
-#define OIDC_SESSION_KEY_ACCESSTOKEN "at"
-/* key for storing the access_token expiry in the session context */
-#define OIDC_SESSION_KEY_ACCESSTOKEN_EXPIRES "ate"
-/* key for storing the refresh_token in the session context */
-#define OIDC_SESSION_KEY_REFRESH_TOKEN "rt"
-/* key for storing maximum session duration in the session context */
-#define OIDC_SESSION_KEY_SESSION_EXPIRES "se"
-/* key for storing the cookie domain in the session context */
-#define OIDC_SESSION_KEY_COOKIE_DOMAIN "cd"
-/* key for storing last user info refresh timestamp in the session context */
-#define OIDC_SESSION_KEY_USERINFO_LAST_REFRESH "uilr"
-/* key for storing last access token refresh timestamp in the session context */
-#define OIDC_SESSION_KEY_ACCESS_TOKEN_LAST_REFRESH "atlr"
-/* key for storing request state */
-#define OIDC_SESSION_KEY_REQUEST_STATE "rs"
-/* key for storing the original URL */
-#define OIDC_SESSION_KEY_ORIGINAL_URL "ou"
-/* key for storing the session_state in the session context */
-#define OIDC_SESSION_KEY_SESSION_STATE "ss"
-/* key for storing the issuer in the session context */
-#define OIDC_SESSION_KEY_ISSUER "iss"
-
 /*
  * helper functions
  */
-typedef const char *(*oidc_session_get_str_function)(request_rec *r,
-		oidc_session_t *z);
-
 static void oidc_session_set_timestamp(request_rec *r, oidc_session_t *z,
 		const char *key, const apr_time_t timestamp) {
 	if (timestamp != -1)
@@ -487,20 +743,37 @@ static void oidc_session_set_timestamp(request_rec *r, oidc_session_t *z,
 				apr_psprintf(r->pool, "%" APR_TIME_T_FMT, timestamp));
 }
 
-static json_t *oidc_session_get_str2json(request_rec *r, oidc_session_t *z,
-		oidc_session_get_str_function session_get_str_fn) {
-	json_t *json = NULL;
-	const char *str = session_get_str_fn(r, z);
+static const char *oidc_session_get_key2string(request_rec *r,
+		oidc_session_t *z, const char *key) {
+	const char *s_value = NULL;
+	oidc_session_get(r, z, key, &s_value);
+	return s_value;
+}
+
+/*
+ * get a JSON object that is stored natively when loaded from the binary format or as a string otherwise
+ */
+static json_t *oidc_session_get_key2json(request_rec *r, oidc_session_t *z,
+		const char *key) {
+	json_t *json = (z->state != NULL) ? json_object_get(z->state, key) : NULL;
+	const char *str = NULL;
+
+	if (json_is_object(json))
+		return json_incref(json);
+
+	json = NULL;
+	str = oidc_session_get_key2string(r, z, key);
 	if (str != NULL)
 		oidc_util_decode_json_object(r, str, &json);
 	return json;
 }
 
-static const char *oidc_session_get_key2string(request_rec *r,
+static const char *oidc_session_get_key2json_string(request_rec *r,
 		oidc_session_t *z, const char *key) {
-	const char *s_value = NULL;
-	oidc_session_get(r, z, key, &s_value);
-	return s_value;
+	json_t *json = (z->state != NULL) ? json_object_get(z->state, key) : NULL;
+	if (json_is_object(json))
+		return oidc_util_encode_json_object(r, json, JSON_COMPACT);
+	return oidc_session_get_key2string(r, z, key);
 }
 
 static apr_time_t oidc_session_get_key2timestamp(request_rec *r,
@@ -572,11 +845,12 @@ void oidc_session_set_userinfo_claims(request_rec *r, oidc_session_t *z,
 }
 
 const char * oidc_session_get_userinfo_claims(request_rec *r, oidc_session_t *z) {
-	return oidc_session_get_key2string(r, z, OIDC_SESSION_KEY_USERINFO_CLAIMS);
+	return oidc_session_get_key2json_string(r, z,
+			OIDC_SESSION_KEY_USERINFO_CLAIMS);
 }
 
 json_t *oidc_session_get_userinfo_claims_json(request_rec *r, oidc_session_t *z) {
-	return oidc_session_get_str2json(r, z, oidc_session_get_userinfo_claims);
+	return oidc_session_get_key2json(r, z, OIDC_SESSION_KEY_USERINFO_CLAIMS);
 }
 
 void oidc_session_set_userinfo_jwt(request_rec *r, oidc_session_t *z,
@@ -598,11 +872,12 @@ void oidc_session_set_idtoken_claims(request_rec *r, oidc_session_t *z,
 }
 
 const char * oidc_session_get_idtoken_claims(request_rec *r, oidc_session_t *z) {
-	return oidc_session_get_key2string(r, z, OIDC_SESSION_KEY_IDTOKEN_CLAIMS);
+	return oidc_session_get_key2json_string(r, z,
+			OIDC_SESSION_KEY_IDTOKEN_CLAIMS);
 }
 
 json_t *oidc_session_get_idtoken_claims_json(request_rec *r, oidc_session_t *z) {
-	return oidc_session_get_str2json(r, z, oidc_session_get_idtoken_claims);
+	return oidc_session_get_key2json(r, z, OIDC_SESSION_KEY_IDTOKEN_CLAIMS);
 }
 
 /*
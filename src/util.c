@@ -61,11 +61,20 @@
 
 #include <curl/curl.h>
 
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include <apr_thread_mutex.h>
+
 #include "mod_auth_openidc.h"
 
 #include <pcre.h>
 #include "pcre_subst.h"
 
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
 /* hrm, should we get rid of this by adding parameters to the (3) functions? */
 extern module AP_MODULE_DECLARE_DATA auth_openidc_module;
 
@@ -140,6 +149,209 @@ int oidc_base64url_decode(apr_pool_t *pool, char **dst, const char *src) {
 	return apr_base64_decode(*dst, dec);
 }
 
+/*
+ * release the symmetric key derived from the crypto passphrase
+ */
+static apr_status_t oidc_util_crypto_passphrase_cleanup(void *data) {
+	oidc_jwk_destroy((oidc_jwk_t *) data);
+	return APR_SUCCESS;
+}
+
+/* context for deriving the key for the MAC over state cookie timestamps from the crypto passphrase */
+#define OIDC_UTIL_STATE_COOKIE_MAC_CONTEXT "state-cookie-mac"
+
+/*
+ * derive the key for the MAC over state cookie timestamps with HMAC-SHA256, so that
+ * the crypto passphrase itself is not used as a key for anything else
+ */
+static unsigned char *oidc_util_state_cookie_mac_key_derive(apr_pool_t *pool,
+		const char *passphrase, unsigned int *key_len) {
+	unsigned char *key = apr_palloc(pool, EVP_MAX_MD_SIZE);
+	if (HMAC(EVP_sha256(), passphrase, strlen(passphrase),
+			(const unsigned char *) OIDC_UTIL_STATE_COOKIE_MAC_CONTEXT,
+			strlen(OIDC_UTIL_STATE_COOKIE_MAC_CONTEXT), key, key_len) == NULL)
+		return NULL;
+	return key;
+}
+
+/*
+ * get the key for the MAC over state cookie timestamps; the key derived at startup
+ * is shared read-only, otherwise it is derived for this request
+ */
+const unsigned char *oidc_util_state_cookie_mac_key(request_rec *r,
+		unsigned int *key_len) {
+	oidc_cfg *c = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	if (c->state_cookie_mac_key != NULL) {
+		*key_len = c->state_cookie_mac_key_len;
+		return c->state_cookie_mac_key;
+	}
+	if (c->crypto_passphrase == NULL)
+		return NULL;
+	return oidc_util_state_cookie_mac_key_derive(r->pool, c->crypto_passphrase,
+			key_len);
+}
+
+/*
+ * derive the symmetric key for the crypto passphrase once at startup
+ */
+apr_byte_t oidc_util_crypto_passphrase_post_config(apr_pool_t *pool,
+		server_rec *s) {
+	oidc_cfg *c = ap_get_module_config(s->module_config, &auth_openidc_module);
+	unsigned char *key = NULL;
+	unsigned int key_len = 0;
+	oidc_jose_error_t err;
+
+	if (c->crypto_passphrase == NULL)
+		return TRUE;
+
+	/* vhosts may share the same configuration */
+	if (c->state_cookie_mac_key == NULL) {
+		c->state_cookie_mac_key = oidc_util_state_cookie_mac_key_derive(pool,
+				c->crypto_passphrase, &c->state_cookie_mac_key_len);
+		if (c->state_cookie_mac_key == NULL) {
+			oidc_serror(s,
+					"could not derive the state cookie MAC key from the crypto passphrase");
+			return FALSE;
+		}
+	}
+
+	if (c->crypto_passphrase_jwk != NULL)
+		return TRUE;
+
+	if (oidc_jose_hash_bytes(pool, OIDC_JOSE_ALG_SHA256,
+			(const unsigned char *) c->crypto_passphrase,
+			strlen(c->crypto_passphrase), &key, &key_len, &err) == FALSE) {
+		oidc_serror(s, "oidc_jose_hash_bytes returned an error: %s", err.text);
+		return FALSE;
+	}
+
+	c->crypto_passphrase_jwk = oidc_jwk_create_symmetric_key(pool, NULL, key,
+			key_len, FALSE, &err);
+	if (c->crypto_passphrase_jwk == NULL) {
+		oidc_serror(s, "could not create JWK from the crypto passphrase: %s",
+				oidc_jose_e2s(pool, err));
+		return FALSE;
+	}
+
+	apr_pool_cleanup_register(pool, c->crypto_passphrase_jwk,
+			oidc_util_crypto_passphrase_cleanup, apr_pool_cleanup_null);
+
+	return TRUE;
+}
+
+/*
+ * get the symmetric key for a secret; the key derived from the crypto passphrase
+ * at startup is shared read-only, any other secret gets a new key
+ */
+static apr_byte_t oidc_util_get_secret_key(request_rec *r, const char *secret,
+		oidc_jwk_t **jwk) {
+	oidc_cfg *c = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	if ((c->crypto_passphrase_jwk != NULL) && (secret != NULL)
+			&& (apr_strnatcmp(secret, c->crypto_passphrase) == 0)) {
+		*jwk = c->crypto_passphrase_jwk;
+		return TRUE;
+	}
+	return oidc_util_create_symmetric_key(r, secret, 0, OIDC_JOSE_ALG_SHA256,
+			FALSE, jwk);
+}
+
+/*
+ * release a key obtained with oidc_util_get_secret_key
+ */
+static void oidc_util_release_secret_key(request_rec *r, oidc_jwk_t *jwk) {
+	oidc_cfg *c = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	if ((jwk != NULL) && (jwk != c->crypto_passphrase_jwk))
+		oidc_jwk_destroy(jwk);
+}
+
+/*
+ * encrypt a string with dir/A256GCM, DEFLATE compressing it first when configured and worthwhile
+ */
+static apr_byte_t oidc_util_jwe_encrypt(request_rec *r, oidc_jwk_t *jwk,
+		const char *plaintext, char **compact_encoded_jwe) {
+
+	oidc_cfg *c = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	apr_byte_t rv = FALSE;
+	oidc_jose_error_t err;
+	const char *payload = plaintext;
+	apr_size_t payload_len = strlen(plaintext);
+	char *deflated = NULL;
+	apr_size_t deflated_len = 0;
+
+	oidc_jwt_t *jwe = oidc_jwt_new(r->pool, TRUE, FALSE);
+	if (jwe == NULL) {
+		oidc_error(r, "creating JWE failed");
+		return FALSE;
+	}
+
+	/* A256GCM is authenticated encryption so the plaintext is integrity protected */
+	jwe->header.alg = apr_pstrdup(r->pool, CJOSE_HDR_ALG_DIR);
+	jwe->header.enc = apr_pstrdup(r->pool, CJOSE_HDR_ENC_A256GCM);
+
+	if ((c->compress_min_size > 0) && (payload_len >= c->compress_min_size)
+			&& (oidc_util_deflate(r, plaintext, payload_len, &deflated,
+					&deflated_len) == TRUE) && (deflated_len < payload_len)) {
+		oidc_debug(r, "compressed JWE payload from %d to %d bytes",
+				(int )payload_len, (int )deflated_len);
+		jwe->header.zip = apr_pstrdup(r->pool, OIDC_JOSE_ZIP_DEFLATE);
+		payload = deflated;
+		payload_len = deflated_len;
+	}
+
+	if (oidc_jwe_encrypt_bytes(r->pool, jwe, jwk, payload, payload_len,
+			compact_encoded_jwe, &err) == FALSE) {
+		oidc_error(r, "encrypting JWE failed: %s", oidc_jose_e2s(r->pool, err));
+		goto end;
+	}
+
+	rv = TRUE;
+
+end:
+
+	oidc_jwt_destroy(jwe);
+
+	return rv;
+}
+
+/*
+ * decrypt a JWE created with oidc_util_jwe_encrypt, inflating the plaintext when it was compressed;
+ * input that is not a JWE is passed through as is unless import_must_succeed is set
+ */
+static apr_byte_t oidc_util_jwe_decrypt(request_rec *r, oidc_jwk_t *jwk,
+		const char *compact_encoded_jwe, char **plaintext,
+		apr_byte_t import_must_succeed) {
+
+	oidc_jose_error_t err;
+	char *zip = NULL;
+	size_t len = 0;
+	apr_size_t inflated_len = 0;
+
+	apr_hash_t *keys = apr_hash_make(r->pool);
+	apr_hash_set(keys, "", APR_HASH_KEY_STRING, jwk);
+
+	*plaintext = NULL;
+	if (oidc_jwe_decrypt_bytes(r->pool, compact_encoded_jwe, keys, plaintext,
+			&len, &zip, &err, import_must_succeed) == FALSE) {
+		oidc_error(r, "decrypting JWE failed: %s", oidc_jose_e2s(r->pool, err));
+		return FALSE;
+	}
+
+	if (zip == NULL)
+		return TRUE;
+
+	if (apr_strnatcmp(zip, OIDC_JOSE_ZIP_DEFLATE) != 0) {
+		oidc_error(r, "unsupported JWE \"%s\" value: %s", OIDC_JOSE_HDR_ZIP,
+				zip);
+		return FALSE;
+	}
+
+	return oidc_util_inflate(r, *plaintext, len, plaintext, &inflated_len);
+}
+
 apr_byte_t oidc_util_jwt_create(request_rec *r, const char *secret,
 		json_t *payload, char **compact_encoded_jwt) {
 
@@ -148,10 +360,8 @@ apr_byte_t oidc_util_jwt_create(request_rec *r, const char *secret,
 
 	oidc_jwk_t *jwk = NULL;
 	oidc_jwt_t *jwt = NULL;
-	oidc_jwt_t *jwe = NULL;
 
-	if (oidc_util_create_symmetric_key(r, secret, 0, OIDC_JOSE_ALG_SHA256,
-			FALSE, &jwk) == FALSE)
+	if (oidc_util_get_secret_key(r, secret, &jwk) == FALSE)
 		goto end;
 
 	jwt = oidc_jwt_new(r->pool, TRUE, FALSE);
@@ -168,30 +378,15 @@ apr_byte_t oidc_util_jwt_create(request_rec *r, const char *secret,
 		goto end;
 	}
 
-	jwe = oidc_jwt_new(r->pool, TRUE, FALSE);
-	if (jwe == NULL) {
-		oidc_error(r, "creating JWE failed");
-		goto end;
-	}
-
-	jwe->header.alg = apr_pstrdup(r->pool, CJOSE_HDR_ALG_DIR);
-	jwe->header.enc = apr_pstrdup(r->pool, CJOSE_HDR_ENC_A256GCM);
-
 	const char *cser = oidc_jwt_serialize(r->pool, jwt, &err);
-	if (oidc_jwt_encrypt(r->pool, jwe, jwk, cser, compact_encoded_jwt,
-			&err) == FALSE) {
-		oidc_error(r, "encrypting JWT failed: %s", oidc_jose_e2s(r->pool, err));
+	if (oidc_util_jwe_encrypt(r, jwk, cser, compact_encoded_jwt) == FALSE)
 		goto end;
-	}
 
 	rv = TRUE;
 
 end:
 
-	if (jwe != NULL)
-		oidc_jwt_destroy(jwe);
-	if (jwk != NULL)
-		oidc_jwk_destroy(jwk);
+	oidc_util_release_secret_key(r, jwk);
 	if (jwt != NULL) {
 		jwt->payload.value.json = NULL;
 		oidc_jwt_destroy(jwt);
@@ -211,38 +406,84 @@ apr_byte_t oidc_util_jwt_verify(request_rec *r, const char *secret,
 
 	oidc_jwk_t *jwk = NULL;
 	oidc_jwt_t *jwt = NULL;
+	char *s_jws = NULL;
+
+	if (oidc_util_get_secret_key(r, secret, &jwk) == FALSE)
+		goto end;
 
-	if (oidc_util_create_symmetric_key(r, secret, 0, OIDC_JOSE_ALG_SHA256,
-			FALSE, &jwk) == FALSE)
+	if (oidc_util_jwe_decrypt(r, jwk, compact_encoded_jwt, &s_jws,
+			FALSE) == FALSE)
 		goto end;
 
 	apr_hash_t *keys = apr_hash_make(r->pool);
 	apr_hash_set(keys, "", APR_HASH_KEY_STRING, jwk);
 
-	if (oidc_jwt_parse(r->pool, compact_encoded_jwt, &jwt, keys, &err) == FALSE) {
+	/* the (decrypted) input is a JWS that oidc_jwt_parse passes through */
+	if (oidc_jwt_parse(r->pool, s_jws, &jwt, keys, &err) == FALSE) {
 		oidc_error(r, "parsing JWT failed: %s", oidc_jose_e2s(r->pool, err));
 		goto end;
 	}
 
+	apr_time_t start = apr_time_now();
 	if (oidc_jwt_verify(r->pool, jwt, keys, &err) == FALSE) {
+		oidc_metrics_jwt_verify(r, jwt->header.alg, start, FALSE);
 		oidc_error(r, "verifying JWT failed: %s", oidc_jose_e2s(r->pool, err));
 		goto end;
 	}
+	oidc_metrics_jwt_verify(r, jwt->header.alg, start, TRUE);
 
-	*result = json_deep_copy(jwt->payload.value.json);
+	/* take over the payload rather than copying it, the JWT is destroyed below */
+	*result = json_incref(jwt->payload.value.json);
 
 	rv = TRUE;
 
 end:
 
-	if (jwk != NULL)
-		oidc_jwk_destroy(jwk);
+	oidc_util_release_secret_key(r, jwk);
 	if (jwt != NULL)
 		oidc_jwt_destroy(jwt);
 
 	return rv;
 }
 
+/*
+ * encrypt a string with a key derived from a secret, without signing it first
+ */
+apr_byte_t oidc_util_jwe_encrypt_string(request_rec *r, const char *secret,
+		const char *plaintext, char **compact_encoded_jwe) {
+
+	apr_byte_t rv = FALSE;
+	oidc_jwk_t *jwk = NULL;
+
+	if (oidc_util_get_secret_key(r, secret, &jwk) == FALSE)
+		return FALSE;
+
+	rv = oidc_util_jwe_encrypt(r, jwk, plaintext, compact_encoded_jwe);
+
+	oidc_util_release_secret_key(r, jwk);
+
+	return rv;
+}
+
+/*
+ * decrypt a string encrypted with a key derived from a secret
+ */
+apr_byte_t oidc_util_jwe_decrypt_string(request_rec *r, const char *secret,
+		const char *compact_encoded_jwe, char **plaintext) {
+
+	apr_byte_t rv = FALSE;
+	oidc_jwk_t *jwk = NULL;
+
+	if (oidc_util_get_secret_key(r, secret, &jwk) == FALSE)
+		return FALSE;
+
+	rv = oidc_util_jwe_decrypt(r, jwk, compact_encoded_jwe, plaintext, TRUE);
+
+	oidc_util_release_secret_key(r, jwk);
+
+	return rv;
+}
+
 /*
  * convert a character to an ENVIRONMENT-variable-safe variant
  */
@@ -291,50 +532,80 @@ int oidc_strnenvcmp(const char *a, const char *b, int len) {
 }
 
 /*
- * escape a string
+ * escape a string: all characters except for the RFC 3986 unreserved ones are %-encoded,
+ * like curl_easy_escape does, but without the need to create a curl handle
  */
 char *oidc_util_escape_string(const request_rec *r, const char *str) {
-	CURL *curl = curl_easy_init();
-	if (curl == NULL) {
-		oidc_error(r, "curl_easy_init() error");
+	static const char hex[] = "0123456789ABCDEF";
+	const unsigned char *p = (const unsigned char *) str;
+	char *rv = NULL, *q = NULL;
+	apr_size_t len = 0;
+
+	if (str == NULL) {
+		oidc_error(r, "cannot escape a NULL string");
 		return NULL;
 	}
-	char *result = curl_easy_escape(curl, str, 0);
-	if (result == NULL) {
-		oidc_error(r, "curl_easy_escape() error");
-		return NULL;
+
+	for (p = (const unsigned char *) str; *p != '\0'; p++)
+		len += (apr_isalnum(*p) || (*p == '-') || (*p == '.') || (*p == '_')
+				|| (*p == '~')) ? 1 : 3;
+
+	rv = q = apr_palloc(r->pool, len + 1);
+	for (p = (const unsigned char *) str; *p != '\0'; p++) {
+		if (apr_isalnum(*p) || (*p == '-') || (*p == '.') || (*p == '_')
+				|| (*p == '~')) {
+			*q++ = *p;
+		} else {
+			*q++ = '%';
+			*q++ = hex[*p >> 4];
+			*q++ = hex[*p & 0x0F];
+		}
 	}
-	char *rv = apr_pstrdup(r->pool, result);
-	curl_free(result);
-	curl_easy_cleanup(curl);
+	*q = '\0';
+
 	return rv;
 }
 
 /*
- * escape a string
+ * convert a hexadecimal character to its value
+ */
+static int oidc_util_hex2int(char c) {
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * unescape a (form-encoded) string: '+' is decoded to a space and %-encoded characters are decoded
  */
 char *oidc_util_unescape_string(const request_rec *r, const char *str) {
-	CURL *curl = curl_easy_init();
-	if (curl == NULL) {
-		oidc_error(r, "curl_easy_init() error");
+	const char *p = NULL;
+	char *rv = NULL, *q = NULL;
+
+	if (str == NULL) {
+		oidc_error(r, "cannot unescape a NULL string");
 		return NULL;
 	}
-	int counter = 0;
-	char *replaced = (char *) str;
-	while (str[counter] != '\0') {
-		if (str[counter] == '+') {
-			replaced[counter] = ' ';
+
+	rv = q = apr_palloc(r->pool, strlen(str) + 1);
+	for (p = str; *p != '\0'; p++) {
+		if (*p == '+') {
+			*q++ = ' ';
+		} else if ((*p == '%') && (oidc_util_hex2int(p[1]) >= 0)
+				&& (oidc_util_hex2int(p[2]) >= 0)) {
+			*q++ = (char) ((oidc_util_hex2int(p[1]) << 4)
+					| oidc_util_hex2int(p[2]));
+			p += 2;
+		} else {
+			*q++ = *p;
 		}
-		counter++;
 	}
-	char *result = curl_easy_unescape(curl, replaced, 0, 0);
-	if (result == NULL) {
-		oidc_error(r, "curl_easy_unescape() error");
-		return NULL;
-	}
-	char *rv = apr_pstrdup(r->pool, result);
-	curl_free(result);
-	curl_easy_cleanup(curl);
+	*q = '\0';
+
 	//oidc_debug(r, "input=\"%s\", output=\"%s\"", str, rv);
 	return rv;
 }
@@ -666,19 +937,169 @@ char *oidc_util_http_form_encoded_data(request_rec *r,
 	return data;
 }
 
+/* maximum number of idle curl handles kept around per process for connection reuse */
+#define OIDC_CURL_POOL_MAX_IDLE 64
+
+/* per-process pool of curl handles that share connections, TLS sessions and DNS results */
+typedef struct oidc_curl_pool_t {
+#if APR_HAS_THREADS
+	apr_thread_mutex_t *mutex;
+	apr_thread_mutex_t *share_mutex[CURL_LOCK_DATA_LAST];
+#endif
+	CURLSH *share;
+	CURL *idle[OIDC_CURL_POOL_MAX_IDLE];
+	int n_idle;
+} oidc_curl_pool_t;
+
+/* set in the child process by oidc_util_http_child_init; when NULL a handle is created for each call */
+static oidc_curl_pool_t *oidc_curl_pool = NULL;
+
+#if APR_HAS_THREADS
+/*
+ * lock callback for the curl share object
+ */
+static void oidc_curl_share_lock(CURL *handle, curl_lock_data data,
+		curl_lock_access access, void *userptr) {
+	oidc_curl_pool_t *cp = (oidc_curl_pool_t *) userptr;
+	if ((data >= 0) && (data < CURL_LOCK_DATA_LAST))
+		apr_thread_mutex_lock(cp->share_mutex[data]);
+}
+
 /*
- * execute a HTTP (GET or POST) request
+ * unlock callback for the curl share object
+ */
+static void oidc_curl_share_unlock(CURL *handle, curl_lock_data data,
+		void *userptr) {
+	oidc_curl_pool_t *cp = (oidc_curl_pool_t *) userptr;
+	if ((data >= 0) && (data < CURL_LOCK_DATA_LAST))
+		apr_thread_mutex_unlock(cp->share_mutex[data]);
+}
+#endif
+
+/*
+ * cleanup the curl handle pool when the child process exits
+ */
+static apr_status_t oidc_util_http_cleanup(void *data) {
+	oidc_curl_pool_t *cp = (oidc_curl_pool_t *) data;
+	oidc_curl_pool = NULL;
+	while (cp->n_idle > 0)
+		curl_easy_cleanup(cp->idle[--cp->n_idle]);
+	if (cp->share != NULL) {
+		curl_share_cleanup(cp->share);
+		cp->share = NULL;
+	}
+	return APR_SUCCESS;
+}
+
+/*
+ * initialize the pool of curl handles in a child process
+ */
+apr_status_t oidc_util_http_child_init(apr_pool_t *p, server_rec *s) {
+	oidc_curl_pool_t *cp = apr_pcalloc(p, sizeof(oidc_curl_pool_t));
+	apr_status_t rv = APR_SUCCESS;
+
+#if APR_HAS_THREADS
+	int i;
+	rv = apr_thread_mutex_create(&cp->mutex, APR_THREAD_MUTEX_DEFAULT, p);
+	for (i = 0; (i < CURL_LOCK_DATA_LAST) && (rv == APR_SUCCESS); i++)
+		rv = apr_thread_mutex_create(&cp->share_mutex[i],
+				APR_THREAD_MUTEX_DEFAULT, p);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s, "apr_thread_mutex_create failed: %d", rv);
+		return rv;
+	}
+#endif
+
+	cp->share = curl_share_init();
+	if (cp->share == NULL) {
+		oidc_serror(s, "curl_share_init() error");
+	} else {
+#if APR_HAS_THREADS
+		curl_share_setopt(cp->share, CURLSHOPT_LOCKFUNC, oidc_curl_share_lock);
+		curl_share_setopt(cp->share, CURLSHOPT_UNLOCKFUNC,
+				oidc_curl_share_unlock);
+		curl_share_setopt(cp->share, CURLSHOPT_USERDATA, cp);
+#endif
+		curl_share_setopt(cp->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(cp->share, CURLSHOPT_SHARE,
+				CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+		curl_share_setopt(cp->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+	}
+
+	apr_pool_cleanup_register(p, cp, oidc_util_http_cleanup,
+			apr_pool_cleanup_null);
+
+	oidc_curl_pool = cp;
+
+	return rv;
+}
+
+/*
+ * get a curl handle, from the pool if possible
+ */
+static CURL *oidc_util_http_curl_get(request_rec *r) {
+	oidc_curl_pool_t *cp = oidc_curl_pool;
+	CURL *curl = NULL;
+
+	if (cp != NULL) {
+#if APR_HAS_THREADS
+		apr_thread_mutex_lock(cp->mutex);
+#endif
+		if (cp->n_idle > 0)
+			curl = cp->idle[--cp->n_idle];
+#if APR_HAS_THREADS
+		apr_thread_mutex_unlock(cp->mutex);
+#endif
+	}
+
+	if (curl == NULL) {
+		curl = curl_easy_init();
+		if (curl == NULL) {
+			oidc_error(r, "curl_easy_init() error");
+			return NULL;
+		}
+	}
+
+	return curl;
+}
+
+/*
+ * return a curl handle to the pool so its connections can be reused, or destroy it
  */
-static apr_byte_t oidc_util_http_call(request_rec *r, const char *url,
+static void oidc_util_http_curl_release(CURL *curl) {
+	oidc_curl_pool_t *cp = oidc_curl_pool;
+
+	if (cp != NULL) {
+		/* resets all options but keeps live connections, the TLS session and DNS cache */
+		curl_easy_reset(curl);
+#if APR_HAS_THREADS
+		apr_thread_mutex_lock(cp->mutex);
+#endif
+		if (cp->n_idle < OIDC_CURL_POOL_MAX_IDLE) {
+			cp->idle[cp->n_idle++] = curl;
+			curl = NULL;
+		}
+#if APR_HAS_THREADS
+		apr_thread_mutex_unlock(cp->mutex);
+#endif
+	}
+
+	if (curl != NULL)
+		curl_easy_cleanup(curl);
+}
+
+/*
+ * get a curl handle and set it up for a HTTP (GET or POST) request
+ */
+static CURL *oidc_util_http_curl_prepare(request_rec *r, const char *url,
 		const char *data, const char *content_type, const char *basic_auth,
-		const char *bearer_token, int ssl_validate_server, char **response,
-		int timeout, const char *outgoing_proxy,
-		apr_array_header_t *pass_cookies, const char *ssl_cert,
-		const char *ssl_key) {
-	char curlError[CURL_ERROR_SIZE];
-	oidc_curl_buffer curlBuffer;
+		const char *bearer_token, int ssl_validate_server, int timeout,
+		const char *outgoing_proxy, apr_array_header_t *pass_cookies,
+		const char *ssl_cert, const char *ssl_key, oidc_curl_buffer *buffer,
+		char *error, struct curl_slist **h_list) {
 	CURL *curl;
-	struct curl_slist *h_list = NULL;
 	int i;
 	oidc_cfg *c = ap_get_module_config(r->server->module_config,
 			&auth_openidc_module);
@@ -690,32 +1111,36 @@ static apr_byte_t oidc_util_http_call(request_rec *r, const char *url,
 			ssl_validate_server, timeout, outgoing_proxy, pass_cookies,
 			ssl_cert, ssl_key);
 
-	curl = curl_easy_init();
-	if (curl == NULL) {
-		oidc_error(r, "curl_easy_init() error");
-		return FALSE;
-	}
+	*h_list = NULL;
+
+	curl = oidc_util_http_curl_get(r);
+	if (curl == NULL)
+		return NULL;
 
 	/* set the error buffer as empty before performing a request */
-	curlError[0] = 0;
+	error[0] = 0;
 
 	/* some of these are not really required */
 	curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
 	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
 	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
-	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curlError);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error);
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 	curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
 
+	/* share connections, TLS sessions and DNS results with the other handles in this process */
+	if ((oidc_curl_pool != NULL) && (oidc_curl_pool->share != NULL))
+		curl_easy_setopt(curl, CURLOPT_SHARE, oidc_curl_pool->share);
+
 	/* set the timeout */
 	curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
 
 	/* setup the buffer where the response will be written to */
-	curlBuffer.r = r;
-	curlBuffer.memory = NULL;
-	curlBuffer.size = 0;
+	buffer->r = r;
+	buffer->memory = NULL;
+	buffer->size = 0;
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, oidc_curl_write);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void * )&curlBuffer);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void * )buffer);
 
 #ifndef LIBCURL_NO_CURLPROTO
 	curl_easy_setopt(curl, CURLOPT_REDIR_PROTOCOLS,
@@ -757,7 +1182,7 @@ static apr_byte_t oidc_util_http_call(request_rec *r, const char *url,
 
 	/* see if we need to add token in the Bearer Authorization header */
 	if (bearer_token != NULL) {
-		h_list = curl_slist_append(h_list,
+		*h_list = curl_slist_append(*h_list,
 				apr_psprintf(r->pool, "Authorization: Bearer %s",
 						bearer_token));
 	}
@@ -782,14 +1207,14 @@ static apr_byte_t oidc_util_http_call(request_rec *r, const char *url,
 
 	if (content_type != NULL) {
 		/* set content type */
-		h_list = curl_slist_append(h_list,
+		*h_list = curl_slist_append(*h_list,
 				apr_psprintf(r->pool, "%s: %s", OIDC_HTTP_HDR_CONTENT_TYPE,
 						content_type));
 	}
 
 	/* see if we need to add any custom headers */
-	if (h_list != NULL)
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, h_list);
+	if (*h_list != NULL)
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, *h_list);
 
 	if (pass_cookies != NULL) {
 		/* gather cookies that we need to pass on from the incoming request */
@@ -819,6 +1244,32 @@ static apr_byte_t oidc_util_http_call(request_rec *r, const char *url,
 	/* set the target URL */
 	curl_easy_setopt(curl, CURLOPT_URL, url);
 
+	return curl;
+}
+
+/*
+ * execute a HTTP (GET or POST) request
+ */
+static apr_byte_t oidc_util_http_call(request_rec *r, int metric,
+		const char *url, const char *data, const char *content_type, const char *basic_auth,
+		const char *bearer_token, int ssl_validate_server, char **response,
+		int timeout, const char *outgoing_proxy,
+		apr_array_header_t *pass_cookies, const char *ssl_cert,
+		const char *ssl_key) {
+	char curlError[CURL_ERROR_SIZE];
+	oidc_curl_buffer curlBuffer;
+	CURL *curl;
+	struct curl_slist *h_list = NULL;
+	apr_time_t start = apr_time_now();
+
+	curl = oidc_util_http_curl_prepare(r, url, data, content_type, basic_auth,
+			bearer_token, ssl_validate_server, timeout, outgoing_proxy,
+			pass_cookies, ssl_cert, ssl_key, &curlBuffer, curlError, &h_list);
+	if (curl == NULL) {
+		oidc_metrics_http(r, metric, start, FALSE);
+		return FALSE;
+	}
+
 	/* call it and record the result */
 	int rv = TRUE;
 	if (curl_easy_perform(curl) != CURLE_OK) {
@@ -842,7 +1293,9 @@ out:
 	/* cleanup and return the result */
 	if (h_list != NULL)
 		curl_slist_free_all(h_list);
-	curl_easy_cleanup(curl);
+	oidc_util_http_curl_release(curl);
+
+	oidc_metrics_http(r, metric, start, rv);
 
 	return rv;
 }
@@ -850,14 +1303,14 @@ out:
 /*
  * execute HTTP GET request
  */
-apr_byte_t oidc_util_http_get(request_rec *r, const char *url,
-		const apr_table_t *params, const char *basic_auth,
+apr_byte_t oidc_util_http_get(request_rec *r, int metric,
+		const char *url, const apr_table_t *params, const char *basic_auth,
 		const char *bearer_token, int ssl_validate_server, char **response,
 		int timeout, const char *outgoing_proxy,
 		apr_array_header_t *pass_cookies, const char *ssl_cert,
 		const char *ssl_key) {
 	char *query_url = oidc_util_http_query_encoded_url(r, url, params);
-	return oidc_util_http_call(r, query_url, NULL, NULL, basic_auth,
+	return oidc_util_http_call(r, metric, query_url, NULL, NULL, basic_auth,
 			bearer_token, ssl_validate_server, response, timeout,
 			outgoing_proxy, pass_cookies, ssl_cert, ssl_key);
 }
@@ -865,14 +1318,14 @@ apr_byte_t oidc_util_http_get(request_rec *r, const char *url,
 /*
  * execute HTTP POST request with form-encoded data
  */
-apr_byte_t oidc_util_http_post_form(request_rec *r, const char *url,
-		const apr_table_t *params, const char *basic_auth,
+apr_byte_t oidc_util_http_post_form(request_rec *r, int metric,
+		const char *url, const apr_table_t *params, const char *basic_auth,
 		const char *bearer_token, int ssl_validate_server, char **response,
 		int timeout, const char *outgoing_proxy,
 		apr_array_header_t *pass_cookies, const char *ssl_cert,
 		const char *ssl_key) {
 	char *data = oidc_util_http_form_encoded_data(r, params);
-	return oidc_util_http_call(r, url, data,
+	return oidc_util_http_call(r, metric, url, data,
 			OIDC_CONTENT_TYPE_FORM_ENCODED, basic_auth, bearer_token,
 			ssl_validate_server, response, timeout, outgoing_proxy,
 			pass_cookies, ssl_cert, ssl_key);
@@ -881,19 +1334,189 @@ apr_byte_t oidc_util_http_post_form(request_rec *r, const char *url,
 /*
  * execute HTTP POST request with JSON-encoded data
  */
-apr_byte_t oidc_util_http_post_json(request_rec *r, const char *url,
-		json_t *json, const char *basic_auth, const char *bearer_token,
-		int ssl_validate_server, char **response, int timeout,
-		const char *outgoing_proxy, apr_array_header_t *pass_cookies,
-		const char *ssl_cert, const char *ssl_key) {
+apr_byte_t oidc_util_http_post_json(request_rec *r, int metric,
+		const char *url, json_t *json, const char *basic_auth,
+		const char *bearer_token, int ssl_validate_server, char **response,
+		int timeout, const char *outgoing_proxy,
+		apr_array_header_t *pass_cookies, const char *ssl_cert,
+		const char *ssl_key) {
 	char *data =
 			json != NULL ?
 					oidc_util_encode_json_object(r, json, JSON_COMPACT) : NULL;
-	return oidc_util_http_call(r, url, data, OIDC_CONTENT_TYPE_JSON, basic_auth,
-			bearer_token, ssl_validate_server, response, timeout,
+	return oidc_util_http_call(r, metric, url, data, OIDC_CONTENT_TYPE_JSON,
+			basic_auth, bearer_token, ssl_validate_server, response, timeout,
 			outgoing_proxy, pass_cookies, ssl_cert, ssl_key);
 }
 
+#if LIBCURL_VERSION_NUM >= 0x071C00
+/* per-call state of a set of parallel HTTP calls */
+typedef struct oidc_http_multi_ctx_t {
+	oidc_http_call_t *call;
+	CURL *curl;
+	oidc_curl_buffer buffer;
+	char error[CURL_ERROR_SIZE];
+	struct curl_slist *h_list;
+	CURLcode result;
+	apr_byte_t done;
+} oidc_http_multi_ctx_t;
+
+/* maximum time in milliseconds to wait for activity before checking the deadline again */
+#define OIDC_HTTP_MULTI_WAIT_MAX 1000
+#endif
+
+/*
+ * execute a set of independent HTTP calls in parallel and wait until all of them completed or the shared
+ * timeout (in seconds) expired; returns TRUE when all calls succeeded, call->rc has the result of each call
+ */
+apr_byte_t oidc_util_http_multi(request_rec *r, oidc_http_call_t *calls, int n,
+		int timeout, const char *outgoing_proxy,
+		apr_array_header_t *pass_cookies) {
+	apr_byte_t rv = TRUE;
+	int i;
+
+	if (n == 1) {
+		calls[0].rc = oidc_util_http_call(r, calls[0].metric, calls[0].url,
+				calls[0].data, calls[0].content_type, calls[0].basic_auth,
+				calls[0].bearer_token, calls[0].ssl_validate_server,
+				&calls[0].response, timeout, outgoing_proxy, pass_cookies,
+				calls[0].ssl_cert, calls[0].ssl_key);
+		return calls[0].rc;
+	}
+
+#if LIBCURL_VERSION_NUM >= 0x071C00
+	oidc_http_multi_ctx_t *ctx = NULL, *c = NULL;
+	apr_time_t start = apr_time_now();
+	apr_time_t deadline = start + apr_time_from_sec(timeout);
+	apr_interval_time_t remaining = 0;
+	CURLM *multi = NULL;
+	CURLMcode mc = CURLM_OK;
+	CURLMsg *msg = NULL;
+	int running = 0, left = 0;
+	long response_code = 0;
+
+	if (n <= 0)
+		return TRUE;
+
+	multi = curl_multi_init();
+	if (multi == NULL) {
+		oidc_error(r, "curl_multi_init() error");
+		for (i = 0; i < n; i++) {
+			calls[i].response = NULL;
+			calls[i].rc = FALSE;
+			oidc_metrics_http(r, calls[i].metric, start, FALSE);
+		}
+		return FALSE;
+	}
+
+	ctx = apr_pcalloc(r->pool, n * sizeof(oidc_http_multi_ctx_t));
+	for (i = 0; i < n; i++) {
+		c = &ctx[i];
+		c->call = &calls[i];
+		c->call->response = NULL;
+		c->call->rc = FALSE;
+		c->curl = oidc_util_http_curl_prepare(r, c->call->url, c->call->data,
+				c->call->content_type, c->call->basic_auth,
+				c->call->bearer_token, c->call->ssl_validate_server, timeout,
+				outgoing_proxy, pass_cookies, c->call->ssl_cert,
+				c->call->ssl_key, &c->buffer, c->error, &c->h_list);
+		if (c->curl == NULL)
+			continue;
+		curl_easy_setopt(c->curl, CURLOPT_PRIVATE, (void * )c);
+		if (curl_multi_add_handle(multi, c->curl) != CURLM_OK) {
+			oidc_error(r, "curl_multi_add_handle() failed on: %s",
+					c->call->url);
+			if (c->h_list != NULL)
+				curl_slist_free_all(c->h_list);
+			oidc_util_http_curl_release(c->curl);
+			c->curl = NULL;
+		}
+	}
+
+	/* drive all transfers until they are done or the deadline passed */
+	do {
+		mc = curl_multi_perform(multi, &running);
+		if ((mc != CURLM_OK) || (running == 0))
+			break;
+		remaining = deadline - apr_time_now();
+		if (remaining <= 0) {
+			oidc_error(r,
+					"%d of %d parallel HTTP call(s) did not complete within %d second(s)",
+					running, n, timeout);
+			break;
+		}
+		mc = curl_multi_wait(multi, NULL, 0,
+				(int) ((apr_time_as_msec(remaining) < OIDC_HTTP_MULTI_WAIT_MAX) ?
+						apr_time_as_msec(remaining) + 1 :
+						OIDC_HTTP_MULTI_WAIT_MAX), NULL);
+	} while (mc == CURLM_OK);
+
+	if (mc != CURLM_OK)
+		oidc_error(r, "curl_multi error: %s", curl_multi_strerror(mc));
+
+	/* collect the results of the completed transfers */
+	while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+		c = NULL;
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char ** )&c);
+		if (c == NULL)
+			continue;
+		c->result = msg->data.result;
+		c->done = TRUE;
+	}
+
+	for (i = 0; i < n; i++) {
+		c = &ctx[i];
+		if (c->curl == NULL) {
+			rv = FALSE;
+			oidc_metrics_http(r, c->call->metric, start, FALSE);
+			continue;
+		}
+
+		if ((c->done == TRUE) && (c->result == CURLE_OK)) {
+			curl_easy_getinfo(c->curl, CURLINFO_RESPONSE_CODE, &response_code);
+			oidc_debug(r, "HTTP response code=%ld for: %s", response_code,
+					c->call->url);
+			c->call->response = apr_pstrmemdup(r->pool, c->buffer.memory,
+					c->buffer.size);
+			oidc_debug(r, "response=%s",
+					c->call->response ? c->call->response : "");
+			c->call->rc = TRUE;
+		} else {
+			oidc_error(r, "parallel HTTP call failed on: %s (%s)",
+					c->call->url,
+					c->error[0] ?
+							c->error :
+							(c->done ?
+									curl_easy_strerror(c->result) : "timeout"));
+			rv = FALSE;
+		}
+
+		curl_multi_remove_handle(multi, c->curl);
+		if (c->h_list != NULL)
+			curl_slist_free_all(c->h_list);
+		oidc_util_http_curl_release(c->curl);
+
+		oidc_metrics_http(r, c->call->metric, start, c->call->rc);
+	}
+
+	curl_multi_cleanup(multi);
+#else
+	/* no curl_multi_wait available: execute the calls one after another */
+	for (i = 0; i < n; i++) {
+		calls[i].rc = oidc_util_http_call(r, calls[i].metric, calls[i].url,
+				calls[i].data, calls[i].content_type, calls[i].basic_auth,
+				calls[i].bearer_token, calls[i].ssl_validate_server,
+				&calls[i].response, timeout, outgoing_proxy, pass_cookies,
+				calls[i].ssl_cert, calls[i].ssl_key);
+		if (calls[i].rc == FALSE)
+			rv = FALSE;
+	}
+#endif
+
+	return rv;
+}
+
 /*
  * get the current path from the request in a normalized way
  */
@@ -1203,12 +1826,12 @@ char *oidc_normalize_header_name(const request_rec *r, const char *str) {
 	const char *separators = "()<>@,;:\\\"/[]?={} \t";
 
 	char *ns = apr_pstrdup(r->pool, str);
-	size_t i;
-	for (i = 0; i < strlen(ns); i++) {
-		if (ns[i] < 32 || ns[i] == 127)
-			ns[i] = '-';
-		else if (strchr(separators, ns[i]) != NULL)
-			ns[i] = '-';
+	char *p;
+	for (p = ns; *p != '\0'; p++) {
+		if (*p < 32 || *p == 127)
+			*p = '-';
+		else if (strchr(separators, *p) != NULL)
+			*p = '-';
 	}
 	return ns;
 }
@@ -1358,33 +1981,372 @@ apr_byte_t oidc_util_decode_json_object(request_rec *r, const char *str,
 		oidc_warn(r, "email %s is added as header", s_value2);
 
 
-		/* something went wrong */
-		/*
-		oidc_error(r, "JSON parsing returned an error: %s (%s)",
-				json_error.text, str);
-		return FALSE;
-		*/
+		/* something went wrong */
+		/*
+		oidc_error(r, "JSON parsing returned an error: %s (%s)",
+				json_error.text, str);
+		return FALSE;
+		*/
+	}
+
+	if (!json_is_object(*json)) {
+		/* oops, no JSON */
+		oidc_error(r, "parsed JSON did not contain a JSON object");
+		json_decref(*json);
+		*json = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * encode a JSON object
+ */
+char *oidc_util_encode_json_object(request_rec *r, json_t *json, size_t flags) {
+	char *s = json_dumps(json, flags);
+	char *s_value = apr_pstrdup(r->pool, s);
+	free(s);
+	return s_value;
+}
+
+/* maximum nesting depth of a MessagePack encoded JSON value */
+#define OIDC_UTIL_MSGPACK_MAX_DEPTH 32
+
+/* a growing buffer to serialize MessagePack in to */
+typedef struct oidc_util_msgpack_buf_t {
+	apr_pool_t *pool;
+	unsigned char *data;
+	apr_size_t len;
+	apr_size_t size;
+} oidc_util_msgpack_buf_t;
+
+/*
+ * append bytes to a MessagePack buffer
+ */
+static void oidc_util_msgpack_put(oidc_util_msgpack_buf_t *buf,
+		const void *src, apr_size_t n) {
+	unsigned char *data = NULL;
+	if (buf->len + n > buf->size) {
+		buf->size = (buf->size * 2 > buf->len + n) ?
+				buf->size * 2 : buf->len + n;
+		data = apr_palloc(buf->pool, buf->size);
+		if (buf->len > 0)
+			memcpy(data, buf->data, buf->len);
+		buf->data = data;
+	}
+	memcpy(buf->data + buf->len, src, n);
+	buf->len += n;
+}
+
+/*
+ * append a type byte followed by an unsigned integer of n bytes in network byte order
+ */
+static void oidc_util_msgpack_put_uint(oidc_util_msgpack_buf_t *buf,
+		unsigned char type, apr_uint64_t v, int n) {
+	unsigned char b[9];
+	int i;
+	b[0] = type;
+	for (i = n; i > 0; i--) {
+		b[i] = (unsigned char) (v & 0xff);
+		v >>= 8;
+	}
+	oidc_util_msgpack_put(buf, b, n + 1);
+}
+
+/*
+ * append the header of a string, array or map using the smallest representation
+ */
+static void oidc_util_msgpack_put_header(oidc_util_msgpack_buf_t *buf,
+		unsigned char fix, apr_size_t fix_max, unsigned char type8,
+		unsigned char type16, apr_size_t n) {
+	if (n < fix_max)
+		oidc_util_msgpack_put_uint(buf, fix | (unsigned char) n, 0, 0);
+	else if ((type8 != 0) && (n <= 0xff))
+		oidc_util_msgpack_put_uint(buf, type8, n, 1);
+	else if (n <= 0xffff)
+		oidc_util_msgpack_put_uint(buf, type16, n, 2);
+	else
+		oidc_util_msgpack_put_uint(buf, type16 + 1, n, 4);
+}
+
+static void oidc_util_msgpack_put_string(oidc_util_msgpack_buf_t *buf,
+		const char *s) {
+	apr_size_t n = strlen(s);
+	oidc_util_msgpack_put_header(buf, 0xa0, 32, 0xd9, 0xda, n);
+	oidc_util_msgpack_put(buf, s, n);
+}
+
+/*
+ * serialize a JSON value as MessagePack
+ */
+static apr_byte_t oidc_util_msgpack_put_json(oidc_util_msgpack_buf_t *buf,
+		json_t *json, int depth) {
+	json_int_t i;
+	double d;
+	apr_uint64_t u;
+	void *iter = NULL;
+	size_t n, k;
+
+	if (depth > OIDC_UTIL_MSGPACK_MAX_DEPTH)
+		return FALSE;
+
+	switch (json_typeof(json)) {
+	case JSON_NULL:
+		oidc_util_msgpack_put_uint(buf, 0xc0, 0, 0);
+		break;
+	case JSON_FALSE:
+		oidc_util_msgpack_put_uint(buf, 0xc2, 0, 0);
+		break;
+	case JSON_TRUE:
+		oidc_util_msgpack_put_uint(buf, 0xc3, 0, 0);
+		break;
+	case JSON_INTEGER:
+		i = json_integer_value(json);
+		if ((i >= 0) && (i < 128))
+			oidc_util_msgpack_put_uint(buf, (unsigned char) i, 0, 0);
+		else if ((i < 0) && (i >= -32))
+			oidc_util_msgpack_put_uint(buf, (unsigned char) (i & 0xff), 0, 0);
+		else if ((i > 0) && (i <= 0xffffffffLL))
+			oidc_util_msgpack_put_uint(buf, 0xce, (apr_uint64_t) i, 4);
+		else
+			oidc_util_msgpack_put_uint(buf, 0xd3, (apr_uint64_t) i, 8);
+		break;
+	case JSON_REAL:
+		d = json_real_value(json);
+		memcpy(&u, &d, sizeof(u));
+		oidc_util_msgpack_put_uint(buf, 0xcb, u, 8);
+		break;
+	case JSON_STRING:
+		oidc_util_msgpack_put_string(buf, json_string_value(json));
+		break;
+	case JSON_ARRAY:
+		n = json_array_size(json);
+		oidc_util_msgpack_put_header(buf, 0x90, 16, 0, 0xdc, n);
+		for (k = 0; k < n; k++)
+			if (oidc_util_msgpack_put_json(buf, json_array_get(json, k),
+					depth + 1) == FALSE)
+				return FALSE;
+		break;
+	case JSON_OBJECT:
+		n = json_object_size(json);
+		oidc_util_msgpack_put_header(buf, 0x80, 16, 0, 0xde, n);
+		iter = json_object_iter(json);
+		while (iter) {
+			oidc_util_msgpack_put_string(buf, json_object_iter_key(iter));
+			if (oidc_util_msgpack_put_json(buf, json_object_iter_value(iter),
+					depth + 1) == FALSE)
+				return FALSE;
+			iter = json_object_iter_next(json, iter);
+		}
+		break;
+	default:
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * serialize a JSON value as MessagePack (https://msgpack.org)
+ */
+apr_byte_t oidc_util_msgpack_encode(request_rec *r, json_t *json, char **dst,
+		apr_size_t *dst_len) {
+	oidc_util_msgpack_buf_t buf = { r->pool, NULL, 0, 0 };
+
+	if (oidc_util_msgpack_put_json(&buf, json, 0) == FALSE) {
+		oidc_error(r, "could not serialize JSON value as MessagePack");
+		return FALSE;
+	}
+
+	*dst = (char *) buf.data;
+	*dst_len = buf.len;
+
+	return TRUE;
+}
+
+/* a MessagePack buffer that is being deserialized */
+typedef struct oidc_util_msgpack_reader_t {
+	const unsigned char *data;
+	apr_size_t len;
+	apr_size_t pos;
+} oidc_util_msgpack_reader_t;
+
+/*
+ * read an unsigned integer of n bytes in network byte order
+ */
+static apr_byte_t oidc_util_msgpack_get_uint(oidc_util_msgpack_reader_t *rd,
+		int n, apr_uint64_t *v) {
+	int i;
+	if (rd->len - rd->pos < (apr_size_t) n)
+		return FALSE;
+	*v = 0;
+	for (i = 0; i < n; i++)
+		*v = (*v << 8) | rd->data[rd->pos++];
+	return TRUE;
+}
+
+static json_t *oidc_util_msgpack_get_json(oidc_util_msgpack_reader_t *rd,
+		apr_pool_t *pool, int depth);
+
+/*
+ * read a string of n bytes
+ */
+static json_t *oidc_util_msgpack_get_string(oidc_util_msgpack_reader_t *rd,
+		apr_pool_t *pool, apr_uint64_t n) {
+	json_t *json = NULL;
+	if (rd->len - rd->pos < n)
+		return NULL;
+	json = json_string(
+			apr_pstrmemdup(pool, (const char *) rd->data + rd->pos, n));
+	rd->pos += n;
+	return json;
+}
+
+/*
+ * read the elements of an array of n elements
+ */
+static json_t *oidc_util_msgpack_get_array(oidc_util_msgpack_reader_t *rd,
+		apr_pool_t *pool, apr_uint64_t n, int depth) {
+	json_t *json = json_array(), *elem = NULL;
+	apr_uint64_t i;
+	for (i = 0; i < n; i++) {
+		elem = oidc_util_msgpack_get_json(rd, pool, depth + 1);
+		if (elem == NULL) {
+			json_decref(json);
+			return NULL;
+		}
+		json_array_append_new(json, elem);
 	}
+	return json;
+}
 
-	if (!json_is_object(*json)) {
-		/* oops, no JSON */
-		oidc_error(r, "parsed JSON did not contain a JSON object");
-		json_decref(*json);
-		*json = NULL;
-		return FALSE;
+/*
+ * read the name/value pairs of a map of n entries; names must be strings
+ */
+static json_t *oidc_util_msgpack_get_map(oidc_util_msgpack_reader_t *rd,
+		apr_pool_t *pool, apr_uint64_t n, int depth) {
+	json_t *json = json_object(), *key = NULL, *value = NULL;
+	apr_uint64_t i;
+	for (i = 0; i < n; i++) {
+		key = oidc_util_msgpack_get_json(rd, pool, depth + 1);
+		if ((key == NULL) || (!json_is_string(key))) {
+			json_decref(key);
+			json_decref(json);
+			return NULL;
+		}
+		value = oidc_util_msgpack_get_json(rd, pool, depth + 1);
+		if (value == NULL) {
+			json_decref(key);
+			json_decref(json);
+			return NULL;
+		}
+		json_object_set_new(json, json_string_value(key), value);
+		json_decref(key);
 	}
+	return json;
+}
 
-	return TRUE;
+/*
+ * deserialize a single MessagePack value in to a JSON value
+ */
+static json_t *oidc_util_msgpack_get_json(oidc_util_msgpack_reader_t *rd,
+		apr_pool_t *pool, int depth) {
+	unsigned char type;
+	apr_uint64_t v = 0;
+	double d;
+
+	if ((depth > OIDC_UTIL_MSGPACK_MAX_DEPTH) || (rd->pos >= rd->len))
+		return NULL;
+
+	type = rd->data[rd->pos++];
+
+	if (type < 0x80)
+		return json_integer(type);
+	if (type >= 0xe0)
+		return json_integer((json_int_t) type - 256);
+	if ((type & 0xe0) == 0xa0)
+		return oidc_util_msgpack_get_string(rd, pool, type & 0x1f);
+	if ((type & 0xf0) == 0x90)
+		return oidc_util_msgpack_get_array(rd, pool, type & 0x0f, depth);
+	if ((type & 0xf0) == 0x80)
+		return oidc_util_msgpack_get_map(rd, pool, type & 0x0f, depth);
+
+	switch (type) {
+	case 0xc0:
+		return json_null();
+	case 0xc2:
+		return json_false();
+	case 0xc3:
+		return json_true();
+	case 0xcc:
+	case 0xcd:
+	case 0xce:
+	case 0xcf:
+		if (oidc_util_msgpack_get_uint(rd, 1 << (type - 0xcc), &v) == FALSE)
+			return NULL;
+		return json_integer((json_int_t) v);
+	case 0xd0:
+		if (oidc_util_msgpack_get_uint(rd, 1, &v) == FALSE)
+			return NULL;
+		return json_integer((json_int_t) (signed char) v);
+	case 0xd1:
+		if (oidc_util_msgpack_get_uint(rd, 2, &v) == FALSE)
+			return NULL;
+		return json_integer((json_int_t) (apr_int16_t) v);
+	case 0xd2:
+		if (oidc_util_msgpack_get_uint(rd, 4, &v) == FALSE)
+			return NULL;
+		return json_integer((json_int_t) (apr_int32_t) v);
+	case 0xd3:
+		if (oidc_util_msgpack_get_uint(rd, 8, &v) == FALSE)
+			return NULL;
+		return json_integer((json_int_t) (apr_int64_t) v);
+	case 0xcb:
+		if (oidc_util_msgpack_get_uint(rd, 8, &v) == FALSE)
+			return NULL;
+		memcpy(&d, &v, sizeof(d));
+		return json_real(d);
+	case 0xd9:
+	case 0xda:
+	case 0xdb:
+		if (oidc_util_msgpack_get_uint(rd, 1 << (type - 0xd9), &v) == FALSE)
+			return NULL;
+		return oidc_util_msgpack_get_string(rd, pool, v);
+	case 0xdc:
+	case 0xdd:
+		if (oidc_util_msgpack_get_uint(rd, 2 << (type - 0xdc), &v) == FALSE)
+			return NULL;
+		return oidc_util_msgpack_get_array(rd, pool, v, depth);
+	case 0xde:
+	case 0xdf:
+		if (oidc_util_msgpack_get_uint(rd, 2 << (type - 0xde), &v) == FALSE)
+			return NULL;
+		return oidc_util_msgpack_get_map(rd, pool, v, depth);
+	}
+
+	/* binary, extension and float32 types are never produced by us */
+	return NULL;
 }
 
 /*
- * encode a JSON object
+ * deserialize a MessagePack buffer in to a JSON object
  */
-char *oidc_util_encode_json_object(request_rec *r, json_t *json, size_t flags) {
-	char *s = json_dumps(json, flags);
-	char *s_value = apr_pstrdup(r->pool, s);
-	free(s);
-	return s_value;
+apr_byte_t oidc_util_msgpack_decode(request_rec *r, const char *src,
+		apr_size_t src_len, json_t **json) {
+	oidc_util_msgpack_reader_t rd = { (const unsigned char *) src, src_len, 0 };
+
+	*json = oidc_util_msgpack_get_json(&rd, r->pool, 0);
+
+	if ((*json == NULL) || (rd.pos != rd.len) || (!json_is_object(*json))) {
+		oidc_error(r, "could not deserialize MessagePack in to a JSON object");
+		if (*json != NULL)
+			json_decref(*json);
+		*json = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 /*
@@ -1406,6 +2368,109 @@ apr_byte_t oidc_util_decode_json_and_check_error(request_rec *r,
 	return TRUE;
 }
 
+/* upper bound on the size of inflated data, protecting against decompression bombs */
+#define OIDC_UTIL_INFLATE_MAX_SIZE 1024 * 1024 * 4
+
+/*
+ * compress a buffer with raw DEFLATE (RFC 1951), as used for the JWE "zip" header
+ */
+apr_byte_t oidc_util_deflate(request_rec *r, const char *src,
+		apr_size_t src_len, char **dst, apr_size_t *dst_len) {
+#ifdef USE_ZLIB
+	z_stream zs;
+	uLong bound = 0;
+	int rc = Z_OK;
+
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+			Z_DEFAULT_STRATEGY) != Z_OK) {
+		oidc_error(r, "deflateInit2 failed");
+		return FALSE;
+	}
+
+	bound = deflateBound(&zs, src_len);
+	*dst = apr_palloc(r->pool, bound + 1);
+
+	zs.next_in = (Bytef *) src;
+	zs.avail_in = src_len;
+	zs.next_out = (Bytef *) *dst;
+	zs.avail_out = bound;
+
+	rc = deflate(&zs, Z_FINISH);
+	*dst_len = zs.total_out;
+	deflateEnd(&zs);
+
+	if (rc != Z_STREAM_END) {
+		oidc_error(r, "deflate failed: %d", rc);
+		return FALSE;
+	}
+	(*dst)[*dst_len] = '\0';
+
+	return TRUE;
+#else
+	oidc_error(r, "compression is not supported: built without zlib");
+	return FALSE;
+#endif
+}
+
+/*
+ * decompress a raw DEFLATE buffer; the result is \0 terminated
+ */
+apr_byte_t oidc_util_inflate(request_rec *r, const char *src,
+		apr_size_t src_len, char **dst, apr_size_t *dst_len) {
+#ifdef USE_ZLIB
+	z_stream zs;
+	apr_size_t size = src_len * 4 + 256;
+	char *buf = NULL;
+	int rc = Z_OK;
+
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+		oidc_error(r, "inflateInit2 failed");
+		return FALSE;
+	}
+
+	zs.next_in = (Bytef *) src;
+	zs.avail_in = src_len;
+
+	buf = apr_palloc(r->pool, size + 1);
+	zs.next_out = (Bytef *) buf;
+	zs.avail_out = size;
+
+	while ((rc = inflate(&zs, Z_NO_FLUSH)) == Z_OK) {
+		if (zs.avail_out > 0)
+			continue;
+		if (size >= OIDC_UTIL_INFLATE_MAX_SIZE) {
+			rc = Z_BUF_ERROR;
+			break;
+		}
+		/* grow the output buffer */
+		char *p = apr_palloc(r->pool, size * 2 + 1);
+		memcpy(p, buf, size);
+		buf = p;
+		zs.next_out = (Bytef *) buf + size;
+		zs.avail_out = size;
+		size *= 2;
+	}
+
+	*dst_len = zs.total_out;
+	inflateEnd(&zs);
+
+	if (rc != Z_STREAM_END) {
+		oidc_error(r, "inflate failed: %d", rc);
+		return FALSE;
+	}
+
+	buf[*dst_len] = '\0';
+	*dst = buf;
+
+	return TRUE;
+#else
+	oidc_error(r, "decompression is not supported: built without zlib");
+	return FALSE;
+#endif
+}
+
 /*
  * sends content to the user agent
  */
@@ -1826,16 +2891,92 @@ apr_byte_t oidc_util_json_array_has_value(request_rec *r, json_t *haystack,
 	return (i == json_array_size(haystack)) ? FALSE : TRUE;
 }
 
+#define OIDC_UTIL_APP_INFO_NAME_CACHE_MAX 4096
+
+/* per-process cache of header/environment variable names, keyed by claim prefix and then by claim name */
+static apr_pool_t *oidc_util_app_info_name_cache_pool = NULL;
+static apr_hash_t *oidc_util_app_info_name_cache = NULL;
+static unsigned int oidc_util_app_info_name_cache_count = 0;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *oidc_util_app_info_name_cache_mutex = NULL;
+#endif
+
+#if APR_HAS_THREADS
+#define oidc_util_app_info_name_cache_lock() apr_thread_mutex_lock(oidc_util_app_info_name_cache_mutex)
+#define oidc_util_app_info_name_cache_unlock() apr_thread_mutex_unlock(oidc_util_app_info_name_cache_mutex)
+#else
+#define oidc_util_app_info_name_cache_lock()
+#define oidc_util_app_info_name_cache_unlock()
+#endif
+
 /*
- * set a HTTP header and/or environment variable to pass information to the application
+ * initialize the per-process cache of header/environment variable names in a child process
  */
-void oidc_util_set_app_info(request_rec *r, const char *s_key,
-		const char *s_value, const char *claim_prefix, apr_byte_t as_header,
-		apr_byte_t as_env_var) {
+apr_status_t oidc_util_app_info_name_cache_child_init(apr_pool_t *p,
+		server_rec *s) {
+	apr_status_t rv = APR_SUCCESS;
+#if APR_HAS_THREADS
+	rv = apr_thread_mutex_create(&oidc_util_app_info_name_cache_mutex,
+			APR_THREAD_MUTEX_DEFAULT, p);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s, "apr_thread_mutex_create failed: %d", rv);
+		return rv;
+	}
+#endif
+	oidc_util_app_info_name_cache = apr_hash_make(p);
+	oidc_util_app_info_name_cache_pool = p;
+	oidc_util_app_info_name_cache_count = 0;
+	return rv;
+}
 
-	/* construct the header name, cq. put the prefix in front of a normalized key name */
-	const char *s_name = apr_psprintf(r->pool, "%s%s", claim_prefix,
-			oidc_normalize_header_name(r, s_key));
+/*
+ * get the header/environment variable name for a claim, cq. the prefix followed by the normalized claim
+ * name; the set of claim names is small and stable so the result is memoized per process
+ */
+const char *oidc_util_app_info_name(request_rec *r, const char *claim_prefix,
+		const char *s_key) {
+	apr_hash_t *names = NULL;
+	const char *s_name = NULL;
+
+	if (oidc_util_app_info_name_cache == NULL)
+		return apr_pstrcat(r->pool, claim_prefix,
+				oidc_normalize_header_name(r, s_key), NULL);
+
+	oidc_util_app_info_name_cache_lock();
+	names = apr_hash_get(oidc_util_app_info_name_cache, claim_prefix,
+			APR_HASH_KEY_STRING);
+	if (names != NULL)
+		s_name = apr_hash_get(names, s_key, APR_HASH_KEY_STRING);
+	if ((s_name == NULL)
+			&& (oidc_util_app_info_name_cache_count
+					< OIDC_UTIL_APP_INFO_NAME_CACHE_MAX)) {
+		if (names == NULL) {
+			names = apr_hash_make(oidc_util_app_info_name_cache_pool);
+			apr_hash_set(oidc_util_app_info_name_cache,
+					apr_pstrdup(oidc_util_app_info_name_cache_pool,
+							claim_prefix), APR_HASH_KEY_STRING, names);
+		}
+		s_name = apr_pstrcat(oidc_util_app_info_name_cache_pool, claim_prefix,
+				oidc_normalize_header_name(r, s_key), NULL);
+		apr_hash_set(names,
+				apr_pstrdup(oidc_util_app_info_name_cache_pool, s_key),
+				APR_HASH_KEY_STRING, s_name);
+		oidc_util_app_info_name_cache_count++;
+	}
+	oidc_util_app_info_name_cache_unlock();
+
+	if (s_name == NULL)
+		s_name = apr_pstrcat(r->pool, claim_prefix,
+				oidc_normalize_header_name(r, s_key), NULL);
+
+	return s_name;
+}
+
+/*
+ * set a HTTP header and/or environment variable with a name that has already been constructed
+ */
+static void oidc_util_set_app_info_name(request_rec *r, const char *s_name,
+		const char *s_value, apr_byte_t as_header, apr_byte_t as_env_var) {
 
 	if (as_header)
 		oidc_util_hdr_in_set(r, s_name, s_value);
@@ -1850,16 +2991,107 @@ void oidc_util_set_app_info(request_rec *r, const char *s_key,
 	}
 }
 
+/*
+ * set a HTTP header and/or environment variable to pass information to the application
+ */
+void oidc_util_set_app_info(request_rec *r, const char *s_key,
+		const char *s_value, const char *claim_prefix, apr_byte_t as_header,
+		apr_byte_t as_env_var) {
+
+	/* construct the header name, cq. put the prefix in front of a normalized key name */
+	const char *s_name = oidc_util_app_info_name(r, claim_prefix, s_key);
+
+	oidc_util_set_app_info_name(r, s_name, s_value, as_header, as_env_var);
+}
+
+/*
+ * convert a claim value to the string that is passed to the application, NULL if it cannot be represented
+ */
+static const char *oidc_util_app_info_value(request_rec *r, const char *s_key,
+		json_t *j_value, const char *claim_delimiter) {
+
+	/* check if it is a single value string */
+	if (json_is_string(j_value))
+		return json_string_value(j_value);
+
+	/* boolean values are passed as "1" or "0" */
+	if (json_is_boolean(j_value))
+		return json_is_true(j_value) ? "1" : "0";
+
+	if (json_is_integer(j_value))
+		return apr_psprintf(r->pool, "%ld", (long) json_integer_value(j_value));
+
+	if (json_is_real(j_value))
+		return apr_psprintf(r->pool, "%lf", json_real_value(j_value));
+
+	/* objects are passed as their JSON serialization */
+	if (json_is_object(j_value))
+		return oidc_util_encode_json_object(r, j_value, 0);
+
+	/* check if it is a multi-value string */
+	if (json_is_array(j_value)) {
+
+		/* some logging about what we're going to do */
+		oidc_debug(r,
+				"parsing attribute array for key \"%s\" (#nr-of-elems: %llu)",
+				s_key, (unsigned long long )json_array_size(j_value));
+
+		/* the string values interleaved with the configured delimiter, concatenated in one go */
+		apr_array_header_t *parts = apr_array_make(r->pool,
+				2 * json_array_size(j_value), sizeof(const char *));
+		size_t i = 0;
+
+		/* loop over the array */
+		for (i = 0; i < json_array_size(j_value); i++) {
+
+			/* get the current element */
+			json_t *elem = json_array_get(j_value, i);
+			const char *s_elem = NULL;
+
+			// TODO: escape the delimiter in the values (maybe reuse/extract url-formatted code from oidc_session_identity_encode)
+			if (json_is_string(elem)) {
+				s_elem = json_string_value(elem);
+			} else if (json_is_boolean(elem)) {
+				s_elem = json_is_true(elem) ? "1" : "0";
+			} else {
+				/* don't know how to handle a non-string array element */
+				oidc_warn(r,
+						"unhandled in-array JSON object type [%d] for key \"%s\" when parsing claims array elements",
+						elem->type, s_key);
+				continue;
+			}
+
+			if (parts->nelts > 0)
+				APR_ARRAY_PUSH(parts, const char *) = claim_delimiter;
+			APR_ARRAY_PUSH(parts, const char *) = s_elem;
+		}
+
+		/* set the concatenated string */
+		return apr_array_pstrcat(r->pool, parts, 0);
+	}
+
+	/* no string and no array, so unclear how to handle this */
+	oidc_warn(r,
+			"unhandled JSON object type [%d] for key \"%s\" when parsing claims",
+			j_value->type, s_key);
+
+	return NULL;
+}
+
 /*
  * set the user/claims information from the session in HTTP headers passed on to the application
  */
 void oidc_util_set_app_infos(request_rec *r, const json_t *j_attrs,
 		const char *claim_prefix, const char *claim_delimiter,
 		apr_byte_t as_header, apr_byte_t as_env_var) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
 
-	char s_int[255];
 	json_t *j_value = NULL;
 	const char *s_key = NULL;
+	const char *s_name = NULL;
+	const char *s_value = NULL;
+	apr_hash_index_t *hi = NULL;
 
 	/* if not attributes are set, nothing needs to be done */
 	if (j_attrs == NULL) {
@@ -1867,6 +3099,27 @@ void oidc_util_set_app_infos(request_rec *r, const json_t *j_attrs,
 		return;
 	}
 
+	/* only pass the configured claims, looking up each of them rather than visiting all claims */
+	if (cfg->pass_claim_names != NULL) {
+		for (hi = apr_hash_first(r->pool, cfg->pass_claim_names); hi;
+				hi = apr_hash_next(hi)) {
+			apr_hash_this(hi, (const void **) &s_key, NULL, (void **) &s_name);
+			j_value = json_object_get(j_attrs, s_key);
+			if (j_value == NULL)
+				continue;
+			s_value = oidc_util_app_info_value(r, s_key, j_value,
+					claim_delimiter);
+			if (s_value == NULL)
+				continue;
+			/* an empty name means the default prefix+claim */
+			if (*s_name == '\0')
+				s_name = oidc_util_app_info_name(r, claim_prefix, s_key);
+			oidc_util_set_app_info_name(r, s_name, s_value, as_header,
+					as_env_var);
+		}
+		return;
+	}
+
 	/* loop over the claims in the JSON structure */
 	void *iter = json_object_iter((json_t*) j_attrs);
 	while (iter) {
@@ -1875,112 +3128,12 @@ void oidc_util_set_app_infos(request_rec *r, const json_t *j_attrs,
 		s_key = json_object_iter_key(iter);
 		j_value = json_object_iter_value(iter);
 
-		//		char *s_value= json_dumps(j_value, JSON_ENCODE_ANY);
-		//		oidc_util_set_app_info(r, s_key, s_value, claim_prefix);
-		//		free(s_value);
-
-		/* check if it is a single value string */
-		if (json_is_string(j_value)) {
-
-			/* set the single string in the application header whose name is based on the key and the prefix */
-			oidc_util_set_app_info(r, s_key, json_string_value(j_value),
-					claim_prefix, as_header, as_env_var);
-
-		} else if (json_is_boolean(j_value)) {
-
-			/* set boolean value in the application header whose name is based on the key and the prefix */
-			oidc_util_set_app_info(r, s_key,
-					(json_is_true(j_value) ? "1" : "0"), claim_prefix,
-					as_header, as_env_var);
-
-		} else if (json_is_integer(j_value)) {
-
-			if (sprintf(s_int, "%ld", (long) json_integer_value(j_value)) > 0) {
-				/* set long value in the application header whose name is based on the key and the prefix */
-				oidc_util_set_app_info(r, s_key, s_int, claim_prefix, as_header,
-						as_env_var);
-			} else {
-				oidc_warn(r,
-						"could not convert JSON number to string (> 255 characters?), skipping");
-			}
-
-		} else if (json_is_real(j_value)) {
-
-			/* set float value in the application header whose name is based on the key and the prefix */
-			oidc_util_set_app_info(r, s_key,
-					apr_psprintf(r->pool, "%lf", json_real_value(j_value)),
-					claim_prefix, as_header, as_env_var);
-
-		} else if (json_is_object(j_value)) {
-
-			/* set json value in the application header whose name is based on the key and the prefix */
-			oidc_util_set_app_info(r, s_key,
-					oidc_util_encode_json_object(r, j_value, 0), claim_prefix,
-					as_header, as_env_var);
-
-			/* check if it is a multi-value string */
-		} else if (json_is_array(j_value)) {
-
-			/* some logging about what we're going to do */
-			oidc_debug(r,
-					"parsing attribute array for key \"%s\" (#nr-of-elems: %llu)",
-					s_key, (unsigned long long )json_array_size(j_value));
-
-			/* string to hold the concatenated array string values */
-			char *s_concat = apr_pstrdup(r->pool, "");
-			size_t i = 0;
-
-			/* loop over the array */
-			for (i = 0; i < json_array_size(j_value); i++) {
-
-				/* get the current element */
-				json_t *elem = json_array_get(j_value, i);
-
-				/* check if it is a string */
-				if (json_is_string(elem)) {
-
-					/* concatenate the string to the s_concat value using the configured separator char */
-					// TODO: escape the delimiter in the values (maybe reuse/extract url-formatted code from oidc_session_identity_encode)
-					if (apr_strnatcmp(s_concat, "") != 0) {
-						s_concat = apr_psprintf(r->pool, "%s%s%s", s_concat,
-								claim_delimiter, json_string_value(elem));
-					} else {
-						s_concat = apr_psprintf(r->pool, "%s",
-								json_string_value(elem));
-					}
-
-				} else if (json_is_boolean(elem)) {
-
-					if (apr_strnatcmp(s_concat, "") != 0) {
-						s_concat = apr_psprintf(r->pool, "%s%s%s", s_concat,
-								claim_delimiter,
-								json_is_true(elem) ? "1" : "0");
-					} else {
-						s_concat = apr_psprintf(r->pool, "%s",
-								json_is_true(elem) ? "1" : "0");
-					}
-
-				} else {
-
-					/* don't know how to handle a non-string array element */
-					oidc_warn(r,
-							"unhandled in-array JSON object type [%d] for key \"%s\" when parsing claims array elements",
-							elem->type, s_key);
-				}
-			}
-
-			/* set the concatenated string */
-			oidc_util_set_app_info(r, s_key, s_concat, claim_prefix, as_header,
+		/* set the value in the application header whose name is based on the key and the prefix */
+		s_value = oidc_util_app_info_value(r, s_key, j_value, claim_delimiter);
+		if (s_value != NULL)
+			oidc_util_set_app_info(r, s_key, s_value, claim_prefix, as_header,
 					as_env_var);
 
-		} else {
-
-			/* no string and no array, so unclear how to handle this */
-			oidc_warn(r,
-					"unhandled JSON object type [%d] for key \"%s\" when parsing claims",
-					j_value->type, s_key);
-		}
-
 		iter = json_object_iter_next((json_t *) j_attrs, iter);
 	}
 }
@@ -2221,6 +3374,149 @@ apr_hash_t * oidc_util_merge_key_sets(apr_pool_t *pool, apr_hash_t *k1,
 	return apr_hash_overlay(pool, k1, k2);
 }
 
+/*
+ * a compiled (and studied) regular expression
+ */
+struct oidc_pcre_t {
+	const char *regexp;
+	pcre *preg;
+	pcre_extra *extra;
+};
+
+/*
+ * free a compiled regular expression
+ */
+static apr_status_t oidc_pcre_cleanup(void *data) {
+	oidc_pcre_t *preg = (oidc_pcre_t *) data;
+	if (preg->extra != NULL) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+		pcre_free_study(preg->extra);
+#else
+		pcre_free(preg->extra);
+#endif
+		preg->extra = NULL;
+	}
+	if (preg->preg != NULL) {
+		pcre_free(preg->preg);
+		preg->preg = NULL;
+	}
+	return APR_SUCCESS;
+}
+
+/*
+ * compile and study a regular expression, for the lifetime of the provided pool
+ */
+oidc_pcre_t *oidc_pcre_compile(apr_pool_t *pool, const char *regexp,
+		char **error_str) {
+	const char *errorptr = NULL;
+	int erroffset;
+	oidc_pcre_t *preg = NULL;
+
+	pcre *p = pcre_compile(regexp, 0, &errorptr, &erroffset, NULL);
+	if (p == NULL) {
+		*error_str = apr_psprintf(pool,
+				"pattern [%s] is not a valid regular expression", regexp);
+		return NULL;
+	}
+
+	preg = apr_pcalloc(pool, sizeof(oidc_pcre_t));
+	preg->regexp = apr_pstrdup(pool, regexp);
+	preg->preg = p;
+	/* a failure to study is not fatal: matching is just slower */
+#ifdef PCRE_STUDY_JIT_COMPILE
+	preg->extra = pcre_study(p, PCRE_STUDY_JIT_COMPILE, &errorptr);
+#else
+	preg->extra = pcre_study(p, 0, &errorptr);
+#endif
+	apr_pool_cleanup_register(pool, preg, oidc_pcre_cleanup,
+			apr_pool_cleanup_null);
+
+	return preg;
+}
+
+/*
+ * see if a string matches a compiled regular expression
+ */
+apr_byte_t oidc_pcre_match(const oidc_pcre_t *preg, const char *input) {
+	return (pcre_exec(preg->preg, preg->extra, input, (int) strlen(input), 0,
+			0, NULL, 0) >= 0);
+}
+
+#define OIDC_UTIL_REGEXP_CACHE_MAX 128
+
+/* per-process cache of regular expressions compiled at request time, keyed by pattern */
+static apr_pool_t *oidc_util_regexp_cache_pool = NULL;
+static apr_hash_t *oidc_util_regexp_cache = NULL;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *oidc_util_regexp_cache_mutex = NULL;
+#endif
+
+#if APR_HAS_THREADS
+#define oidc_util_regexp_cache_lock() apr_thread_mutex_lock(oidc_util_regexp_cache_mutex)
+#define oidc_util_regexp_cache_unlock() apr_thread_mutex_unlock(oidc_util_regexp_cache_mutex)
+#else
+#define oidc_util_regexp_cache_lock()
+#define oidc_util_regexp_cache_unlock()
+#endif
+
+/*
+ * initialize the per-process cache of compiled regular expressions in a child process
+ */
+apr_status_t oidc_util_regexp_cache_child_init(apr_pool_t *p, server_rec *s) {
+	apr_status_t rv = APR_SUCCESS;
+#if APR_HAS_THREADS
+	rv = apr_thread_mutex_create(&oidc_util_regexp_cache_mutex,
+			APR_THREAD_MUTEX_DEFAULT, p);
+	if (rv != APR_SUCCESS) {
+		oidc_serror(s, "apr_thread_mutex_create failed: %d", rv);
+		return rv;
+	}
+#endif
+	oidc_util_regexp_cache = apr_hash_make(p);
+	oidc_util_regexp_cache_pool = p;
+	return rv;
+}
+
+/*
+ * get a compiled regular expression for a pattern that is only known at request time;
+ * compiled patterns are immutable and can be shared by all threads in the process
+ */
+const oidc_pcre_t *oidc_util_regexp_get(request_rec *r, const char *regexp,
+		char **error_str) {
+	oidc_pcre_t *preg = NULL, *cached = NULL;
+	char *cache_error_str = NULL;
+
+	if (oidc_util_regexp_cache == NULL)
+		return oidc_pcre_compile(r->pool, regexp, error_str);
+
+	oidc_util_regexp_cache_lock();
+	cached = apr_hash_get(oidc_util_regexp_cache, regexp, APR_HASH_KEY_STRING);
+	oidc_util_regexp_cache_unlock();
+	if (cached != NULL)
+		return cached;
+
+	/* compile in the request pool first so invalid patterns don't leak into the process pool */
+	preg = oidc_pcre_compile(r->pool, regexp, error_str);
+	if (preg == NULL)
+		return NULL;
+
+	oidc_util_regexp_cache_lock();
+	cached = apr_hash_get(oidc_util_regexp_cache, regexp, APR_HASH_KEY_STRING);
+	if ((cached == NULL)
+			&& (apr_hash_count(oidc_util_regexp_cache)
+					< OIDC_UTIL_REGEXP_CACHE_MAX)) {
+		/* the pattern is known to be valid, so this only allocates from the process pool */
+		cached = oidc_pcre_compile(oidc_util_regexp_cache_pool, regexp,
+				&cache_error_str);
+		if (cached != NULL)
+			apr_hash_set(oidc_util_regexp_cache, cached->regexp,
+					APR_HASH_KEY_STRING, cached);
+	}
+	oidc_util_regexp_cache_unlock();
+
+	return (cached != NULL) ? cached : preg;
+}
+
 /*
  * regexp substitute
  *   Example:
@@ -2229,22 +3525,13 @@ apr_hash_t * oidc_util_merge_key_sets(apr_pool_t *pool, apr_hash_t *k1,
  *     text_original: "match 292 numbers"
  *     text_replaced: "292"
  */
-apr_byte_t oidc_util_regexp_substitute(apr_pool_t *pool, const char *input,
-		const char *regexp, const char *replace, char **output,
-		char **error_str) {
+apr_byte_t oidc_util_regexp_substitute_pcre(apr_pool_t *pool,
+		const char *input, const oidc_pcre_t *preg, const char *replace,
+		char **output, char **error_str) {
 
-	const char *errorptr = NULL;
-	int erroffset;
 	char *substituted = NULL;
 	apr_byte_t rc = FALSE;
 
-	pcre *preg = pcre_compile(regexp, 0, &errorptr, &erroffset, NULL);
-	if (preg == NULL) {
-		*error_str = apr_psprintf(pool,
-				"pattern [%s] is not a valid regular expression", regexp);
-		goto out;
-	}
-
 	if (strlen(input) >= OIDC_PCRE_MAXCAPTURE - 1) {
 		*error_str =
 				apr_psprintf(pool,
@@ -2253,13 +3540,13 @@ apr_byte_t oidc_util_regexp_substitute(apr_pool_t *pool, const char *input,
 		goto out;
 	}
 
-	substituted = pcre_subst(preg, NULL, input, (int) strlen(input), 0, 0,
-			replace);
+	substituted = pcre_subst(preg->preg, preg->extra, input,
+			(int) strlen(input), 0, 0, replace);
 	if (substituted == NULL) {
 		*error_str =
 				apr_psprintf(pool,
 						"unknown error could not match string [%s] using pattern [%s] and replace matches in [%s]",
-						input, regexp, replace);
+						input, preg->regexp, replace);
 		goto out;
 	}
 
@@ -2268,36 +3555,36 @@ apr_byte_t oidc_util_regexp_substitute(apr_pool_t *pool, const char *input,
 
 	out: if (substituted)
 		pcre_free(substituted);
-	if (preg)
-		pcre_free(preg);
 
 	return rc;
 }
 
+apr_byte_t oidc_util_regexp_substitute(apr_pool_t *pool, const char *input,
+		const char *regexp, const char *replace, char **output,
+		char **error_str) {
+	oidc_pcre_t *preg = oidc_pcre_compile(pool, regexp, error_str);
+	if (preg == NULL)
+		return FALSE;
+	return oidc_util_regexp_substitute_pcre(pool, input, preg, replace, output,
+			error_str);
+}
+
 /*
  * regexp match
  */
 #define OIDC_UTIL_REGEXP_MATCH_SIZE 30
 #define OIDC_UTIL_REGEXP_MATCH_NR 1
 
-apr_byte_t oidc_util_regexp_first_match(apr_pool_t *pool, const char *input,
-		const char *regexp, char **output, char **error_str) {
-	const char *errorptr = NULL;
-	int erroffset;
+apr_byte_t oidc_util_regexp_first_match_pcre(apr_pool_t *pool,
+		const char *input, const oidc_pcre_t *preg, char **output,
+		char **error_str) {
 	int rc = 0;
 	int subStr[OIDC_UTIL_REGEXP_MATCH_SIZE];
 	const char *psubStrMatchStr = NULL;
 	apr_byte_t rv = FALSE;
 
-	pcre *preg = pcre_compile(regexp, 0, &errorptr, &erroffset, NULL);
-	if (preg == NULL) {
-		*error_str = apr_psprintf(pool,
-				"pattern [%s] is not a valid regular expression", regexp);
-		goto out;
-	}
-
-	if ((rc = pcre_exec(preg, NULL, input, (int) strlen(input), 0, 0, subStr,
-			OIDC_UTIL_REGEXP_MATCH_SIZE)) < 0) {
+	if ((rc = pcre_exec(preg->preg, preg->extra, input, (int) strlen(input), 0,
+			0, subStr, OIDC_UTIL_REGEXP_MATCH_SIZE)) < 0) {
 		switch (rc) {
 		case PCRE_ERROR_NOMATCH:
 			*error_str = apr_pstrdup(pool, "string did not match the pattern");
@@ -2344,12 +3631,19 @@ out:
 
 	if (psubStrMatchStr)
 		pcre_free_substring(psubStrMatchStr);
-	if (preg)
-		pcre_free(preg);
 
 	return rv;
 }
 
+apr_byte_t oidc_util_regexp_first_match(apr_pool_t *pool, const char *input,
+		const char *regexp, char **output, char **error_str) {
+	oidc_pcre_t *preg = oidc_pcre_compile(pool, regexp, error_str);
+	if (preg == NULL)
+		return FALSE;
+	return oidc_util_regexp_first_match_pcre(pool, input, preg, output,
+			error_str);
+}
+
 int oidc_util_cookie_domain_valid(const char *hostname, char *cookie_domain) {
 	char *p = NULL;
 	char *check_cookie = cookie_domain;
@@ -168,6 +168,10 @@ AP_DECLARE(void) ap_hook_handler(int (*handler)(request_rec *r),
 		const char * const *aszPre, const char * const *aszSucc, int nOrder) {
 }
 
+AP_DECLARE(void) ap_hook_log_transaction(int (*log_transaction)(request_rec *r),
+		const char * const *aszPre, const char * const *aszSucc, int nOrder) {
+}
+
 AP_DECLARE(int) ap_is_initial_req(request_rec *r) {
 	return 0;
 }
@@ -61,6 +61,7 @@
 #include "apr_general.h"
 #include "apr_time.h"
 #include "apr_base64.h"
+#include "apr_file_io.h"
 
 #include "mod_auth_openidc.h"
 
@@ -211,6 +212,29 @@ static char *test_jwt_parse(apr_pool_t *pool) {
 	TST_ASSERT_ERR("oidc_jwt_verify", oidc_jwt_verify(pool, jwt, keys, &err),
 			pool, err);
 	oidc_jwt_destroy(jwt);
+
+	TST_ASSERT("oidc_jwe_is_compact", oidc_jwe_is_compact(s) == FALSE);
+
+	/* verify the signature before the payload is parsed */
+	TST_ASSERT_ERR("oidc_jwt_parse_header",
+			oidc_jwt_parse_header(pool, s, &jwt, NULL, &err), pool, err);
+	TST_ASSERT_STR("header.alg (deferred)", jwt->header.alg, "HS256");
+	TST_ASSERT("payload (deferred)", jwt->payload.value.json == NULL);
+	TST_ASSERT_ERR("oidc_jwt_verify (deferred)",
+			oidc_jwt_verify(pool, jwt, keys, &err), pool, err);
+	TST_ASSERT_ERR("oidc_jwt_parse_payload",
+			oidc_jwt_parse_payload(pool, jwt, &err), pool, err);
+	TST_ASSERT_STR("payload.iss (deferred)", jwt->payload.iss, "joe");
+	oidc_jwt_destroy(jwt);
+
+	/* a tampered signature */
+	char *t = apr_pstrdup(pool, s);
+	t[strlen(t) - 2] = (t[strlen(t) - 2] == 'A') ? 'B' : 'A';
+	TST_ASSERT_ERR("oidc_jwt_parse_header (tampered)",
+			oidc_jwt_parse_header(pool, t, &jwt, NULL, &err), pool, err);
+	TST_ASSERT_ERR("oidc_jwt_verify (tampered)",
+			oidc_jwt_verify(pool, jwt, keys, &err) == FALSE, pool, err);
+	oidc_jwt_destroy(jwt);
 	oidc_jwk_destroy(jwk);
 
 	s[5] = OIDC_CHAR_DOT;
@@ -1296,6 +1320,83 @@ static char * test_current_url(request_rec *r) {
 	return 0;
 }
 
+static char * test_regexp(request_rec *r) {
+	char *output = NULL;
+	char *error_str = NULL;
+
+	oidc_pcre_t *preg = oidc_pcre_compile(r->pool, "^(.*)@([^.]+)\\..+$",
+			&error_str);
+	TST_ASSERT("oidc_pcre_compile (1: valid)", preg != NULL);
+	TST_ASSERT("oidc_pcre_compile (2: invalid)",
+			oidc_pcre_compile(r->pool, "(", &error_str) == NULL);
+
+	TST_ASSERT("oidc_util_regexp_first_match_pcre",
+			oidc_util_regexp_first_match_pcre(r->pool, "joe@example.com", preg, &output, &error_str));
+	TST_ASSERT_STR("oidc_util_regexp_first_match_pcre", output, "joe");
+
+	TST_ASSERT("oidc_util_regexp_substitute_pcre",
+			oidc_util_regexp_substitute_pcre(r->pool, "joe@example.com", preg, "$2\\$1", &output, &error_str));
+	TST_ASSERT_STR("oidc_util_regexp_substitute_pcre", output, "example\\joe");
+
+	TST_ASSERT("oidc_util_regexp_first_match",
+			oidc_util_regexp_first_match(r->pool, "joe@example.com", "^([^@]+)", &output, &error_str));
+	TST_ASSERT_STR("oidc_util_regexp_first_match", output, "joe");
+
+	TST_ASSERT("oidc_pcre_match (1: match)", oidc_pcre_match(preg, "a@b.c"));
+	TST_ASSERT("oidc_pcre_match (2: no match)",
+			oidc_pcre_match(preg, "abc") == FALSE);
+
+	TST_ASSERT("oidc_util_regexp_get (1: uncached)",
+			oidc_util_regexp_get(r, "^a", &error_str) != NULL);
+	TST_ASSERT("oidc_util_regexp_cache_child_init",
+			oidc_util_regexp_cache_child_init(r->pool, r->server) == APR_SUCCESS);
+	TST_ASSERT("oidc_util_regexp_get (2: cached)",
+			oidc_util_regexp_get(r, "^a", &error_str) == oidc_util_regexp_get(r, "^a", &error_str));
+	error_str = NULL;
+	TST_ASSERT("oidc_util_regexp_get (3: invalid)",
+			oidc_util_regexp_get(r, "(", &error_str) == NULL);
+	TST_ASSERT("oidc_util_regexp_get (3: error)", error_str != NULL);
+
+	return 0;
+}
+
+static char * test_escape(request_rec *r) {
+
+	char *s = oidc_util_escape_string(r, "a b/c?d=e&f~g.h-i_j");
+	TST_ASSERT_STR("oidc_util_escape_string", s,
+			"a%20b%2Fc%3Fd%3De%26f~g.h-i_j");
+
+	s = oidc_util_unescape_string(r, "a+b%2Fc%3fd%zz%");
+	TST_ASSERT_STR("oidc_util_unescape_string", s, "a b/c?d%zz%");
+
+	return 0;
+}
+
+static char * test_msgpack(request_rec *r) {
+	json_t *json = json_pack("{s:s,s:i,s:i,s:I,s:b,s:n,s:f,s:[s,i],s:{s:s}}",
+			"sub", "a string that is longer than thirty-one characters", "exp",
+			1602676800, "neg", -1234, "big", (json_int_t) 1 << 40, "verified", 1,
+			"none", "real", 1.5, "groups", "a", 7, "address", "country", "NL");
+	json_t *result = NULL;
+	char *buf = NULL;
+	apr_size_t len = 0;
+
+	TST_ASSERT("oidc_util_msgpack_encode", oidc_util_msgpack_encode(r, json, &buf, &len));
+	TST_ASSERT("oidc_util_msgpack_decode (1)",
+			oidc_util_msgpack_decode(r, buf, len, &result));
+	TST_ASSERT("oidc_util_msgpack_decode (1: equal)", json_equal(json, result));
+	json_decref(result);
+
+	TST_ASSERT("oidc_util_msgpack_decode (2: truncated)",
+			oidc_util_msgpack_decode(r, buf, len - 1, &result) == FALSE);
+	TST_ASSERT("oidc_util_msgpack_decode (3: not an object)",
+			oidc_util_msgpack_decode(r, "\x93\x01\x02\x03", 4, &result) == FALSE);
+
+	json_decref(json);
+
+	return 0;
+}
+
 static char * test_accept(request_rec *r) {
 
 	// ie 9/10/11
@@ -1366,6 +1467,98 @@ static char * test_accept(request_rec *r) {
 	return 0;
 }
 
+static char * test_app_infos(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	apr_table_t *headers_in = r->headers_in;
+	json_t *claims = json_pack("{s:s,s:[s,s,b],s:i,s:s}", "sub", "joe",
+			"groups", "a", "b", 1, "n", 5, "e mail", "joe@example.com");
+
+	/* all claims, prefixed and normalized */
+	r->headers_in = apr_table_make(r->pool, 8);
+	oidc_util_set_app_infos(r, claims, "OIDC_CLAIM_", ",", TRUE, FALSE);
+	TST_ASSERT_STR("app_infos (sub)",
+			apr_table_get(r->headers_in, "OIDC_CLAIM_sub"), "joe");
+	TST_ASSERT_STR("app_infos (groups)",
+			apr_table_get(r->headers_in, "OIDC_CLAIM_groups"), "a,b,1");
+	TST_ASSERT_STR("app_infos (n)",
+			apr_table_get(r->headers_in, "OIDC_CLAIM_n"), "5");
+	TST_ASSERT_STR("app_infos (e-mail)",
+			apr_table_get(r->headers_in, "OIDC_CLAIM_e-mail"),
+			"joe@example.com");
+
+	/* the memoized name for a different prefix */
+	TST_ASSERT_STR("oidc_util_app_info_name",
+			oidc_util_app_info_name(r, "X_", "e mail"), "X_e-mail");
+
+	/* only the configured claims, optionally under an explicit name */
+	cfg->pass_claim_names = apr_hash_make(r->pool);
+	apr_hash_set(cfg->pass_claim_names, "sub", APR_HASH_KEY_STRING, "X-User");
+	apr_hash_set(cfg->pass_claim_names, "groups", APR_HASH_KEY_STRING, "");
+	apr_hash_set(cfg->pass_claim_names, "absent", APR_HASH_KEY_STRING, "");
+	r->headers_in = apr_table_make(r->pool, 8);
+	oidc_util_set_app_infos(r, claims, "OIDC_CLAIM_", ",", TRUE, FALSE);
+	TST_ASSERT_STR("app_infos allow-list (X-User)",
+			apr_table_get(r->headers_in, "X-User"), "joe");
+	TST_ASSERT_STR("app_infos allow-list (groups)",
+			apr_table_get(r->headers_in, "OIDC_CLAIM_groups"), "a,b,1");
+	TST_ASSERT("app_infos allow-list (n)",
+			apr_table_get(r->headers_in, "OIDC_CLAIM_n") == NULL);
+	TST_ASSERT_LONG("app_infos allow-list (count)",
+			(long )apr_table_elts(r->headers_in)->nelts, 2L);
+
+	/* scrub the prefixed headers and the explicitly named ones */
+	r->headers_in = apr_table_make(r->pool, 8);
+	apr_table_set(r->headers_in, "OIDC_CLAIM_sub", "evil");
+	apr_table_set(r->headers_in, "oidc-claim-groups", "evil");
+	apr_table_set(r->headers_in, "x_user", "evil");
+	apr_table_set(r->headers_in, "Accept", "text/html");
+	oidc_scrub_headers(r);
+	TST_ASSERT_LONG("oidc_scrub_headers (count)",
+			(long )apr_table_elts(r->headers_in)->nelts, 1L);
+	TST_ASSERT_STR("oidc_scrub_headers (Accept)",
+			apr_table_get(r->headers_in, "Accept"), "text/html");
+
+	cfg->pass_claim_names = NULL;
+	r->headers_in = headers_in;
+	json_decref(claims);
+
+	return 0;
+}
+
+static char * test_request_state_json(request_rec *r) {
+	json_t *json = NULL, *seeded = json_pack("{s:s}", "sub", "jane");
+
+	oidc_request_state_set(r, OIDC_REQUEST_STATE_KEY_CLAIMS,
+			"{\"sub\":\"joe\"}");
+	json = oidc_request_state_get_json(r, OIDC_REQUEST_STATE_KEY_CLAIMS);
+	TST_ASSERT("oidc_request_state_get_json (1)", json != NULL);
+	TST_ASSERT_STR("oidc_request_state_get_json (sub)",
+			json_string_value(json_object_get(json, "sub")), "joe");
+	TST_ASSERT("oidc_request_state_get_json (parsed once)",
+			oidc_request_state_get_json(r, OIDC_REQUEST_STATE_KEY_CLAIMS) == json);
+
+	/* a new value invalidates the parsed object */
+	oidc_request_state_set(r, OIDC_REQUEST_STATE_KEY_CLAIMS,
+			"{\"sub\":\"john\"}");
+	json = oidc_request_state_get_json(r, OIDC_REQUEST_STATE_KEY_CLAIMS);
+	TST_ASSERT_STR("oidc_request_state_get_json (new value)",
+			json_string_value(json_object_get(json, "sub")), "john");
+
+	oidc_request_state_set_json(r, OIDC_REQUEST_STATE_KEY_CLAIMS,
+			"{\"sub\":\"jane\"}", seeded);
+	TST_ASSERT("oidc_request_state_set_json",
+			oidc_request_state_get_json(r, OIDC_REQUEST_STATE_KEY_CLAIMS) == seeded);
+	json_decref(seeded);
+
+	oidc_request_state_set(r, OIDC_REQUEST_STATE_KEY_CLAIMS, "invalid");
+	TST_ASSERT("oidc_request_state_get_json (invalid)",
+			oidc_request_state_get_json(r, OIDC_REQUEST_STATE_KEY_CLAIMS) == NULL);
+	oidc_request_state_set(r, OIDC_REQUEST_STATE_KEY_CLAIMS, "{}");
+
+	return 0;
+}
+
 #if MODULE_MAGIC_NUMBER_MAJOR >= 20100714
 
 static char * test_authz_worker(request_rec *r) {
@@ -1486,6 +1679,1129 @@ static char * test_authz_worker(request_rec *r) {
 
 #endif
 
+static char * test_cache_shm(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	void *cache_cfg = cfg->cache_cfg;
+	apr_array_header_t *slabs = cfg->cache_shm_slabs;
+	apr_hash_t *quota = cfg->cache_shm_quota;
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	oidc_cache_shm_stats_t stats;
+	const char *value = NULL;
+	char *large = NULL;
+
+	TST_ASSERT("oidc_parse_cache_shm_slab (1)",
+			oidc_parse_cache_shm_slab(r->pool, "256", &cfg->cache_shm_slabs) != NULL);
+	TST_ASSERT("oidc_parse_cache_shm_slab (2)",
+			oidc_parse_cache_shm_slab(r->pool, "256:64", &cfg->cache_shm_slabs) == NULL);
+	TST_ASSERT("oidc_parse_cache_shm_section_quota (1)",
+			oidc_parse_cache_shm_section_quota(r->pool, "bogus", "1", &cfg->cache_shm_quota) != NULL);
+	TST_ASSERT("oidc_parse_cache_shm_section_quota (2)",
+			oidc_parse_cache_shm_section_quota(r->pool, "nonce", "1", &cfg->cache_shm_quota) == NULL);
+
+	cfg->cache_cfg = NULL;
+	TST_ASSERT("post_config", oidc_cache_shm.post_config(r->server) == OK);
+
+	TST_ASSERT("set (1: small)",
+			oidc_cache_shm.set(r, OIDC_CACHE_SECTION_SID, "sid1", "small", expiry));
+	TST_ASSERT("get (1: small)",
+			oidc_cache_shm.get(r, OIDC_CACHE_SECTION_SID, "sid1", &value));
+	TST_ASSERT_STR("value (1: small)", value, "small");
+
+	large = apr_pcalloc(r->pool, 1025);
+	memset(large, 'x', 1024);
+	TST_ASSERT("set (2: large)",
+			oidc_cache_shm.set(r, OIDC_CACHE_SECTION_SID, "sid1", large, expiry));
+	TST_ASSERT("get (2: large)",
+			oidc_cache_shm.get(r, OIDC_CACHE_SECTION_SID, "sid1", &value));
+	TST_ASSERT_STR("value (2: large)", value, large);
+
+	TST_ASSERT("set (3: delete)",
+			oidc_cache_shm.set(r, OIDC_CACHE_SECTION_SID, "sid1", NULL, 0));
+	TST_ASSERT("get (3: delete)",
+			oidc_cache_shm.get(r, OIDC_CACHE_SECTION_SID, "sid1", &value));
+	TST_ASSERT_STR("value (3: delete)", value, NULL);
+
+	TST_ASSERT("set (4: expired)",
+			oidc_cache_shm.set(r, OIDC_CACHE_SECTION_SID, "sid1", "small", apr_time_now() - 1));
+	TST_ASSERT("get (4: expired)",
+			oidc_cache_shm.get(r, OIDC_CACHE_SECTION_SID, "sid1", &value));
+	TST_ASSERT_STR("value (4: expired)", value, NULL);
+
+	TST_ASSERT("set (5: quota)",
+			oidc_cache_shm.set(r, OIDC_CACHE_SECTION_NONCE, "nonce1", "small", expiry));
+	TST_ASSERT("set (6: quota evict)",
+			oidc_cache_shm.set(r, OIDC_CACHE_SECTION_NONCE, "nonce2", "small", expiry));
+	TST_ASSERT("get (6: quota evict)",
+			oidc_cache_shm.get(r, OIDC_CACHE_SECTION_NONCE, "nonce2", &value));
+	TST_ASSERT_STR("value (6: quota evict)", value, "small");
+	TST_ASSERT("set (7: quota replace)",
+			oidc_cache_shm.set(r, OIDC_CACHE_SECTION_NONCE, "nonce1", "other", expiry));
+	TST_ASSERT("get (7: quota replace)",
+			oidc_cache_shm.get(r, OIDC_CACHE_SECTION_NONCE, "nonce1", &value));
+	TST_ASSERT_STR("value (7: quota replace)", value, "other");
+	TST_ASSERT("set (8: quota move to larger class)",
+			oidc_cache_shm.set(r, OIDC_CACHE_SECTION_NONCE, "nonce1", large, expiry));
+	TST_ASSERT("get (8: quota move to larger class)",
+			oidc_cache_shm.get(r, OIDC_CACHE_SECTION_NONCE, "nonce1", &value));
+	TST_ASSERT_STR("value (8: quota move to larger class)", value, large);
+
+	TST_ASSERT("oidc_cache_shm_stats", oidc_cache_shm_stats(r->server, &stats));
+	TST_ASSERT_LONG("stats.lookups", (long )stats.lookups, 7L);
+	TST_ASSERT_LONG("stats.hits", (long )stats.hits, 5L);
+	/* making room for nonce2 (6) evicts at most a single entry; (7) and (8) replace nonce1 itself */
+	TST_ASSERT("stats.evictions", stats.evictions <= 1);
+
+	oidc_cache_shm.destroy(r->server);
+	cfg->cache_cfg = cache_cfg;
+	cfg->cache_shm_slabs = slabs;
+	cfg->cache_shm_quota = quota;
+
+	return 0;
+}
+
+static char * test_cache_replay(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	int entries = cfg->replay_cache_entries;
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	char *id = NULL;
+	int i;
+
+	TST_ASSERT("oidc_parse_replay_cache_entries (1)",
+			oidc_parse_replay_cache_entries(r->pool, "-1", &cfg->replay_cache_entries) != NULL);
+	TST_ASSERT("oidc_parse_replay_cache_entries (2)",
+			oidc_parse_replay_cache_entries(r->pool, "8", &cfg->replay_cache_entries) == NULL);
+
+	cfg->replay_cache_cfg = NULL;
+	TST_ASSERT("post_config",
+			oidc_cache_replay_post_config(r->server) == OK);
+	TST_ASSERT("replay_cache_cfg", cfg->replay_cache_cfg != NULL);
+
+	TST_ASSERT("exists (1: unknown)",
+			oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_JTI, "jti1") == FALSE);
+	TST_ASSERT("add (1)",
+			oidc_cache_replay_add(r, OIDC_CACHE_SECTION_JTI, "jti1", expiry));
+	TST_ASSERT("exists (1: added)",
+			oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_JTI, "jti1"));
+	TST_ASSERT("exists (2: other section)",
+			oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_NONCE, "jti1") == FALSE);
+
+	TST_ASSERT("add (3: expired)",
+			oidc_cache_replay_add(r, OIDC_CACHE_SECTION_NONCE, "nonce1", apr_time_now() - 1));
+	TST_ASSERT("exists (3: expired)",
+			oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_NONCE, "nonce1") == FALSE);
+
+	/* beyond the horizon of the time wheel */
+	TST_ASSERT("add (4: far expiry)",
+			oidc_cache_replay_add(r, OIDC_CACHE_SECTION_NONCE, "nonce2", apr_time_now() + apr_time_from_sec(86400)));
+	TST_ASSERT("exists (4: far expiry)",
+			oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_NONCE, "nonce2"));
+
+	/* IDs that don't fit in the single full bucket go to the regular cache and are never dropped */
+	for (i = 0; i < 16; i++) {
+		id = apr_psprintf(r->pool, "jti-%d", i);
+		TST_ASSERT("add (5: overflow)",
+				oidc_cache_replay_add(r, OIDC_CACHE_SECTION_JTI, id, expiry + apr_time_from_sec(i + 1)));
+	}
+	for (i = 0; i < 16; i++) {
+		id = apr_psprintf(r->pool, "jti-%d", i);
+		TST_ASSERT("exists (5: overflow)",
+				oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_JTI, id));
+	}
+	TST_ASSERT("exists (5: first)",
+			oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_JTI, "jti1"));
+	TST_ASSERT("exists (5: unknown)",
+			oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_JTI, "jti-16") == FALSE);
+
+	oidc_cache_replay_destroy(r->server);
+	cfg->replay_cache_cfg = NULL;
+
+	/* without a dedicated store the regular cache is used */
+	TST_ASSERT("add (6: fallback)",
+			oidc_cache_replay_add(r, OIDC_CACHE_SECTION_JTI, "jti2", expiry));
+	TST_ASSERT("exists (6: fallback)",
+			oidc_cache_replay_exists(r, OIDC_CACHE_SECTION_JTI, "jti2"));
+
+	cfg->replay_cache_entries = entries;
+
+	return 0;
+}
+
+static char * test_metrics(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	apr_time_t start = apr_time_now();
+	char *value = NULL;
+	char *metrics = NULL;
+	const char *handler = r->handler;
+
+	TST_ASSERT("oidc_metrics_prometheus (disabled)",
+			oidc_metrics_prometheus(r) == NULL);
+	TST_ASSERT("oidc_metrics_handler (other handler)",
+			oidc_metrics_handler(r) == DECLINED);
+	r->handler = OIDC_METRICS_HANDLER;
+	TST_ASSERT("oidc_metrics_handler (disabled)",
+			oidc_metrics_handler(r) == HTTP_NOT_FOUND);
+	r->handler = handler;
+
+	cfg->metrics = 1;
+	TST_ASSERT("oidc_metrics_post_config",
+			oidc_metrics_post_config(r->pool, r->server));
+
+	oidc_metrics_http(r, OIDC_METRICS_HTTP_TOKEN, start, FALSE);
+	oidc_metrics_jwt_verify(r, "RS256", start, FALSE);
+	oidc_metrics_session(r, OIDC_METRICS_SESSION_OP_SAVE, start);
+	oidc_metrics_session_size(r, OIDC_METRICS_SESSION_OP_SAVE, 100);
+	oidc_cache_set(r, OIDC_CACHE_SECTION_NONCE, "metrics", "value", expiry);
+	oidc_cache_get(r, OIDC_CACHE_SECTION_NONCE, "metrics", &value);
+	oidc_cache_get(r, OIDC_CACHE_SECTION_NONCE, "unknown", &value);
+
+	metrics = oidc_metrics_prometheus(r);
+	TST_ASSERT("oidc_metrics_prometheus (enabled)", metrics != NULL);
+	TST_ASSERT("http duration",
+			strstr(metrics, "oidc_http_request_duration_seconds_count{type=\"token\"} 1\n") != NULL);
+	TST_ASSERT("http errors",
+			strstr(metrics, "oidc_http_request_errors_total{type=\"token\"} 1\n") != NULL);
+	TST_ASSERT("http other types",
+			strstr(metrics, "type=\"userinfo\"") == NULL);
+	TST_ASSERT("jwt errors",
+			strstr(metrics, "oidc_jwt_verify_errors_total{alg=\"RS256\"} 1\n") != NULL);
+	TST_ASSERT("session duration",
+			strstr(metrics, "oidc_session_duration_seconds_bucket{op=\"save\",le=\"+Inf\"} 1\n") != NULL);
+	TST_ASSERT("session size",
+			strstr(metrics, "oidc_session_size_bytes_sum{op=\"save\"} 100.000000\n") != NULL);
+	TST_ASSERT("cache set",
+			strstr(metrics, "oidc_cache_operations_total{backend=\"shm\",section=\"nonce\",result=\"ok\"} 1\n") != NULL);
+	TST_ASSERT("cache hit",
+			strstr(metrics, "oidc_cache_operations_total{backend=\"shm\",section=\"nonce\",result=\"hit\"} 1\n") != NULL);
+	TST_ASSERT("cache miss",
+			strstr(metrics, "oidc_cache_operations_total{backend=\"shm\",section=\"nonce\",result=\"miss\"} 1\n") != NULL);
+	TST_ASSERT("cache get duration",
+			strstr(metrics, "oidc_cache_operation_duration_seconds_count{backend=\"shm\",section=\"nonce\",op=\"get\"} 2\n") != NULL);
+
+	TST_ASSERT("note oidc-http-usec",
+			apr_table_get(r->notes, "oidc-http-usec") != NULL);
+	TST_ASSERT("note oidc-cache-usec",
+			apr_table_get(r->notes, "oidc-cache-usec") != NULL);
+
+	return 0;
+}
+
+static char * test_crypto_passphrase(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	json_t *payload = json_pack("{s:s}", "sub", "stef");
+	json_t *result = NULL;
+	char *value = NULL;
+	char *jwt = NULL;
+
+	/* values created with keys derived per request */
+	TST_ASSERT("oidc_cache_set (1: per request)",
+			oidc_cache_set(r, OIDC_CACHE_SECTION_SID, "sid1", "value1", expiry));
+	TST_ASSERT("oidc_util_jwt_create (1: per request)",
+			oidc_util_jwt_create(r, cfg->crypto_passphrase, payload, &jwt));
+
+	/* must be readable with keys derived at startup */
+	TST_ASSERT("oidc_util_crypto_passphrase_post_config",
+			oidc_util_crypto_passphrase_post_config(r->pool, r->server));
+	TST_ASSERT("oidc_cache_crypto_post_config",
+			oidc_cache_crypto_post_config(r->pool, r->server));
+	TST_ASSERT("oidc_cache_get (2: derived)",
+			oidc_cache_get(r, OIDC_CACHE_SECTION_SID, "sid1", &value));
+	TST_ASSERT_STR("value (2: derived)", value, "value1");
+	TST_ASSERT("oidc_util_jwt_verify (2: derived)",
+			oidc_util_jwt_verify(r, cfg->crypto_passphrase, jwt, &result));
+	TST_ASSERT_STR("sub (2: derived)",
+			json_string_value(json_object_get(result, "sub")), "stef");
+	json_decref(result);
+
+	/* and vice versa */
+	TST_ASSERT("oidc_cache_set (3: derived)",
+			oidc_cache_set(r, OIDC_CACHE_SECTION_SID, "sid1", "value3", expiry));
+	TST_ASSERT("oidc_util_jwt_create (3: derived)",
+			oidc_util_jwt_create(r, cfg->crypto_passphrase, payload, &jwt));
+	cfg->crypto_passphrase_jwk = NULL;
+	cfg->cache_crypto = NULL;
+	value = NULL;
+	TST_ASSERT("oidc_cache_get (4: per request)",
+			oidc_cache_get(r, OIDC_CACHE_SECTION_SID, "sid1", &value));
+	TST_ASSERT_STR("value (4: per request)", value, "value3");
+	TST_ASSERT("oidc_util_jwt_verify (4: per request)",
+			oidc_util_jwt_verify(r, cfg->crypto_passphrase, jwt, &result));
+	json_decref(result);
+
+	oidc_cache_set(r, OIDC_CACHE_SECTION_SID, "sid1", NULL, 0);
+	json_decref(payload);
+
+	return 0;
+}
+
+static char * test_state_cookie(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	const char *prefix = oidc_cfg_dir_state_cookie_prefix(r);
+	const char *name = apr_psprintf(r->pool, "%sabc", prefix);
+	const char *cookies = apr_table_get(r->headers_in, "Cookie");
+	int state_timeout = cfg->state_timeout;
+	apr_time_t now = apr_time_now();
+	apr_time_t ts = 0;
+	const char *encrypted = NULL, *s_ts = NULL, *set_cookie = NULL;
+	unsigned char key[EVP_MAX_MD_SIZE], mac[EVP_MAX_MD_SIZE];
+	unsigned int key_len = 0, mac_len = 0;
+	char *value = NULL, *expected = NULL, *legacy = NULL;
+	oidc_proto_state_t *proto_state = NULL;
+	int n = 0;
+
+	/* the MAC is keyed with HMAC-SHA256(passphrase, "state-cookie-mac"), not with the passphrase itself */
+	s_ts = apr_psprintf(r->pool, "%" APR_TIME_T_FMT, apr_time_sec(now));
+	HMAC(EVP_sha256(), cfg->crypto_passphrase, strlen(cfg->crypto_passphrase),
+			(const unsigned char *) "state-cookie-mac", strlen("state-cookie-mac"),
+			key, &key_len);
+	value = apr_psprintf(r->pool, "%s.%s", name, s_ts);
+	HMAC(EVP_sha256(), key, key_len, (const unsigned char *) value,
+			strlen(value), mac, &mac_len);
+	oidc_base64url_encode(r, &expected, (const char *) mac, 16, TRUE);
+	expected = apr_psprintf(r->pool, "%s.%s.%s", s_ts, expected, "eyJenc");
+
+	value = oidc_state_cookie_value(r, cfg, name, now, "eyJenc");
+	TST_ASSERT_STR("oidc_state_cookie_value", value, expected);
+	TST_ASSERT("oidc_state_cookie_parse (1)",
+			oidc_state_cookie_parse(r, cfg, name, value, &ts, &encrypted));
+	TST_ASSERT_LONG("oidc_state_cookie_parse (1: timestamp)",
+			(long )apr_time_sec(ts), (long )apr_time_sec(now));
+	TST_ASSERT_STR("oidc_state_cookie_parse (1: encrypted)", encrypted,
+			"eyJenc");
+
+	/* a tampered timestamp or a value moved to another cookie is rejected */
+	value = apr_psprintf(r->pool, "%" APR_TIME_T_FMT "%s",
+			apr_time_sec(now) + 3600, value + strlen(s_ts));
+	TST_ASSERT("oidc_state_cookie_parse (2: tampered timestamp)",
+			oidc_state_cookie_parse(r, cfg, name, value, &ts, &encrypted) == FALSE);
+	value = oidc_state_cookie_value(r, cfg, name, now, "eyJenc");
+	TST_ASSERT("oidc_state_cookie_parse (3: other cookie)",
+			oidc_state_cookie_parse(r, cfg, apr_psprintf(r->pool, "%sdef", prefix), value, &ts, &encrypted) == FALSE);
+
+	/* a cookie created by an older version has no MAC but is decrypted to get its timestamp */
+	proto_state = oidc_proto_state_new();
+	oidc_proto_state_set_nonce(proto_state, "nonce");
+	oidc_proto_state_set_timestamp_now(proto_state);
+	legacy = oidc_proto_state_to_cookie(r, cfg, proto_state);
+	oidc_proto_state_destroy(proto_state);
+	TST_ASSERT("oidc_state_cookie_parse (4: legacy)",
+			oidc_state_cookie_parse(r, cfg, name, legacy, &ts, &encrypted) == FALSE);
+
+	apr_table_set(r->headers_in, "Cookie",
+			apr_psprintf(r->pool, "%sold=%s; %s=%s", prefix, legacy, name, value));
+	apr_table_clear(r->err_headers_out);
+	n = oidc_clean_expired_state_cookies(r, cfg, NULL, 0);
+	TST_ASSERT_LONG("oidc_clean_expired_state_cookies (4: valid)", (long )n,
+			2L);
+	TST_ASSERT("oidc_clean_expired_state_cookies (4: kept)",
+			apr_table_get(r->err_headers_out, "Set-Cookie") == NULL);
+
+	/* and both are deleted once they've expired */
+	cfg->state_timeout = -1;
+	n = oidc_clean_expired_state_cookies(r, cfg, NULL, 0);
+	TST_ASSERT_LONG("oidc_clean_expired_state_cookies (5: expired)", (long )n,
+			0L);
+	set_cookie = apr_table_get(r->err_headers_out, "Set-Cookie");
+	TST_ASSERT("oidc_clean_expired_state_cookies (5: legacy deleted)",
+			(set_cookie != NULL) && (strstr(set_cookie, apr_psprintf(r->pool, "%sold=;", prefix)) == set_cookie));
+
+	cfg->state_timeout = state_timeout;
+	apr_table_clear(r->err_headers_out);
+	apr_table_set(r->headers_in, "Cookie", cookies);
+
+	return 0;
+}
+
+static char * test_cache_index(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_cache_index_update_function index_update = cfg->cache->index_update;
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	apr_array_header_t *members = NULL;
+	apr_time_t index_expiry = 0;
+	char *value = NULL;
+	int i;
+	oidc_cache_entry_t add[] = {
+			{ OIDC_CACHE_SECTION_SID, "sid1", "uuid1", expiry },
+			{ OIDC_CACHE_SECTION_SID, "sid1", "uuid2", expiry + apr_time_from_sec(60) },
+			{ OIDC_CACHE_SECTION_SUB, "sub1", "uuid1", expiry } };
+	oidc_cache_entry_t remove[] = {
+			{ OIDC_CACHE_SECTION_SID, "sid1", "uuid1", 0 } };
+	oidc_cache_entry_t expired[] = {
+			{ OIDC_CACHE_SECTION_SID, "sid1", "uuid3", apr_time_now() - 1 } };
+	oidc_cache_entry_t drop[] = {
+			{ OIDC_CACHE_SECTION_SID, "sid1", NULL, 0 },
+			{ OIDC_CACHE_SECTION_SUB, "sub1", NULL, 0 } };
+
+	/* index values */
+	value = oidc_cache_index_value_update(r->pool, "uuid0", "uuid1", expiry, &index_expiry);
+	TST_ASSERT_STR("oidc_cache_index_value_update (1: earlier value dropped)", value,
+			apr_psprintf(r->pool, "uuid1:%" APR_TIME_T_FMT, apr_time_sec(expiry)));
+	TST_ASSERT("index_expiry (1)", index_expiry == expiry);
+	members = oidc_cache_index_value_members(r->pool, "uuid0");
+	TST_ASSERT_LONG("oidc_cache_index_value_members (2: earlier value)", (long )members->nelts, 1L);
+	TST_ASSERT_STR("member (2)", APR_ARRAY_IDX(members, 0, const char *), "uuid0");
+	value = oidc_cache_index_value_update(r->pool, value, "uuid1", 0, &index_expiry);
+	TST_ASSERT_STR("oidc_cache_index_value_update (3: removed)", value, NULL);
+
+	/* native and regular value based indexes */
+	for (i = 0; i < 2; i++) {
+		if (i == 1)
+			cfg->cache->index_update = NULL;
+
+		TST_ASSERT("oidc_cache_index_update (4: add)",
+				oidc_cache_index_update(r, add, 3));
+		TST_ASSERT("oidc_cache_index_update (4: add again)",
+				oidc_cache_index_update(r, add, 1));
+		TST_ASSERT("oidc_cache_index_get (4)",
+				oidc_cache_index_get(r, OIDC_CACHE_SECTION_SID, "sid1", &members));
+		TST_ASSERT_LONG("members (4)", (long )members->nelts, 2L);
+		TST_ASSERT("oidc_cache_index_get (5: sub)",
+				oidc_cache_index_get(r, OIDC_CACHE_SECTION_SUB, "sub1", &members));
+		TST_ASSERT_LONG("members (5: sub)", (long )members->nelts, 1L);
+		TST_ASSERT_STR("member (5: sub)", APR_ARRAY_IDX(members, 0, const char *), "uuid1");
+
+		TST_ASSERT("oidc_cache_index_update (6: remove)",
+				oidc_cache_index_update(r, remove, 1));
+		TST_ASSERT("oidc_cache_index_update (6: expired)",
+				oidc_cache_index_update(r, expired, 1));
+		TST_ASSERT("oidc_cache_index_get (6)",
+				oidc_cache_index_get(r, OIDC_CACHE_SECTION_SID, "sid1", &members));
+		TST_ASSERT_LONG("members (6)", (long )members->nelts, 1L);
+		TST_ASSERT_STR("member (6)", APR_ARRAY_IDX(members, 0, const char *), "uuid2");
+
+		TST_ASSERT("oidc_cache_index_update (7: drop)",
+				oidc_cache_index_update(r, drop, 2));
+		TST_ASSERT("oidc_cache_index_get (7)",
+				oidc_cache_index_get(r, OIDC_CACHE_SECTION_SID, "sid1", &members));
+		TST_ASSERT_LONG("members (7)", (long )members->nelts, 0L);
+	}
+	cfg->cache->index_update = index_update;
+
+	/* remove the sessions found in an index together with the index */
+	oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION, "uuid1", "session1", expiry);
+	oidc_cache_index_update(r, add, 2);
+	oidc_cache_index_get(r, OIDC_CACHE_SECTION_SID, "sid1", &members);
+	TST_ASSERT("oidc_session_kill_cache_multi (8)",
+			oidc_session_kill_cache_multi(r, members, OIDC_CACHE_SECTION_SID, "sid1"));
+	TST_ASSERT("oidc_cache_get (8: session)",
+			oidc_cache_get(r, OIDC_CACHE_SECTION_SESSION, "uuid1", &value));
+	TST_ASSERT_STR("value (8: session)", value, NULL);
+	TST_ASSERT("oidc_cache_index_get (8)",
+			oidc_cache_index_get(r, OIDC_CACHE_SECTION_SID, "sid1", &members));
+	TST_ASSERT_LONG("members (8)", (long )members->nelts, 0L);
+
+	return 0;
+}
+
+static char * test_cache_l1(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	char *value = NULL;
+
+	TST_ASSERT("oidc_parse_cache_l1_section (1: session)",
+			oidc_parse_cache_l1_section(r->pool, "session", "10", &cfg->cache_l1_sections) != NULL);
+	TST_ASSERT("oidc_parse_cache_l1_section (1: access_token)",
+			oidc_parse_cache_l1_section(r->pool, "access_token", "10", &cfg->cache_l1_sections) != NULL);
+	TST_ASSERT("oidc_parse_cache_l1_section (1: jti)",
+			oidc_parse_cache_l1_section(r->pool, "jti", "10", &cfg->cache_l1_sections) != NULL);
+	TST_ASSERT("oidc_parse_cache_l1_section (2: provider)",
+			oidc_parse_cache_l1_section(r->pool, "provider", "10", &cfg->cache_l1_sections) == NULL);
+	TST_ASSERT("oidc_cache_l1_child_init",
+			oidc_cache_l1_child_init(r->pool, r->server) == APR_SUCCESS);
+
+	TST_ASSERT("oidc_cache_set (1)",
+			oidc_cache_set(r, OIDC_CACHE_SECTION_PROVIDER, "issuer", "metadata1", expiry));
+
+	/* change the backend behind the back of the L1 cache */
+	TST_ASSERT("oidc_cache_set (2: other section)",
+			oidc_cache_set(r, OIDC_CACHE_SECTION_SID, "issuer", "other", expiry));
+	cfg->cache->set(r, OIDC_CACHE_SECTION_PROVIDER, "issuer", NULL, 0);
+	TST_ASSERT("oidc_cache_get (2: L1 hit)",
+			oidc_cache_get(r, OIDC_CACHE_SECTION_PROVIDER, "issuer", &value));
+	TST_ASSERT_STR("value (2: L1 hit)", value, "metadata1");
+
+	/* writes go through */
+	TST_ASSERT("oidc_cache_set (3: delete)",
+			oidc_cache_set(r, OIDC_CACHE_SECTION_PROVIDER, "issuer", NULL, 0));
+	value = NULL;
+	TST_ASSERT("oidc_cache_get (3: delete)",
+			oidc_cache_get(r, OIDC_CACHE_SECTION_PROVIDER, "issuer", &value));
+	TST_ASSERT_STR("value (3: delete)", value, NULL);
+
+	oidc_cache_set(r, OIDC_CACHE_SECTION_SID, "issuer", NULL, 0);
+	cfg->cache_l1_sections = NULL;
+
+	return 0;
+}
+
+static char * test_cache_multi(request_rec *r) {
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	char *value = NULL;
+	oidc_cache_entry_t set[] = {
+			{ OIDC_CACHE_SECTION_SESSION, "uuid1", "session1", expiry },
+			{ OIDC_CACHE_SECTION_SID, "sid1", "uuid1", expiry } };
+	oidc_cache_entry_t get[] = {
+			{ OIDC_CACHE_SECTION_SESSION, "uuid1", NULL, 0 },
+			{ OIDC_CACHE_SECTION_SID, "sid1", NULL, 0 },
+			{ OIDC_CACHE_SECTION_SID, "sid2", NULL, 0 } };
+	oidc_cache_entry_t del[] = {
+			{ OIDC_CACHE_SECTION_SESSION, "uuid1", NULL, 0 },
+			{ OIDC_CACHE_SECTION_SID, "sid1", NULL, 0 } };
+
+	TST_ASSERT("oidc_cache_set_multi (1)", oidc_cache_set_multi(r, set, 2));
+	TST_ASSERT("oidc_cache_get_multi (1)", oidc_cache_get_multi(r, get, 3));
+	TST_ASSERT_STR("value (1: session)", get[0].value, "session1");
+	TST_ASSERT_STR("value (1: sid)", get[1].value, "uuid1");
+	TST_ASSERT_STR("value (1: miss)", get[2].value, NULL);
+
+	/* entries are encrypted one by one, so they must be readable on their own */
+	TST_ASSERT("oidc_cache_get (2)",
+			oidc_cache_get(r, OIDC_CACHE_SECTION_SID, "sid1", &value));
+	TST_ASSERT_STR("value (2)", value, "uuid1");
+
+	TST_ASSERT("oidc_cache_set_multi (3: delete)", oidc_cache_set_multi(r, del, 2));
+	TST_ASSERT("oidc_cache_get_multi (3: delete)", oidc_cache_get_multi(r, get, 2));
+	TST_ASSERT_STR("value (3: session)", get[0].value, NULL);
+	TST_ASSERT_STR("value (3: sid)", get[1].value, NULL);
+
+	return 0;
+}
+
+static char * test_cache_touch(request_rec *r) {
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	char *value = NULL;
+	oidc_session_t z = { { 0 } };
+
+	TST_ASSERT("oidc_cache_touch (1: miss)",
+			oidc_cache_touch(r, OIDC_CACHE_SECTION_SESSION, "uuid2", expiry) == FALSE);
+	TST_ASSERT("oidc_cache_set (2)",
+			oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION, "uuid2", "session2", apr_time_now() + apr_time_from_sec(1)));
+	TST_ASSERT("oidc_cache_touch (2: hit)",
+			oidc_cache_touch(r, OIDC_CACHE_SECTION_SESSION, "uuid2", expiry) == TRUE);
+	TST_ASSERT("oidc_cache_get (2)",
+			oidc_cache_get(r, OIDC_CACHE_SECTION_SESSION, "uuid2", &value));
+	TST_ASSERT_STR("value (2)", value, "session2");
+	oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION, "uuid2", NULL, 0);
+
+	/* only actual modifications make a session dirty */
+	oidc_session_set(r, &z, "k", "v");
+	TST_ASSERT("oidc_session_set (3: new)", z.dirty == TRUE);
+	z.dirty = FALSE;
+	oidc_session_set(r, &z, "k", "v");
+	TST_ASSERT("oidc_session_set (4: same)", z.dirty == FALSE);
+	oidc_session_set(r, &z, "x", NULL);
+	TST_ASSERT("oidc_session_set (5: delete non-existing)", z.dirty == FALSE);
+	oidc_session_set(r, &z, "k", NULL);
+	TST_ASSERT("oidc_session_set (6: delete)", z.dirty == TRUE);
+	oidc_session_free(r, &z);
+
+	return 0;
+}
+
+static char * test_cache_lease(request_rec *r) {
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+
+	TST_ASSERT("oidc_cache_lease_acquire (1)",
+			oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_ACCESS_TOKEN, "token1", expiry) == TRUE);
+	TST_ASSERT("oidc_cache_lease_acquire (2: held)",
+			oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_ACCESS_TOKEN, "token1", expiry) == FALSE);
+	TST_ASSERT("oidc_cache_lease_acquire (3: other key)",
+			oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_ACCESS_TOKEN, "token2", expiry) == TRUE);
+	oidc_cache_lease_release(r, OIDC_CACHE_SECTION_ACCESS_TOKEN, "token1");
+	TST_ASSERT("oidc_cache_lease_acquire (4: released)",
+			oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_ACCESS_TOKEN, "token1", expiry) == TRUE);
+
+	oidc_cache_lease_release(r, OIDC_CACHE_SECTION_ACCESS_TOKEN, "token1");
+	oidc_cache_lease_release(r, OIDC_CACHE_SECTION_ACCESS_TOKEN, "token2");
+
+	return 0;
+}
+
+static char * test_refresh_defer(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	oidc_session_t session;
+	request_rec *r2 = apr_pmemdup(r->pool, r, sizeof(request_rec));
+	request_rec *r3 = apr_pmemdup(r->pool, r, sizeof(request_rec));
+	apr_pool_create(&r2->pool, r->pool);
+	apr_pool_create(&r3->pool, r->pool);
+
+	memset(&session, 0, sizeof(oidc_session_t));
+	apr_cpystrn(session.uuid, "refresh-defer", sizeof(session.uuid));
+
+	/* only the request that acquires the lease runs the deferred refresh */
+	TST_ASSERT("oidc_refresh_access_token_defer (1)",
+			oidc_refresh_access_token_defer(r2, cfg, &session) == TRUE);
+	TST_ASSERT_STR("oidc_refresh_access_token_defer (1: state)",
+			oidc_request_state_get(r2, OIDC_REQUEST_STATE_KEY_REFRESH),
+			"refresh-defer");
+	TST_ASSERT("oidc_refresh_access_token_defer (2: scheduled)",
+			oidc_refresh_access_token_defer(r2, cfg, &session) == FALSE);
+	TST_ASSERT("oidc_refresh_access_token_defer (3: lease held)",
+			oidc_refresh_access_token_defer(r3, cfg, &session) == FALSE);
+	TST_ASSERT("oidc_refresh_access_token_defer (3: state)",
+			oidc_request_state_get(r3, OIDC_REQUEST_STATE_KEY_REFRESH) == NULL);
+
+	/* a request that didn't get the lease doesn't refresh nor release it */
+	TST_ASSERT("oidc_log_transaction (3: not scheduled)",
+			oidc_log_transaction(r3) == DECLINED);
+	TST_ASSERT("oidc_cache_lease_acquire (3: still held)",
+			oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_SESSION, session.uuid, apr_time_now() + apr_time_from_sec(60)) == FALSE);
+
+	/* the session cannot be restored, so the refresh fails and the lease is released */
+	TST_ASSERT("oidc_log_transaction (1: failed refresh)",
+			oidc_log_transaction(r2) == DECLINED);
+	TST_ASSERT("oidc_cache_lease_acquire (1: released)",
+			oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_SESSION, session.uuid, apr_time_now() + apr_time_from_sec(60)) == TRUE);
+
+	oidc_cache_lease_release(r, OIDC_CACHE_SECTION_SESSION, session.uuid);
+	apr_pool_destroy(r3->pool);
+	apr_pool_destroy(r2->pool);
+
+	return 0;
+}
+
+/* create a JWT access token signed with a shared key, optionally bound to a certificate fingerprint */
+static char *test_oauth_jwt_access_token(request_rec *r, oidc_jwk_t *jwk,
+		apr_time_t exp, const char *x5t) {
+	oidc_jose_error_t err;
+	char *cser = NULL;
+	oidc_jwt_t *jwt = oidc_jwt_new(r->pool, TRUE, TRUE);
+	json_object_set_new(jwt->payload.value.json, "sub", json_string("stef"));
+	json_object_set_new(jwt->payload.value.json, "exp",
+			json_integer(apr_time_sec(exp)));
+	if (x5t != NULL)
+		json_object_set_new(jwt->payload.value.json, "cnf",
+				json_pack("{s:s}", "x5t#S256", x5t));
+	jwt->header.alg = apr_pstrdup(r->pool, "HS256");
+	if (oidc_jwt_sign(r->pool, jwt, jwk, &err) == TRUE)
+		cser = oidc_jwt_serialize(r->pool, jwt, &err);
+	oidc_jwt_destroy(jwt);
+	return cser;
+}
+
+static char * test_oauth_verify_cache(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	apr_hash_t *shared_keys = cfg->oauth.verify_shared_keys;
+	apr_hash_t *public_keys = cfg->oauth.verify_public_keys;
+	char *jwks_uri = cfg->oauth.verify_jwks_uri;
+	int interval = cfg->oauth.verify_cache_interval;
+	int policy = cfg->oauth.access_token_binding_policy;
+	char *hostname = r->server->server_hostname;
+	apr_table_t *env = r->subprocess_env;
+	const char *secret = "01234567890123456789012345678901";
+	apr_hash_t *keys = apr_hash_make(r->pool);
+	oidc_jose_error_t err;
+	oidc_jwk_t *jwk = oidc_jwk_create_symmetric_key(r->pool, NULL,
+			(const unsigned char *) secret, strlen(secret), FALSE, &err);
+	apr_time_t exp = apr_time_now() + apr_time_from_sec(60);
+	char *cser = NULL, *other = NULL, *cache_key = NULL, *response = NULL,
+			*value = NULL;
+	json_t *token = NULL;
+	oidc_jwt_t *jwt = NULL;
+
+	TST_ASSERT_ERR("oidc_jwk_create_symmetric_key", jwk != NULL, r->pool, err);
+	apr_hash_set(keys, "shared", APR_HASH_KEY_STRING, jwk);
+
+	cfg->oauth.verify_shared_keys = keys;
+	cfg->oauth.verify_public_keys = NULL;
+	cfg->oauth.verify_jwks_uri = NULL;
+	cfg->oauth.verify_cache_interval = 3600;
+	cfg->oauth.access_token_binding_policy = OIDC_TOKEN_BINDING_POLICY_DISABLED;
+
+	cser = test_oauth_jwt_access_token(r, jwk, exp, NULL);
+	other = test_oauth_jwt_access_token(r, jwk, exp + apr_time_from_sec(1), NULL);
+	TST_ASSERT("test_oauth_jwt_access_token", (cser != NULL) && (other != NULL));
+
+	TST_ASSERT("validate (1: verified)",
+			oidc_oauth_validate_jwt_access_token(r, cfg, cser, &token, &response));
+	json_decref(token);
+	cache_key = oidc_oauth_jwt_access_token_cache_key(r, cfg, cser);
+	oidc_cache_get_access_token(r, cache_key, &value);
+	TST_ASSERT("cache (1: stored)", value != NULL);
+
+	/* a cache hit skips signature verification, so it succeeds without keys */
+	cfg->oauth.verify_shared_keys = NULL;
+	TST_ASSERT("validate (2: cache hit)",
+			oidc_oauth_validate_jwt_access_token(r, cfg, cser, &token, &response));
+	TST_ASSERT_STR("validate (2: sub)",
+			json_string_value(json_object_get(token, "sub")), "stef");
+	json_decref(token);
+	TST_ASSERT("validate (2: not cached)",
+			oidc_oauth_validate_jwt_access_token(r, cfg, other, &token, &response) == FALSE);
+
+	/* the result is bound to the JWKs URI and the virtual host that validated it */
+	cfg->oauth.verify_jwks_uri = "https://idp.example.com/jwks";
+	TST_ASSERT("cache key (3: jwks_uri)",
+			apr_strnatcmp(oidc_oauth_jwt_access_token_cache_key(r, cfg, cser), cache_key) != 0);
+	TST_ASSERT("validate (3: jwks_uri)",
+			oidc_oauth_validate_jwt_access_token(r, cfg, cser, &token, &response) == FALSE);
+	cfg->oauth.verify_jwks_uri = NULL;
+	r->server->server_hostname = "other.example.com";
+	TST_ASSERT("cache key (4: vhost)",
+			apr_strnatcmp(oidc_oauth_jwt_access_token_cache_key(r, cfg, cser), cache_key) != 0);
+	TST_ASSERT("validate (4: vhost)",
+			oidc_oauth_validate_jwt_access_token(r, cfg, cser, &token, &response) == FALSE);
+	r->server->server_hostname = hostname;
+	TST_ASSERT_STR("cache key (5: same)",
+			oidc_oauth_jwt_access_token_cache_key(r, cfg, cser), cache_key);
+
+	/* the result is not cached beyond the expiry of the token, even within the interval */
+	jwt = oidc_jwt_new(r->pool, FALSE, TRUE);
+	jwt->payload.value.str = "{\"sub\":\"stef\"}";
+	jwt->payload.exp = apr_time_sec(apr_time_now()) - 1;
+	oidc_oauth_cache_jwt_access_token(r, cfg, "jwt:expired", jwt);
+	value = NULL;
+	oidc_cache_get_access_token(r, "jwt:expired", &value);
+	TST_ASSERT("cache (6: expired token)", value == NULL);
+	jwt->payload.exp = apr_time_sec(apr_time_now()) + 60;
+	oidc_oauth_cache_jwt_access_token(r, cfg, "jwt:expired", jwt);
+	oidc_cache_get_access_token(r, "jwt:expired", &value);
+	TST_ASSERT_STR("cache (6: valid token)", value, "{\"sub\":\"stef\"}");
+	oidc_cache_set_access_token(r, "jwt:expired", NULL, 0);
+	oidc_jwt_destroy(jwt);
+
+	/* the certificate binding is a property of the request, so it is checked on every hit */
+	cfg->oauth.verify_shared_keys = keys;
+	r->subprocess_env = apr_table_make(r->pool, 1);
+	apr_table_set(r->subprocess_env, OIDC_TB_CFG_FINGERPRINT_ENV_VAR, "fp1");
+	cfg->oauth.access_token_binding_policy = OIDC_TOKEN_BINDING_POLICY_ENFORCED;
+	cser = test_oauth_jwt_access_token(r, jwk,
+			apr_time_now() + apr_time_from_sec(60), "fp1");
+	TST_ASSERT("validate (7: bound)",
+			oidc_oauth_validate_jwt_access_token(r, cfg, cser, &token, &response));
+	json_decref(token);
+	cfg->oauth.verify_shared_keys = NULL;
+	TST_ASSERT("validate (8: bound, cache hit)",
+			oidc_oauth_validate_jwt_access_token(r, cfg, cser, &token, &response));
+	json_decref(token);
+	apr_table_set(r->subprocess_env, OIDC_TB_CFG_FINGERPRINT_ENV_VAR, "fp2");
+	TST_ASSERT("validate (9: other certificate)",
+			oidc_oauth_validate_jwt_access_token(r, cfg, cser, &token, &response) == FALSE);
+
+	r->subprocess_env = env;
+	cfg->oauth.verify_shared_keys = shared_keys;
+	cfg->oauth.verify_public_keys = public_keys;
+	cfg->oauth.verify_jwks_uri = jwks_uri;
+	cfg->oauth.verify_cache_interval = interval;
+	cfg->oauth.access_token_binding_policy = policy;
+	oidc_jwk_destroy(jwk);
+
+	return 0;
+}
+
+static int test_oauth_introspect_count = 0;
+
+/* stand in for the introspection endpoint: an active token for the subject "stef" */
+static apr_byte_t test_oauth_introspect(request_rec *r, oidc_cfg *c,
+		const char *token, char **response) {
+	test_oauth_introspect_count++;
+	*response = apr_psprintf(r->pool,
+			"{\"active\":true,\"sub\":\"stef\",\"exp\":%" APR_TIME_T_FMT "}",
+			apr_time_sec(apr_time_now()) + 60);
+	return TRUE;
+}
+
+static char * test_oauth_introspection_coalesce(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	int negative_interval = cfg->oauth.introspection_negative_interval;
+	int coalesce_timeout = cfg->oauth.introspection_coalesce_timeout;
+	json_t *token = NULL, *result = NULL;
+	char *response = NULL;
+
+	cfg->oauth.introspection_negative_interval = 60;
+	cfg->oauth.introspection_coalesce_timeout = 100;
+	test_oauth_introspect_count = 0;
+
+	/* a cached negative result rejects the token without introspecting it again */
+	result = json_pack("{s:b}", "active", 0);
+	oidc_oauth_cache_access_token(r, cfg, apr_time_now() + apr_time_from_sec(60),
+			"inactive-token", result);
+	json_decref(result);
+	TST_ASSERT("resolve (1: cached inactive)",
+			oidc_oauth_resolve_access_token(r, cfg, "inactive-token", test_oauth_introspect, &token, &response) == FALSE);
+	TST_ASSERT_LONG("introspected (1: cached inactive)",
+			(long )test_oauth_introspect_count, 0L);
+
+	/* a cached result is used without waiting for the request that holds the lease */
+	TST_ASSERT("oidc_cache_lease_acquire (2: held by another request)",
+			oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_ACCESS_TOKEN, "coalesce-token", apr_time_now() + apr_time_from_sec(60)));
+	result = json_pack("{s:b,s:s}", "active", 1, "sub", "stef");
+	oidc_oauth_cache_access_token(r, cfg, apr_time_now() + apr_time_from_sec(60),
+			"coalesce-token", result);
+	json_decref(result);
+	result = NULL;
+	TST_ASSERT("resolve (2: cached by the leader)",
+			oidc_oauth_resolve_access_token(r, cfg, "coalesce-token", test_oauth_introspect, &result, &response));
+	TST_ASSERT_STR("resolve (2: sub)",
+			json_string_value(json_object_get(result, "sub")), "stef");
+	json_decref(result);
+	TST_ASSERT_LONG("introspected (2: cached by the leader)",
+			(long )test_oauth_introspect_count, 0L);
+
+	/* without a result from the lease holder the token is introspected once the wait times out */
+	oidc_cache_set_access_token(r, "coalesce-token", NULL, 0);
+	result = NULL;
+	TST_ASSERT("resolve (3: leader timed out)",
+			oidc_oauth_resolve_access_token(r, cfg, "coalesce-token", test_oauth_introspect, &result, &response));
+	json_decref(result);
+	TST_ASSERT_LONG("introspected (3: leader timed out)",
+			(long )test_oauth_introspect_count, 1L);
+	oidc_cache_lease_release(r, OIDC_CACHE_SECTION_ACCESS_TOKEN,
+			"coalesce-token");
+
+	/* an unknown token is introspected by the request that obtains the lease, which releases it */
+	result = NULL;
+	TST_ASSERT("resolve (4: leader)",
+			oidc_oauth_resolve_access_token(r, cfg, "unknown-token", test_oauth_introspect, &result, &response));
+	TST_ASSERT_STR("resolve (4: sub)",
+			json_string_value(json_object_get(result, "sub")), "stef");
+	json_decref(result);
+	TST_ASSERT_LONG("introspected (4: leader)",
+			(long )test_oauth_introspect_count, 2L);
+	TST_ASSERT("oidc_cache_lease_acquire (4: released)",
+			oidc_cache_lease_acquire(r, OIDC_CACHE_SECTION_ACCESS_TOKEN, "unknown-token", apr_time_now() + apr_time_from_sec(60)));
+	oidc_cache_lease_release(r, OIDC_CACHE_SECTION_ACCESS_TOKEN,
+			"unknown-token");
+
+	/* and its result is cached */
+	result = NULL;
+	TST_ASSERT("resolve (5: cached)",
+			oidc_oauth_resolve_access_token(r, cfg, "unknown-token", test_oauth_introspect, &result, &response));
+	json_decref(result);
+	TST_ASSERT_LONG("introspected (5: cached)",
+			(long )test_oauth_introspect_count, 2L);
+
+	oidc_cache_set_access_token(r, "inactive-token", NULL, 0);
+	oidc_cache_set_access_token(r, "coalesce-token", NULL, 0);
+	oidc_cache_set_access_token(r, "unknown-token", NULL, 0);
+	cfg->oauth.introspection_negative_interval = negative_interval;
+	cfg->oauth.introspection_coalesce_timeout = coalesce_timeout;
+
+	return 0;
+}
+
+/* count the file cache entries in a directory and (optionally) its subdirectories */
+static int test_cache_file_count(request_rec *r, const char *dirname,
+		apr_byte_t recurse) {
+	apr_dir_t *dir = NULL;
+	apr_finfo_t fi;
+	int n = 0;
+	if (apr_dir_open(&dir, dirname, r->pool) != APR_SUCCESS)
+		return 0;
+	while (apr_dir_read(&fi, APR_FINFO_NAME | APR_FINFO_TYPE, dir) == APR_SUCCESS) {
+		if (fi.name[0] == '.')
+			continue;
+		if (fi.filetype == APR_DIR) {
+			if (recurse)
+				n += test_cache_file_count(r,
+						apr_psprintf(r->pool, "%s/%s", dirname, fi.name), recurse);
+		} else if (strstr(fi.name, "last-cleaned") == NULL) {
+			n++;
+		}
+	}
+	apr_dir_close(dir);
+	return n;
+}
+
+static char * test_cache_file(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	const char *tmp = NULL;
+	char *dir = NULL;
+	char *save_dir = cfg->cache_file_dir;
+	int save_levels = cfg->cache_file_levels;
+	int save_clean_max = cfg->cache_file_clean_max;
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	const char *value = NULL;
+	apr_finfo_t fi;
+
+	apr_temp_dir_get(&tmp, r->pool);
+	dir = apr_psprintf(r->pool, "%s/mod-auth-openidc-test-cache", tmp);
+	apr_dir_make_recursive(dir, APR_OS_DEFAULT, r->pool);
+	cfg->cache_file_dir = dir;
+	cfg->cache_file_levels = 2;
+	cfg->cache_file_clean_max = OIDC_CONFIG_POS_INT_UNSET;
+	oidc_cache_file.post_config(r->server);
+
+	TST_ASSERT("oidc_cache_file.set (1)",
+			oidc_cache_file.set(r, OIDC_CACHE_SECTION_SESSION, "uuid3", "session3", expiry));
+	TST_ASSERT("oidc_cache_file.get (1)",
+			oidc_cache_file.get(r, OIDC_CACHE_SECTION_SESSION, "uuid3", &value));
+	TST_ASSERT_STR("value (1)", value, "session3");
+	TST_ASSERT_LONG("count (1: top-level)", (long)test_cache_file_count(r, dir, FALSE), 0L);
+	TST_ASSERT_LONG("count (1: subdirectories)", (long)test_cache_file_count(r, dir, TRUE), 1L);
+
+	/* an expired entry is removed by the next clean cycle without being read */
+	TST_ASSERT("oidc_cache_file.set (2: expired)",
+			oidc_cache_file.set(r, OIDC_CACHE_SECTION_SESSION, "uuid4", "session4", apr_time_now() - apr_time_from_sec(1)));
+	TST_ASSERT_LONG("count (2)", (long)test_cache_file_count(r, dir, TRUE), 2L);
+	apr_file_remove(apr_psprintf(r->pool, "%s/mod-auth-openidc-cache-file-last-cleaned", dir), r->pool);
+	TST_ASSERT("oidc_cache_file.set (3: clean)",
+			oidc_cache_file.set(r, OIDC_CACHE_SECTION_NONCE, "nonce3", "nonce3", expiry));
+	TST_ASSERT_LONG("count (3)", (long)test_cache_file_count(r, dir, TRUE), 2L);
+	TST_ASSERT("apr_stat (3)",
+			apr_stat(&fi, apr_psprintf(r->pool, "%s/mod-auth-openidc-cache-file-last-cleaned", dir), APR_FINFO_SIZE, r->pool) == APR_SUCCESS);
+
+	oidc_cache_file.set(r, OIDC_CACHE_SECTION_SESSION, "uuid3", NULL, 0);
+	oidc_cache_file.set(r, OIDC_CACHE_SECTION_NONCE, "nonce3", NULL, 0);
+
+	cfg->cache_file_dir = save_dir;
+	cfg->cache_file_levels = save_levels;
+	cfg->cache_file_clean_max = save_clean_max;
+
+	return 0;
+}
+
+static char * test_metadata_registry(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	char *save_dir = cfg->metadata_dir;
+	const char *tmp = NULL;
+	oidc_provider_t *p1 = NULL, *p2 = NULL;
+	apr_array_header_t *list = NULL;
+
+	apr_temp_dir_get(&tmp, r->pool);
+	cfg->metadata_dir = apr_psprintf(r->pool, "%s/mod-auth-openidc-test-metadata", tmp);
+	apr_dir_make_recursive(cfg->metadata_dir, APR_OS_DEFAULT, r->pool);
+	TST_ASSERT("oidc_util_file_write (provider)",
+			oidc_util_file_write(r, apr_psprintf(r->pool, "%s/idp.example.com.provider", cfg->metadata_dir),
+					"{ \"issuer\": \"https://idp.example.com\", \"authorization_endpoint\": \"https://idp.example.com/authorize\", \"response_types_supported\": [ \"code\" ] }"));
+	TST_ASSERT("oidc_util_file_write (client)",
+			oidc_util_file_write(r, apr_psprintf(r->pool, "%s/idp.example.com.client", cfg->metadata_dir),
+					"{ \"client_id\": \"client1\", \"client_secret\": \"secret1\" }"));
+
+	TST_ASSERT("oidc_metadata_registry_child_init",
+			oidc_metadata_registry_child_init(r->pool, r->server) == APR_SUCCESS);
+
+	TST_ASSERT("oidc_metadata_get (1)",
+			oidc_metadata_get(r, cfg, "https://idp.example.com", &p1, FALSE));
+	TST_ASSERT_STR("p1->client_id", p1->client_id, "client1");
+
+	/* the parsed provider is shared until its metadata files are modified */
+	TST_ASSERT("oidc_metadata_get (2)",
+			oidc_metadata_get(r, cfg, "https://idp.example.com", &p2, FALSE));
+	TST_ASSERT("p1 == p2", p1 == p2);
+
+	/* another (virtual) server gets a provider parsed with its own defaults */
+	oidc_cfg *vhost = apr_pmemdup(r->pool, cfg, sizeof(oidc_cfg));
+	vhost->provider.token_binding_policy =
+			(cfg->provider.token_binding_policy == OIDC_TOKEN_BINDING_POLICY_ENFORCED) ?
+					OIDC_TOKEN_BINDING_POLICY_OPTIONAL : OIDC_TOKEN_BINDING_POLICY_ENFORCED;
+	TST_ASSERT("oidc_metadata_get (2: vhost)",
+			oidc_metadata_get(r, vhost, "https://idp.example.com", &p2, FALSE));
+	TST_ASSERT("p1 != p2 (vhost)", p1 != p2);
+	TST_ASSERT_LONG("p2->token_binding_policy (vhost)",
+			(long)p2->token_binding_policy, (long)vhost->provider.token_binding_policy);
+	TST_ASSERT("oidc_metadata_get (2: server)",
+			oidc_metadata_get(r, cfg, "https://idp.example.com", &p2, FALSE));
+	TST_ASSERT("p1 == p2 (server)", p1 == p2);
+
+	TST_ASSERT("oidc_metadata_list", oidc_metadata_list(r, cfg, &list));
+	TST_ASSERT_LONG("list->nelts", (long)list->nelts, 1L);
+	TST_ASSERT_STR("list[0]", APR_ARRAY_IDX(list, 0, const char *), "https://idp.example.com");
+
+	TST_ASSERT("oidc_metadata_get (3: unknown)",
+			oidc_metadata_get(r, cfg, "https://other.example.com", &p2, FALSE) == FALSE);
+
+	apr_file_remove(apr_psprintf(r->pool, "%s/idp.example.com.provider", cfg->metadata_dir), r->pool);
+	apr_file_remove(apr_psprintf(r->pool, "%s/idp.example.com.client", cfg->metadata_dir), r->pool);
+	cfg->metadata_dir = save_dir;
+
+	return 0;
+}
+
+static int test_metadata_fetch_count = 0;
+
+static apr_byte_t test_metadata_fetch(request_rec *r, oidc_cfg *cfg,
+		const void *data, char **value) {
+	if (data != NULL)
+		return FALSE;
+	test_metadata_fetch_count++;
+	*value = apr_psprintf(r->pool, "{\"n\":%d}", test_metadata_fetch_count);
+	return TRUE;
+}
+
+static char * test_metadata_stale_while_revalidate(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	const char *key = "https://op.example.org/jwks";
+	char *value = NULL;
+	apr_byte_t fetched = FALSE;
+
+	cfg->metadata_stale_ttl = 60;
+
+	TST_ASSERT("oidc_metadata_cache_get_or_fetch (1: miss)",
+			oidc_metadata_cache_get_or_fetch(r, cfg, OIDC_CACHE_SECTION_JWKS, key, 30, test_metadata_fetch, NULL, &value, &fetched));
+	TST_ASSERT("fetched (1: miss)", fetched == TRUE);
+	TST_ASSERT_STR("value (1: miss)", value, "{\"n\":1}");
+
+	TST_ASSERT("oidc_metadata_cache_get_or_fetch (2: fresh)",
+			oidc_metadata_cache_get_or_fetch(r, cfg, OIDC_CACHE_SECTION_JWKS, key, 30, test_metadata_fetch, NULL, &value, &fetched));
+	TST_ASSERT("fetched (2: fresh)", fetched == FALSE);
+	TST_ASSERT_STR("value (2: fresh)", value, "{\"n\":1}");
+
+	/* a stale copy is refreshed by the worker that obtains the lease */
+	oidc_cache_set(r, OIDC_CACHE_SECTION_JWKS, key, "1:{\"n\":0}", expiry);
+	TST_ASSERT("oidc_metadata_cache_get_or_fetch (3: stale)",
+			oidc_metadata_cache_get_or_fetch(r, cfg, OIDC_CACHE_SECTION_JWKS, key, 30, test_metadata_fetch, NULL, &value, &fetched));
+	TST_ASSERT("fetched (3: stale)", fetched == TRUE);
+	TST_ASSERT_STR("value (3: stale)", value, "{\"n\":2}");
+
+	/* and served as is by others while the lease is held */
+	oidc_cache_set(r, OIDC_CACHE_SECTION_JWKS, key, "1:{\"n\":0}", expiry);
+	TST_ASSERT("oidc_metadata_cache_get_or_fetch (4: leased)",
+			oidc_metadata_cache_get_or_fetch(r, cfg, OIDC_CACHE_SECTION_JWKS, key, 30, test_metadata_fetch, NULL, &value, &fetched));
+	TST_ASSERT("fetched (4: leased)", fetched == FALSE);
+	TST_ASSERT_STR("value (4: leased)", value, "{\"n\":0}");
+	TST_ASSERT_LONG("test_metadata_fetch_count (4: leased)",
+			(long )test_metadata_fetch_count, 2L);
+
+	/* a failing refresh serves the stale copy */
+	oidc_cache_lease_release(r, OIDC_CACHE_SECTION_JWKS, key);
+	TST_ASSERT("oidc_metadata_cache_get_or_fetch (5: failure)",
+			oidc_metadata_cache_get_or_fetch(r, cfg, OIDC_CACHE_SECTION_JWKS, key, 30, test_metadata_fetch, "fail", &value, &fetched));
+	TST_ASSERT_STR("value (5: failure)", value, "{\"n\":0}");
+
+	oidc_cache_set(r, OIDC_CACHE_SECTION_JWKS, key, NULL, 0);
+	oidc_cache_lease_release(r, OIDC_CACHE_SECTION_JWKS, key);
+	cfg->metadata_stale_ttl = 0;
+
+	return 0;
+}
+
+#ifdef USE_ZLIB
+
+static char * test_compress(request_rec *r) {
+	oidc_cfg *cfg = ap_get_module_config(r->server->module_config,
+			&auth_openidc_module);
+	apr_time_t expiry = apr_time_now() + apr_time_from_sec(60);
+	const char *large = apr_psprintf(r->pool, "{\"groups\":[%s\"z\"]}",
+			apr_pstrcat(r->pool, "\"group\",", "\"group\",", "\"group\",",
+					"\"group\",", "\"group\",", "\"group\",", "\"group\",",
+					"\"group\",", "\"group\",", "\"group\",", NULL));
+	const char *stored = NULL;
+	char *deflated = NULL, *inflated = NULL, *value = NULL, *jwt = NULL;
+	apr_size_t deflated_len = 0, inflated_len = 0;
+	json_t *payload = NULL, *result = NULL;
+
+	TST_ASSERT("oidc_util_deflate",
+			oidc_util_deflate(r, large, strlen(large), &deflated, &deflated_len));
+	TST_ASSERT("deflated_len", deflated_len < strlen(large));
+	TST_ASSERT("oidc_util_inflate",
+			oidc_util_inflate(r, deflated, deflated_len, &inflated, &inflated_len));
+	TST_ASSERT_STR("inflated", inflated, large);
+	TST_ASSERT("oidc_util_inflate (corrupted)",
+			oidc_util_inflate(r, "garbage", 7, &inflated, &inflated_len) == FALSE);
+
+	cfg->compress_min_size = 64;
+
+	/* encrypted cache values */
+	TST_ASSERT("oidc_cache_set (1: encrypted)",
+			oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION, "uuid3", large, expiry));
+	TST_ASSERT("oidc_cache_get (1: encrypted)",
+			oidc_cache_get(r, OIDC_CACHE_SECTION_SESSION, "uuid3", &value));
+	TST_ASSERT_STR("value (1: encrypted)", value, large);
+	oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION, "uuid3", NULL, 0);
+
+	/* unencrypted cache values */
+	cfg->cache_encrypt = 0;
+	TST_ASSERT("oidc_cache_set (2: plain)",
+			oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION, "uuid3", large, expiry));
+	TST_ASSERT("cache->get (2: plain)",
+			cfg->cache->get(r, OIDC_CACHE_SECTION_SESSION, "uuid3", &stored));
+	TST_ASSERT("stored (2: plain)", strlen(stored) < strlen(large));
+	TST_ASSERT("oidc_cache_get (2: plain)",
+			oidc_cache_get(r, OIDC_CACHE_SECTION_SESSION, "uuid3", &value));
+	TST_ASSERT_STR("value (2: plain)", value, large);
+	TST_ASSERT("oidc_cache_set (3: small)",
+			oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION, "uuid3", "small", expiry));
+	TST_ASSERT("cache->get (3: small)",
+			cfg->cache->get(r, OIDC_CACHE_SECTION_SESSION, "uuid3", &stored));
+	TST_ASSERT_STR("stored (3: small)", stored, "small");
+	oidc_cache_set(r, OIDC_CACHE_SECTION_SESSION, "uuid3", NULL, 0);
+	cfg->cache_encrypt = 1;
+
+	/* client-side cookie payloads */
+	payload = json_loads(large, 0, NULL);
+	TST_ASSERT("oidc_util_jwt_create (4: zip)",
+			oidc_util_jwt_create(r, cfg->crypto_passphrase, payload, &jwt));
+	TST_ASSERT("JWE zip header (4: zip)",
+			strstr(oidc_proto_peek_jwt_header(r, jwt, NULL), "\"zip\":\"DEF\"") != NULL);
+	TST_ASSERT("oidc_util_jwt_verify (4: zip)",
+			oidc_util_jwt_verify(r, cfg->crypto_passphrase, jwt, &result));
+	TST_ASSERT("json_equal (4: zip)", json_equal(payload, result));
+	json_decref(result);
+	json_decref(payload);
+
+	cfg->compress_min_size = 0;
+
+	return 0;
+}
+
+#endif
+
+#ifdef USE_LIBJQ
+
+static char * test_authz_claims_expr(request_rec *r) {
+	json_t *claims = json_pack("{s:s,s:[s,s],s:i}", "sub", "stef", "groups",
+			"a", "b", "level", 3);
+	const char *expr = ".groups | index(\"b\") != null";
+
+	TST_ASSERT("oidc_authz_match_claims_expr (1: uncached)",
+			oidc_authz_match_claims_expr(r, expr, claims) == TRUE);
+
+	TST_ASSERT("oidc_authz_jq_cache_child_init",
+			oidc_authz_jq_cache_child_init(r->pool, r->server) == APR_SUCCESS);
+	TST_ASSERT("oidc_authz_match_claims_expr (2: compiled)",
+			oidc_authz_match_claims_expr(r, expr, claims) == TRUE);
+	TST_ASSERT("oidc_authz_match_claims_expr (3: cached)",
+			oidc_authz_match_claims_expr(r, expr, claims) == TRUE);
+	TST_ASSERT("oidc_authz_match_claims_expr (4: number)",
+			oidc_authz_match_claims_expr(r, ".level > 2", claims) == TRUE);
+	TST_ASSERT("oidc_authz_match_claims_expr (5: false)",
+			oidc_authz_match_claims_expr(r, ".sub == \"hans\"", claims) == FALSE);
+	TST_ASSERT("oidc_authz_match_claims_expr (6: string \"true\")",
+			oidc_authz_match_claims_expr(r, "\"true\"", claims) == FALSE);
+	TST_ASSERT("oidc_authz_match_claims_expr (7: invalid)",
+			oidc_authz_match_claims_expr(r, ".[", claims) == FALSE);
+
+	json_decref(claims);
+
+	return 0;
+}
+
+#endif
+
+#ifdef USE_LIBHIREDIS
+
+static char * test_cache_redis_key_slot(apr_pool_t *pool) {
+	const char *key = "123456789";
+	TST_ASSERT_LONG("oidc_cache_redis_key_slot (1: plain)",
+			(long )oidc_cache_redis_key_slot(key, strlen(key)), 12739L);
+	key = "{user1000}.following";
+	TST_ASSERT_LONG("oidc_cache_redis_key_slot (2: hash tag)",
+			(long )oidc_cache_redis_key_slot(key, strlen(key)),
+			(long )oidc_cache_redis_key_slot("user1000", strlen("user1000")));
+	key = "foo{}{bar}";
+	TST_ASSERT_LONG("oidc_cache_redis_key_slot (3: empty hash tag)",
+			(long )oidc_cache_redis_key_slot(key, strlen(key)), 8363L);
+	return 0;
+}
+
+#endif
+
 static char * all_tests(apr_pool_t *pool, request_rec *r) {
 	char *message;
 	TST_RUN(test_public_key_parse, pool);
@@ -1517,11 +2833,42 @@ static char * all_tests(apr_pool_t *pool, request_rec *r) {
 	TST_RUN(test_proto_validate_jwt, r);
 
 	TST_RUN(test_current_url, r);
+	TST_RUN(test_escape, r);
+	TST_RUN(test_msgpack, r);
+	TST_RUN(test_regexp, r);
 	TST_RUN(test_accept, r);
+	TST_RUN(test_app_infos, r);
+	TST_RUN(test_request_state_json, r);
+
+	TST_RUN(test_cache_shm, r);
+	TST_RUN(test_cache_replay, r);
+	TST_RUN(test_metrics, r);
+	TST_RUN(test_crypto_passphrase, r);
+	TST_RUN(test_state_cookie, r);
+	TST_RUN(test_cache_multi, r);
+	TST_RUN(test_cache_index, r);
+	TST_RUN(test_cache_l1, r);
+	TST_RUN(test_cache_touch, r);
+	TST_RUN(test_cache_file, r);
+#ifdef USE_ZLIB
+	TST_RUN(test_compress, r);
+#endif
+	TST_RUN(test_cache_lease, r);
+	TST_RUN(test_refresh_defer, r);
+	TST_RUN(test_oauth_verify_cache, r);
+	TST_RUN(test_oauth_introspection_coalesce, r);
+	TST_RUN(test_metadata_stale_while_revalidate, r);
+	TST_RUN(test_metadata_registry, r);
+#ifdef USE_LIBHIREDIS
+	TST_RUN(test_cache_redis_key_slot, pool);
+#endif
 
 #if MODULE_MAGIC_NUMBER_MAJOR >= 20100714
 	TST_RUN(test_authz_worker, r);
 #endif
+#ifdef USE_LIBJQ
+	TST_RUN(test_authz_claims_expr, r);
+#endif
 
 	return 0;
 }